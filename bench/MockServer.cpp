@@ -0,0 +1,443 @@
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *STATUSES[] = {
+    "currently-watching", "plan-to-watch", "completed", "on-hold", "dropped"
+};
+
+static const char *TYPES[] = { "TV", "Movie", "OVA", "ONA", "Special", "Music" };
+
+static const char *GENRES[] = {
+    "Action", "Adventure", "Comedy", "Drama", "Sci-Fi", "Space", "Mystery",
+    "Magic", "Supernatural", "Police", "Fantasy", "Sports", "Romance"
+};
+
+/* Small deterministic hash, so the same request always gets the same answer */
+static unsigned mix(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Maps a hash to a number in [0, 1) */
+static double unit(unsigned h) {
+    return (h >> 8) / (double)(1 << 24);
+}
+
+/* The reason phrase for an HTTP status code */
+static const char* reasonFor(int status) {
+    switch(status) {
+        case 200: return "OK";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+/* MockServer server;
+
+   Constructor for the MockServer class. The server doesn't listen until
+   start() is called, and by default answers every request immediately and
+   correctly, with libraries of 100 entries out of 1000 anime. */
+
+MockServer::MockServer()
+{
+    listen_fd = -1;
+    port = -1;
+    fast_ms = 0;
+    slow_ms = 0;
+    slow_fraction = 0;
+    jitter_ms = 0;
+    library_entries = 100;
+    anime_count = 1000;
+    error_fraction = 0;
+    error_status = 500;
+    loris_fraction = 0;
+    loris_delay_ms = 0;
+    requests = 0;
+    errors = 0;
+    running = false;
+}
+
+/* Destructor: stops the server if it is still running */
+MockServer::~MockServer()
+{
+    stop();
+}
+
+/* void setLatency(int, int, double);
+
+   Makes the server wait fast_ms before answering most requests, and slow_ms
+   before answering requests for a slow_fraction of the anime ids.
+
+   ex. server.setLatency(5, 500, 0.02);
+
+   Pre-conditions: none. Can be called before or after start().
+
+   Post-conditions: none. */
+
+void MockServer::setLatency(int fast_ms, int slow_ms, double slow_fraction) {
+    this->fast_ms = fast_ms;
+    this->slow_ms = slow_ms;
+    this->slow_fraction = slow_fraction;
+}
+
+/* void setJitter(int);
+
+   Adds a random delay of up to jitter_ms to every response, on top of the
+   latency set by setLatency(). */
+
+void MockServer::setJitter(int jitter_ms) {
+    this->jitter_ms = jitter_ms;
+}
+
+/* void setLibrary(int, int);
+
+   Sets how many entries each user's library has, and how many different
+   anime (ids 1 to anime_count) the libraries are made from. Each user's
+   library is a run of entries consecutive ids starting at a point that
+   depends on the username, so libraries overlap more the fewer anime there
+   are.
+
+   ex. server.setLibrary(500, 5000);
+
+   Pre-conditions: 0 <= entries <= anime_count.
+
+   Post-conditions: none. */
+
+void MockServer::setLibrary(int entries, int anime_count) {
+    library_entries = entries;
+    this->anime_count = anime_count;
+}
+
+/* void setErrorRate(double, int);
+
+   Answers a fraction of the requests (picked by hashing the request number,
+   so the same ones on every run, but not always the same URLs) with the
+   given error status, e.g. 500, 503 or 429.
+
+   ex. server.setErrorRate(0.01, 503); */
+
+void MockServer::setErrorRate(double fraction, int status) {
+    error_fraction = fraction;
+    error_status = status;
+}
+
+/* void setSlowLoris(double, int);
+
+   Writes a fraction of the responses in LORIS_PIECES pieces, waiting
+   chunk_delay_ms between pieces, like a server (or a network) that trickles
+   data out and keeps the connection busy all the while. With a delay of
+   10 ms each of those responses takes about 0.2 seconds, whatever its size.
+
+   ex. server.setSlowLoris(0.01, 10); */
+
+void MockServer::setSlowLoris(double fraction, int chunk_delay_ms) {
+    loris_fraction = fraction;
+    loris_delay_ms = chunk_delay_ms;
+}
+
+/* vector<double> getServiceTimes();
+
+   Returns how long, in milliseconds, the server took to answer each request
+   so far (from reading the request to writing the last byte), in the order
+   they finished. */
+
+std::vector<double> MockServer::getServiceTimes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return service_times;
+}
+
+/* int start(int);
+
+   Starts listening on the given port on 127.0.0.1 (or on a free port, if
+   port is 0) and returns the port, or -1 on failure.
+
+   ex. int port = server.start();
+
+   Pre-conditions: the server isn't already running.
+
+   Post-conditions: the server answers requests in the background until
+   stop() is called. */
+
+int MockServer::start(int port) {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listen_fd == -1)
+        return -1;
+
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 1024) != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (struct sockaddr*)&addr, &len);
+    this->port = ntohs(addr.sin_port);
+
+    running = true;
+    acceptor = std::thread(&MockServer::acceptLoop, this);
+    return this->port;
+}
+
+/* void stop();
+
+   Stops accepting connections, closes every open connection and waits for
+   all of the server's threads to finish. */
+
+void MockServer::stop() {
+    if(!running)
+        return;
+    running = false;
+
+    shutdown(listen_fd, SHUT_RDWR);
+    close(listen_fd);
+    acceptor.join();
+
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for(unsigned i=0; i<client_fds.size(); i++)
+            shutdown(client_fds[i], SHUT_RDWR);
+        finished.swap(workers);
+    }
+    for(unsigned i=0; i<finished.size(); i++)
+        finished[i].join();
+    listen_fd = -1;
+}
+
+/* string getBaseUrl();
+
+   Returns the URL to use in place of https://hummingbird.me/api/v1 */
+
+std::string MockServer::getBaseUrl() {
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/api/v1", port);
+    return std::string(url);
+}
+
+/* void acceptLoop();
+
+   Runs on its own thread: accepts connections and starts a thread to serve
+   each of them. */
+
+void MockServer::acceptLoop() {
+    while(running) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd == -1)
+            continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> guard(lock);
+        client_fds.push_back(fd);
+        workers.push_back(std::thread(&MockServer::serve, this, fd));
+    }
+}
+
+/* void serve(int);
+
+   Runs on a connection's thread: reads requests one at a time, waits for the
+   configured latency and writes the response, until the client hangs up. */
+
+void MockServer::serve(int fd) {
+    std::string in;
+    char chunk[4096];
+
+    while(running) {
+        size_t end = in.find("\r\n\r\n");
+        if(end == std::string::npos) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if(n <= 0)
+                break;
+            in.append(chunk, n);
+            continue;
+        }
+
+        /* Request line looks like "GET /api/v1/anime/6 HTTP/1.1" */
+        std::string path;
+        size_t sp1 = in.find(' ');
+        size_t sp2 = in.find(' ', sp1 + 1);
+        if(sp1 != std::string::npos && sp2 != std::string::npos)
+            path = in.substr(sp1 + 1, sp2 - sp1 - 1);
+        in.erase(0, end + 4);
+        long n = requests++;
+        Clock::time_point start = Clock::now();
+
+        int status;
+        std::string body = respond(path, n, status);
+
+        char header[256];
+        snprintf(header, sizeof(header),
+            "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+            status, reasonFor(status), body.size());
+        std::string out = std::string(header) + body;
+
+        /* A slow loris trickles the response out; everyone else gets it at
+           once. (send() rather than write(), so a client that has hung up
+           doesn't kill us with SIGPIPE) */
+        size_t chunk = out.size();
+        if(loris_fraction > 0 && unit(mix(n * 2 + 1)) < loris_fraction)
+            chunk = out.size() / LORIS_PIECES + 1;
+        size_t written = 0;
+        while(written < out.size()) {
+            if(written > 0)
+                usleep(loris_delay_ms * 1000);
+            size_t size = std::min(chunk, out.size() - written);
+            if(send(fd, out.data() + written, size, MSG_NOSIGNAL) != (ssize_t)size)
+                break;
+            written += size;
+        }
+        if(written < out.size())
+            break;
+
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::lock_guard<std::mutex> guard(lock);
+        service_times.push_back(ms);
+    }
+
+    /* Forget the fd before closing it, so stop() never shuts down a reused fd */
+    std::lock_guard<std::mutex> guard(lock);
+    for(unsigned i=0; i<client_fds.size(); i++) {
+        if(client_fds[i] == fd) {
+            client_fds.erase(client_fds.begin() + i);
+            break;
+        }
+    }
+    close(fd);
+}
+
+/* string respond(const string&, long, int&);
+
+   Builds the response body for a request path, sleeping first if the
+   request should be slow. n is the request's number. Sets status to the
+   HTTP status code. */
+
+std::string MockServer::respond(const std::string &path, long n, int &status) {
+    const std::string users = "/api/v1/users/";
+    const std::string library = "/library";
+    const std::string anime = "/api/v1/anime/";
+
+    bool is_library = path.compare(0, users.size(), users) == 0 && path.size() > users.size() + library.size() &&
+        path.compare(path.size() - library.size(), library.size(), library) == 0;
+    bool is_anime = path.compare(0, anime.size(), anime) == 0;
+    if(!is_library && !is_anime) {
+        status = 404;
+        return "{\"error\":\"Not found\"}";
+    }
+
+    int id = is_anime ? atoi(path.c_str() + anime.size()) : 0;
+    int delay = latencyFor(id, n);
+    if(delay > 0)
+        usleep(delay * 1000);
+
+    if(error_fraction > 0 && unit(mix(n * 2)) < error_fraction) {
+        errors++;
+        status = error_status;
+        return "{\"error\":\"Something went wrong\"}";
+    }
+
+    status = 200;
+    if(is_library)
+        return libraryFor(path.substr(users.size(), path.size() - users.size() - library.size()));
+    return animeFor(id);
+}
+
+/* string libraryFor(const string&);
+
+   Builds the /users/{name}/library response for a user: library_entries
+   entries with consecutive anime ids, wrapping around at anime_count, and
+   a status, episode count and rating that depend on the id and the user. */
+
+std::string MockServer::libraryFor(const std::string &username) {
+    unsigned user = 2166136261u;
+    for(unsigned i=0; i<username.size(); i++)
+        user = (user ^ (unsigned char)username[i]) * 16777619u;
+
+    int first = anime_count > 0 ? mix(user) % anime_count : 0;
+    std::string body = "[";
+    for(int i=0; i<library_entries; i++) {
+        int id = anime_count > 0 ? 1 + (first + i) % anime_count : i + 1;
+        unsigned h = mix(user ^ (id * 2654435761u));
+        char rating[24];
+        if(h % 4 == 0)
+            snprintf(rating, sizeof(rating), "null");
+        else
+            snprintf(rating, sizeof(rating), "\"%.1f\"", ((h >> 8) % 11) / 2.0);
+
+        char entry[384];
+        snprintf(entry, sizeof(entry),
+            "%s{\"id\":%d,\"episodes_watched\":%u,\"last_watched\":\"2016-01-01T00:00:00.000Z\","
+            "\"rewatched_times\":0,\"notes\":null,\"status\":\"%s\",\"private\":false,"
+            "\"rating\":{\"type\":\"advanced\",\"value\":%s},\"anime\":{\"id\":%d,\"title\":\"Anime %d\"}}",
+            i > 0 ? "," : "", i + 1, (h >> 4) % 13, STATUSES[(h >> 12) % 5], rating, id, id);
+        body += entry;
+    }
+    body += "]";
+    return body;
+}
+
+/* string animeFor(int);
+
+   Builds the /anime/{id} response for an anime id. */
+
+std::string MockServer::animeFor(int id) {
+    unsigned h = mix(id);
+    std::string genres;
+    for(int g=0; g<1 + (int)(h % 4); g++) {
+        if(g > 0)
+            genres += ",";
+        genres += std::string("{\"name\":\"") + GENRES[(h >> (4 + 4 * g)) % 13] + "\"}";
+    }
+
+    char body[768];
+    snprintf(body, sizeof(body),
+        "{\"id\":%d,\"slug\":\"anime-%d\",\"status\":\"Finished Airing\","
+        "\"title\":\"Anime %d\",\"episode_count\":%d,\"synopsis\":\"Synopsis of anime %d.\","
+        "\"show_type\":\"%s\",\"community_rating\":%.2f,"
+        "\"genres\":[%s]}",
+        id, id, id, 12 + id % 14, id, TYPES[(h >> 24) % 6], 2.5 + (id % 25) / 10.0, genres.c_str());
+    return std::string(body);
+}
+
+/* int latencyFor(int, long);
+
+   Returns how long to wait before answering request number n, for the
+   given anime id (or 0 for a library). The slow ids are chosen by hashing
+   the id, so they are the same on every run; the jitter depends on the
+   request number. */
+
+int MockServer::latencyFor(int id, long n) {
+    unsigned h = (unsigned)id * 2654435761u;
+    double x = (h >> 8) / (double)(1 << 24);
+    int ms = id != 0 && x < slow_fraction ? slow_ms : fast_ms;
+    if(jitter_ms > 0)
+        ms += mix(n * 2 + 7) % (jitter_ms + 1);
+    return ms;
+}
@@ -0,0 +1,83 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/* Defines the MockServer class, a small HTTP/1.1 server on localhost that
+   imitates the parts of the Hummingbird API that Library uses, so that the
+   benchmarks can measure downloads without touching the real service.
+
+   It serves /users/{name}/library with a synthetic library of a set number
+   of entries (each user gets a different, overlapping range of anime ids
+   out of a set number of anime), and /anime/{id} with synthetic metadata.
+   The same name and id always get the same response.
+
+   Every connection is served by its own thread, and keep-alive is supported
+   so that curl can reuse connections like it would with the real API.
+   Misbehaviour can be switched on to see how the client copes:
+   - latency: a fixed fraction of the anime ids (always the same ones) are
+     slow, and every response can get some random jitter on top;
+   - errors: a fraction of the requests get an error status instead;
+   - slow loris: a fraction of the responses are written a few bytes at a
+     time, with a pause in between.
+
+   ex. MockServer server;
+       server.setLibrary(500, 5000);
+       server.setLatency(5, 500, 0.02);
+       server.start();
+       options.base_url = server.getBaseUrl(); */
+
+class MockServer
+{
+    public:
+        MockServer();
+        virtual ~MockServer();
+        int start(int port = 0);
+        void stop();
+        std::string getBaseUrl();
+        void setLatency(int fast_ms, int slow_ms, double slow_fraction);
+        void setJitter(int jitter_ms);
+        void setLibrary(int entries, int anime_count);
+        void setErrorRate(double fraction, int status = 500);
+        void setSlowLoris(double fraction, int chunk_delay_ms);
+        long getRequestCount() { return requests; }
+        long getErrorCount() { return errors; }
+        std::vector<double> getServiceTimes();
+
+        /* Number of pieces a slow loris response is written in */
+        static const int LORIS_PIECES = 20;
+
+    protected:
+    private:
+        void acceptLoop();
+        void serve(int fd);
+        std::string respond(const std::string &path, long n, int &status);
+        std::string libraryFor(const std::string &username);
+        std::string animeFor(int id);
+        int latencyFor(int id, long n);
+        int listen_fd;
+        int port;
+        int fast_ms;
+        int slow_ms;
+        double slow_fraction;
+        int jitter_ms;
+        int library_entries;
+        int anime_count;
+        double error_fraction;
+        int error_status;
+        double loris_fraction;
+        int loris_delay_ms;
+        std::atomic<long> requests;
+        std::atomic<long> errors;
+        std::vector<double> service_times;  /* Milliseconds, guarded by lock */
+        std::atomic<bool> running;
+        std::thread acceptor;
+        std::mutex lock;
+        std::vector<std::thread> workers;
+        std::vector<int> client_fds;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,190 @@
+#include "Synthetic.h"
+#include <cstdio>
+#include <unistd.h>
+
+static const char *WORDS[] = {
+    "Sword", "Art", "Online", "Neon", "Genesis", "Evangelion", "Cowboy", "Bebop",
+    "Ghost", "Shell", "Attack", "Titan", "Steins", "Gate", "Spirited", "Away",
+    "Fullmetal", "Alchemist", "Brotherhood", "Death", "Note", "Code", "Geass",
+    "Lelouch", "Rebellion", "Magical", "Girl", "Madoka", "Serial", "Experiments",
+    "Lain", "Moving", "Castle", "Princess", "Mononoke", "Samurai", "Champloo",
+    "Hunter", "Space", "Dandy", "Trigun", "Monster", "Tokyo", "Ghoul", "Mushishi"
+};
+static const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static const char *STATUSES[] = {
+    "currently-watching", "plan-to-watch", "completed", "on-hold", "dropped"
+};
+
+static const char *TYPES[] = { "TV", "Movie", "OVA", "ONA", "Special", "Music" };
+
+static const char *GENRES[] = {
+    "Action", "Adventure", "Comedy", "Drama", "Sci-Fi", "Space", "Mystery",
+    "Magic", "Supernatural", "Police", "Fantasy", "Sports", "Romance",
+    "Slice of Life", "Horror", "Psychological", "Thriller", "Mecha"
+};
+static const int GENRE_COUNT = sizeof(GENRES) / sizeof(GENRES[0]);
+
+/* Small deterministic hash used to pick the nth entry's words and fields */
+static unsigned mix(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* string syntheticTitle(int);
+
+   Returns the title of the nth synthetic entry, e.g. "Ghost Lain Castle 42".
+   Every n gives a different title. */
+
+std::string syntheticTitle(int n) {
+    unsigned h = mix(n + 1);
+    std::string title;
+    int words = 1 + h % 3;
+    for(int i=0; i<words; i++) {
+        if(i > 0)
+            title += " ";
+        title += WORDS[(h >> (4 + 6 * i)) % WORD_COUNT];
+    }
+    char number[16];
+    snprintf(number, sizeof(number), " %d", n);
+    return title + number;
+}
+
+/* json_object* syntheticEntryJson(int);
+
+   Returns the final library entry json object (as built by Library::beginLoad() and finishEntry())
+   for the nth synthetic entry. The caller must json_object_put() it. */
+
+json_object* syntheticEntryJson(int n) {
+    unsigned h = mix(n + 7);
+    json_object *j = json_object_new_object();
+    json_object_object_add(j, "anime_id", json_object_new_int(n + 1));
+    json_object_object_add(j, "title", json_object_new_string(syntheticTitle(n).c_str()));
+    json_object_object_add(j, "synopsis", json_object_new_string(
+        "A synthetic synopsis, long enough to look like the real thing. The hero sets out "
+        "on a journey, meets a cast of unlikely friends and learns something about themself "
+        "along the way. Meanwhile, a mysterious organisation watches from the shadows."));
+    json_object_object_add(j, "airing_status", json_object_new_string(h % 10 ? "Finished Airing" : "Currently Airing"));
+    json_object_object_add(j, "episode_count", json_object_new_int(1 + h % 52));
+    json_object_object_add(j, "episodes_watched", json_object_new_int(h % 13));
+    json_object_object_add(j, "library_status", json_object_new_string(STATUSES[(h >> 4) % 5]));
+    char rating[8];
+    snprintf(rating, sizeof(rating), "%.1f", ((h >> 8) % 11) / 2.0);
+    json_object_object_add(j, "rating", json_object_new_string(rating));
+    json_object_object_add(j, "community_rating", json_object_new_double(1.0 + ((h >> 12) % 400) / 100.0));
+    json_object_object_add(j, "show_type", json_object_new_string(TYPES[(h >> 20) % 6]));
+
+    json_object *genres = json_object_new_array();
+    int count = 1 + (h >> 24) % 4;
+    for(int i=0; i<count; i++) {
+        json_object *genre = json_object_new_object();
+        json_object_object_add(genre, "name", json_object_new_string(GENRES[mix(n * 31 + i) % GENRE_COUNT]));
+        json_object_array_add(genres, genre);
+    }
+    json_object_object_add(j, "genres", genres);
+    return j;
+}
+
+/* string syntheticAnimeResponse(int);
+
+   Returns the /anime/{id} response for the nth synthetic entry, with every
+   field the real API sends (most of which a Library doesn't use), and a
+   synopsis with the escapes real synopses have: quotes, line breaks and
+   non-ASCII characters. */
+
+std::string syntheticAnimeResponse(int n) {
+    unsigned h = mix(n + 7);
+    std::string genres;
+    int count = 1 + (h >> 24) % 4;
+    for(int i=0; i<count; i++) {
+        if(i > 0)
+            genres += ",";
+        genres += std::string("{\"name\":\"") + GENRES[mix(n * 31 + i) % GENRE_COUNT] + "\"}";
+    }
+
+    std::string title = syntheticTitle(n);
+    char body[2048];
+    snprintf(body, sizeof(body),
+        "{\"id\":%d,\"mal_id\":%d,\"slug\":\"anime-%d\",\"status\":\"%s\","
+        "\"url\":\"https://hummingbird.me/anime/anime-%d\",\"title\":\"%s\","
+        "\"alternate_title\":\"%s (Japanese)\",\"episode_count\":%d,\"episode_length\":24,"
+        "\"cover_image\":\"https://static.hummingbird.me/anime/poster_images/000/%03d/%03d/large/%d.jpg\","
+        "\"synopsis\":\"A synthetic synopsis, long enough to look like the real thing. The hero sets out "
+        "on a journey, meets a cast of unlikely friends and learns something about themself "
+        "along the way.\\n\\nMeanwhile, a mysterious organisation calling itself \\\"the Watchers\\\" "
+        "keeps an eye on them from the shadows\\u2026 (Source: ANN)\","
+        "\"show_type\":\"%s\",\"started_airing\":\"2006-04-0%d\",\"finished_airing\":\"2006-09-2%d\","
+        "\"community_rating\":%.12f,\"age_rating\":\"PG13\",\"genres\":[%s]}",
+        n + 1, 1000 + n, n, h % 10 ? "Finished Airing" : "Currently Airing", n, title.c_str(), title.c_str(),
+        1 + h % 52, n / 1000 % 1000, n % 1000, n, TYPES[(h >> 20) % 6], 1 + h % 9, h % 10,
+        1.0 + ((h >> 12) % 400) / 100.0, genres.c_str());
+    return std::string(body);
+}
+
+/* string syntheticLibraryList(int);
+
+   Returns the /users/{name}/library response for a library of the first
+   entries synthetic entries. Like the real API's, each entry has the whole
+   anime object in it as well as the user's fields. */
+
+std::string syntheticLibraryList(int entries) {
+    std::string list = "[";
+    for(int n=0; n<entries; n++) {
+        unsigned h = mix(n + 7);
+        char rating[16];
+        if(h % 4 == 0)
+            snprintf(rating, sizeof(rating), "null");
+        else
+            snprintf(rating, sizeof(rating), "\"%.1f\"", ((h >> 8) % 11) / 2.0);
+
+        char entry[512];
+        snprintf(entry, sizeof(entry),
+            "%s{\"id\":%d,\"episodes_watched\":%u,\"last_watched\":\"2016-01-01T00:00:00.000Z\","
+            "\"updated_at\":\"2016-01-01T00:00:00.000Z\",\"rewatched_times\":0,\"notes\":null,"
+            "\"notes_present\":false,\"status\":\"%s\",\"private\":false,\"rewatching\":false,"
+            "\"anime\":",
+            n > 0 ? "," : "", 5000000 + n, h % 13, STATUSES[(h >> 4) % 5]);
+        list += entry;
+        list += syntheticAnimeResponse(n);
+        snprintf(entry, sizeof(entry), ",\"rating\":{\"type\":\"advanced\",\"value\":%s}}", rating);
+        list += entry;
+    }
+    list += "]";
+    return list;
+}
+
+/* LibraryEntry* syntheticEntry(LibraryStore*, int);
+
+   Adds the nth synthetic entry to a store and returns its LibraryEntry. */
+
+LibraryEntry* syntheticEntry(LibraryStore *store, int n) {
+    json_object *j = syntheticEntryJson(n);
+    LibraryEntry *le = store->add(j);
+    json_object_put(j);
+    return le;
+}
+
+/* Library* libraryFromStore(LibraryStore*, const string&);
+
+   Returns a new Library with the same entries as store, without any
+   downloading: the store is saved as a snapshot at path, which the Library
+   is then loaded from (the file is deleted again straight away, but stays
+   mapped for as long as the Library needs it). Returns NULL on failure. */
+
+Library* libraryFromStore(LibraryStore *store, const std::string &path) {
+    Snapshot out;
+    store->save(out);
+    if(!out.write(path))
+        return NULL;
+    Library *library = new Library(SnapshotFile(path));
+    unlink(path.c_str());
+    if(library->getLibrarySize() == -1) {
+        delete library;
+        return NULL;
+    }
+    return library;
+}
@@ -0,0 +1,20 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+#include "LibraryStore.h"
+#include "Library.h"
+#include <string>
+#include <json-c/json.h>
+
+/* Helpers for building synthetic library entries for the benchmarks. The
+   nth entry is always the same, so results are repeatable. Titles are made
+   of a few words from a fixed vocabulary plus a number, similar in length
+   and variety to real anime titles. */
+
+std::string syntheticTitle(int n);
+json_object* syntheticEntryJson(int n);
+std::string syntheticAnimeResponse(int n);
+std::string syntheticLibraryList(int entries);
+LibraryEntry* syntheticEntry(LibraryStore *store, int n);
+Library* libraryFromStore(LibraryStore *store, const std::string &path);
+
+#endif // SYNTHETIC_H
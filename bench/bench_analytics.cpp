@@ -0,0 +1,85 @@
+/* Benchmark: Analytics::compute() on 1 to N threads.
+
+   Builds a set of synthetic libraries (as LibraryStores) and computes their
+   LibraryStats with 1, 2, 4, ... threads up to the number of CPU cores (or
+   the number given), printing the time, the speedup over one thread, and
+   whether the result is exactly the same as with one thread.
+
+   usage: bench_analytics [libraries] [entries per library] [max threads] */
+
+#include "Analytics.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* True if a and b are the same to the last bit */
+static bool sameStats(LibraryStats &a, LibraryStats &b) {
+    return a.entries == b.entries && a.genres == b.genres && a.rated == b.rated &&
+        memcmp(&a.rating_sum, &b.rating_sum, sizeof(double)) == 0 &&
+        memcmp(&a.community_rating_sum, &b.community_rating_sum, sizeof(double)) == 0 &&
+        memcmp(a.type_entries, b.type_entries, sizeof(a.type_entries)) == 0 &&
+        memcmp(a.type_completed, b.type_completed, sizeof(a.type_completed)) == 0 &&
+        memcmp(a.type_dropped, b.type_dropped, sizeof(a.type_dropped)) == 0 &&
+        memcmp(a.status_entries, b.status_entries, sizeof(a.status_entries)) == 0 &&
+        memcmp(a.status_episodes_known, b.status_episodes_known, sizeof(a.status_episodes_known)) == 0 &&
+        memcmp(a.status_episodes_watched, b.status_episodes_watched, sizeof(a.status_episodes_watched)) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int libraries = argc > 1 ? atoi(argv[1]) : 16;
+    int entries = argc > 2 ? atoi(argv[2]) : 250000;
+    int max_threads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    if(max_threads < 1)
+        max_threads = 1;
+
+    /* Each library gets a different slice of the synthetic entries */
+    std::vector<LibraryStore*> stores;
+    for(int l=0; l<libraries; l++) {
+        LibraryStore *store = new LibraryStore();
+        for(int i=0; i<entries; i++)
+            syntheticEntry(store, l * entries / 2 + i);
+        stores.push_back(store);
+    }
+    printf("libraries=%d entries=%lld cores=%u\n", libraries, (long long)libraries * entries,
+        std::thread::hardware_concurrency());
+
+    LibraryStats baseline;
+    double baseline_time = 0;
+    for(int threads=1; ; threads*=2) {
+        if(threads > max_threads)
+            threads = max_threads;
+        Analytics analytics(threads);
+        analytics.compute(stores);  // warm up
+
+        Clock::time_point start = Clock::now();
+        LibraryStats stats = analytics.compute(stores);
+        double t = secondsSince(start);
+        if(threads == 1) {
+            baseline = stats;
+            baseline_time = t;
+        }
+        printf("threads=%-3d %8.1f ms  %5.2fx  %s\n", threads, t * 1000, baseline_time / t,
+            sameStats(stats, baseline) ? "identical" : "DIFFERENT");
+        if(threads == max_threads)
+            break;
+    }
+
+    printf("mean rating %.4f vs community %.4f, TV completion %.4f, top genre %s\n",
+        baseline.meanRating(), baseline.meanCommunityRating(), baseline.completionRate(SHOW_TV),
+        baseline.genres.empty() ? "-" : baseline.genres[0].first.c_str());
+
+    for(unsigned i=0; i<stores.size(); i++)
+        delete stores[i];
+    return 0;
+}
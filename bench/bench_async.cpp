@@ -0,0 +1,172 @@
+/* Benchmark: using a library while a LibraryLoad loads it in the background.
+
+   Serves a library of synthetic entries from a MockServer with some slow
+   responses, loads it once the old way (the Library constructor, which
+   returns when it's done) and then with a LibraryLoad, while this thread
+   keeps reading the partial library: listing each status, looking entries
+   up by id and running a query. Prints how soon the first entries could
+   be read compared with how long the whole load took, and how many reads
+   were done meanwhile (this thread reads as fast as it can, so it takes
+   CPU time from the load on a machine with few cores). Then starts another
+   load and cancels it a quarter of the way through, and prints how long it
+   took to stop.
+
+   Fails (exits 1) if a read ever sees the library inconsistent (an entry
+   listed but not found by its id, a status listed out of title order, or
+   fewer entries than before), if the library loaded in the background
+   isn't the same as the one loaded the old way, if the progress didn't
+   reach the end, or if the cancelled load didn't stop within a second or
+   left a library that doesn't add up.
+
+   usage: bench_async [entries] */
+
+#include "Library.h"
+#include "LibraryLoad.h"
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Hash of every entry's fields, in status index order */
+static unsigned long long fingerprint(Library *library) {
+    unsigned long long h = 1469598103934665603ULL;
+    for(int s=0; s<=UNDEFINED; s++) {
+        std::vector<LibraryEntry*> v = library->getLibraryEntries((library_status)s);
+        for(unsigned i=0; i<v.size(); i++) {
+            char fields[64];
+            snprintf(fields, sizeof(fields), "%d|%d|%d|%d|%g|%g|", s, v[i]->getId(), v[i]->getEpisodeCountValue(),
+                v[i]->getEpisodesWatchedValue(), v[i]->getRatingValue(), v[i]->getCommunityRating());
+            std::string text = std::string(fields) + std::string(v[i]->getTitle()) + "|" + std::string(v[i]->getSynopsis());
+            std::vector<std::string_view> genres = v[i]->getGenres();
+            for(unsigned g=0; g<genres.size(); g++)
+                text += std::string(genres[g]) + ",";
+            for(unsigned c=0; c<text.size(); c++)
+                h = (h ^ (unsigned char)text[c]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+/* Reads the whole of a (possibly partial) library once: every status's
+   entries, which must be in title order, each looked up again by its id,
+   and a query for all of them.
+   Returns the number of entries seen, or -1 if the reads disagreed. */
+static int readAll(Library *library) {
+    int listed = 0;
+    for(int s=0; s<=UNDEFINED; s++) {
+        std::vector<LibraryEntry*> v = library->getLibraryEntries((library_status)s);
+        for(unsigned i=0; i<v.size(); i++) {
+            LibraryEntry *le = library->getLibraryEntryById(v[i]->getId());
+            if(le != v[i] || le->getTitle().empty() || le->getLibraryStatus() != s)
+                return -1;
+            if(i > 0 && Library::libraryEntryTitleSort(v[i], v[i - 1]))
+                return -1;
+        }
+        listed += (int)v.size();
+    }
+    int queried = (int)library->query(LibraryQuery()).size();
+    return queried >= listed ? queried : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 5000;
+    bool pass = true;
+
+    MockServer server;
+    server.setLibrary(entries, entries);
+    server.setLatency(1, 100, 0.02);
+    if(server.start() == -1) {
+        fprintf(stderr, "Couldn't start the mock server\n");
+        return 1;
+    }
+    LibraryOptions options;
+    options.base_url = server.getBaseUrl();
+    printf("entries=%d\n\n", entries);
+
+    /* The old way, for comparison */
+    Clock::time_point start = Clock::now();
+    Library *reference = new Library("bench", options);
+    double sync_seconds = secondsSince(start);
+    printf("%-34s %8.3f s\n", "Library constructor returned", sync_seconds);
+
+    /* In the background, reading it all the while */
+    start = Clock::now();
+    LibraryLoad load("bench", options);
+    double first_seconds = -1;
+    long reads = 0, entries_read = 0;
+    int seen = 0;
+    while(load.getFuture().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        int n = readAll(load.getLibrary());
+        if(n < seen) {
+            fprintf(stderr, "Read an inconsistent library while it was loading (%d entries after %d)\n", n, seen);
+            pass = false;
+            break;
+        }
+        if(n > 0 && first_seconds < 0)
+            first_seconds = secondsSince(start);
+        seen = n;
+        reads++;
+        entries_read += n;
+    }
+    Library *library = load.wait();
+    double async_seconds = secondsSince(start);
+    printf("%-34s %8.3f s\n", "First entries readable after", first_seconds);
+    printf("%-34s %8.3f s\n", "LibraryLoad finished after", async_seconds);
+    printf("%-34s %8ld (%ld entries)\n", "Reads of the whole partial library", reads, entries_read);
+
+    if(library->getLibrarySize() != reference->getLibrarySize() || fingerprint(library) != fingerprint(reference) ||
+       readAll(library) != library->getLibrarySize()) {
+        fprintf(stderr, "The library loaded in the background isn't the same\n");
+        pass = false;
+    }
+    if(load.getTotal() != entries || load.getDone() != entries) {
+        fprintf(stderr, "Progress ended at %d of %d\n", load.getDone(), load.getTotal());
+        pass = false;
+    }
+    if(library->completeTitle(reference->getStore()->getEntry(0)->getTitle()).empty()) {
+        fprintf(stderr, "The title search index wasn't built\n");
+        pass = false;
+    }
+    delete library;
+
+    /* Cancelled a quarter of the way through */
+    LibraryLoad cancelled("bench", options);
+    while(cancelled.getTotal() == 0 || cancelled.getDone() < cancelled.getTotal() / 4) {
+        if(cancelled.isFinished())
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int done = cancelled.getDone();
+    start = Clock::now();
+    cancelled.cancel();
+    library = cancelled.wait();
+    double cancel_seconds = secondsSince(start);
+    printf("%-34s %8.3f s (%d of %d entries kept)\n", "Cancelled load stopped after", cancel_seconds,
+        library->getLibrarySize(), entries);
+
+    if(cancel_seconds > 1.0) {
+        fprintf(stderr, "Cancelling took too long\n");
+        pass = false;
+    }
+    if(library->getLibrarySize() < done || library->getLibrarySize() > entries ||
+       readAll(library) != library->getLibrarySize()) {
+        fprintf(stderr, "The cancelled load left an inconsistent library\n");
+        pass = false;
+    }
+    delete library;
+    delete reference;
+
+    server.stop();
+    return pass ? 0 : 1;
+}
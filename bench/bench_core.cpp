@@ -0,0 +1,216 @@
+/* Benchmark: the core data paths, on synthetic libraries of 10^2 up to
+   10^6 entries.
+
+   - entry_from_json: building a LibraryEntry (a store row) from its final
+     json_object, as finishEntry() does
+   - index_insert: adding entries to the title/id index, as addEntry() does
+   - title_hash: hashing a title for the index
+   - lookup_hit / lookup_miss: Library::getLibraryEntry() for titles that
+     are / aren't in the library
+   - entries_by_status: Library::getLibraryEntries() for each status in
+     turn, per call and per entry returned
+   - title_sort: sorting every entry with Library::libraryEntryTitleSort
+
+   Results are printed as CSV (the default) or JSON, one record per
+   benchmark and library size, with the time per operation in nanoseconds,
+   so runs of different versions can be compared to catch regressions.
+   Every timing is the best of a few repetitions.
+
+   usage: bench_core [csv|json] [max entries] */
+
+#include "Library.h"
+#include "EntryIndex.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+/* Each timing is repeated until it has taken at least this long in total,
+   and the best repetition is kept */
+static const double MIN_SECONDS = 0.2;
+static const int MIN_REPEATS = 3;
+
+/* Entries are turned into json a batch at a time, to bound memory */
+static const int JSON_BATCH = 50000;
+
+/* One line of output */
+struct Result {
+    std::string benchmark;
+    int entries;
+    long long ops;
+    double ns_per_op;
+};
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Times fn(), which does ops operations, repeatedly; returns the best
+   time per operation in nanoseconds */
+template <class F>
+static double bestNsPerOp(long long ops, F fn) {
+    double best = 0;
+    double total = 0;
+    for(int run=0; run < MIN_REPEATS || total < MIN_SECONDS; run++) {
+        Clock::time_point start = Clock::now();
+        fn();
+        double t = secondsSince(start);
+        total += t;
+        if(run == 0 || t < best)
+            best = t;
+    }
+    return best * 1e9 / ops;
+}
+
+/* Keeps the compiler from optimizing away a result */
+static volatile uintptr_t sink;
+
+static void benchSize(int n, std::vector<Result> &results) {
+    Result r;
+    r.entries = n;
+
+    /* entry_from_json: once through, since each run adds n more rows */
+    LibraryStore store;
+    double seconds = 0;
+    for(int first=0; first<n; first+=JSON_BATCH) {
+        int count = std::min(JSON_BATCH, n - first);
+        std::vector<json_object*> batch(count);
+        for(int i=0; i<count; i++)
+            batch[i] = syntheticEntryJson(first + i);
+        Clock::time_point start = Clock::now();
+        for(int i=0; i<count; i++)
+            store.add(batch[i]);
+        seconds += secondsSince(start);
+        for(int i=0; i<count; i++)
+            json_object_put(batch[i]);
+    }
+    r.benchmark = "entry_from_json";
+    r.ops = n;
+    r.ns_per_op = seconds * 1e9 / n;
+    results.push_back(r);
+
+    std::vector<LibraryEntry*> entries(n);
+    for(int i=0; i<n; i++)
+        entries[i] = store.getEntry(i);
+
+    r.benchmark = "index_insert";
+    r.ns_per_op = bestNsPerOp(n, [&]() {
+        EntryIndex index;
+        for(int i=0; i<n; i++)
+            index.insert(entries[i]);
+        sink = index.size();
+    });
+    results.push_back(r);
+
+    r.benchmark = "title_hash";
+    r.ns_per_op = bestNsPerOp(n, [&]() {
+        uint64_t h = 0;
+        for(int i=0; i<n; i++) {
+            std::string_view t = entries[i]->getTitle();
+            h += EntryIndex::hash(t.data(), t.size());
+        }
+        sink = h;
+    });
+    results.push_back(r);
+
+    Library *library = libraryFromStore(&store, "/tmp/bench_core.snapshot");
+    if(library == NULL) {
+        fprintf(stderr, "couldn't build a library of %d entries\n", n);
+        exit(1);
+    }
+
+    /* Look the titles up in a scrambled order, so it isn't just a scan */
+    int lookups = std::max(n, 100000);
+    std::vector<std::string> hits(lookups);
+    std::vector<std::string> misses(lookups);
+    for(int i=0; i<lookups; i++) {
+        hits[i] = syntheticTitle((int)(((unsigned)i * 2654435761u) % n));
+        misses[i] = syntheticTitle(n + i);
+    }
+    r.ops = lookups;
+    r.benchmark = "lookup_hit";
+    r.ns_per_op = bestNsPerOp(lookups, [&]() {
+        uintptr_t found = 0;
+        for(int i=0; i<lookups; i++)
+            found += (uintptr_t)library->getLibraryEntry(hits[i]);
+        sink = found;
+    });
+    results.push_back(r);
+
+    r.benchmark = "lookup_miss";
+    r.ns_per_op = bestNsPerOp(lookups, [&]() {
+        uintptr_t found = 0;
+        for(int i=0; i<lookups; i++)
+            found += (uintptr_t)library->getLibraryEntry(misses[i]);
+        sink = found;
+    });
+    results.push_back(r);
+
+    /* Enough calls to return about a million entries in total */
+    int calls = std::max(1, 1000000 / n) * (UNDEFINED + 1);
+    r.ops = calls;
+    r.benchmark = "entries_by_status";
+    r.ns_per_op = bestNsPerOp(calls, [&]() {
+        size_t total = 0;
+        for(int i=0; i<calls; i++)
+            total += library->getLibraryEntries((library_status)(i % (UNDEFINED + 1))).size();
+        sink = total;
+    });
+    results.push_back(r);
+
+    r.ops = (long long)calls / (UNDEFINED + 1) * n;
+    r.benchmark = "entries_by_status_per_entry";
+    r.ns_per_op = results.back().ns_per_op * calls / r.ops;
+    results.push_back(r);
+
+    /* Sort a scrambled copy of the entries each time */
+    std::vector<LibraryEntry*> scrambled = entries;
+    for(int i=n-1; i>0; i--)
+        std::swap(scrambled[i], scrambled[((unsigned)i * 2654435761u) % (i + 1)]);
+    std::vector<LibraryEntry*> sorted;
+    r.ops = n;
+    r.benchmark = "title_sort";
+    r.ns_per_op = bestNsPerOp(n, [&]() {
+        sorted = scrambled;
+        std::sort(sorted.begin(), sorted.end(), Library::libraryEntryTitleSort);
+        sink = (uintptr_t)sorted[0];
+    });
+    results.push_back(r);
+
+    delete library;
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = argc > 1 && strcmp(argv[1], "json") == 0;
+    int max_entries = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    std::vector<Result> results;
+    for(int n=100; n<=max_entries; n*=10) {
+        benchSize(n, results);
+        fprintf(stderr, "%d entries done\n", n);
+    }
+
+    if(json) {
+        printf("[\n");
+        for(unsigned i=0; i<results.size(); i++) {
+            printf("  {\"benchmark\": \"%s\", \"entries\": %d, \"ops\": %lld, \"ns_per_op\": %.2f}%s\n",
+                results[i].benchmark.c_str(), results[i].entries, results[i].ops, results[i].ns_per_op,
+                i + 1 < results.size() ? "," : "");
+        }
+        printf("]\n");
+    } else {
+        printf("benchmark,entries,ops,ns_per_op\n");
+        for(unsigned i=0; i<results.size(); i++) {
+            printf("%s,%d,%lld,%.2f\n", results[i].benchmark.c_str(), results[i].entries,
+                results[i].ops, results[i].ns_per_op);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,416 @@
+/* Benchmark: queries per second and latency of the query daemon.
+
+   Starts a MockServer and a QueryServer (what "main --daemon" runs) with a
+   number of users' synthetic libraries loaded, on a thread of its own, and
+   then acts as its clients: connects over the Unix domain socket, finds
+   the users with USERS and their entries' ids and titles with LIST, and
+   sends requests in a 40/40/15/5 mix of ID, GET, STATS and LIST (of at
+   most 50 entries) for random users and entries. Or, given a socket path,
+   runs the same clients against a daemon that is already running.
+
+   Each run has a number of connections, each on its own thread, and a
+   pipeline depth: how many requests each connection keeps sent but not
+   answered yet (it sends as many as it's short of at once, in one write).
+   For each run, prints the requests per second over all connections and
+   the percentiles of the time from sending a request to reading its
+   response. With depth 1, that is a round trip; with more, requests wait
+   their turn behind the others in the pipeline, but far fewer system
+   calls are made per request.
+
+   Fails (exits 1) if a response is an error, or isn't the one asked for
+   (an entry with another id, say), or if the server answered a different
+   number of requests than were sent.
+
+   usage: bench_daemon [users] [entries] [seconds per run] [socket path] */
+
+#include "QueryServer.h"
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <json-c/json.h>
+
+typedef std::chrono::steady_clock Clock;
+
+/* Latencies in nanoseconds, in buckets 1/16 of a power of two wide, so
+   percentiles are within about 6% without keeping every request */
+struct RequestLatencies {
+    std::vector<long> counts;
+    long total;
+
+    /* Constructor */
+    RequestLatencies(){
+        counts.assign(64 * 16, 0);
+        total = 0;
+    }
+
+    static int bucketOf(uint64_t ns) {
+        if(ns < 16)
+            return (int)ns;
+        int msb = 63 - __builtin_clzll(ns);
+        return (msb - 3) * 16 + (int)((ns >> (msb - 4)) & 15);
+    }
+
+    static double lowerBound(int bucket) {
+        if(bucket < 16)
+            return bucket;
+        int msb = bucket / 16 + 3;
+        return (double)((16 + bucket % 16) * (1ULL << (msb - 4)));
+    }
+
+    void add(uint64_t ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+    }
+
+    void merge(const RequestLatencies &h) {
+        for(unsigned i=0; i<counts.size(); i++)
+            counts[i] += h.counts[i];
+        total += h.total;
+    }
+
+    /* The pth percentile, in nanoseconds */
+    double percentile(double p) {
+        if(total == 0)
+            return 0;
+        long want = std::min((long)(total * p / 100.0), total - 1);
+        long seen = 0;
+        for(unsigned i=0; i<counts.size(); i++) {
+            seen += counts[i];
+            if(seen > want)
+                return lowerBound(i);
+        }
+        return 0;
+    }
+};
+
+/* A user's entries, to ask about */
+struct UserEntries {
+    std::string username;
+    std::vector<int> ids;
+    std::vector<std::string> titles;
+};
+
+/* A request sent and not answered yet: when it was sent, what it was, and
+   for ID, the id that should come back */
+struct InFlight {
+    Clock::time_point sent;
+    char op;
+    int id;
+};
+
+/* What every connection of a run shares */
+struct Run {
+    std::string path;
+    int depth;
+    const std::vector<UserEntries> *users;
+    std::atomic<bool> stop;
+    std::atomic<long> failures;
+};
+
+static int connectTo(const std::string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+        return -1;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd != -1 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+/* Reads one response line (without its newline) into line; in holds what
+   has been read past it */
+static bool readLine(int fd, std::string &in, std::string &line) {
+    size_t end;
+    while((end = in.find('\n')) == std::string::npos) {
+        char buffer[65536];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n <= 0)
+            return false;
+        in.append(buffer, n);
+    }
+    line.assign(in, 0, end);
+    in.erase(0, end + 1);
+    return true;
+}
+
+/* Sends one request and parses its response */
+static json_object* ask(int fd, std::string &in, const std::string &request) {
+    std::string line;
+    if(!writeAll(fd, request + "\n") || !readLine(fd, in, line))
+        return NULL;
+    return json_tokener_parse(line.c_str());
+}
+
+/* Finds every user the server has loaded, and their entries */
+static bool discover(const std::string &path, std::vector<UserEntries> &users, long &requests) {
+    int fd = connectTo(path);
+    if(fd == -1)
+        return false;
+    std::string in;
+    json_object *response = ask(fd, in, "USERS");
+    requests++;
+    json_object *list = NULL;
+    if(response == NULL || !json_object_object_get_ex(response, "users", &list)) {
+        close(fd);
+        return false;
+    }
+    for(size_t i=0; i<json_object_array_length(list); i++) {
+        json_object *user = NULL;
+        json_object_object_get_ex(json_object_array_get_idx(list, i), "user", &user);
+        UserEntries u;
+        u.username = json_object_get_string(user);
+        for(int s=CURRENTLY_WATCHING; s<UNDEFINED; s++) {
+            std::string request = "LIST " + u.username + " " + LibraryStore::libraryStatusName((library_status)s);
+            json_object *entries_response = ask(fd, in, request);
+            requests++;
+            json_object *entries = NULL;
+            if(entries_response == NULL || !json_object_object_get_ex(entries_response, "entries", &entries)) {
+                json_object_put(entries_response);
+                json_object_put(response);
+                close(fd);
+                return false;
+            }
+            for(size_t e=0; e<json_object_array_length(entries); e++) {
+                json_object *entry = json_object_array_get_idx(entries, e);
+                json_object *id = NULL;
+                json_object *title = NULL;
+                json_object_object_get_ex(entry, "id", &id);
+                json_object_object_get_ex(entry, "title", &title);
+                u.ids.push_back(json_object_get_int(id));
+                u.titles.push_back(json_object_get_string(title));
+            }
+            json_object_put(entries_response);
+        }
+        if(!u.ids.empty())
+            users.push_back(u);
+    }
+    json_object_put(response);
+    close(fd);
+    return !users.empty();
+}
+
+/* Checks that a response is the one asked for */
+static bool responseMatches(const InFlight &f, std::string_view line) {
+    if(line.find("\"error\"") != std::string_view::npos)
+        return false;
+    if(f.op == 'I') {
+        char expect[32];
+        snprintf(expect, sizeof(expect), "{\"id\":%d,", f.id);
+        return line.substr(0, strlen(expect)) == expect;
+    }
+    if(f.op == 'G')
+        return line.substr(0, 6) == "{\"id\":";
+    if(f.op == 'S')
+        return line.substr(0, 11) == "{\"version\":";
+    return line.substr(0, 10) == "{\"status\":";
+}
+
+/* One connection: keeps depth requests in flight until the run stops, then
+   reads the responses still to come */
+static void connection(Run *run, int seed, RequestLatencies *latency, long *sent) {
+    static const char *statuses[] = { "currently-watching", "plan-to-watch", "completed", "on-hold", "dropped" };
+    int fd = connectTo(run->path);
+    if(fd == -1) {
+        fprintf(stderr, "Couldn't connect to %s\n", run->path.c_str());
+        run->failures++;
+        return;
+    }
+    std::minstd_rand random(seed);
+    const std::vector<UserEntries> &users = *run->users;
+    std::deque<InFlight> in_flight;
+    std::string out;
+    std::string in;
+    char buffer[65536];
+
+    while(!run->stop || !in_flight.empty()) {
+
+        /* Top the pipeline up, with one write */
+        out.clear();
+        Clock::time_point now = Clock::now();
+        while(!run->stop && (int)in_flight.size() < run->depth) {
+            const UserEntries &u = users[random() % users.size()];
+            int e = random() % u.ids.size();
+            int op = random() % 100;
+            InFlight f;
+            f.sent = now;
+            f.id = u.ids[e];
+            if(op < 40) {
+                f.op = 'I';
+                out += "ID " + u.username + " " + std::to_string(f.id) + "\n";
+            } else if(op < 80) {
+                f.op = 'G';
+                out += "GET " + u.username + " " + u.titles[e] + "\n";
+            } else if(op < 95) {
+                f.op = 'S';
+                out += "STATS " + u.username + "\n";
+            } else {
+                f.op = 'L';
+                out += "LIST " + u.username + " " + statuses[random() % 5] + " 50\n";
+            }
+            in_flight.push_back(f);
+            (*sent)++;
+        }
+        if(!out.empty() && !writeAll(fd, out)) {
+            run->failures++;
+            break;
+        }
+
+        /* Take in whatever responses have arrived (at least one) */
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n <= 0) {
+            run->failures++;
+            break;
+        }
+        in.append(buffer, n);
+        now = Clock::now();
+        size_t start = 0;
+        size_t end;
+        while((end = in.find('\n', start)) != std::string::npos) {
+            if(in_flight.empty()) {
+                run->failures++;
+                break;
+            }
+            const InFlight &f = in_flight.front();
+            latency->add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - f.sent).count());
+            if(!responseMatches(f, std::string_view(in.data() + start, end - start))) {
+                if(run->failures++ == 0)
+                    fprintf(stderr, "Unexpected response: %s\n", in.substr(start, std::min(end - start, (size_t)200)).c_str());
+            }
+            in_flight.pop_front();
+            start = end + 1;
+        }
+        in.erase(0, start);
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    int user_count = argc > 1 ? atoi(argv[1]) : 8;
+    int entries = argc > 2 ? atoi(argv[2]) : 2000;
+    double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+    std::string path = argc > 4 ? argv[4] : "";
+
+    /* Unless given a daemon to query, start one */
+    MockServer mock;
+    QueryServer *server = NULL;
+    std::thread server_thread;
+    if(path.empty()) {
+        mock.setLibrary(entries, entries * 2);
+        if(mock.start() == -1) {
+            fprintf(stderr, "Couldn't start the mock server\n");
+            return 1;
+        }
+        LibraryOptions options;
+        options.base_url = mock.getBaseUrl();
+        server = new QueryServer(options);
+        std::vector<std::string> usernames;
+        for(int u=0; u<user_count; u++)
+            usernames.push_back("user" + std::to_string(u));
+        if(server->addUsers(usernames) != user_count) {
+            fprintf(stderr, "Couldn't load the libraries\n");
+            return 1;
+        }
+        path = "/tmp/bench_daemon." + std::to_string(getpid()) + ".sock";
+        if(!server->listen(path)) {
+            fprintf(stderr, "Couldn't listen on %s\n", path.c_str());
+            return 1;
+        }
+        server_thread = std::thread(&QueryServer::run, server);
+    }
+
+    std::vector<UserEntries> users;
+    long requests = 0;
+    if(!discover(path, users, requests)) {
+        fprintf(stderr, "Couldn't find any users on %s\n", path.c_str());
+        return 1;
+    }
+    long total_entries = 0;
+    for(unsigned u=0; u<users.size(); u++)
+        total_entries += users[u].ids.size();
+
+    printf("users=%d entries=%ld seconds=%g cores=%u\n\n", (int)users.size(), total_entries, seconds,
+        std::thread::hardware_concurrency());
+    printf("%11s %5s %12s %9s %9s %9s %9s\n", "connections", "depth", "requests/s", "p50 us", "p99 us",
+        "p99.9 us", "max us");
+
+    const int connection_counts[] = { 1, 4 };
+    const int depths[] = { 1, 16, 64 };
+    bool pass = true;
+    for(int c=0; c<2; c++) {
+        for(int d=0; d<3; d++) {
+            Run run;
+            run.path = path;
+            run.depth = depths[d];
+            run.users = &users;
+            run.stop = false;
+            run.failures = 0;
+
+            int connections = connection_counts[c];
+            std::vector<RequestLatencies> latencies(connections);
+            std::vector<long> sent(connections, 0);
+            std::vector<std::thread> threads;
+            Clock::time_point start = Clock::now();
+            for(int i=0; i<connections; i++)
+                threads.push_back(std::thread(connection, &run, i + 1, &latencies[i], &sent[i]));
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            run.stop = true;
+            for(int i=0; i<connections; i++)
+                threads[i].join();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            RequestLatencies all;
+            for(int i=0; i<connections; i++) {
+                all.merge(latencies[i]);
+                requests += sent[i];
+            }
+            printf("%11d %5d %12.0f %9.1f %9.1f %9.1f %9.1f\n", connections, run.depth, all.total / elapsed,
+                all.percentile(50) / 1000, all.percentile(99) / 1000, all.percentile(99.9) / 1000,
+                all.percentile(100) / 1000);
+            if(run.failures != 0) {
+                fprintf(stderr, "%ld requests failed\n", (long)run.failures);
+                pass = false;
+            }
+        }
+    }
+
+    if(server != NULL) {
+        server->stop();
+        server_thread.join();
+        if(server->getRequestCount() != requests) {
+            fprintf(stderr, "The server answered %ld requests, %ld were sent\n", server->getRequestCount(), requests);
+            pass = false;
+        }
+        delete server;
+        mock.stop();
+    }
+    return pass ? 0 : 1;
+}
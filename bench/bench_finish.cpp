@@ -0,0 +1,143 @@
+/* Benchmark: how the parse-and-construct stage of a load scales with threads.
+
+   Serves a library of synthetic entries from a MockServer, with every
+   anime's metadata already in an AnimeCache (as realistic /anime/{id}
+   responses, see syntheticAnimeResponse()), so that once the library list
+   has been downloaded the whole load is parsing the responses, building
+   the rows and indexing them: the stage LibraryOptions::parse_threads
+   spreads over a ThreadPool. Loads the library with 1 thread and then
+   with twice as many each time, up to at least the number of CPU cores,
+   and prints how long the stage took (best of a few loads) and the
+   speedup over 1 thread. Checks that every library is the same as the one
+   loaded with 1 thread: rows, genres, index lookups and status indexes.
+
+   usage: bench_finish [entries] [max threads] [cache path] */
+
+#include "Library.h"
+#include "AnimeCache.h"
+#include "MockServer.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+
+/* Whether two libraries have the same rows, in the same order, and look up
+   and list their entries the same way */
+static bool sameLibrary(Library *a, Library *b) {
+    LibraryStore *x = a->getStore();
+    LibraryStore *y = b->getStore();
+    if(x->size() != y->size() || a->getLibrarySize() != b->getLibrarySize())
+        return false;
+
+    for(int row=0; row<x->size(); row++) {
+        LibraryEntry *p = x->getEntry(row);
+        LibraryEntry *q = y->getEntry(row);
+        float rp = x->getRatings()[row], rq = y->getRatings()[row];
+        if(p->getId() != q->getId() || p->getTitle() != q->getTitle() || p->getSynopsis() != q->getSynopsis() ||
+           p->getLibraryStatus() != q->getLibraryStatus() || p->getEpisodeCountValue() != q->getEpisodeCountValue() ||
+           p->getEpisodesWatchedValue() != q->getEpisodesWatchedValue() || p->getShowType() != q->getShowType() ||
+           p->getAiringStatusCode() != q->getAiringStatusCode() ||
+           x->getCommunityRatings()[row] != y->getCommunityRatings()[row] ||
+           !(rp == rq || (std::isnan(rp) && std::isnan(rq))) ||
+           x->getGenreMasks()[row] != y->getGenreMasks()[row] ||
+           x->getGenreOffsets()[row + 1] != y->getGenreOffsets()[row + 1])
+            return false;
+
+        /* Genre ids, not just names, so they were interned in the same order */
+        for(uint32_t g=x->getGenreOffsets()[row]; g<x->getGenreOffsets()[row + 1]; g++) {
+            if(x->getGenreIds()[g] != y->getGenreIds()[g])
+                return false;
+        }
+
+        LibraryEntry *pa = a->getLibraryEntry(p->getTitle());
+        LibraryEntry *qb = b->getLibraryEntry(q->getTitle());
+        LibraryEntry *pi = a->getLibraryEntryById(p->getId());
+        LibraryEntry *qi = b->getLibraryEntryById(q->getId());
+        if(pa == NULL || qb == NULL || pa->getRow() != qb->getRow() ||
+           pi == NULL || qi == NULL || pi->getRow() != qi->getRow())
+            return false;
+    }
+
+    for(int s=0; s<=UNDEFINED; s++) {
+        std::vector<LibraryEntry*> va = a->getLibraryEntries((library_status)s);
+        std::vector<LibraryEntry*> vb = b->getLibraryEntries((library_status)s);
+        if(va.size() != vb.size())
+            return false;
+        for(unsigned i=0; i<va.size(); i++) {
+            if(va[i]->getRow() != vb[i]->getRow())
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 50000;
+    int cores = (int)std::thread::hardware_concurrency();
+    int max_threads = argc > 2 ? atoi(argv[2]) : (cores > 8 ? cores : 8);
+    std::string cache_path = argc > 3 ? argv[3] : "/tmp/bench_finish.cache";
+
+    MockServer server;
+    server.setLibrary(entries, entries);
+    if(server.start() == -1) {
+        fprintf(stderr, "Couldn't start the mock server\n");
+        return 1;
+    }
+
+    unlink(cache_path.c_str());
+    AnimeCache cache(cache_path, AnimeCache::DEFAULT_TTL, (size_t)entries * 4096);
+    size_t bytes = 0;
+    for(int id=1; id<=entries; id++) {
+        std::string body = syntheticAnimeResponse(id);
+        bytes += body.size();
+        cache.put(id, body);
+    }
+    printf("entries=%d responses=%.1f MB cores=%d\n\n", entries, bytes / 1e6, cores);
+    printf("%8s %12s %12s %10s\n", "threads", "stage ms", "entries/s", "speedup");
+
+    Library *reference = NULL;
+    double base = 0;
+    bool all_same = true;
+    for(int threads=1; threads<=max_threads; threads*=2) {
+        LibraryOptions options;
+        options.base_url = server.getBaseUrl();
+        options.cache = &cache;
+        options.parse_threads = threads;
+
+        double best = 0;
+        Library *library = NULL;
+        for(int run=0; run<3; run++) {
+            delete library;
+            library = new Library("bench", options);
+            double stage = library->getLoadTimings().parse;
+            if(run == 0 || stage < best)
+                best = stage;
+        }
+        if(library->getLibrarySize() != entries) {
+            fprintf(stderr, "Loaded %d entries instead of %d\n", library->getLibrarySize(), entries);
+            return 1;
+        }
+
+        bool same = true;
+        if(reference == NULL) {
+            reference = library;
+            base = best;
+        } else {
+            same = sameLibrary(reference, library);
+            all_same = all_same && same;
+            delete library;
+        }
+        printf("%8d %12.2f %12.0f %9.2fx%s\n", threads, best * 1000, entries / best, base / best,
+            same ? "" : "  DIFFERENT");
+    }
+
+    delete reference;
+    unlink(cache_path.c_str());
+    printf("\nlibraries %s\n", all_same ? "identical" : "DIFFERENT");
+    return all_same ? 0 : 1;
+}
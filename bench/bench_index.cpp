@@ -0,0 +1,196 @@
+/* Benchmark: EntryIndex vs. the old hashSum/LibraryEntryWrapper table.
+
+   Builds synthetic libraries of 100, 10,000 and 1,000,000 entries, inserts
+   them into both tables and times lookups of titles that are in the table
+   (hits) and titles that aren't (misses). Prints nanoseconds per operation.
+
+   usage: bench_index [sizes...] */
+
+#include "EntryIndex.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+/* The title table Library used before EntryIndex: HASHSIZE slots, indexed
+   by the sum of the title's character codes, with collisions chained in
+   linked lists of new-allocated wrappers. */
+class ChainedTable
+{
+    struct LibraryEntryWrapper {
+        LibraryEntry *entry;
+        LibraryEntryWrapper *next;
+        LibraryEntryWrapper() { entry = NULL; next = NULL; }
+    };
+
+    public:
+        ChainedTable() {
+            hashTable = new LibraryEntryWrapper[HASHSIZE];
+            for(int i=0; i<HASHSIZE; i++)
+                tails[i] = &hashTable[i];
+        }
+        ~ChainedTable() {
+            for(int i=0; i<HASHSIZE; i++) {
+                LibraryEntryWrapper *x = hashTable[i].next;
+                while(x != NULL) {
+                    LibraryEntryWrapper *next = x->next;
+                    delete x;
+                    x = next;
+                }
+            }
+            delete [] hashTable;
+        }
+
+        /* Like the original, walks to the end of the chain to append */
+        void addEntry(LibraryEntry *le) {
+            int h = hashSum(std::string(le->getTitle()));
+            LibraryEntryWrapper *y = &hashTable[h];
+            if(y->entry == NULL) {
+                y->entry = le;
+                return;
+            }
+            LibraryEntryWrapper *wrapper = new LibraryEntryWrapper();
+            wrapper->entry = le;
+            while(y->next != NULL)
+                y = y->next;
+            y->next = wrapper;
+            tails[h] = wrapper;
+        }
+
+        /* Builds the same chains as addEntry() without walking them, because
+           walking is quadratic and takes many minutes at a million entries */
+        void appendEntry(LibraryEntry *le) {
+            int h = hashSum(std::string(le->getTitle()));
+            if(hashTable[h].entry == NULL) {
+                hashTable[h].entry = le;
+                return;
+            }
+            LibraryEntryWrapper *wrapper = new LibraryEntryWrapper();
+            wrapper->entry = le;
+            tails[h]->next = wrapper;
+            tails[h] = wrapper;
+        }
+
+        LibraryEntry* getLibraryEntry(std::string title) {
+            LibraryEntryWrapper *x = &hashTable[hashSum(title)];
+            while(x != NULL && x->entry != NULL) {
+                if(x->entry->getTitle().compare(title) == 0)
+                    return x->entry;
+                x = x->next;
+            }
+            return NULL;
+        }
+
+    private:
+        static const int HASHSIZE = 100;
+        int hashSum(std::string title) {
+            int sum = 0;
+            for(unsigned i = 0; i < title.size(); i++)
+                sum += title[i];
+            return sum % HASHSIZE;
+        }
+        LibraryEntryWrapper *hashTable;
+        LibraryEntryWrapper *tails[HASHSIZE];
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> sizes;
+    for(int i=1; i<argc; i++)
+        sizes.push_back(atoi(argv[i]));
+    if(sizes.empty()) {
+        sizes.push_back(100);
+        sizes.push_back(10000);
+        sizes.push_back(1000000);
+    }
+
+    printf("%10s %-12s %12s %12s %12s\n", "entries", "table", "insert ns", "hit ns", "miss ns");
+
+    for(unsigned s=0; s<sizes.size(); s++) {
+        int n = sizes[s];
+        LibraryStore *store = new LibraryStore();
+        std::vector<LibraryEntry*> entries(n);
+        for(int i=0; i<n; i++)
+            entries[i] = syntheticEntry(store, i);
+
+        /* Look titles up in a scattered order so the cache isn't warmed for us */
+        int lookups = n < 100000 ? n : 100000;
+        std::vector<std::string> hits(lookups), misses(lookups);
+        for(int i=0; i<lookups; i++) {
+            hits[i] = syntheticTitle((int)(((long long)i * 7919) % n));
+            misses[i] = syntheticTitle(n + i);
+        }
+
+        /* The chained table's chains are n/100 long, so limit how many
+           lookups it does at large sizes or it would take minutes */
+        int chained_lookups = lookups;
+        long long chain = n / 100 > 0 ? n / 100 : 1;
+        if(chained_lookups * chain > 20000000LL)
+            chained_lookups = (int)(20000000LL / chain);
+
+        /* Insert time is only measured where the original insert is feasible */
+        bool faithful_insert = n <= 100000;
+        Clock::time_point start = Clock::now();
+        ChainedTable *chained = new ChainedTable();
+        for(int i=0; i<n; i++) {
+            if(faithful_insert)
+                chained->addEntry(entries[i]);
+            else
+                chained->appendEntry(entries[i]);
+        }
+        double insert = nsSince(start) / n;
+
+        int found = 0;
+        start = Clock::now();
+        for(int i=0; i<chained_lookups; i++)
+            found += chained->getLibraryEntry(hits[i]) != NULL;
+        double hit = nsSince(start) / chained_lookups;
+
+        start = Clock::now();
+        for(int i=0; i<chained_lookups; i++)
+            found += chained->getLibraryEntry(misses[i]) != NULL;
+        double miss = nsSince(start) / chained_lookups;
+        if(faithful_insert)
+            printf("%10d %-12s %12.1f %12.1f %12.1f\n", n, "chained", insert, hit, miss);
+        else
+            printf("%10d %-12s %12s %12.1f %12.1f\n", n, "chained", "-", hit, miss);
+        delete chained;
+
+        start = Clock::now();
+        EntryIndex *index = new EntryIndex();
+        for(int i=0; i<n; i++)
+            index->insert(entries[i]);
+        insert = nsSince(start) / n;
+
+        start = Clock::now();
+        for(int i=0; i<lookups; i++)
+            found += index->find(hits[i]) != NULL;
+        hit = nsSince(start) / lookups;
+
+        start = Clock::now();
+        for(int i=0; i<lookups; i++)
+            found += index->find(misses[i]) != NULL;
+        miss = nsSince(start) / lookups;
+
+        start = Clock::now();
+        for(int i=0; i<lookups; i++)
+            found += index->findById((int)(((long long)i * 7919) % n) + 1) != NULL;
+        double by_id = nsSince(start) / lookups;
+        printf("%10d %-12s %12.1f %12.1f %12.1f   (by id: %.1f ns)\n", n, "EntryIndex", insert, hit, miss, by_id);
+        delete index;
+
+        if(found != chained_lookups + 2 * lookups)
+            fprintf(stderr, "warning: unexpected lookup results (%d)\n", found);
+
+        delete store;
+    }
+    return 0;
+}
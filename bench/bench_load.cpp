@@ -0,0 +1,122 @@
+/* Benchmark: end-to-end library loading against a local MockServer.
+
+   Loads the libraries of a number of users with a LibraryLoader pointed at
+   a MockServer (no cache, so every run downloads everything), several
+   times over, and prints the load time of each run (median and worst),
+   the requests per second the loader achieved, and the server's response
+   time percentiles, along with how many transfers were retried or timed
+   out, how many connections were opened and how many the adaptive window
+   allowed in flight. Also checks that
+   no library failed to load, unless errors were switched on and retries
+   switched off.
+
+   usage: bench_load [users] [entries] [anime] [runs] [fast_ms] [slow_ms] [slow_fraction]
+                     [error_rate] [loris_fraction] [timeout_ms] [max_retries] [max_concurrency] [error_status] */
+
+#include "LibraryLoader.h"
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* The pth percentile of v, which must be sorted */
+static double percentile(const std::vector<double> &v, double p) {
+    if(v.empty())
+        return 0;
+    size_t i = (size_t)(p / 100 * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+int main(int argc, char *argv[])
+{
+    int users = argc > 1 ? atoi(argv[1]) : 10;
+    int entries = argc > 2 ? atoi(argv[2]) : 300;
+    int anime = argc > 3 ? atoi(argv[3]) : 2000;
+    int runs = argc > 4 ? atoi(argv[4]) : 5;
+    int fast_ms = argc > 5 ? atoi(argv[5]) : 2;
+    int slow_ms = argc > 6 ? atoi(argv[6]) : 200;
+    double slow_fraction = argc > 7 ? atof(argv[7]) : 0.01;
+    double error_rate = argc > 8 ? atof(argv[8]) : 0;
+    double loris_fraction = argc > 9 ? atof(argv[9]) : 0;
+    long timeout_ms = argc > 10 ? atol(argv[10]) : 30000;
+    int max_retries = argc > 11 ? atoi(argv[11]) : 3;
+    int max_concurrency = argc > 12 ? atoi(argv[12]) : 100;
+    int error_status = argc > 13 ? atoi(argv[13]) : 500;
+
+    MockServer server;
+    server.setLibrary(entries, anime);
+    server.setLatency(fast_ms, slow_ms, slow_fraction);
+    server.setErrorRate(error_rate, error_status);
+    server.setSlowLoris(loris_fraction, 10);
+    if(server.start() == -1) {
+        fprintf(stderr, "couldn't start the mock server\n");
+        return 1;
+    }
+
+    LibraryOptions options;
+    options.base_url = server.getBaseUrl();
+    options.timeout_ms = timeout_ms;
+    options.max_retries = max_retries;
+    options.max_concurrency = max_concurrency;
+
+    printf("users=%d entries=%d anime=%d latency=%d/%dms (%.1f%% slow) errors=%.1f%% loris=%.1f%%\n",
+        users, entries, anime, fast_ms, slow_ms, slow_fraction * 100, error_rate * 100, loris_fraction * 100);
+    printf("timeout=%ldms retries=%d max concurrency=%d error status=%d\n", timeout_ms, max_retries,
+        max_concurrency, error_status);
+
+    std::vector<double> times;
+    long total_requests = 0;
+    double total_time = 0;
+    int failed = 0;
+    LoadMetrics metrics;
+    for(int run=0; run<runs; run++) {
+        LibraryLoader loader(options);
+        for(int u=0; u<users; u++)
+            loader.addUser("user" + std::to_string(u));
+
+        Clock::time_point start = Clock::now();
+        std::vector<Library*> libraries = loader.load();
+        double t = secondsSince(start);
+
+        times.push_back(t);
+        total_time += t;
+        total_requests += loader.getRequestCount();
+        for(unsigned i=0; i<libraries.size(); i++) {
+            if(libraries[i]->getLibrarySize() != entries)
+                failed++;
+            delete libraries[i];
+        }
+        LoadMetrics m = loader.getMetrics();
+        printf("run %d: %8.1f ms  %d requests  %d anime  %ld connections  %ld retries  window %ld\n", run + 1,
+            t * 1000, loader.getRequestCount(), loader.getAnimeCount(), m.connections, m.retries, m.concurrency);
+        metrics.merge(m);
+    }
+
+    std::sort(times.begin(), times.end());
+    std::vector<double> service = server.getServiceTimes();
+    std::sort(service.begin(), service.end());
+    server.stop();
+
+    printf("load time      median %8.1f ms   worst %8.1f ms\n", percentile(times, 50) * 1000, times.back() * 1000);
+    printf("throughput     %8.0f requests/s\n", total_requests / total_time);
+    printf("server latency p50 %6.2f ms  p99 %6.2f ms  p99.9 %6.2f ms  max %6.2f ms\n",
+        percentile(service, 50), percentile(service, 99), percentile(service, 99.9),
+        service.empty() ? 0 : service.back());
+    printf("server errors  %ld of %ld requests\n", server.getErrorCount(), server.getRequestCount());
+    printf("client         %ld connections  %ld TLS handshakes  %ld retries  %ld timeouts  %ld failed transfers\n",
+        metrics.connections, metrics.tls_handshakes, metrics.retries, metrics.timeouts, metrics.failures);
+    printf("libraries      %d failed of %d\n", failed, users * runs);
+
+    /* Without errors, or with retries to get past them, every library must
+       have loaded */
+    return (error_rate == 0 || max_retries > 0) && failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+/* Benchmark: peak memory of a load, with and without a memory budget.
+
+   Serves a library of synthetic entries from a MockServer, with the
+   metadata of every other anime already in an AnimeCache (as realistic
+   /anime/{id} responses, see syntheticAnimeResponse()) and the rest to be
+   downloaded, and loads it with no budget, which keeps every response
+   until the end of the load, and then streaming under
+   LibraryOptions::memory_budget. Does both for a tenth of the library and
+   for all of it, to show which part of the memory grows with the library.
+
+   Each load is done in a process of its own, so that one load's freed
+   memory doesn't hide the next one's peak, and the mock server runs in
+   another one. The peak is of the anonymous memory the process has
+   resident (RssAnon in /proc/self/status, sampled every millisecond or so),
+   above what it had before the load, so the cache file that is mapped into
+   memory doesn't count. Fails (exits 1) if the libraries loaded the two
+   ways aren't the same, if the response buffers went well over the budget,
+   or if the streaming load didn't take less memory.
+
+   usage: bench_memory [entries] [budget in KB] [cache path] */
+
+#include "Library.h"
+#include "AnimeCache.h"
+#include "MockServer.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+/* What a load in a child process sends back */
+struct LoadResult {
+    bool ok;
+    int size;
+    long peak_kb;           /* Anonymous memory above the baseline */
+    long buffer_peak;
+    double seconds;
+    unsigned long long fingerprint;
+};
+
+/* Resident anonymous memory of this process in KB, or all of its resident
+   memory on kernels that don't say */
+static long residentKB() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if(f == NULL)
+        return 0;
+    char line[256];
+    long anon = -1, rss = 0;
+    while(fgets(line, sizeof(line), f) != NULL) {
+        if(strncmp(line, "RssAnon:", 8) == 0)
+            anon = atol(line + 8);
+        else if(strncmp(line, "VmRSS:", 6) == 0)
+            rss = atol(line + 6);
+    }
+    fclose(f);
+    return anon >= 0 ? anon : rss;
+}
+
+/* Hash of every entry's fields, in status index order (by title, so not
+   by the order the responses arrived in) */
+static unsigned long long fingerprint(Library *library) {
+    unsigned long long h = 1469598103934665603ULL;
+    for(int s=0; s<=UNDEFINED; s++) {
+        std::vector<LibraryEntry*> v = library->getLibraryEntries((library_status)s);
+        for(unsigned i=0; i<v.size(); i++) {
+            char fields[64];
+            snprintf(fields, sizeof(fields), "%d|%d|%d|%d|%g|%g|", s, v[i]->getId(), v[i]->getEpisodeCountValue(),
+                v[i]->getEpisodesWatchedValue(), v[i]->getRatingValue(), v[i]->getCommunityRating());
+            std::string text = std::string(fields) + std::string(v[i]->getTitle()) + "|" + std::string(v[i]->getSynopsis());
+            std::vector<std::string_view> genres = v[i]->getGenres();
+            for(unsigned g=0; g<genres.size(); g++)
+                text += std::string(genres[g]) + ",";
+            for(unsigned c=0; c<text.size(); c++)
+                h = (h ^ (unsigned char)text[c]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+static bool copyFile(const std::string &from, const std::string &to) {
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = in != -1 && out != -1;
+    char buffer[65536];
+    ssize_t n;
+    while(ok && (n = read(in, buffer, sizeof(buffer))) > 0)
+        ok = write(out, buffer, n) == n;
+    if(in != -1)
+        close(in);
+    if(out != -1)
+        close(out);
+    return ok;
+}
+
+/* Loads the library in a child process, with its own copy of the cache
+   (which is cache_bytes at most), and returns what it measured */
+static LoadResult measureLoad(const std::string &base_url, size_t budget, const std::string &cache_path, size_t cache_bytes) {
+    LoadResult r;
+    memset(&r, 0, sizeof(r));
+    int fds[2];
+    if(pipe(fds) != 0)
+        return r;
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        std::string copy = cache_path + ".load";
+        copyFile(cache_path, copy);
+        AnimeCache cache(copy, AnimeCache::DEFAULT_TTL, cache_bytes);
+
+        long baseline = residentKB();
+        std::atomic<long> peak(baseline);
+        std::atomic<bool> loading(true);
+        std::thread sampler([&]() {
+            while(loading) {
+                long kb = residentKB();
+                if(kb > peak)
+                    peak = kb;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        LibraryOptions options;
+        options.base_url = base_url;
+        options.cache = &cache;
+        options.memory_budget = budget;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Library *library = new Library("bench", options);
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long kb = residentKB();
+        if(kb > peak)
+            peak = kb;
+        loading = false;
+        sampler.join();
+
+        r.ok = true;
+        r.size = library->getLibrarySize();
+        r.peak_kb = peak - baseline;
+        r.buffer_peak = library->metrics().buffer_peak;
+        r.fingerprint = fingerprint(library);
+        unlink(copy.c_str());
+        if(write(fds[1], &r, sizeof(r)) != sizeof(r))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    if(pid == -1 || read(fds[0], &r, sizeof(r)) != sizeof(r))
+        r.ok = false;
+    close(fds[0]);
+    if(pid != -1)
+        waitpid(pid, NULL, 0);
+    return r;
+}
+
+/* Starts a mock server for a library of the given size in a process of its
+   own, and returns its port, or -1 if it couldn't be started */
+static int startServer(int entries, pid_t &pid) {
+    int fds[2];
+    if(pipe(fds) != 0)
+        return -1;
+    pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        MockServer server;
+        server.setLibrary(entries, entries);
+        int port = server.start();
+        if(write(fds[1], &port, sizeof(port)) != sizeof(port))
+            _exit(1);
+        pause();
+        _exit(0);
+    }
+    close(fds[1]);
+    int port = -1;
+    if(pid == -1 || read(fds[0], &port, sizeof(port)) != sizeof(port))
+        port = -1;
+    close(fds[0]);
+    return port;
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t budget = (argc > 2 ? atol(argv[2]) : 4096) * 1024;
+    std::string cache_path = argc > 3 ? argv[3] : "/tmp/bench_memory.cache";
+
+    /* The metadata of every other anime is cached; the rest is downloaded */
+    size_t cache_bytes = (size_t)entries * 4096;
+    unlink(cache_path.c_str());
+    {
+        AnimeCache cache(cache_path, AnimeCache::DEFAULT_TTL, cache_bytes);
+        for(int id=1; id<=entries; id+=2)
+            cache.put(id, syntheticAnimeResponse(id));
+    }
+
+    printf("entries=%d budget=%zu KB\n\n", entries, budget / 1024);
+    printf("%8s %10s %10s %12s %12s %12s\n", "entries", "budget KB", "load s", "peak KB", "bytes/entry", "buffers KB");
+
+    /* Nothing in this process starts threads, so the loads and servers can
+       be forked safely */
+    bool pass = true;
+    LoadResult unbounded, bounded;
+    memset(&unbounded, 0, sizeof(unbounded));
+    memset(&bounded, 0, sizeof(bounded));
+    int sizes[2] = { entries / 10, entries };
+    for(int i=0; i<2; i++) {
+        pid_t server;
+        int port = startServer(sizes[i], server);
+        if(port == -1) {
+            fprintf(stderr, "Couldn't start the mock server\n");
+            return 1;
+        }
+        char base_url[64];
+        snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%d/api/v1", port);
+
+        for(int b=0; b<2; b++) {
+            size_t limit = b == 0 ? 0 : budget;
+            LoadResult r = measureLoad(base_url, limit, cache_path, cache_bytes);
+            if(!r.ok || r.size != sizes[i]) {
+                fprintf(stderr, "Load of %d entries failed\n", sizes[i]);
+                pass = false;
+            }
+            printf("%8d %10zu %10.2f %12ld %12.0f %12.1f\n", r.size, limit / 1024, r.seconds, r.peak_kb,
+                r.peak_kb * 1024.0 / (r.size > 0 ? r.size : 1), r.buffer_peak / 1024.0);
+            (b == 0 ? unbounded : bounded) = r;
+        }
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+
+        if(unbounded.fingerprint != bounded.fingerprint) {
+            fprintf(stderr, "The libraries loaded with and without a budget are different\n");
+            pass = false;
+        }
+        if((size_t)bounded.buffer_peak > budget + budget / 4) {
+            fprintf(stderr, "Response buffers peaked at %ld bytes, over the budget\n", bounded.buffer_peak);
+            pass = false;
+        }
+    }
+
+    if(bounded.peak_kb >= unbounded.peak_kb) {
+        fprintf(stderr, "The load took no less memory with a budget\n");
+        pass = false;
+    }
+    printf("\nstreaming saved %ld KB (%.0f%%) at %d entries\n", unbounded.peak_kb - bounded.peak_kb,
+        unbounded.peak_kb > 0 ? 100.0 * (unbounded.peak_kb - bounded.peak_kb) / unbounded.peak_kb : 0.0, entries);
+
+    unlink(cache_path.c_str());
+    return pass ? 0 : 1;
+}
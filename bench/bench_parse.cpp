@@ -0,0 +1,231 @@
+/* Benchmark: parsing the API's responses with the ResponseParser vs the
+   json-c path it replaced.
+
+   Builds a synthetic library list and the /anime/{id} response of every
+   entry in it, in the format of the real API (with all the fields a
+   Library doesn't use), and turns them into rows of a LibraryStore both
+   ways:
+
+   - json-c: json_tokener_parse() each response into a tree of
+     json_objects, copy the fields we want into a new json_object per entry
+     and have the store read them back out of that
+   - streaming: parse the fields we want straight into EntryFields with a
+     ResponseParser, skipping the rest, and add those to the store
+
+   For the list and for the anime responses separately, prints the time
+   taken (best of a few runs), the parse throughput in MB/s, and how many
+   heap allocations were made and bytes allocated per entry. Allocations
+   are counted by wrapping malloc() and friends (glibc only), so they
+   include json-c's and the store's as well as operator new's. Also checks
+   that both ways give the same rows.
+
+   usage: bench_parse [entries] */
+
+#include "LibraryStore.h"
+#include "ResponseParser.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+
+/* Allocation counting: malloc() and friends are replaced with versions
+   that count the calls and bytes, then hand over to glibc's own */
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void *p, size_t size);
+    void __libc_free(void *p);
+}
+
+static unsigned long allocations = 0;
+static unsigned long allocated_bytes = 0;
+
+extern "C" void* malloc(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    allocations++;
+    allocated_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void *p, size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    return __libc_realloc(p, size);
+}
+
+extern "C" void free(void *p) {
+    __libc_free(p);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* How long one run of one phase took, and what it allocated */
+struct Run {
+    double seconds;
+    unsigned long allocations;
+    unsigned long bytes;
+};
+
+/* Times fn() a few times, keeping the best time; allocations are the same
+   on every run */
+template <class F>
+static Run best(F fn) {
+    Run r;
+    for(int run=0; run<5; run++) {
+        unsigned long a = allocations, b = allocated_bytes;
+        Clock::time_point start = Clock::now();
+        fn();
+        double t = secondsSince(start);
+        if(run == 0 || t < r.seconds)
+            r.seconds = t;
+        r.allocations = allocations - a;
+        r.bytes = allocated_bytes - b;
+    }
+    return r;
+}
+
+static void print(const char *path, const char *phase, const Run &r, size_t bytes, int entries) {
+    printf("%-10s %-6s %8.2f ms %8.1f MB/s %10.2f allocs/entry %10.0f bytes/entry\n", path, phase,
+        r.seconds * 1000, bytes / 1e6 / r.seconds, (double)r.allocations / entries, (double)r.bytes / entries);
+}
+
+/* The json-c path: builds the final library entry json object for one
+   entry of the list, the way Library::beginLoad() used to */
+static json_object* finalEntryJson(json_object *entry) {
+    json_object *final_json = json_object_new_object();
+    json_object *value = NULL;
+    json_object_object_get_ex(entry, "status", &value);
+    json_object_object_add(final_json, "library_status", json_object_get(value));
+    json_object_object_get_ex(entry, "episodes_watched", &value);
+    json_object_object_add(final_json, "episodes_watched", json_object_get(value));
+    json_object *rating = NULL;
+    json_object_object_get_ex(entry, "rating", &rating);
+    value = NULL;
+    json_object_object_get_ex(rating, "value", &value);
+    json_object_object_add(final_json, "rating", json_object_get(value));
+    json_object *anime = NULL;
+    json_object_object_get_ex(entry, "anime", &anime);
+    value = NULL;
+    json_object_object_get_ex(anime, "id", &value);
+    json_object_object_add(final_json, "anime_id", json_object_get(value));
+    return final_json;
+}
+
+/* The json-c path: copies the anime's fields into its final library entry
+   json object, the way Library::finishEntry() used to */
+static void addAnimeJson(json_object *final_json, json_object *anime) {
+    static const char *FIELDS[][2] = {
+        { "title", "title" }, { "synopsis", "synopsis" }, { "status", "airing_status" },
+        { "episode_count", "episode_count" }, { "show_type", "show_type" },
+        { "community_rating", "community_rating" }, { "genres", "genres" }
+    };
+    for(unsigned i=0; i<sizeof(FIELDS) / sizeof(FIELDS[0]); i++) {
+        json_object *value = NULL;
+        json_object_object_get_ex(anime, FIELDS[i][0], &value);
+        json_object_object_add(final_json, FIELDS[i][1], json_object_get(value));
+    }
+}
+
+/* Whether row i of a and b are the same */
+static bool sameRow(LibraryStore &a, LibraryStore &b, int i) {
+    LibraryEntry *x = a.getEntry(i);
+    LibraryEntry *y = b.getEntry(i);
+    float ra = a.getRatings()[i], rb = b.getRatings()[i];
+    return x->getId() == y->getId() && x->getTitle() == y->getTitle() && x->getSynopsis() == y->getSynopsis() &&
+        x->getGenres() == y->getGenres() && x->getLibraryStatus() == y->getLibraryStatus() &&
+        x->getEpisodeCountValue() == y->getEpisodeCountValue() &&
+        x->getEpisodesWatchedValue() == y->getEpisodesWatchedValue() &&
+        x->getShowType() == y->getShowType() && x->getAiringStatusCode() == y->getAiringStatusCode() &&
+        a.getCommunityRatings()[i] == b.getCommunityRatings()[i] &&
+        (ra == rb || (std::isnan(ra) && std::isnan(rb)));
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 20000;
+
+    std::string list = syntheticLibraryList(entries);
+    std::vector<std::string> bodies(entries);
+    size_t anime_bytes = 0;
+    for(int i=0; i<entries; i++) {
+        bodies[i] = syntheticAnimeResponse(i);
+        anime_bytes += bodies[i].size();
+    }
+    printf("entries=%d list=%.1f MB anime responses=%.1f MB\n\n", entries, list.size() / 1e6, anime_bytes / 1e6);
+
+    /* json-c */
+    std::vector<json_object*> finals;
+    Run list_jsonc = best([&]() {
+        for(unsigned i=0; i<finals.size(); i++)
+            json_object_put(finals[i]);
+        finals.clear();
+        json_object *list_json = json_tokener_parse(list.c_str());
+        int n = json_object_array_length(list_json);
+        for(int i=0; i<n; i++)
+            finals.push_back(finalEntryJson(json_object_array_get_idx(list_json, i)));
+        json_object_put(list_json);
+    });
+    LibraryStore *jsonc_store = NULL;
+    Run anime_jsonc = best([&]() {
+        delete jsonc_store;
+        jsonc_store = new LibraryStore();
+        for(int i=0; i<entries; i++) {
+            json_object *anime = json_tokener_parse(bodies[i].c_str());
+            json_object *final_json = json_object_get(finals[i]);
+            addAnimeJson(final_json, anime);
+            jsonc_store->add(final_json);
+            json_object_put(final_json);
+            json_object_put(anime);
+        }
+    });
+
+    /* Streaming, with a new parser each run so its buffers have to grow
+       from nothing, as they do on a real load */
+    std::vector<EntryFields> fields;
+    Run list_streaming = best([&]() {
+        ResponseParser parser;
+        parser.parseLibraryList(list, fields);
+    });
+    LibraryStore *streaming_store = NULL;
+    Run anime_streaming = best([&]() {
+        delete streaming_store;
+        streaming_store = new LibraryStore();
+        ResponseParser parser;
+        for(int i=0; i<entries; i++) {
+            EntryFields f = fields[i];
+            if(parser.parseAnime(bodies[i], f))
+                streaming_store->add(f);
+        }
+    });
+
+    print("json-c", "list", list_jsonc, list.size(), entries);
+    print("streaming", "list", list_streaming, list.size(), entries);
+    print("json-c", "anime", anime_jsonc, anime_bytes, entries);
+    print("streaming", "anime", anime_streaming, anime_bytes, entries);
+    printf("\nspeedup: list %.1fx, anime %.1fx\n",
+        list_jsonc.seconds / list_streaming.seconds, anime_jsonc.seconds / anime_streaming.seconds);
+
+    bool same = jsonc_store->size() == entries && streaming_store->size() == entries;
+    for(int i=0; same && i<entries; i++)
+        same = sameRow(*jsonc_store, *streaming_store, i);
+    printf("rows %s\n", same ? "identical" : "DIFFERENT");
+
+    for(unsigned i=0; i<finals.size(); i++)
+        json_object_put(finals[i]);
+    delete jsonc_store;
+    delete streaming_store;
+    return same ? 0 : 1;
+}
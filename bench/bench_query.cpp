@@ -0,0 +1,80 @@
+/* Benchmark: LibraryStore::select() vs. filtering entries with getters.
+
+   Builds a synthetic library and runs the query "completed, Action AND
+   Sci-Fi, community rating >= 4.0" three ways: the naive loop over every
+   LibraryEntry copying getGenres(), select() with the scalar kernel, and
+   select() with the AVX2 kernel. Prints rows filtered per second.
+
+   usage: bench_query [entries] [repetitions] */
+
+#include "LibraryStore.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* The way a query had to be written before LibraryQuery */
+static void naiveFilter(LibraryStore &store, std::vector<int> &rows) {
+    rows.clear();
+    for(int i=0; i<store.size(); i++) {
+        LibraryEntry *le = store.getEntry(i);
+        if(le->getLibraryStatus() != COMPLETED || le->getCommunityRating() < 4.0)
+            continue;
+        std::vector<std::string_view> genres = le->getGenres();
+        if(std::find(genres.begin(), genres.end(), "Action") != genres.end() &&
+           std::find(genres.begin(), genres.end(), "Sci-Fi") != genres.end())
+            rows.push_back(i);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    int reps = argc > 2 ? atoi(argv[2]) : 20;
+
+    LibraryStore store;
+    for(int i=0; i<n; i++)
+        syntheticEntry(&store, i);
+
+    LibraryQuery q;
+    q.status = COMPLETED;
+    q.genres.push_back("Action");
+    q.genres.push_back("Sci-Fi");
+    q.min_community_rating = 4.0;
+
+    std::vector<int> expected, rows;
+    printf("entries=%d repetitions=%d avx2=%s\n", n, reps,
+        __builtin_cpu_supports("avx2") ? "yes" : "no");
+
+    Clock::time_point start = Clock::now();
+    for(int r=0; r<reps; r++)
+        naiveFilter(store, expected);
+    double naive = secondsSince(start);
+    printf("%-14s %14.0f rows/s  (%zu matches)\n", "naive getters", (double)n * reps / naive, expected.size());
+
+    start = Clock::now();
+    for(int r=0; r<reps; r++)
+        store.select(q, rows, false);
+    double scalar = secondsSince(start);
+    printf("%-14s %14.0f rows/s  (%zu matches%s)\n", "select scalar", (double)n * reps / scalar,
+        rows.size(), rows == expected ? "" : ", MISMATCH");
+
+    start = Clock::now();
+    for(int r=0; r<reps; r++)
+        store.select(q, rows, true);
+    double simd = secondsSince(start);
+    printf("%-14s %14.0f rows/s  (%zu matches%s)\n", "select simd", (double)n * reps / simd,
+        rows.size(), rows == expected ? "" : ", MISMATCH");
+
+    printf("speedup over naive: scalar %.1fx, simd %.1fx\n", naive / scalar, naive / simd);
+    return 0;
+}
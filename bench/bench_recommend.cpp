@@ -0,0 +1,245 @@
+/* Benchmark: "similar to X" and "recommended for U" queries.
+
+   Makes the libraries of a number of users out of a catalog of synthetic
+   titles: every title is in at least one library, and each library has
+   extra titles picked with a bias towards popular ones (the low numbers),
+   so libraries overlap the way real ones do. Builds a Recommender over
+   them, then times similarTo() for random titles and recommendFor() for
+   every user, comparing the scalar and AVX2 kernels, and times the same
+   "similar to X" by genres done the way a first prototype did it: a loop
+   over every entry of every library comparing getGenres() lists of
+   strings, then a sort of every score.
+
+   Fails (exits 1) if the two kernels ever give different results, if a
+   result lists the title it was asked about or something from the user's
+   library, if results aren't best first, or if the best 10 aren't the
+   first 10 of the best 50.
+
+   usage: bench_recommend [titles] [users] [queries] */
+
+#include "Recommender.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Times of a set of queries, in milliseconds */
+struct QueryTimes {
+    std::vector<double> ms;
+
+    double mean() {
+        double sum = 0;
+        for(unsigned i=0; i<ms.size(); i++)
+            sum += ms[i];
+        return ms.empty() ? 0 : sum / ms.size();
+    }
+
+    double percentile(double p) {
+        if(ms.empty())
+            return 0;
+        std::vector<double> sorted = ms;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min((size_t)(sorted.size() * p / 100.0), sorted.size() - 1)];
+    }
+};
+
+static void printTimes(const char *name, QueryTimes &t) {
+    printf("%-30s %8zu %10.3f %10.3f %12.0f\n", name, t.ms.size(), t.mean(), t.percentile(99), 1000.0 / t.mean());
+}
+
+/* "Similar to X" by genres the prototype's way */
+static std::vector<std::pair<float, int> > prototypeSimilarTo(const std::vector<Library*> &libraries, int anime_id, int k) {
+    LibraryEntry *query = NULL;
+    for(unsigned l=0; l<libraries.size() && query == NULL; l++)
+        query = libraries[l]->getLibraryEntryById(anime_id);
+    std::vector<std::string_view> query_genres = query->getGenres();
+
+    std::unordered_set<int> seen;
+    std::vector<std::pair<float, int> > scores;
+    for(unsigned l=0; l<libraries.size(); l++) {
+        std::vector<LibraryEntry*> entries;
+        for(int s=CURRENTLY_WATCHING; s<=UNDEFINED; s++) {
+            std::vector<LibraryEntry*> v = libraries[l]->getLibraryEntries((library_status)s);
+            entries.insert(entries.end(), v.begin(), v.end());
+        }
+        for(unsigned e=0; e<entries.size(); e++) {
+            if(entries[e]->getId() == anime_id || !seen.insert(entries[e]->getId()).second)
+                continue;
+            std::vector<std::string_view> genres = entries[e]->getGenres();
+            int common = 0;
+            for(unsigned i=0; i<query_genres.size(); i++) {
+                for(unsigned j=0; j<genres.size(); j++) {
+                    if(query_genres[i] == genres[j]) {
+                        common++;
+                        break;
+                    }
+                }
+            }
+            float either = (float)(query_genres.size() + genres.size() - common);
+            scores.push_back(std::make_pair(either > 0 ? -common / either : 0.0f, entries[e]->getId()));
+        }
+    }
+    std::sort(scores.begin(), scores.end());
+    scores.resize(std::min((int)scores.size(), k));
+    return scores;
+}
+
+/* Checks a result: best first, no excluded titles, k of them (unless the
+   catalog is smaller) */
+static bool resultOk(const std::vector<Recommendation> &r, int k, const std::unordered_set<int> &excluded) {
+    for(unsigned i=0; i<r.size(); i++) {
+        if(excluded.count(r[i].id) != 0)
+            return false;
+        if(i > 0 && (r[i].score > r[i - 1].score || (r[i].score == r[i - 1].score && r[i].id < r[i - 1].id)))
+            return false;
+    }
+    return (int)r.size() == k;
+}
+
+static bool sameResults(const std::vector<Recommendation> &a, const std::vector<Recommendation> &b, unsigned n) {
+    if(a.size() < n || b.size() < n)
+        return false;
+    for(unsigned i=0; i<n; i++) {
+        if(a[i].id != b[i].id || a[i].score != b[i].score)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int title_count = argc > 1 ? atoi(argv[1]) : 60000;
+    int user_count = argc > 2 ? atoi(argv[2]) : 64;
+    int queries = argc > 3 ? atoi(argv[3]) : 200;
+    const int k = 10;
+
+    /* Every title in one library, plus popular extras in each */
+    Clock::time_point start = Clock::now();
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<Library*> libraries;
+    long entries = 0;
+    std::string path = "/tmp/bench_recommend." + std::to_string(getpid()) + ".snapshot";
+    for(int u=0; u<user_count; u++) {
+        std::vector<uint8_t> in(title_count, 0);
+        for(int n=u; n<title_count; n+=user_count)
+            in[n] = 1;
+        int extras = std::min(2000, title_count / 2);
+        for(int i=0; i<extras; i++)
+            in[(int)(title_count * uniform(random) * uniform(random) * uniform(random))] = 1;
+
+        LibraryStore store;
+        for(int n=0; n<title_count; n++) {
+            if(in[n])
+                syntheticEntry(&store, n);
+        }
+        Library *library = libraryFromStore(&store, path);
+        if(library == NULL) {
+            fprintf(stderr, "Couldn't make a library\n");
+            return 1;
+        }
+        entries += library->getLibrarySize();
+        libraries.push_back(library);
+    }
+    double make_time = secondsSince(start);
+
+    start = Clock::now();
+    Recommender recommender(libraries);
+    double build_time = secondsSince(start);
+    printf("titles=%d users=%d entries=%ld genres=%d avx2=%s\n", recommender.getTitleCount(), user_count, entries,
+        recommender.getGenreCount(), __builtin_cpu_supports("avx2") ? "yes" : "no");
+    printf("(libraries made in %.2fs, catalog built in %.1f ms)\n\n", make_time, build_time * 1000);
+    printf("%-30s %8s %10s %10s %12s\n", "query", "queries", "mean ms", "p99 ms", "queries/s");
+
+    bool pass = true;
+    std::vector<int> ids;
+    for(int q=0; q<queries; q++)
+        ids.push_back(1 + (int)(random() % title_count));
+
+    /* The prototype, on fewer queries, as it's slow */
+    QueryTimes prototype;
+    for(int q=0; q<std::min(queries, 10); q++) {
+        Clock::time_point t = Clock::now();
+        std::vector<std::pair<float, int> > r = prototypeSimilarTo(libraries, ids[q], k);
+        prototype.ms.push_back(secondsSince(t) * 1000);
+        if(r.empty())
+            pass = false;
+    }
+    printTimes("similar, prototype (genres)", prototype);
+
+    /* Similar to X, with each kernel */
+    for(int simd=0; simd<2; simd++) {
+        QueryTimes times;
+        for(int q=0; q<queries; q++) {
+            Clock::time_point t = Clock::now();
+            std::vector<Recommendation> r = recommender.similarTo(ids[q], k, simd == 1);
+            times.ms.push_back(secondsSince(t) * 1000);
+            std::unordered_set<int> excluded;
+            excluded.insert(ids[q]);
+            if(!resultOk(r, k, excluded)) {
+                fprintf(stderr, "Bad result for similarTo(%d)\n", ids[q]);
+                pass = false;
+            }
+        }
+        printTimes(simd ? "similar, AVX2" : "similar, scalar", times);
+    }
+
+    /* Recommended for U, with each kernel */
+    for(int simd=0; simd<2; simd++) {
+        QueryTimes times;
+        for(int u=0; u<user_count; u++) {
+            Clock::time_point t = Clock::now();
+            std::vector<Recommendation> r = recommender.recommendFor(libraries[u], k, simd == 1);
+            times.ms.push_back(secondsSince(t) * 1000);
+            std::unordered_set<int> excluded;
+            LibraryStore *store = libraries[u]->getStore();
+            for(int row=0; row<store->size(); row++)
+                excluded.insert(store->getIds()[row]);
+            if(!resultOk(r, k, excluded)) {
+                fprintf(stderr, "Bad result for recommendFor(user %d)\n", u);
+                pass = false;
+            }
+        }
+        printTimes(simd ? "recommended, AVX2" : "recommended, scalar", times);
+    }
+
+    /* The kernels agree, and the heap keeps the right titles */
+    for(int m=0; m<2; m++) {
+        RecommenderOptions options;
+        options.metric = m == 0 ? JACCARD : COSINE;
+        Recommender checked(libraries, options);
+        for(int q=0; q<std::min(queries, 50); q++) {
+            std::vector<Recommendation> scalar = checked.similarTo(ids[q], 50, false);
+            std::vector<Recommendation> simd = checked.similarTo(ids[q], 50, true);
+            std::vector<Recommendation> top = checked.similarTo(ids[q], k, true);
+            if(!sameResults(scalar, simd, 50) || !sameResults(top, simd, k)) {
+                fprintf(stderr, "Results for similarTo(%d) don't match (%s)\n", ids[q], m == 0 ? "Jaccard" : "cosine");
+                pass = false;
+            }
+        }
+        for(int u=0; u<std::min(user_count, 16); u++) {
+            std::vector<Recommendation> scalar = checked.recommendFor(libraries[u], 50, false);
+            std::vector<Recommendation> simd = checked.recommendFor(libraries[u], 50, true);
+            if(!sameResults(scalar, simd, std::min<size_t>(50, scalar.size())) || scalar.size() != simd.size()) {
+                fprintf(stderr, "Results for recommendFor(user %d) don't match\n", u);
+                pass = false;
+            }
+        }
+    }
+
+    for(unsigned l=0; l<libraries.size(); l++)
+        delete libraries[l];
+    return pass ? 0 : 1;
+}
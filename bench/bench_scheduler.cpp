@@ -0,0 +1,113 @@
+/* Benchmark: sliding-window TransferScheduler vs. the old batch barrier.
+
+   Downloads the same set of /anime/{id} URLs from a local MockServer in
+   which a small fraction of the ids respond slowly, first the way
+   getLibrary() used to (add N transfers, wait for all of them, repeat)
+   and then with TransferScheduler, and prints the wall-clock time of each.
+
+   usage: bench_scheduler [requests] [window] [fast_ms] [slow_ms] [slow_fraction] */
+
+#include "TransferScheduler.h"
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+    ((std::string*)userp)->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+/* The scheduling that getLibrary() used before TransferScheduler: start a
+   batch of window transfers and wait until every one of them is done before
+   starting the next batch. */
+static int runBatched(std::vector<std::string> &urls, std::vector<std::string> &buffers, int window) {
+    CURLM *multi_handle = curl_multi_init();
+    std::vector<CURL*> curls(window);
+    for(int i=0; i<window; i++)
+        curls[i] = curl_easy_init();
+
+    int counter = 0;
+    int total = (int)urls.size();
+    while(counter < total) {
+        int batch = total - counter < window ? total - counter : window;
+        for(int i=0; i<batch; i++) {
+            curl_easy_reset(curls[i]);
+            curl_easy_setopt(curls[i], CURLOPT_URL, urls[counter].c_str());
+            curl_easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curls[i], CURLOPT_WRITEDATA, &buffers[counter]);
+            curl_easy_setopt(curls[i], CURLOPT_FAILONERROR, 1);
+            curl_multi_add_handle(multi_handle, curls[i]);
+            counter++;
+        }
+
+        int still_running;
+        do {
+            curl_multi_perform(multi_handle, &still_running);
+            if(still_running)
+                curl_multi_poll(multi_handle, NULL, 0, 1000, NULL);
+        } while(still_running);
+
+        for(int i=0; i<batch; i++)
+            curl_multi_remove_handle(multi_handle, curls[i]);
+    }
+
+    for(int i=0; i<window; i++)
+        curl_easy_cleanup(curls[i]);
+    curl_multi_cleanup(multi_handle);
+    return 0;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    int requests = argc > 1 ? atoi(argv[1]) : 1000;
+    int window = argc > 2 ? atoi(argv[2]) : 50;
+    int fast_ms = argc > 3 ? atoi(argv[3]) : 5;
+    int slow_ms = argc > 4 ? atoi(argv[4]) : 300;
+    double slow_fraction = argc > 5 ? atof(argv[5]) : 0.02;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    MockServer server;
+    server.setLatency(fast_ms, slow_ms, slow_fraction);
+    if(server.start() == -1) {
+        fprintf(stderr, "Couldn't start mock server\n");
+        return 1;
+    }
+
+    std::vector<std::string> urls(requests);
+    for(int i=0; i<requests; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "%d", i + 1);
+        urls[i] = server.getBaseUrl() + "/anime/" + id;
+    }
+
+    printf("requests=%d window=%d fast_ms=%d slow_ms=%d slow_fraction=%.3f\n",
+        requests, window, fast_ms, slow_ms, slow_fraction);
+
+    std::vector<std::string> buffers(requests);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    runBatched(urls, buffers, window);
+    double batched = secondsSince(start);
+    printf("batch barrier:  %8.3f s  (%8.1f req/s)\n", batched, requests / batched);
+
+    std::vector<std::string> buffers2(requests);
+    TransferScheduler scheduler(window);
+    for(int i=0; i<requests; i++)
+        scheduler.add(urls[i], &buffers2[i]);
+    start = std::chrono::steady_clock::now();
+    int failed = scheduler.run();
+    double sliding = secondsSince(start);
+    printf("sliding window: %8.3f s  (%8.1f req/s, %d failed)\n", sliding, requests / sliding, failed);
+    printf("speedup:        %8.2fx\n", batched / sliding);
+
+    server.stop();
+    curl_global_cleanup();
+    return 0;
+}
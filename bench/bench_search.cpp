@@ -0,0 +1,101 @@
+/* Benchmark: TitleSearch vs. scanning every title with edit distance.
+
+   Builds a synthetic library, then looks up misspelled titles (one or two
+   characters changed, dropped or added) with TitleSearch::search() and
+   with a linear scan computing the edit distance to every title, and
+   completes prefixes with TitleSearch::complete(). Prints microseconds per
+   query and how often the misspelled title's entry came back first.
+
+   usage: bench_search [entries] [queries] */
+
+#include "LibraryStore.h"
+#include "TitleSearch.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static double usSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/* Returns title with a couple of deterministic typos in it */
+static std::string misspell(std::string title, unsigned seed) {
+    int typos = 1 + seed % 2;
+    for(int t=0; t<typos; t++) {
+        seed = seed * 1103515245 + 12345;
+        size_t pos = (seed >> 8) % title.size();
+        switch((seed >> 4) % 3) {
+            case 0: title[pos] = 'a' + (seed >> 16) % 26; break;
+            case 1: title.erase(pos, 1); break;
+            default: title.insert(pos, 1, 'a' + (seed >> 16) % 26); break;
+        }
+    }
+    return title;
+}
+
+/* The way typos had to be handled before TitleSearch */
+static LibraryEntry* linearSearch(LibraryStore &store, const std::string &query) {
+    std::string key = TitleSearch::normalize(query);
+    LibraryEntry *best = NULL;
+    int best_distance = 0;
+    for(int i=0; i<store.size(); i++) {
+        int d = TitleSearch::editDistance(key, TitleSearch::normalize(store.getEntry(i)->getTitle()));
+        if(best == NULL || d < best_distance) {
+            best = store.getEntry(i);
+            best_distance = d;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 100000;
+    int queries = argc > 2 ? atoi(argv[2]) : 1000;
+
+    LibraryStore store;
+    for(int i=0; i<n; i++)
+        syntheticEntry(&store, i);
+
+    Clock::time_point start = Clock::now();
+    TitleSearch search;
+    search.build(&store);
+    printf("entries=%d queries=%d build=%.1f ms\n", n, queries, usSince(start) / 1000);
+
+    std::vector<int> targets(queries);
+    std::vector<std::string> typos(queries);
+    for(int q=0; q<queries; q++) {
+        targets[q] = (int)(((unsigned)q * 2654435761u) % n);
+        typos[q] = misspell(syntheticTitle(targets[q]), q);
+    }
+
+    int found = 0;
+    start = Clock::now();
+    for(int q=0; q<queries; q++) {
+        std::vector<TitleMatch> v = search.search(typos[q], 5);
+        found += !v.empty() && v[0].entry->getRow() == targets[q];
+    }
+    printf("%-16s %10.1f us/query  (%d/%d found first)\n", "trigram search", usSince(start) / queries, found, queries);
+
+    /* The scan is slow, so only time a few queries */
+    int scanned = queries < 20 ? queries : 20;
+    found = 0;
+    start = Clock::now();
+    for(int q=0; q<scanned; q++)
+        found += linearSearch(store, typos[q])->getRow() == targets[q];
+    printf("%-16s %10.1f us/query  (%d/%d found first)\n", "linear scan", usSince(start) / scanned, found, scanned);
+
+    int completions = 0;
+    start = Clock::now();
+    for(int q=0; q<queries; q++) {
+        std::string title = syntheticTitle(targets[q]);
+        completions += search.complete(title.substr(0, 1 + q % 8), 10).size();
+    }
+    printf("%-16s %10.1f us/query  (%d completions)\n", "prefix complete", usSince(start) / queries, completions);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/* Benchmark: starting up from a snapshot vs rebuilding from JSON.
+
+   Builds a library of synthetic entries the way a download does (parsing
+   each entry's JSON into a LibraryStore, indexing it and sorting the status
+   indexes) and times that, then saves it as a snapshot and times loading
+   it back with the Library(SnapshotFile) constructor. Checks that both give
+   the same library. The snapshot is read from the page cache, as it would
+   be on a second start; the network time a real rebuild also needs isn't
+   counted at all.
+
+   usage: bench_snapshot [entries] [snapshot path] */
+
+#include "Library.h"
+#include "EntryIndex.h"
+#include "Synthetic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 100000;
+    std::string path = argc > 2 ? argv[2] : "/tmp/bench_snapshot.snapshot";
+
+    /* The responses, as they'd arrive from the API */
+    std::vector<std::string> bodies(entries);
+    for(int i=0; i<entries; i++) {
+        json_object *j = syntheticEntryJson(i);
+        bodies[i] = json_object_to_json_string(j);
+        json_object_put(j);
+    }
+
+    /* JSON rebuild: what a Library does with each response once it's here */
+    Clock::time_point start = Clock::now();
+    LibraryStore store;
+    EntryIndex index;
+    std::vector<LibraryEntry*> status_index[UNDEFINED + 1];
+    for(int i=0; i<entries; i++) {
+        json_object *j = json_tokener_parse(bodies[i].c_str());
+        LibraryEntry *le = store.add(j);
+        json_object_put(j);
+        index.insert(le);
+        status_index[le->getLibraryStatus()].push_back(le);
+    }
+    for(int s=0; s<=UNDEFINED; s++)
+        std::stable_sort(status_index[s].begin(), status_index[s].end(), Library::libraryEntryTitleSort);
+    double rebuild = secondsSince(start);
+
+    /* Turn the store into a Library, and time saving that */
+    Library *saved = libraryFromStore(&store, path);
+    int rc = 1;
+    double save = 0;
+    if(saved != NULL) {
+        start = Clock::now();
+        rc = saved->save(path);
+        save = secondsSince(start);
+        delete saved;
+    }
+    if(rc != 0) {
+        fprintf(stderr, "couldn't write %s\n", path.c_str());
+        return 1;
+    }
+
+    /* Snapshot load, best of a few */
+    double load = 0;
+    for(int run=0; run<5; run++) {
+        start = Clock::now();
+        Library *L = new Library(SnapshotFile(path));
+        double t = secondsSince(start);
+        if(run == 0 || t < load)
+            load = t;
+        if(run < 4)
+            delete L;
+        else
+            saved = L;
+    }
+
+    /* Both ways must give the same library */
+    bool same = saved->getLibrarySize() == entries;
+    for(int s=0; same && s<=UNDEFINED; s++) {
+        std::vector<LibraryEntry*> v = saved->getLibraryEntries((library_status)s);
+        same = v.size() == status_index[s].size();
+        for(unsigned i=0; same && i<v.size(); i++) {
+            same = v[i]->getTitle() == status_index[s][i]->getTitle() &&
+                v[i]->getSynopsis() == status_index[s][i]->getSynopsis() &&
+                v[i]->getGenres() == status_index[s][i]->getGenres() &&
+                v[i]->getRating() == status_index[s][i]->getRating();
+        }
+    }
+    for(int i=0; same && i<entries; i+=97)
+        same = saved->getLibraryEntryById(i + 1) != NULL && saved->getLibraryEntry(syntheticTitle(i)) != NULL;
+
+    struct stat st;
+    stat(path.c_str(), &st);
+    printf("entries=%d snapshot=%.1f MB (save %.1f ms)\n", entries, st.st_size / 1e6, save * 1000);
+    printf("json rebuild   %8.2f ms\n", rebuild * 1000);
+    printf("snapshot load  %8.2f ms  %6.1fx  %s\n", load * 1000, rebuild / load,
+        same ? "identical" : "DIFFERENT");
+
+    delete saved;
+    unlink(path.c_str());
+    return same ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+/* Benchmark: reading a library from many threads while it's refreshed.
+
+   Loads a library of synthetic entries from a MockServer, then runs
+   reader threads against it while a writer thread refreshes it over and
+   over (each refresh downloads the library list again and publishes the
+   result). The readers look entries up by id and by title and list the
+   entries of a status, in a 45/45/10 mix, and time every read. They read
+   two ways:
+
+   - rwlock: the way it had to be done without versions, reading the
+     library itself under a global reader/writer lock, which the writer
+     holds for the whole of each refresh;
+   - versions: reading the library's current LibraryVersion through a
+     LibraryVersion::Reader, without locking anything, while the writer
+     publishes a new version at the end of each refresh.
+
+   For 1, 2, 4, ... reader threads (up to the number of CPU cores, and at
+   least 4), prints reads per second over all readers, the read latency
+   percentiles (including the cost of timing each read, ~20-30 ns) and the
+   refreshes per second the writer got done. Reads only scale with threads
+   as far as there are cores for them.
+
+   Fails (exits 1) if a read ever misses an entry that is in the library,
+   if a reader sees an older version after a newer one, or if any version
+   hasn't been freed once the library is deleted.
+
+   usage: bench_versions [entries] [seconds per run] [max readers] */
+
+#include "Library.h"
+#include "LibraryVersion.h"
+#include "Epoch.h"
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <shared_mutex>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+/* Latencies in nanoseconds, in buckets 1/16 of a power of two wide, so
+   percentiles are within about 6% without keeping every read */
+struct ReadLatencies {
+    std::vector<long> counts;
+    long total;
+
+    /* Constructor */
+    ReadLatencies(){
+        counts.assign(64 * 16, 0);
+        total = 0;
+    }
+
+    static int bucketOf(uint64_t ns) {
+        if(ns < 16)
+            return (int)ns;
+        int msb = 63 - __builtin_clzll(ns);
+        return (msb - 3) * 16 + (int)((ns >> (msb - 4)) & 15);
+    }
+
+    static double lowerBound(int bucket) {
+        if(bucket < 16)
+            return bucket;
+        int msb = bucket / 16 + 3;
+        return (double)((16 + bucket % 16) * (1ULL << (msb - 4)));
+    }
+
+    void add(uint64_t ns) {
+        counts[bucketOf(ns)]++;
+        total++;
+    }
+
+    void merge(const ReadLatencies &h) {
+        for(unsigned i=0; i<counts.size(); i++)
+            counts[i] += h.counts[i];
+        total += h.total;
+    }
+
+    /* The pth percentile, in nanoseconds */
+    double percentile(double p) {
+        long want = std::min((long)(total * p / 100.0), total - 1);
+        long seen = 0;
+        for(unsigned i=0; i<counts.size(); i++) {
+            seen += counts[i];
+            if(seen > want)
+                return lowerBound(i);
+        }
+        return 0;
+    }
+};
+
+/* What every thread of a run shares */
+struct Run {
+    Library *library;
+    bool versioned;
+    std::shared_mutex lock;                  /* The global lock, without versions */
+    std::atomic<bool> stop;
+    std::atomic<bool> failed;
+    const std::vector<int> *ids;
+    const std::vector<std::string> *titles;
+};
+
+/* One read: an entry by id, one by title, or a status's entries. Returns
+   false if the entry wasn't found. */
+static bool readOnce(Library *library, LibraryVersion *version, int op, int id, const std::string &title, int &sink) {
+    LibraryEntry *le;
+    if(op < 45) {
+        le = version != NULL ? version->getLibraryEntryById(id) : library->getLibraryEntryById(id);
+    } else if(op < 90) {
+        le = version != NULL ? version->getLibraryEntry(title) : library->getLibraryEntry(title);
+    } else {
+        library_status s = (library_status)(op % (UNDEFINED + 1));
+        if(version != NULL)
+            sink += (int)version->getLibraryEntries(s).size();
+        else
+            sink += (int)library->getLibraryEntries(s).size();
+        return true;
+    }
+    if(le == NULL)
+        return false;
+    sink += le->getEpisodeCountValue();
+    return true;
+}
+
+static void reader(Run *run, int seed, ReadLatencies *latency) {
+    std::minstd_rand random(seed);
+    int n = (int)run->ids->size();
+    int sink = 0;
+    long last_version = 0;
+    while(!run->stop.load(std::memory_order_relaxed)) {
+        int i = random() % n;
+        int op = random() % 100;
+        Clock::time_point start = Clock::now();
+        bool found;
+        if(run->versioned) {
+            LibraryVersion::Reader r(run->library);
+            found = readOnce(run->library, r.get(), op, (*run->ids)[i], (*run->titles)[i], sink);
+            if(r->getNumber() < last_version) {
+                fprintf(stderr, "A reader went back from version %ld to %ld\n", last_version, r->getNumber());
+                run->failed = true;
+            }
+            last_version = r->getNumber();
+        } else {
+            std::shared_lock<std::shared_mutex> guard(run->lock);
+            found = readOnce(run->library, NULL, op, (*run->ids)[i], (*run->titles)[i], sink);
+        }
+        latency->add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        if(!found) {
+            fprintf(stderr, "Entry %d wasn't found\n", (*run->ids)[i]);
+            run->failed = true;
+        }
+    }
+    if(sink == -1)
+        printf(" ");
+}
+
+static void writer(Run *run, long *refreshes) {
+    while(!run->stop) {
+        int rc;
+        if(run->versioned) {
+            rc = run->library->refresh();
+        } else {
+            std::unique_lock<std::shared_mutex> guard(run->lock);
+            rc = run->library->refresh();
+        }
+        if(rc != 0) {
+            fprintf(stderr, "A refresh failed\n");
+            run->failed = true;
+        }
+        (*refreshes)++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = argc > 1 ? atoi(argv[1]) : 10000;
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+    int max_readers = argc > 3 ? atoi(argv[3]) : 0;
+    if(max_readers <= 0) {
+        max_readers = 4;
+        while(max_readers < (int)std::thread::hardware_concurrency())
+            max_readers *= 2;
+    }
+
+    MockServer server;
+    server.setLibrary(entries, entries);
+    if(server.start() == -1) {
+        fprintf(stderr, "Couldn't start the mock server\n");
+        return 1;
+    }
+    LibraryOptions options;
+    options.base_url = server.getBaseUrl();
+    options.versioned = true;
+    Library *library = new Library("bench", options);
+    if(library->getLibrarySize() != entries) {
+        fprintf(stderr, "Couldn't load the library\n");
+        return 1;
+    }
+
+    /* What the readers look up */
+    std::vector<int> ids;
+    std::vector<std::string> titles;
+    LibraryStore *store = library->getStore();
+    for(int row=0; row<store->size(); row++) {
+        ids.push_back(store->getIds()[row]);
+        titles.push_back(std::string(store->getTitles()[row]));
+    }
+
+    printf("entries=%d seconds=%g cores=%u\n\n", entries, seconds, std::thread::hardware_concurrency());
+    printf("%-9s %7s %14s %9s %9s %9s %10s %10s %11s\n", "mode", "readers", "reads/s", "p50 ns", "p99 ns", "p99.9 ns",
+        "p99.99 ns", "max ns", "refreshes/s");
+
+    bool pass = true;
+    for(int m=0; m<2; m++) {
+        for(int readers=1; readers<=max_readers; readers*=2) {
+            Run run;
+            run.library = library;
+            run.versioned = m == 1;
+            run.stop = false;
+            run.failed = false;
+            run.ids = &ids;
+            run.titles = &titles;
+
+            std::vector<ReadLatencies> latencies(readers);
+            std::vector<std::thread> threads;
+            long refreshes = 0;
+            Clock::time_point start = Clock::now();
+            for(int r=0; r<readers; r++)
+                threads.push_back(std::thread(reader, &run, r + 1, &latencies[r]));
+            std::thread w(writer, &run, &refreshes);
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            run.stop = true;
+            for(int r=0; r<readers; r++)
+                threads[r].join();
+            w.join();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            ReadLatencies all;
+            for(int r=0; r<readers; r++)
+                all.merge(latencies[r]);
+            printf("%-9s %7d %14.0f %9.0f %9.0f %9.0f %10.0f %10.0f %11.1f\n", run.versioned ? "versions" : "rwlock",
+                readers, all.total / elapsed, all.percentile(50), all.percentile(99), all.percentile(99.9),
+                all.percentile(99.99), all.percentile(100), refreshes / elapsed);
+            if(run.failed)
+                pass = false;
+        }
+    }
+
+    delete library;
+    if(Epoch::getRetiredCount() != 0) {
+        fprintf(stderr, "%d versions were never freed\n", Epoch::getRetiredCount());
+        pass = false;
+    }
+    server.stop();
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+/* Standalone mock Hummingbird API server.
+
+   Runs a MockServer on localhost until it's killed, so that the example
+   program (or anything else using LibraryOptions::base_url) can be pointed
+   at it instead of the real API. Prints the base URL to use.
+
+   usage: mock_server [port] [entries] [anime] [fast_ms] [slow_ms] [slow_fraction]
+                      [error_rate] [loris_fraction] [loris_delay_ms] [jitter_ms] */
+
+#include "MockServer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+    int port = argc > 1 ? atoi(argv[1]) : 8080;
+    int entries = argc > 2 ? atoi(argv[2]) : 100;
+    int anime = argc > 3 ? atoi(argv[3]) : 1000;
+    int fast_ms = argc > 4 ? atoi(argv[4]) : 0;
+    int slow_ms = argc > 5 ? atoi(argv[5]) : 0;
+    double slow_fraction = argc > 6 ? atof(argv[6]) : 0;
+    double error_rate = argc > 7 ? atof(argv[7]) : 0;
+    double loris_fraction = argc > 8 ? atof(argv[8]) : 0;
+    int loris_delay_ms = argc > 9 ? atoi(argv[9]) : 10;
+    int jitter_ms = argc > 10 ? atoi(argv[10]) : 0;
+
+    MockServer server;
+    server.setLibrary(entries, anime);
+    server.setLatency(fast_ms, slow_ms, slow_fraction);
+    server.setJitter(jitter_ms);
+    server.setErrorRate(error_rate);
+    server.setSlowLoris(loris_fraction, loris_delay_ms);
+    if(server.start(port) == -1) {
+        fprintf(stderr, "couldn't listen on port %d\n", port);
+        return 1;
+    }
+
+    printf("serving libraries of %d entries out of %d anime at %s\n", entries, anime,
+        server.getBaseUrl().c_str());
+    fflush(stdout);
+    while(true)
+        pause();
+    return 0;
+}
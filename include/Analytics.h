@@ -0,0 +1,102 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+#include "Library.h"
+#include "LibraryStore.h"
+#include "ThreadPool.h"
+#include <string>
+#include <vector>
+#include <utility>
+
+/* Aggregates over every entry of a set of libraries, as computed by
+   Analytics::compute(). The counters are public so they can be reported
+   however is needed; the methods below work out the usual ratios. */
+
+struct LibraryStats {
+    long long entries;
+
+    /* Number of entries with each genre, most common first (ties by name) */
+    std::vector<std::pair<std::string, long long> > genres;
+
+    /* Over the entries the user has rated: the sum of the user's ratings,
+       and of the community ratings of the same entries */
+    long long rated;
+    double rating_sum;
+    double community_rating_sum;
+
+    /* By show_type */
+    long long type_entries[SHOW_UNKNOWN + 1];
+    long long type_completed[SHOW_UNKNOWN + 1];
+    long long type_dropped[SHOW_UNKNOWN + 1];
+
+    /* By library_status; episodes watched only counts entries where it's known */
+    long long status_entries[UNDEFINED + 1];
+    long long status_episodes_known[UNDEFINED + 1];
+    long long status_episodes_watched[UNDEFINED + 1];
+
+    /* Constructor */
+    LibraryStats();
+
+    double meanRating();
+    double meanCommunityRating();
+    double completionRate(show_type t);
+    double dropRate(show_type t);
+    double meanEpisodesWatched(library_status s);
+};
+
+/* Defines the Analytics class, which computes LibraryStats over many
+   libraries at once on a ThreadPool.
+
+   Every library's rows are split into chunks of CHUNK_ROWS rows, and each
+   chunk is aggregated separately (by whichever thread gets to it) straight
+   from the LibraryStore's columns. The partial results are then merged in
+   chunk order. Because the chunks don't depend on the number of threads,
+   and neither does the order they're merged in, the floating point sums
+   come out exactly the same however many threads are used.
+
+   ex. Analytics analytics(4);
+       LibraryStats stats = analytics.compute(libraries);
+       printf("%.2f\n", stats.meanRating()); */
+
+class Analytics
+{
+
+    /* A range of rows of one store. (Private to the Analytics class) */
+    struct Chunk {
+        LibraryStore *store;
+        const std::vector<int> *genre_map;  /* Store genre id -> genre number */
+        int begin;
+        int end;
+    };
+
+    /* The aggregates of one chunk. (Private to the Analytics class) */
+    struct Partial {
+        LibraryStats stats;
+        std::vector<long long> genre_counts;  /* By genre number */
+    };
+
+    /* Everything the tasks of one compute() share.
+       (Private to the Analytics class) */
+    struct Job {
+        std::vector<Chunk> chunks;
+        std::vector<Partial> partials;
+        int genre_count;
+    };
+
+    public:
+        Analytics(int threads = 0);
+        virtual ~Analytics();
+        LibraryStats compute(const std::vector<Library*> &libraries);
+        LibraryStats compute(const std::vector<LibraryStore*> &stores);
+        int getThreadCount() { return pool.getThreadCount(); }
+
+        /* Rows per chunk: enough to make each task worth handing out, few
+           enough to keep every thread busy */
+        static const int CHUNK_ROWS = 1 << 16;
+
+    protected:
+    private:
+        static void computeChunk(int task, int thread, void *userdata);
+        ThreadPool pool;
+};
+
+#endif // ANALYTICS_H
@@ -0,0 +1,74 @@
+#ifndef ANIMECACHE_H
+#define ANIMECACHE_H
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Defines the AnimeCache class, a persistent on-disk cache of the raw
+   /anime/{id} responses downloaded from the Hummingbird API. Anime metadata
+   almost never changes, so a Library can check the cache before queueing a
+   download and only fetch the ids it has never seen (or whose cached copy
+   has expired).
+
+   The cache file is an append-only log of records that is memory-mapped for
+   reading. An in-memory index maps each anime id to its newest record. When
+   the file grows past the size limit it is compacted, keeping the newest
+   records that have not expired. */
+
+class AnimeCache
+{
+
+    /* On-disk header that precedes every record's body.
+       (Private to the AnimeCache class) */
+    struct RecordHeader {
+        uint32_t magic;
+        int32_t id;
+        uint32_t length;
+        uint32_t checksum;
+        int64_t stored_at;
+    };
+
+    public:
+        AnimeCache(std::string path, long ttl_seconds = DEFAULT_TTL, size_t max_bytes = DEFAULT_MAX_BYTES);
+        virtual ~AnimeCache();
+        bool isOpen() { return fd != -1; }
+        bool get(int id, std::string &body);
+        bool has(int id);
+        void put(int id, const std::string &body);
+        void setTTL(long ttl_seconds) { ttl = ttl_seconds; }
+        void setMaxBytes(size_t bytes) { max_bytes = bytes; }
+        long getTTL() { return ttl; }
+        size_t getMaxBytes() { return max_bytes; }
+        long getHits() { return hits; }
+        long getMisses() { return misses; }
+        int getEntryCount() { return (int)index.size(); }
+        size_t getFileSize() { return file_size; }
+
+        /* One week; anime metadata rarely changes */
+        static const long DEFAULT_TTL = 7 * 24 * 60 * 60;
+        /* 64 MiB is roughly 20,000 anime */
+        static const size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+    protected:
+    private:
+        bool openFile();
+        void closeFile();
+        bool remap();
+        void scan();
+        void compact(size_t reserve);
+        bool expired(int64_t stored_at, int64_t now);
+        static uint32_t checksumOf(const char *data, size_t length);
+        std::string path;
+        long ttl;
+        size_t max_bytes;
+        long hits;
+        long misses;
+        int fd;
+        char *map;
+        size_t map_size;
+        size_t file_size;
+        std::unordered_map<int, size_t> index;
+};
+
+#endif // ANIMECACHE_H
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <string_view>
+#include <vector>
+#include <stddef.h>
+
+/* Defines the Arena class, a bump allocator. Memory is handed out from
+   large chunks by just moving a pointer forward, so allocating is a few
+   instructions and related data ends up next to each other in memory.
+   Nothing is freed individually: all of the chunks are released at once
+   when the Arena is destroyed.
+
+   The LibraryStore uses an Arena to hold the text of every entry (titles,
+   synopses and genre names), so loading a library doesn't make a separate
+   heap allocation per string, and deleting it doesn't make a separate free
+   per string either. */
+
+class Arena
+{
+
+    /* A block of memory that allocations are carved out of.
+       (Private to the Arena class) */
+    struct Chunk {
+        char *data;
+        size_t size;
+    };
+
+    public:
+        Arena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+        virtual ~Arena();
+        void* allocate(size_t size, size_t align = 8);
+        std::string_view copy(const char *s, size_t length);
+        std::string_view copy(std::string_view s) { return copy(s.data(), s.size()); }
+        void clear();
+        size_t getBytesUsed() { return used; }
+        size_t getBytesReserved() { return reserved; }
+
+        static const size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+    protected:
+    private:
+        Arena(const Arena&);
+        Arena& operator=(const Arena&);
+        std::vector<Chunk> chunks;
+        size_t chunk_size;
+        char *next;
+        char *end;
+        size_t used;
+        size_t reserved;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,58 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stddef.h>
+
+/* Defines the BufferPool class, which hands out the buffers that responses
+   are downloaded into and takes them back once they have been parsed, so a
+   load reuses the same few buffers over and over instead of keeping a
+   string for every response.
+
+   The pool has a budget in bytes, which the buffers it holds (in use or
+   not) are kept under: acquire() returns NULL when one more buffer, of the
+   size responses have been so far, wouldn't fit. That is how a
+   TransferScheduler with a pool holds off starting transfers (see
+   TransferScheduler::setBufferPool()). A buffer is always handed out when
+   none are in use, so a budget smaller than one response still gets
+   somewhere. Buffers can grow past what was set aside for them while a
+   response arrives, so the budget is kept to as closely as response sizes
+   can be guessed, not exactly; getPeakBytes() says how close it was.
+
+   ex. BufferPool pool(4 * 1024 * 1024);
+       std::string *buffer = pool.acquire();
+       if(buffer != NULL) {
+           ...download into and parse *buffer...
+           pool.release(buffer);
+       } */
+
+class BufferPool
+{
+    public:
+        BufferPool(size_t budget = 0);
+        virtual ~BufferPool();
+        std::string* acquire();
+        void release(std::string *buffer);
+        void setBudget(size_t bytes) { budget = bytes; }
+        size_t getBudget() { return budget; }
+        size_t getBytes() { return in_use_bytes + free_bytes; }
+        size_t getPeakBytes() { return peak_bytes; }
+        int getInUse() { return (int)reserved.size(); }
+
+        /* What a response is expected to take before any have come back */
+        static const size_t INITIAL_ESTIMATE = 4096;
+
+    protected:
+    private:
+        std::vector<std::string*> buffers;              /* Every buffer, to free them */
+        std::vector<std::string*> free_buffers;
+        std::unordered_map<std::string*, size_t> reserved;  /* Bytes set aside for each buffer in use */
+        size_t budget;          /* 0 for no limit */
+        size_t estimate;        /* Running mean of the responses' sizes */
+        size_t in_use_bytes;
+        size_t free_bytes;
+        size_t peak_bytes;
+};
+
+#endif // BUFFERPOOL_H
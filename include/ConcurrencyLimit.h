@@ -0,0 +1,73 @@
+#ifndef CONCURRENCYLIMIT_H
+#define CONCURRENCYLIMIT_H
+
+/* Defines the ConcurrencyLimit class, which decides how many requests to
+   keep in flight against a server, using AIMD (additive increase,
+   multiplicative decrease) the way TCP does for its congestion window.
+
+   It starts small and grows by one for every response (doubling every
+   round trip) until the first sign of trouble, and after that by about one
+   per round trip. It is halved when the server says it is overloaded (HTTP
+   429, 503 or 504) or a request times out, and cut by a tenth when responses
+   take much longer than the fastest they have been, since that means
+   requests are queueing up on the server. Either way it is cut at most
+   once per window's worth of responses, so one burst of errors only counts
+   once.
+
+   Latency is judged by the median of the last few responses, so a few slow
+   responses (which the sliding window copes with anyway) don't shrink it.
+
+   ex. ConcurrencyLimit limit(1, 100);
+       ...
+       if(overloaded)
+           limit.overload();
+       else
+           limit.success(seconds);
+       int window = limit.get(); */
+
+class ConcurrencyLimit
+{
+    public:
+        ConcurrencyLimit(int min_limit, int max_limit, int initial = INITIAL_LIMIT);
+        virtual ~ConcurrencyLimit();
+        void success(double latency);
+        void overload();
+        int get() { return (int)limit; }
+        double getBaseline() { return baseline; }
+
+        /* Requests in flight to start with */
+        static const int INITIAL_LIMIT = 8;
+
+        /* Number of recent latencies the median is taken over */
+        static const int SAMPLES = 15;
+
+        /* The median latency may be up to this many times the baseline, plus
+           LATENCY_SLACK seconds, before the limit is cut */
+        static constexpr double LATENCY_TOLERANCE = 2.0;
+        static constexpr double LATENCY_SLACK = 0.005;
+
+        /* How far the baseline moves towards the median on each response
+           when the median is higher, so it follows a server that has got
+           slower for good instead of holding the limit down forever */
+        static constexpr double BASELINE_DRIFT = 0.01;
+
+        /* What the limit is multiplied by on overload and on high latency */
+        static constexpr double OVERLOAD_DECREASE = 0.5;
+        static constexpr double LATENCY_DECREASE = 0.9;
+
+    protected:
+    private:
+        void decrease(double factor);
+        double median();
+        double limit;
+        int min_limit;
+        int max_limit;
+        bool slow_start;            /* No trouble seen yet, so grow quickly */
+        double baseline;            /* Lowest median latency seen, 0 if none yet */
+        double samples[SAMPLES];    /* Ring of the latest latencies */
+        int sample_count;
+        int next_sample;
+        long since_decrease;        /* Responses since the limit was last cut */
+};
+
+#endif // CONCURRENCYLIMIT_H
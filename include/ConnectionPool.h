@@ -0,0 +1,47 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+#include <mutex>
+#include <curl/curl.h>
+
+/* Defines the ConnectionPool class, which wraps a cURL share handle
+   (CURLSH) so that every transfer made with it shares one DNS cache, one
+   cache of TLS sessions and one cache of open connections, even across
+   TransferScheduler runs and LibraryLoaders. A connection opened by one
+   load can be reused by the next one, and a new connection to a host that
+   has been talked to before can resume the TLS session instead of doing a
+   full handshake.
+
+   A LibraryLoader always uses one for its transfers; give the same one to
+   every load (with LibraryOptions::connections) to keep the connections
+   warm between them, e.g. for a load followed by refreshes.
+
+   ex. ConnectionPool pool;
+       LibraryOptions options;
+       options.connections = &pool;
+       Library *L = new Library("Josh", options);
+       ...
+       L->refresh();    // Reuses the connections of the load
+
+   A pool is for one load at a time: libcurl doesn't support a cache of
+   connections shared by transfers running on several threads at once, so
+   loads on different threads (e.g. two LibraryLoads at once) must each
+   have their own pool, or take turns. */
+
+class ConnectionPool
+{
+    public:
+        ConnectionPool();
+        virtual ~ConnectionPool();
+        CURLSH* getShare() { return share; }
+
+    protected:
+    private:
+        ConnectionPool(const ConnectionPool&);
+        ConnectionPool& operator=(const ConnectionPool&);
+        static void lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userdata);
+        static void unlock(CURL *curl, curl_lock_data data, void *userdata);
+        CURLSH *share;
+        std::mutex locks[CURL_LOCK_DATA_LAST];  /* One for each kind of shared data */
+};
+
+#endif // CONNECTIONPOOL_H
@@ -0,0 +1,88 @@
+#ifndef ENTRYINDEX_H
+#define ENTRYINDEX_H
+#include "LibraryEntry.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <stdint.h>
+
+/* Defines the EntryIndex class, which the Library uses to look up its
+   LibraryEntries by title and by Hummingbird anime id.
+
+   Titles are kept in open-addressing hash tables using Robin Hood
+   hashing: each slot holds the entry's full 64-bit hash and a pointer to
+   it, all in one flat array, so a lookup is a short linear scan of
+   neighbouring slots instead of a walk down a linked list. Entries that
+   have been displaced far from their home slot take the place of entries
+   that are closer to theirs, which keeps every probe sequence short. A
+   table doubles in size whenever it gets more than 7/8 full. Removing an
+   entry shifts the slots after it back, so a table never fills up with
+   tombstones.
+
+   Anime ids are small and dense, so they index plain arrays.
+
+   The index is split into SHARDS shards, each with its own lock: a title
+   goes in the shard picked by the top bits of its hash, and an id in the
+   shard picked by its low bits. So insert() and remove() can be called
+   from many threads at once, and they only wait for each other when they
+   happen to hit the same shard. Lookups don't lock, so they mustn't run at
+   the same time as an insert() or remove().
+
+   When two entries have the same title (or id), the one with the lower row
+   in the store is the one that's found, however they were inserted, so an
+   index filled by several threads is the same as one filled in order. */
+
+class EntryIndex
+{
+
+    /* A slot in a title table; entry is NULL if the slot is empty.
+       (Private to the EntryIndex class) */
+    struct Slot {
+        uint64_t hash;
+        LibraryEntry *entry;
+    };
+
+    /* One independently locked part of the index: a title table and the
+       ids that fall in this shard, indexed by id / SHARDS. Entries whose id
+       is already taken by one with a lower row wait in duplicate_ids, so
+       that one can take its place if it's removed. Padded to a cache line
+       so neighbouring shards' locks don't slow each other down.
+       (Private to the EntryIndex class) */
+    struct alignas(64) Shard {
+        std::mutex lock;
+        int count;
+        uint64_t mask;
+        std::vector<Slot> slots;
+        std::vector<LibraryEntry*> ids;
+        std::unordered_map<int, LibraryEntry*> sparse_ids;
+        std::unordered_multimap<int, LibraryEntry*> duplicate_ids;
+    };
+
+    public:
+        EntryIndex(int capacity = 16);
+        virtual ~EntryIndex();
+        void insert(LibraryEntry *le);
+        void remove(LibraryEntry *le);
+        LibraryEntry* find(std::string_view title);
+        LibraryEntry* findById(int id);
+        int size();
+        int getCapacity();
+        static uint64_t hash(const char *key, size_t length);
+
+        static const int SHARD_BITS = 6;
+        static const int SHARDS = 1 << SHARD_BITS;
+
+    protected:
+    private:
+        EntryIndex(const EntryIndex&);
+        EntryIndex& operator=(const EntryIndex&);
+        Shard& titleShard(uint64_t h) { return shards[h >> (64 - SHARD_BITS)]; }
+        Shard& idShard(int id) { return shards[(unsigned)id & (SHARDS - 1)]; }
+        static void insertSlot(Shard &s, Slot slot);
+        static void grow(Shard &s);
+        Shard shards[SHARDS];
+};
+
+#endif // ENTRYINDEX_H
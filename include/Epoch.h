@@ -0,0 +1,103 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+/* Defines the Epoch class, which frees memory that readers on other
+   threads may still be using once none of them can be (epoch-based
+   reclamation). It's what lets LibraryVersions be read without any locks:
+   a reader only announces that it's reading, and a writer that replaces
+   a version hands the old one to retire() instead of deleting it.
+
+   There is one global epoch, a counter. A reader holds an Epoch::Guard
+   while it reads, which records the epoch it started in, in a slot of its
+   own (one per thread, on its own cache line, so readers never write to
+   the same memory). Slots come in chunks that are added as more threads
+   read, and a thread's slot is given back when it exits. retire() notes the epoch an object was retired in and
+   moves the epoch on; the object is freed once every reader that is
+   still reading started in a later epoch, since those can only have seen
+   what replaced it. Entering and leaving a guard are a couple of atomic
+   operations on the reader's own slot, and never wait for anything.
+
+   A reader must get the pointer to what it reads while holding the guard,
+   and mustn't use it after the guard goes out of scope. Guards can be
+   nested. Readers that hold a guard for a long time hold up the freeing of
+   everything retired meanwhile, but never the writers themselves.
+
+   ex. Epoch::Guard guard;
+       Thing *t = current.load();
+       ...read t...
+
+       Thing *old = current.exchange(replacement);
+       Epoch::retire(old, deleteThing); */
+
+/* Frees an object given to Epoch::retire() */
+typedef void (*retire_function)(void *object);
+
+class Epoch
+{
+
+    /* A thread's slot: the epoch it started reading in, or 0 while it isn't
+       reading. Padded to a cache line so readers don't slow each other down.
+       (Private to the Epoch class) */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> taken;
+
+        /* Constructor */
+        Slot(){
+            epoch = 0;
+            taken = false;
+        }
+    };
+
+    /* An object waiting to be freed.
+       (Private to the Epoch class) */
+    struct Retired {
+        void *object;
+        retire_function free;
+        uint64_t epoch;             /* Epoch it was retired in */
+    };
+
+    public:
+
+        /* Marks this thread as reading until it goes out of scope */
+        class Guard {
+            public:
+                Guard() { Epoch::enter(); }
+                ~Guard() { Epoch::exit(); }
+            private:
+                Guard(const Guard&);
+                Guard& operator=(const Guard&);
+        };
+
+        static void enter();
+        static void exit();
+        static void retire(void *object, retire_function free);
+        static void synchronize();
+        static int getRetiredCount();
+
+        /* Slots are added SLOTS_PER_CHUNK at a time, up to MAX_THREADS.
+           A thread that starts reading when all MAX_THREADS are taken
+           aborts the program. */
+        static const int SLOTS_PER_CHUNK = 256;
+        static const int MAX_CHUNKS = 64;
+        static const int MAX_THREADS = SLOTS_PER_CHUNK * MAX_CHUNKS;
+
+    protected:
+    private:
+        friend struct EpochThread;
+        Epoch();
+        static int slotOfThisThread();
+        static void exitThread(int i);
+        static void reclaim();
+        static Slot& slot(int i) { return chunks[i / SLOTS_PER_CHUNK].load()[i % SLOTS_PER_CHUNK]; }
+        static std::atomic<Slot*> chunks[MAX_CHUNKS];   /* Added in order; never freed */
+        static std::atomic<uint64_t> global;
+        static std::mutex retired_lock;             /* Guards retired */
+        static std::vector<Retired> retired;
+};
+
+#endif // EPOCH_H
@@ -0,0 +1,87 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+#include <string>
+#include <string_view>
+#include <stdint.h>
+
+/* What the next value in a JsonReader's input is */
+enum json_token {
+    TOKEN_OBJECT,
+    TOKEN_ARRAY,
+    TOKEN_STRING,
+    TOKEN_NUMBER,
+    TOKEN_BOOL,
+    TOKEN_NULL,
+    TOKEN_END,      /* No more input */
+    TOKEN_ERROR     /* Not valid JSON */
+};
+
+/* Defines the JsonReader class, a pull parser for JSON. Instead of
+   building a tree of the whole document (like json_tokener_parse() does),
+   the caller walks through it, reading the values it wants and skipping
+   the rest, so nothing is allocated for the parts that aren't needed.
+
+   Strings are returned as string_views into the input wherever possible;
+   only strings with escapes are decoded, into a buffer owned by the reader.
+   Either way they stay valid until the next reset(). The buffer is sized
+   for the whole input up front, and keeps its memory between documents,
+   so a reader that is reused doesn't allocate at all once it has seen its
+   largest document.
+
+   Once something isn't valid JSON, every call returns false and failed()
+   returns true. Values that are skipped are only checked for matching
+   brackets and closed strings.
+
+   ex. JsonReader r;
+       r.reset(body.data(), body.size());
+       std::string_view key, title;
+       if(r.beginObject()) {
+           while(r.nextKey(key)) {
+               if(key == "title")
+                   r.readString(title);
+               else
+                   r.skipValue();
+           }
+       }
+       if(r.failed())
+           ... */
+
+class JsonReader
+{
+    public:
+        JsonReader();
+        virtual ~JsonReader();
+        void reset(const char *data, size_t size);
+        json_token peek();
+        bool beginObject();
+        bool nextKey(std::string_view &key);
+        bool beginArray();
+        bool nextElement();
+        bool readString(std::string_view &s);
+        bool readNumber(double &d);
+        bool readBool(bool &b);
+        bool readNull();
+        bool skipValue();
+        bool atEnd();
+        bool failed() { return error; }
+
+        /* Most objects and arrays that can be open at once */
+        static const int MAX_DEPTH = 64;
+
+    protected:
+    private:
+        bool fail();
+        void skipSpace();
+        bool next(bool object);
+        bool skipString();
+        bool readLiteral(const char *literal, size_t length);
+        bool decodeString(const char *start, std::string_view &s);
+        const char *p;
+        const char *end;
+        bool error;
+        int depth;
+        uint64_t first;         /* Bit d set if the object/array at depth d has no members yet */
+        std::string scratch;    /* Decoded strings */
+};
+
+#endif // JSONREADER_H
@@ -1,58 +1,234 @@
 #ifndef LIBRARY_H
 #define LIBRARY_H
 #include "LibraryEntry.h"
+#include "LibraryStore.h"
+#include "EntryIndex.h"
+#include "TitleSearch.h"
+#include "AnimeCache.h"
+#include "ConnectionPool.h"
+#include "Snapshot.h"
+#include "LoadMetrics.h"
+#include "ResponseParser.h"
+#include "ReadWriteLock.h"
+#include "LibraryVersion.h"
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <json-c/json.h>
 
-/* Defines the Library class, which includes the LibraryEntry class.
-   The Library class has 4 public methods and the LibraryEntry class
-   has 10 public methods, almost all of which are simple getters.
-   The Library class contains a hash table that stores LibraryEntries.
+/* Defines the Library class, which includes the LibraryEntry class (see
+   LibraryEntry.h; its public methods are getters, as strings or typed).
+   A Library is made by downloading a user's library (Library(username))
+   or by mapping a snapshot of one (Library(SnapshotFile), see Snapshot.h).
+   Its entries are looked up by title or anime id (getLibraryEntry,
+   getLibraryEntryById), listed by status (getLibraryEntries), filtered
+   and sorted (query, see LibraryQuery.h), or found from part of a title
+   (completeTitle, searchTitles, see TitleSearch.h). refresh() brings it
+   up to date, save() writes a snapshot of it, and publish() makes its
+   current state a LibraryVersion. getLoadTimings() and metrics() say how
+   its loads went, and getStore() gives its columns to read directly.
+   The Library class keeps its entries in a LibraryStore and indexes them
+   by title and by anime id with an EntryIndex.
    Each LibraryEntry object corresponds to an anime with metadata
    downloaded from the Hummingbird API, and the Library object
    stores all of the LibraryEntries contained in a user's Hummingbird
-   library. */
+   library. Libraries are downloaded by a LibraryLoader, either one at a
+   time by the Library constructor or many at once (see LibraryLoader.h),
+   or in the background by a LibraryLoad (see LibraryLoad.h), in which
+   case the library can be used while it loads. To read a library from
+   many threads while it's refreshed, read its LibraryVersions (see
+   LibraryVersion.h). */
+
+class LibraryLoader;
+class LibraryLoad;
+class ThreadPool;
+class Library;
+
+/* Called as a library loads, from the thread loading it: with the number
+   of its entries finished so far (added, or left out because their
+   metadata couldn't be downloaded) and the number there are to finish
+   (0 until the user's library list has arrived; for a refresh, just the
+   new ones) */
+typedef void (*load_progress_callback)(Library *library, int done, int total, void *userdata);
+
+/* Options that control how a Library downloads its contents. By default
+   responses are parsed as they arrive, up to 100 downloads are kept in
+   flight with the number adapted to what the API keeps up with, each
+   download is aborted after 30 seconds, and one that times out or gets a
+   429 or 5xx response is tried up to 3 more times. (The original
+   Library(username) constructor used a fixed 50 downloads at a time, with
+   no timeout and no retries: pipelined = false, max_concurrency = 50,
+   adaptive_concurrency = false, timeout_ms = 0 and max_retries = 0 come
+   closest to it.) */
+struct LibraryOptions {
+    /* Where the API lives, e.g. a local mock server's URL for testing */
+    std::string base_url;
+
+    /* Cache of /anime/{id} responses to check before downloading (or NULL) */
+    AnimeCache *cache;
+
+    /* Connections (and DNS and TLS sessions) to reuse, or NULL for the
+       loader to make its own for each load */
+    ConnectionPool *connections;
+
+    /* Parse each response as soon as it's downloaded instead of at the end */
+    bool pipelined;
+
+    /* Most downloads to keep in flight at once. With adaptive_concurrency
+       the loader finds out how many the API keeps up with, up to this many
+       (see ConcurrencyLimit); otherwise it always uses this many. */
+    int max_concurrency;
+    bool adaptive_concurrency;
+
+    /* Milliseconds a download may take before it's aborted (0 for no limit),
+       and how many times one that times out or gets an HTTP 429 or 5xx
+       response is tried again */
+    long timeout_ms;
+    int max_retries;
+
+    /* Threads to parse the responses that are left once the downloads are
+       done on (all of them when not pipelined, or cached ones); 0 for one
+       per CPU core. The library comes out the same however many there are. */
+    int parse_threads;
+
+    /* Most bytes of responses to hold in memory at once, or 0 for no limit.
+       Setting it makes the load stream (see LibraryLoader.h): it's always
+       pipelined, and each response is let go of once it has been parsed,
+       so memory no longer grows with the number of responses. */
+    size_t memory_budget;
+
+    /* Called with the progress of the load (see load_progress_callback),
+       or NULL */
+    load_progress_callback progress;
+    void *progress_userdata;
+
+    /* Publish a LibraryVersion at the end of every load and refresh, for
+       other threads to read without locking (see LibraryVersion.h) */
+    bool versioned;
+
+    /* Constructor */
+    LibraryOptions(){
+        base_url = "https://hummingbird.me/api/v1";
+        cache = NULL;
+        connections = NULL;
+        pipelined = true;
+        max_concurrency = 100;
+        adaptive_concurrency = true;
+        timeout_ms = 30000;
+        max_retries = 3;
+        parse_threads = 0;
+        memory_budget = 0;
+        progress = NULL;
+        progress_userdata = NULL;
+        versioned = false;
+    }
+};
+
+/* Names a snapshot file written by Library::save(), for the constructor
+   that loads a library from one (so it isn't mistaken for a username) */
+struct SnapshotFile {
+    std::string path;
+
+    /* Constructor */
+    explicit SnapshotFile(std::string path){
+        this->path = path;
+    }
+};
 
 class Library
 {
 
-    /* Structure that wraps LibraryEntries so that we can make chains
-       (linked lists) to deal with collisions in the hash table.
+    /* What each thread finishing entries for finishEntries() keeps: its
+       parser, and the genre names of the entries it parsed, copied into the
+       store once per name. (Private to the Library class) */
+    struct ParseThread {
+        ResponseParser parser;
+        std::vector<std::string_view> genres;
+        std::unordered_map<std::string_view, std::string_view> genre_copies;
+    };
+
+    /* A batch of entries being finished by finishEntries().
        (Private to the Library class) */
-    struct LibraryEntryWrapper {
-        LibraryEntry *entry;
-        LibraryEntryWrapper *next;
-        LibraryEntryWrapper *previous;
-
-        /* Constructor */
-        LibraryEntryWrapper(){
-            entry = NULL;
-            next = NULL;
-            previous = NULL;
-        }
+    struct FinishJob {
+        Library *library;
+        const std::vector<int> *entries;
+        const std::vector<const std::string*> *bodies;
+        std::vector<ParseThread> threads;
+        std::vector<int> genre_starts;      /* Of each entry in its thread's genres; -1 if it couldn't be parsed */
+        std::vector<int> parsed_by;         /* Thread that parsed each entry */
+        std::vector<LibraryEntry*> added;   /* In the order of entries */
     };
 
     public:
-        Library(std:: string username);
+        Library(std:: string username, LibraryOptions options = LibraryOptions());
+        Library(SnapshotFile file, LibraryOptions options = LibraryOptions());
         virtual ~Library();
-        LibraryEntry* getLibraryEntry(std::string title);
+        int refresh();
+        int save(const std::string &path);
+        void publish();
+        LibraryEntry* getLibraryEntry(std::string_view title);
+        LibraryEntry* getLibraryEntryById(int id);
         std::vector<LibraryEntry*> getLibraryEntries(library_status ls);
+        std::vector<LibraryEntry*> query(const LibraryQuery &q);
+        std::vector<LibraryEntry*> completeTitle(std::string_view prefix, int limit = 10);
+        std::vector<TitleMatch> searchTitles(std::string_view query, int limit = 5);
         static bool libraryEntryTitleSort(LibraryEntry* i, LibraryEntry* j);
         int getLibrarySize();
+        LoadTimings getLoadTimings();
+        LoadMetrics metrics();
+
+        /* The library's columns, for reading them directly (see Analytics) */
+        LibraryStore* getStore() { return &store; }
 
     protected:
     private:
-        int getLibrary(std::string username);
+        friend class LibraryLoader;
+        friend class LibraryLoad;
+        friend class LibraryVersion;
+        explicit Library(LibraryOptions options);
+        void setConcurrent(bool on);
+        int beginLoad(const std::string &list_body, std::vector<int> &ids);
+        int beginRefresh(const std::string &list_body, std::vector<int> &ids);
+        int finishEntry(int entry, const std::string &body);
+        int finishEntries(const std::vector<int> &entries, const std::vector<const std::string*> &bodies,
+                          ThreadPool &pool, std::vector<int> &left_out);
+        static void parseTask(int task, int thread, void *userdata);
+        static void indexTask(int task, int thread, void *userdata);
+        void endLoad(bool failed, bool cancelled = false);
         void addEntry(LibraryEntry *x);
-        int hashSum(std::string title);
-        static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
-        bool curl_setup;
-        json_object *library_json;
+        void addToStatusIndex(LibraryEntry *x);
+        void removeEntry(LibraryEntry *x);
+        void removeFromStatusIndex(LibraryEntry *x, library_status ls);
+        void sortStatusIndexes();
+        bool loadSnapshot(const std::string &path);
+        bool loadStatusIndexes();
+        std::string username;
+        LibraryOptions options;
+        LoadTimings timings;
+        LoadMetrics load_metrics;           /* Of the last load or refresh */
+        std::vector<EntryFields> pending;   /* Fields of each new entry while loading */
+        ResponseParser parser;
         int library_size;
-        int hash_size;
-        LibraryEntryWrapper *hashTable;
+        Snapshot source;                    /* File loaded from; the store points into it */
+        LibraryStore store;
+        EntryIndex index;
+        TitleSearch title_search;
+        bool titles_stale;                  /* title_search needs rebuilding by endLoad() */
+        std::vector<LibraryEntry*> status_index[UNDEFINED + 1];
+        bool loading;
+
+        /* While loading, the first partial_sorted[s].size() entries of
+           status_index[s] in title order, merged up to date by
+           getLibraryEntries() so polling it doesn't sort them all again */
+        std::vector<LibraryEntry*> partial_sorted[UNDEFINED + 1];
+        std::mutex partial_lock;            /* Guards partial_sorted between readers */
+        ReadWriteLock lock;                 /* On while a LibraryLoad fills the library in */
+        std::atomic<LibraryVersion*> version;   /* Last one published, or NULL */
+        long versions;                      /* Number published */
 };
 
 #endif // LIBRARY_H
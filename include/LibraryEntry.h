@@ -1,8 +1,11 @@
 #ifndef LIBRARYENTRY_H
 #define LIBRARYENTRY_H
 #include <string>
-#include <json-c/json.h>
+#include <string_view>
 #include <vector>
+#include <stdint.h>
+
+class LibraryStore;
 
 /* Possible values for libraryStatus */
 enum library_status {
@@ -14,32 +17,64 @@ enum library_status {
     UNDEFINED
 };
 
+/* Possible values for a show's type */
+enum show_type {
+    SHOW_TV,
+    SHOW_MOVIE,
+    SHOW_OVA,
+    SHOW_ONA,
+    SHOW_SPECIAL,
+    SHOW_MUSIC,
+    SHOW_UNKNOWN
+};
+
+/* Possible values for a show's airing status */
+enum airing_status {
+    NOT_YET_AIRED,
+    CURRENTLY_AIRING,
+    FINISHED_AIRING,
+    AIRING_UNKNOWN
+};
+
+/* A LibraryEntry is a handle to one row of a LibraryStore, which keeps
+   every field of every entry in typed columns. The getters returning
+   strings format the columns the same way the Hummingbird API would, and
+   the typed getters return the column values directly.
+
+   Text is returned as string_views of the store's own copy, so nothing is
+   copied or allocated. The views stay valid for the life of the Library;
+   copy them into a std::string to keep them any longer. */
+
 class LibraryEntry
 {
     public:
-        LibraryEntry(json_object *j);
-        virtual ~LibraryEntry();
-        std::string getTitle() { return title; }
-        std::string getSynopsis() { return synopsis; }
-        std::string getAiringStatus() { return airingStatus; }
-        std::string getEpisodeCount() { return episodeCount; }
-        std::string getType() { return type; }
-        library_status getLibraryStatus() { return libraryStatus; }
-        std::string getEpisodesWatched() { return episodesWatched; }
-        std::string getRating() { return rating; }
-        double getCommunityRating() { return communityRating; }
-        std::vector<std::string> getGenres() { return genres; }
+        LibraryEntry(LibraryStore *store, int row);
+        ~LibraryEntry();
+        int getRow() { return row; }
+        int getId();
+        std::string_view getTitle();
+        std::string_view getSynopsis();
+        std::string_view getAiringStatus();
+        std::string getEpisodeCount();
+        std::string_view getType();
+        library_status getLibraryStatus();
+        std::string getEpisodesWatched();
+        std::string getRating();
+        double getCommunityRating();
+        std::vector<std::string_view> getGenres();
+        int getGenreCount();
+        std::string_view getGenre(int i);
+
+        /* Typed getters */
+        airing_status getAiringStatusCode();
+        show_type getShowType();
+        int getEpisodeCountValue();
+        int getEpisodesWatchedValue();
+        double getRatingValue();
+        const uint16_t* getGenreIds(int &count);
     protected:
     private:
-        std::string title;
-        std::string synopsis;
-        std::vector<std::string> genres;
-        std::string airingStatus;
-        std::string episodeCount;
-        std::string type;
-        library_status libraryStatus;
-        std::string episodesWatched;
-        std::string rating;
-        double communityRating;
+        LibraryStore *store;
+        int row;
 };
 #endif // LIBRARYENTRY_H
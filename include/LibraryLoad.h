@@ -0,0 +1,72 @@
+#ifndef LIBRARYLOAD_H
+#define LIBRARYLOAD_H
+#include "Library.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <future>
+
+class LibraryLoader;
+
+/* Defines the LibraryLoad class, which downloads a user's library on a
+   thread of its own, so the caller can get on with something else, show
+   how far it has got, or stop it. The library can be used while it loads:
+   getLibraryEntry(), getLibraryEntries(), query() and the LibraryEntry
+   getters see every entry finished so far, and are safe to call from any
+   thread (see ReadWriteLock.h). completeTitle() and searchTitles() only
+   find anything once the load is over, since the title search index is
+   built at the end, and the store's columns (getStore()) mustn't be read
+   directly until then either.
+
+   wait() (or the future from getFuture()) gives the library once it's
+   loaded; progress can be polled with getDone() and getTotal(), or
+   followed with options.progress, which is called on the loading thread.
+   cancel() stops the load, and the library keeps the entries that were
+   finished.
+
+   ex. LibraryLoad load("Josh");
+       while(!load.isFinished()) {
+           printf("%d of %d\n", load.getDone(), load.getTotal());
+           ...
+       }
+       Library *L = load.wait();
+
+   The library belongs to the caller, and outlives the LibraryLoad. */
+
+class LibraryLoad
+{
+    public:
+        LibraryLoad(std::string username, LibraryOptions options = LibraryOptions());
+        virtual ~LibraryLoad();
+        Library* getLibrary() { return library; }
+        Library* wait();
+        std::shared_future<Library*> getFuture() { return future; }
+        void cancel();
+        bool isCancelled() { return cancelled; }
+        bool isFinished() { return finished; }
+        int getDone() { return done; }
+        int getTotal() { return total; }
+
+    protected:
+    private:
+        LibraryLoad(const LibraryLoad&);
+        LibraryLoad& operator=(const LibraryLoad&);
+        void run();
+        static void onProgress(Library *library, int done, int total, void *userdata);
+        Library *library;
+        LibraryOptions options;             /* The loader's, with progress going to onProgress() */
+        load_progress_callback progress;    /* The caller's, or NULL */
+        void *progress_userdata;
+        std::promise<Library*> promise;
+        std::shared_future<Library*> future;
+        std::mutex cancel_lock;             /* Guards loader */
+        LibraryLoader *loader;              /* While it's running */
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        std::atomic<int> done;
+        std::atomic<int> total;
+        std::thread thread;
+};
+
+#endif // LIBRARYLOAD_H
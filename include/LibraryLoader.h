@@ -0,0 +1,140 @@
+#ifndef LIBRARYLOADER_H
+#define LIBRARYLOADER_H
+#include "Library.h"
+#include "TransferScheduler.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <curl/curl.h>
+
+/* Defines the LibraryLoader class, which downloads the libraries of many
+   users at once. Every download for every user goes through one
+   TransferScheduler, so they share one window of transfers in flight and
+   one ConnectionPool (options.connections, or the loader's own), which
+   keeps the open connections, DNS lookups and TLS sessions. Over HTTP/2,
+   the transfers are multiplexed over a few of those connections.
+
+   The users' library lists are downloaded first, and each one queues up the
+   /anime/{id} downloads its entries need as soon as it arrives. Each anime
+   id is only downloaded once per run, however many of the users have it in
+   their library: its response is handed to every entry waiting for it.
+   Responses that are still to be parsed when the downloads are done are
+   parsed on a ThreadPool, each library's all at once.
+
+   With options.memory_budget set, the load streams: responses are
+   downloaded into buffers from a BufferPool that is kept under the budget,
+   and each buffer goes back to the pool as soon as its response has been
+   parsed into every entry waiting for it (and put in the cache), instead of
+   every response being kept until the end. Cached responses are read from
+   the cache when they're parsed rather than when the lists arrive, and an
+   anime whose response has already been let go of is read back from the
+   cache, or downloaded again, for a user whose list arrives later.
+
+   A load can be cancelled from another thread with cancel(): the downloads
+   stop, and each library keeps the entries that had been finished.
+
+   ex. LibraryLoader loader;
+       loader.addUser("Josh");
+       loader.addUser("Hjalte");
+       std::vector<Library*> libraries = loader.load();
+
+   The Library(username) constructor is a LibraryLoader with one user, and
+   Library::refresh() is one with one refresh. */
+
+class LibraryLoader
+{
+
+    /* A user whose library is being loaded.
+       (Private to the LibraryLoader class) */
+    struct User {
+        std::string username;
+        Library *library;
+        std::string list_buffer;     /* Response of /users/{name}/library */
+        std::vector<int> anime;      /* Index in anime of each entry */
+        bool refresh;                /* Bring an existing library up to date */
+        bool failed;
+        int done;                    /* Entries finished so far */
+        double list_time;            /* Seconds into the run the list arrived */
+        double parse_time;           /* Seconds spent finishing entries */
+    };
+
+    /* An entry of a user's library that is waiting for its anime's metadata.
+       (Private to the LibraryLoader class) */
+    struct Waiter {
+        int user;
+        int entry;
+    };
+
+    /* An anime id needed by at least one of the users.
+       (Private to the LibraryLoader class) */
+    struct Anime {
+        int id;
+        std::string body;             /* Response of /anime/{id}, unless streaming */
+        bool cached;                  /* body came from options.cache */
+        bool ready;                   /* body is complete (or failed) */
+        CURLcode result;
+        std::vector<Waiter> waiters;  /* Entries to finish once ready */
+    };
+
+    /* What each of the scheduler's transfers is for: a user's list, or an
+       anime. (Private to the LibraryLoader class) */
+    struct Target {
+        bool is_list;
+        int index;
+    };
+
+    public:
+        LibraryLoader(LibraryOptions options = LibraryOptions());
+        virtual ~LibraryLoader();
+        void addUser(std::string username);
+        void addRefresh(Library *library);
+        std::vector<Library*> load();
+        void cancel();
+        bool isCancelled() { return cancelled; }
+        int getUserCount() { return (int)users.size(); }
+        int getAnimeCount() { return (int)anime.size(); }
+        int getRequestCount() { return requests; }
+        LoadMetrics getMetrics() { return metrics; }
+
+    protected:
+    private:
+        friend class Library;
+        friend class LibraryLoad;
+        void addLibrary(Library *library, std::string username);
+        int run();
+        void listDone(int user, CURLcode result);
+        void download(int a);
+        void requeue(const Waiter &w);
+        void finish(int user, int entry, const std::string &body);
+        void finishReady(const Waiter &w);
+        void finishAll(int user, const std::vector<int> &entries);
+        void finishBatch(int user, const std::vector<int> &entries, const std::vector<const std::string*> &bodies);
+        void progress(int user);
+        static void onTransferDone(int index, CURLcode result, void *userdata);
+        LibraryOptions options;
+        bool streaming;                            /* options.memory_budget is set */
+        std::vector<User> users;
+        std::deque<Anime> anime;                   /* Never moves, buffers are in it */
+        std::unordered_map<int, int> anime_lookup;  /* Anime id -> index in anime */
+        std::vector<Target> targets;               /* By transfer index */
+        std::deque<Waiter> ready;                  /* Cached entries to parse */
+        TransferScheduler *scheduler;              /* During run(), guarded by cancel_lock */
+        std::mutex cancel_lock;
+        std::atomic<bool> cancelled;
+        std::chrono::steady_clock::time_point run_start;
+        int requests;
+        double parse_time;                         /* Seconds, this run */
+        LoadMetrics metrics;                       /* Of the whole run */
+        ConnectionPool pool;                       /* Unless options.connections is set */
+        ThreadPool *parse_pool;                    /* Started by the first big finishAll() */
+        BufferPool buffers;                        /* Response buffers, when streaming */
+        std::string cache_body;                    /* Cached response being parsed, when streaming */
+};
+
+#endif // LIBRARYLOADER_H
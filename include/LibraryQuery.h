@@ -0,0 +1,46 @@
+#ifndef LIBRARYQUERY_H
+#define LIBRARYQUERY_H
+#include "LibraryEntry.h"
+#include <string>
+#include <vector>
+#include <cmath>
+
+/* A filter over the entries of a Library, for use with Library::query().
+   An entry matches if it passes every predicate that has been set; the
+   defaults match everything.
+
+   ex. LibraryQuery q;
+       q.status = COMPLETED;
+       q.genres.push_back("Action");
+       q.genres.push_back("Sci-Fi");
+       q.min_community_rating = 4.0;
+       std::vector<LibraryEntry*> v = L->query(q); */
+
+struct LibraryQuery {
+    /* library_status to match, or -1 for any */
+    int status;
+
+    /* show_type to match, or -1 for any */
+    int type;
+
+    /* Inclusive range of community ratings to match */
+    float min_community_rating;
+    float max_community_rating;
+
+    /* Minimum user rating; if set, entries the user hasn't rated don't match */
+    float min_rating;
+
+    /* Genres the entry must have (all of them) */
+    std::vector<std::string> genres;
+
+    /* Constructor */
+    LibraryQuery(){
+        status = -1;
+        type = -1;
+        min_community_rating = -INFINITY;
+        max_community_rating = INFINITY;
+        min_rating = -INFINITY;
+    }
+};
+
+#endif // LIBRARYQUERY_H
@@ -0,0 +1,163 @@
+#ifndef LIBRARYSTORE_H
+#define LIBRARYSTORE_H
+#include "LibraryEntry.h"
+#include "LibraryQuery.h"
+#include "Arena.h"
+#include "Snapshot.h"
+#include "ReadWriteLock.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <stdint.h>
+#include <cmath>
+#include <json-c/json.h>
+
+/* The fields of one library entry, as parsed from the API's responses (see
+   ResponseParser), for LibraryStore::add(). The text is copied into the
+   store, so the string_views only need to stay valid until add() returns.
+   The defaults are what a missing or null field is stored as. */
+struct EntryFields {
+    /* From the user's library list */
+    int id;                             /* Hummingbird anime id */
+    library_status status;
+    int episodes_watched;               /* -1 if unknown */
+    float rating;                       /* NaN if the user hasn't rated it */
+
+    /* From /anime/{id} */
+    std::string_view title;
+    std::string_view synopsis;
+    airing_status airing;
+    int episode_count;                  /* -1 if unknown */
+    show_type type;
+    float community_rating;
+    const std::string_view *genres;     /* genre_count genre names */
+    int genre_count;
+
+    /* Constructor */
+    EntryFields(){
+        id = 0;
+        status = UNDEFINED;
+        episodes_watched = -1;
+        rating = NAN;
+        airing = AIRING_UNKNOWN;
+        episode_count = -1;
+        type = SHOW_UNKNOWN;
+        community_rating = 0;
+        genres = NULL;
+        genre_count = 0;
+    }
+};
+
+/* Defines the LibraryStore class, which holds the contents of every entry in
+   a Library as a set of typed columns (a "struct of arrays"): one array of
+   ids, one of episode counts, one of ratings, and so on. Scanning one field
+   over the whole library touches a single contiguous array instead of one
+   heap object (and several heap strings) per entry.
+
+   Numbers are stored as numbers, show types and airing statuses as enums,
+   and genres as ids into a table of genre names, so each genre name is
+   only stored once. Each row's genre ids are a slice of one shared array,
+   from genre_offsets[row] to genre_offsets[row + 1]. The first 64 genre ids
+   are also kept as a bitmask per row, so that select() can test whether
+   rows have a set of genres with a single AND and compare.
+
+   The text of each row (its title and synopsis) and the genre names are
+   copied into Arenas owned by the store (one per thread that copies text
+   into it, see copyText()), and the columns only hold string_views of
+   them. LibraryEntry hands those views out directly, so reading a title
+   never copies it, and the whole library's text is freed in a few large
+   blocks when the store is destroyed. A store loaded from a
+   Snapshot points into the snapshot's mapped file instead, so loading it
+   copies each column in one go and no string at all.
+
+   Rows are accessed through LibraryEntry handles, which the store owns and
+   which stay at the same address for the life of the store. Rows are
+   never deleted, only marked as removed, so row numbers stay the same too;
+   code scanning the columns directly should skip the rows marked in
+   getRemoved().
+
+   While rows are being added on another thread (see LibraryLoad.h), the
+   store's lock is switched on: add(), update() and remove() hold it for
+   writing and LibraryEntry's getters for reading, so entries can be read
+   while the columns grow. Anything else reading the columns then has to
+   hold it for reading too (see getLock()). */
+
+class LibraryStore
+{
+    public:
+        LibraryStore();
+        virtual ~LibraryStore();
+        LibraryEntry* add(const EntryFields &f, bool copy_text = true);
+        LibraryEntry* add(json_object *j);
+        void setTextArenas(int count);
+        std::string_view copyText(std::string_view s, int arena);
+        void update(int row, const EntryFields &f);
+        void remove(int row);
+        void save(Snapshot &snapshot);
+        bool load(Snapshot &snapshot);
+        void copyFrom(LibraryStore &other);
+        bool isRemoved(int row) { return removed[row] != 0; }
+        int getRemovedCount() { return removed_count; }
+        LibraryEntry* getEntry(int row) { return &handles[row]; }
+        int size() { return (int)ids.size(); }
+        int internGenre(std::string_view name);
+        std::string_view getGenreName(int genre) { ReadWriteLock::Reader guard(lock); return genre_names[genre]; }
+        int getGenreCount() { return (int)genre_names.size(); }
+        int findGenre(std::string_view name);
+        void select(const LibraryQuery &query, std::vector<int> &rows, bool allow_simd = true);
+        bool hasGenre(int row, int genre);
+
+        static show_type parseShowType(std::string_view s);
+        static airing_status parseAiringStatus(std::string_view s);
+        static library_status parseLibraryStatus(std::string_view s);
+        static const char* libraryStatusName(library_status ls);
+        static const char* showTypeName(show_type t);
+        static const char* airingStatusName(airing_status a);
+
+        /* Columns, one element per row (read-only outside the store) */
+        const std::vector<int32_t>& getIds() { return ids; }
+        const std::vector<int32_t>& getEpisodeCounts() { return episode_counts; }
+        const std::vector<int32_t>& getEpisodesWatched() { return episodes_watched; }
+        const std::vector<float>& getRatings() { return ratings; }
+        const std::vector<float>& getCommunityRatings() { return community_ratings; }
+        const std::vector<uint8_t>& getShowTypes() { return show_types; }
+        const std::vector<uint8_t>& getAiringStatuses() { return airing_statuses; }
+        const std::vector<uint8_t>& getLibraryStatuses() { return library_statuses; }
+        const std::vector<uint32_t>& getGenreOffsets() { return genre_offsets; }
+        const std::vector<uint16_t>& getGenreIds() { return genre_ids; }
+        const std::vector<uint64_t>& getGenreMasks() { return genre_masks; }
+        const std::vector<uint8_t>& getRemoved() { return removed; }
+        const std::vector<std::string_view>& getTitles() { return titles; }
+
+        size_t getTextBytes();
+        ReadWriteLock& getLock() { return lock; }
+
+    protected:
+    private:
+        friend class LibraryEntry;
+        Arena text;                              /* Titles, synopses and genre names */
+        std::deque<Arena> thread_text;           /* Text copied on other threads (see copyText) */
+        std::deque<LibraryEntry> handles;
+        std::vector<int32_t> ids;
+        std::vector<std::string_view> titles;
+        std::vector<std::string_view> synopses;
+        std::vector<int32_t> episode_counts;     /* -1 if unknown */
+        std::vector<int32_t> episodes_watched;   /* -1 if unknown */
+        std::vector<float> ratings;              /* NaN if the user hasn't rated it */
+        std::vector<float> community_ratings;
+        std::vector<uint8_t> show_types;         /* show_type */
+        std::vector<uint8_t> airing_statuses;    /* airing_status */
+        std::vector<uint8_t> library_statuses;   /* library_status */
+        std::vector<uint32_t> genre_offsets;
+        std::vector<uint16_t> genre_ids;
+        std::vector<uint64_t> genre_masks;       /* Bit g set if row has genre g < 64 */
+        std::vector<uint8_t> removed;            /* 1 if the row has been removed */
+        int removed_count;
+        std::vector<std::string_view> genre_names;
+        std::unordered_map<std::string_view, int> genre_lookup;
+        ReadWriteLock lock;
+};
+
+#endif // LIBRARYSTORE_H
@@ -0,0 +1,87 @@
+#ifndef LIBRARYVERSION_H
+#define LIBRARYVERSION_H
+#include "LibraryEntry.h"
+#include "LibraryStore.h"
+#include "LibraryQuery.h"
+#include "EntryIndex.h"
+#include "Epoch.h"
+#include <string_view>
+#include <vector>
+
+class Library;
+
+/* Defines the LibraryVersion class, a copy of a Library as it was when the
+   version was published, which never changes, so any number of threads
+   can read it without locking anything while the library itself is
+   refreshed on another thread.
+
+   A library with LibraryOptions::versioned set publishes a new version at
+   the end of every load and refresh (or whenever Library::publish() is
+   called). Publishing swaps one atomic pointer, so a reader sees either
+   the whole old version or the whole new one. Readers hold a
+   LibraryVersion::Reader, which pins the version that was current when it
+   was made: the version isn't freed while any Reader of it exists, however
+   many newer ones are published meanwhile (see Epoch.h). A Reader costs a
+   couple of atomic operations on memory of the reading thread's own, so
+   reads scale with the number of cores.
+
+   A version has its own copy of the library's columns and index, but
+   shares the text of the entries with the library, so it takes about as
+   much memory as the library's columns. Entries and lists got from a
+   version are only valid while the Reader is.
+
+   Publishing isn't incremental: every version deep-copies all of the
+   library's columns and rebuilds its EntryIndex and status lists from
+   scratch, so it costs time in proportion to the size of the library,
+   however few entries changed. A versioned library pays that at the end
+   of every refresh, even one that found nothing new (so does each
+   REFRESH of a library served by a QueryServer, see QueryServer.h).
+
+   ex. LibraryVersion::Reader reader(library);
+       if(reader.get() != NULL) {
+           LibraryEntry *le = reader->getLibraryEntry("Serial Experiments Lain");
+           const std::vector<LibraryEntry*> &watching = reader->getLibraryEntries(CURRENTLY_WATCHING);
+           ...
+       } */
+
+class LibraryVersion
+{
+    public:
+
+        /* Pins a library's current version until it goes out of scope; get()
+           is NULL if the library hasn't published one */
+        class Reader {
+            public:
+                explicit Reader(Library *library);
+                LibraryVersion* get() { return version; }
+                LibraryVersion* operator->() { return version; }
+            private:
+                Reader(const Reader&);
+                Reader& operator=(const Reader&);
+                Epoch::Guard guard;
+                LibraryVersion *version;
+        };
+
+        LibraryVersion(Library *library, long number);
+        virtual ~LibraryVersion();
+        LibraryEntry* getLibraryEntry(std::string_view title) { return index.find(title); }
+        LibraryEntry* getLibraryEntryById(int id) { return index.findById(id); }
+        const std::vector<LibraryEntry*>& getLibraryEntries(library_status ls);
+        std::vector<LibraryEntry*> query(const LibraryQuery &q);
+        int getLibrarySize() { return library_size; }
+        long getNumber() { return number; }
+        LibraryStore* getStore() { return &store; }
+        static void destroy(void *version);
+
+    protected:
+    private:
+        LibraryVersion(const LibraryVersion&);
+        LibraryVersion& operator=(const LibraryVersion&);
+        LibraryStore store;
+        EntryIndex index;
+        std::vector<LibraryEntry*> status_index[UNDEFINED + 1];
+        int library_size;
+        long number;                /* Counts up from 1 with each version published */
+};
+
+#endif // LIBRARYVERSION_H
@@ -0,0 +1,116 @@
+#ifndef LOADMETRICS_H
+#define LOADMETRICS_H
+#include <string>
+#include <curl/curl.h>
+
+/* How long (in seconds) each stage of loading a Library took */
+struct LoadTimings {
+    double library_fetch;   /* Downloading the user's library list */
+    double metadata_fetch;  /* Downloading every /anime/{id}, start to finish */
+    double network_wait;    /* Part of metadata_fetch spent waiting on the network */
+    double parse;           /* Parsing responses and building LibraryEntries */
+    double index_build;     /* Sorting the status indexes and building title search */
+    double total;           /* The whole load */
+
+    /* Constructor */
+    LoadTimings(){
+        library_fetch = 0;
+        metadata_fetch = 0;
+        network_wait = 0;
+        parse = 0;
+        index_build = 0;
+        total = 0;
+    }
+};
+
+/* What one transfer spent its time on, as reported by curl_easy_getinfo().
+   Times are in seconds and are the length of each step, not the time since
+   the transfer started, except for ttfb and total. */
+struct TransferTimings {
+    double dns;             /* Resolving the host name */
+    double connect;         /* TCP connect, after resolving */
+    double tls;             /* TLS handshake, after connecting (0 without TLS) */
+    double ttfb;            /* Start of the transfer to the first byte of the response */
+    double total;           /* Start to finish */
+    long bytes;             /* Body bytes received */
+    long status;            /* HTTP status, 0 if there was no response */
+    long connects;          /* New connections opened (0 if one was reused) */
+    long http_version;      /* CURL_HTTP_VERSION_* the response came over, 0 if none */
+
+    /* Constructor */
+    TransferTimings(){
+        dns = 0;
+        connect = 0;
+        tls = 0;
+        ttfb = 0;
+        total = 0;
+        bytes = 0;
+        status = 0;
+        connects = 0;
+        http_version = 0;
+    }
+};
+
+/* A histogram of latencies, with buckets that double in size from 100
+   microseconds up, so it covers fast local responses and multi-second
+   stalls alike in a fixed amount of memory. Percentiles are estimated as
+   the upper limit of the bucket they fall in. */
+struct Histogram {
+    static const int BUCKETS = 24;  /* The last one holds everything bigger */
+
+    long counts[BUCKETS];
+    long count;
+    double sum;
+    double min;
+    double max;
+
+    /* Constructor */
+    Histogram();
+
+    void add(double seconds);
+    void merge(const Histogram &h);
+    double mean() const;
+    double percentile(double p) const;
+    static double bucketLimit(int bucket);
+};
+
+/* Everything measured while loading libraries: counters, latency
+   histograms of each step of every transfer, and how long each stage of
+   the load took. Kept by every Library for its most recent load or
+   refresh (see Library::metrics()), and by LibraryLoader for a whole run.
+
+   ex. LoadMetrics m = L->metrics();
+       printf("p99 %.3fs over %ld requests\n", m.total.percentile(99), m.requests);
+       fputs(m.toJson().c_str(), stderr); */
+
+struct LoadMetrics {
+    long requests;          /* Transfers finished, including retries */
+    long failures;          /* Transfers that failed for good */
+    long retries;           /* Attempts that failed and were tried again */
+    long timeouts;          /* Attempts that ran out of time */
+    long bytes;             /* Body bytes received */
+    long connections;       /* New connections opened */
+    long tls_handshakes;    /* TLS handshakes done, full or resumed */
+    long http2_requests;    /* Responses that came over HTTP/2 */
+    long cache_hits;        /* Anime taken from the cache instead of downloaded */
+    long concurrency;       /* Transfers allowed in flight at the end of the load */
+    long buffer_peak;       /* Most bytes in response buffers at once (streaming loads) */
+
+    /* Latency of each step of the transfers (see TransferTimings) */
+    Histogram dns;
+    Histogram connect;
+    Histogram tls;
+    Histogram ttfb;
+    Histogram total;
+
+    LoadTimings phases;
+
+    /* Constructor */
+    LoadMetrics();
+
+    void record(const TransferTimings &t, CURLcode result, bool retried = false);
+    void merge(const LoadMetrics &m);
+    std::string toJson() const;
+};
+
+#endif // LOADMETRICS_H
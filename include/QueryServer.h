@@ -0,0 +1,156 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+#include "Library.h"
+#include "LibraryVersion.h"
+#include "Analytics.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+/* Defines the QueryServer class, which keeps many users' libraries loaded
+   and answers queries about them over a Unix domain socket, so that the
+   libraries are downloaded once rather than by every program that wants
+   to look something up (see "main --daemon").
+
+   Requests and responses are lines of text. Each request is a command and
+   its arguments, separated by spaces; each response is one line of JSON,
+   an object with an "error" member if the request failed (blank lines are
+   ignored):
+
+       ID <user> <anime id>             an entry, by Hummingbird anime id
+       GET <user> <title>               an entry, by title (the rest of the line)
+       LIST <user> <status> [limit]     ids and titles of the entries with a
+                                        status ("currently-watching", ...)
+       STATS <user>                     counts and means over the library
+       USERS                            every loaded user and library size
+       LOAD <user>                      starts loading (or refreshing) a library
+       REFRESH <user>                   starts refreshing a library
+
+   LOAD only takes usernames made of letters, digits, - and _ (as on
+   Hummingbird.me), up to MAX_USERNAME of them, and only up to MAX_USERS
+   users, so clients can't make the server download arbitrary URLs or grow
+   without limit.
+
+   A client may send any number of requests without waiting for the
+   responses (pipelining), and they are answered in order. Everything runs
+   on one thread, with an epoll loop: each time a connection has data, all
+   of the complete requests in it are answered, and all of their responses
+   are written back with a single write(). A connection whose responses
+   aren't being read isn't read from either, until it catches up.
+
+   Loads and refreshes are done on a thread of their own, one at a time,
+   while queries go on being answered. The libraries are versioned, and
+   queries read their current LibraryVersion (see LibraryVersion.h), so a
+   refresh never holds a query up and a query sees all of it or none of
+   it. LOAD and REFRESH are answered as soon as they start; USERS shows
+   when a library is loaded.
+
+   ex. QueryServer server(options);
+       server.addUsers(usernames);
+       if(server.listen("/tmp/hummingbird.sock"))
+           server.run(); */
+
+class QueryServer
+{
+
+    /* A connected client: requests read but not answered yet (an
+       incomplete one, at most), and responses not written yet.
+       (Private to the QueryServer class) */
+    struct Client {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t out_sent;            /* Bytes of out already written */
+        uint32_t events;            /* What epoll is watching it for */
+        bool eof;                   /* Has stopped sending; closed once out is written */
+    };
+
+    /* A loaded library, and its stats response as of one of its versions.
+       (Private to the QueryServer class) */
+    struct User {
+        Library *library;
+        long stats_version;
+        std::string stats;
+    };
+
+    /* A load or refresh for the worker thread, or one it has finished.
+       (Private to the QueryServer class) */
+    struct Job {
+        std::string username;
+        Library *library;           /* To refresh, or the one loaded; NULL to load */
+        int rc;
+    };
+
+    public:
+        QueryServer(LibraryOptions options = LibraryOptions());
+        virtual ~QueryServer();
+        int addUsers(const std::vector<std::string> &usernames);
+        bool listen(std::string path);
+        void run();
+        void stop();
+        void handle(std::string_view request, std::string &response);
+        int getUserCount() { return (int)users.size(); }
+        long getRequestCount() { return requests; }
+
+        /* Longest request line; a client that sends a longer one is
+           disconnected */
+        static const size_t MAX_REQUEST = 4096;
+
+        /* Unwritten responses past which a client isn't read from */
+        static const size_t MAX_BACKLOG = 1024 * 1024;
+
+        /* Most bytes read from one client before the others get a turn */
+        static const size_t MAX_READ = 256 * 1024;
+
+        /* Most users loaded and being loaded; LOAD fails past it */
+        static const size_t MAX_USERS = 1024;
+
+        /* Longest username LOAD accepts */
+        static const size_t MAX_USERNAME = 64;
+
+    protected:
+    private:
+        QueryServer(const QueryServer&);
+        QueryServer& operator=(const QueryServer&);
+        void accept();
+        bool readFrom(Client *c);
+        bool writeTo(Client *c);
+        void watch(Client *c);
+        void disconnect(Client *c);
+        void finishJobs();
+        void queue(std::string username, Library *library);
+        void workerLoop();
+        void stats(User &u, LibraryVersion *v, std::string &response);
+        void entry(LibraryEntry *le, std::string &response);
+        static void appendString(std::string &out, std::string_view s);
+        static void appendError(std::string &out, const char *message);
+        LibraryOptions options;
+        Analytics analytics;            /* For STATS */
+        std::unordered_map<std::string, User> users;
+        std::unordered_set<std::string> pending;         /* Users being loaded or refreshed */
+        std::unordered_map<int, Client*> clients;        /* By file descriptor */
+        std::string path;
+        int listen_fd;
+        int epoll_fd;
+        int wake_fd;                    /* eventfd: stop() or a job is done */
+        std::atomic<bool> stopping;
+        long requests;
+
+        /* Worker thread, and its queues (guarded by jobs_lock) */
+        std::thread worker;
+        std::mutex jobs_lock;
+        std::condition_variable jobs_ready;
+        std::deque<Job> jobs;
+        std::deque<Job> done;
+        bool worker_exit;
+};
+
+#endif // QUERYSERVER_H
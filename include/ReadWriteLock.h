@@ -0,0 +1,73 @@
+#ifndef READWRITELOCK_H
+#define READWRITELOCK_H
+#include <shared_mutex>
+#include <atomic>
+
+/* Defines the ReadWriteLock class, a reader/writer lock that is off until
+   it's switched on. Any number of readers can hold it at once, or one
+   writer. Library and LibraryStore each have one, which is only switched
+   on while a LibraryLoad is filling them in on another thread (see
+   LibraryLoad.h), so that the rest of the time reading an entry costs no
+   more than it did without it.
+
+   Readers and writers hold it with the Reader and Writer guards, which do
+   nothing while it's off. It may only be switched on or off while nothing
+   is writing to what it guards, e.g. before the thread that writes starts
+   and after it's done.
+
+   A thread mustn't take the same lock for reading twice at once: a writer
+   waiting in between would block it forever.
+
+   ex. ReadWriteLock::Reader guard(lock);
+       ...read...
+
+       ReadWriteLock::Writer guard(lock);
+       ...write... */
+
+class ReadWriteLock
+{
+    public:
+
+        /* Holds a ReadWriteLock for reading until it goes out of scope */
+        class Reader {
+            public:
+                explicit Reader(ReadWriteLock &l) : lock(l), locked(l.enabled.load(std::memory_order_acquire)) {
+                    if(locked)
+                        lock.mutex.lock_shared();
+                }
+                ~Reader() {
+                    if(locked)
+                        lock.mutex.unlock_shared();
+                }
+            private:
+                ReadWriteLock &lock;
+                bool locked;
+        };
+
+        /* Holds a ReadWriteLock for writing until it goes out of scope */
+        class Writer {
+            public:
+                explicit Writer(ReadWriteLock &l) : lock(l), locked(l.enabled.load(std::memory_order_acquire)) {
+                    if(locked)
+                        lock.mutex.lock();
+                }
+                ~Writer() {
+                    if(locked)
+                        lock.mutex.unlock();
+                }
+            private:
+                ReadWriteLock &lock;
+                bool locked;
+        };
+
+        ReadWriteLock() : enabled(false) {}
+        void setEnabled(bool on) { enabled.store(on, std::memory_order_release); }
+        bool isEnabled() { return enabled.load(std::memory_order_acquire); }
+
+    protected:
+    private:
+        std::shared_mutex mutex;
+        std::atomic<bool> enabled;
+};
+
+#endif // READWRITELOCK_H
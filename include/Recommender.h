@@ -0,0 +1,113 @@
+#ifndef RECOMMENDER_H
+#define RECOMMENDER_H
+#include "Library.h"
+#include "LibraryStore.h"
+#include "Arena.h"
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+/* How the similarity of two sets of features (genres, or users) is
+   measured: Jaccard is the size of their intersection over the size of
+   their union, cosine the size of their intersection over the geometric
+   mean of their sizes */
+enum similarity_metric {
+    JACCARD,
+    COSINE
+};
+
+/* Options that control how a Recommender scores titles. A title's score is
+   the weighted sum of its similarity to what it's compared with in genres,
+   in which users have it in their libraries, and in community rating. */
+struct RecommenderOptions {
+    similarity_metric metric;
+    float genre_weight;
+    float co_occurrence_weight;
+    float rating_weight;
+
+    /* Constructor */
+    RecommenderOptions(){
+        metric = JACCARD;
+        genre_weight = 0.5f;
+        co_occurrence_weight = 0.35f;
+        rating_weight = 0.15f;
+    }
+};
+
+/* A recommended title, and its score (from 0 up to the sum of the
+   weights; higher is more similar) */
+struct Recommendation {
+    int id;
+    std::string_view title;
+    float score;
+};
+
+/* Defines the Recommender class, which finds the shows most similar to a
+   show ("similar to X"), or to the shows a user liked ("recommended for
+   U"), among every show in a set of libraries (the catalog).
+
+   Each title of the catalog is turned into a compact feature vector when
+   the Recommender is made: a bitset of its genres, a bitset of the users
+   that have it in their library (and haven't dropped it), so that shows
+   watched by the same people come out similar, and its community rating
+   scaled to between 0 and 1. Genres are numbered across all of the
+   libraries, up to GENRE_BITS of them (any more are ignored), and users
+   by the order of their libraries, modulo USER_BITS.
+
+   A query is compared with every title of the catalog, 8 at a time with
+   AVX2 when the CPU supports it, otherwise one at a time: the sizes of
+   the intersections of the bitsets are counted with a nibble lookup table
+   (pshufb), and the scores worked out from them. The best k are kept in a
+   heap as the scores are worked out, so there's never anything to sort
+   but the k. Both ways give exactly the same scores.
+
+   ex. Recommender recommender(libraries);
+       std::vector<Recommendation> like_lain = recommender.similarTo(339, 10);
+       std::vector<Recommendation> for_josh = recommender.recommendFor(josh, 10);
+
+   The catalog doesn't change once it's made, so any number of threads can
+   query it at once. Titles are copied, so the libraries can be deleted. */
+
+class Recommender
+{
+    public:
+        Recommender(const std::vector<Library*> &libraries, RecommenderOptions options = RecommenderOptions());
+        Recommender(const std::vector<LibraryStore*> &stores, RecommenderOptions options = RecommenderOptions());
+        virtual ~Recommender();
+        std::vector<Recommendation> similarTo(int anime_id, int k = 10, bool allow_simd = true);
+        std::vector<Recommendation> recommendFor(Library *library, int k = 10, bool allow_simd = true);
+        int getTitleCount() { return (int)ids.size(); }
+        int getGenreCount() { return (int)genre_names.size(); }
+
+        /* Sizes of the bitsets; each is a whole AVX2 register */
+        static const int GENRE_BITS = 256;
+        static const int USER_BITS = 256;
+        static const int WORDS = (GENRE_BITS + USER_BITS) / 64;
+
+        /* A liked title is one rated at least this, or completed and not rated */
+        static constexpr float LIKED_RATING = 3.5f;
+
+    protected:
+    private:
+        Recommender(const Recommender&);
+        Recommender& operator=(const Recommender&);
+        void build(const std::vector<LibraryStore*> &stores);
+        std::vector<Recommendation> topK(const uint64_t *bits, float rating, int k, const std::vector<uint8_t> &exclude,
+                                         bool allow_simd);
+        RecommenderOptions options;
+        Arena text;                                 /* Titles and genre names */
+        std::vector<std::string_view> genre_names;
+        std::unordered_map<std::string_view, int> genre_lookup;  /* Name -> bit */
+        std::unordered_map<int, int> index;        /* Anime id -> title */
+
+        /* The catalog, one of each per title */
+        std::vector<int> ids;
+        std::vector<std::string_view> titles;
+        std::vector<uint64_t> bits;                 /* WORDS each: genres, then users */
+        std::vector<float> genre_counts;            /* Bits set in each bitset */
+        std::vector<float> user_counts;
+        std::vector<float> ratings;                 /* Community rating / 5 */
+};
+
+#endif // RECOMMENDER_H
@@ -0,0 +1,46 @@
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+#include "JsonReader.h"
+#include "LibraryStore.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Defines the ResponseParser class, which parses the Hummingbird API's
+   responses straight into EntryFields with a JsonReader. Only the fields
+   a LibraryEntry has are read; everything else in the responses (cover
+   images, slugs, dates, ...) is skipped over without being parsed into
+   anything, and no json_objects are built at all.
+
+   A parser keeps its buffers between responses, so reusing one for every
+   response of a load means parsing hardly allocates.
+
+   ex. ResponseParser parser;
+       std::vector<EntryFields> entries;
+       parser.parseLibraryList(list_body, entries);
+       for(unsigned i=0; i<entries.size(); i++) {
+           parser.parseAnime(anime_bodies[i], entries[i]);
+           store.add(entries[i]);
+       } */
+
+class ResponseParser
+{
+    public:
+        ResponseParser();
+        virtual ~ResponseParser();
+        bool parseLibraryList(const std::string &body, std::vector<EntryFields> &entries);
+        bool parseAnime(const std::string &body, EntryFields &f);
+
+    protected:
+    private:
+        bool parseListEntry(EntryFields &f);
+        bool parseGenres();
+        bool readText(std::string_view &s);
+        bool readNumber(double &d);
+        bool readInt(int &i);
+        bool readFloat(float &x);
+        JsonReader reader;
+        std::vector<std::string_view> genres;   /* Of the last anime parsed */
+};
+
+#endif // RESPONSEPARSER_H
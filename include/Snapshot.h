@@ -0,0 +1,99 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Tags of the sections of a library snapshot (see Library::save()) */
+enum snapshot_section {
+    SNAPSHOT_IDS = 1,
+    SNAPSHOT_EPISODE_COUNTS,
+    SNAPSHOT_EPISODES_WATCHED,
+    SNAPSHOT_RATINGS,
+    SNAPSHOT_COMMUNITY_RATINGS,
+    SNAPSHOT_SHOW_TYPES,
+    SNAPSHOT_AIRING_STATUSES,
+    SNAPSHOT_LIBRARY_STATUSES,
+    SNAPSHOT_REMOVED,
+    SNAPSHOT_GENRE_OFFSETS,
+    SNAPSHOT_GENRE_IDS,
+    SNAPSHOT_GENRE_MASKS,
+    SNAPSHOT_TEXT,           /* Every string, each followed by a NUL */
+    SNAPSHOT_TEXT_LENGTHS,   /* Titles, then synopses, then genre names */
+    SNAPSHOT_USERNAME,
+    SNAPSHOT_LIBRARY_SIZE,
+    SNAPSHOT_STATUS_ROWS     /* Row count of each status index, then its rows */
+};
+
+/* Defines the Snapshot class, a binary file made of tagged sections of raw
+   data (arrays of numbers, or text). Library::save() writes a whole library
+   to one, so that it can be loaded again later without downloading or
+   parsing anything.
+
+   The file starts with a header (magic number, format version, number of
+   sections and a checksum of everything after the header), followed by a
+   table of the sections and then the sections themselves, each starting at
+   a multiple of 8 bytes. A snapshot is read by memory-mapping the file, so
+   the sections are used in place: arrays are read straight out of the
+   mapping, and strings can point into it instead of being copied. Files
+   with the wrong magic number or version, a checksum that doesn't match or
+   sections that don't fit in the file are refused.
+
+   ex. Snapshot out;
+       out.add(SNAPSHOT_IDS, ids.data(), ids.size() * sizeof(int32_t));
+       out.write("josh.snapshot");
+
+       Snapshot in;
+       if(in.open("josh.snapshot")) {
+           size_t bytes;
+           const int32_t *ids = (const int32_t*)in.get(SNAPSHOT_IDS, bytes);
+       } */
+
+class Snapshot
+{
+
+    /* On-disk file header. (Private to the Snapshot class) */
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t section_count;
+        uint32_t reserved;
+        uint64_t size;          /* Of the whole file */
+        uint64_t checksum;      /* Of everything after the header */
+    };
+
+    /* On-disk entry of the table of sections. (Private to the Snapshot class) */
+    struct SectionHeader {
+        uint32_t tag;
+        uint32_t reserved;
+        uint64_t offset;        /* From the start of the file */
+        uint64_t size;
+    };
+
+    public:
+        Snapshot();
+        virtual ~Snapshot();
+        void add(uint32_t tag, const void *data, size_t size);
+        bool write(const std::string &path);
+        bool open(const std::string &path);
+        void close();
+        bool isOpen() { return map != NULL; }
+        const void* get(uint32_t tag, size_t &size);
+        size_t getFileSize() { return map_size; }
+        static uint64_t checksumOf(const char *data, size_t length);
+
+        /* Bumped whenever the meaning of a section changes */
+        static const uint32_t VERSION = 1;
+
+    protected:
+    private:
+        Snapshot(const Snapshot&);
+        Snapshot& operator=(const Snapshot&);
+        std::vector<SectionHeader> sections;  /* Added so far, offsets into body */
+        std::string body;                     /* Their data, padded to 8 bytes */
+        char *map;
+        size_t map_size;
+};
+
+#endif // SNAPSHOT_H
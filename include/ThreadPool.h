@@ -0,0 +1,73 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+/* Defines the ThreadPool class, a fixed set of worker threads that run the
+   tasks of a parallel loop. run() splits task numbers 0 to tasks-1 into one
+   contiguous range per thread (the calling thread works too), and returns
+   once all of them are done. Each thread works through its own range from
+   the front; a thread that runs out steals the back half of what is left of
+   another thread's range. So uneven tasks still keep every thread busy to
+   the end, while each thread mostly runs neighbouring tasks and the threads
+   hardly ever touch the same memory.
+
+   Tasks are told which thread they are running on, from 0 to
+   getThreadCount()-1, so they can keep per-thread state without locking.
+
+   ex. ThreadPool pool(4);
+       pool.run(chunks, computeChunk, &state); */
+
+/* Called by run() once for each task number, on thread number thread */
+typedef void (*task_function)(int task, int thread, void *userdata);
+
+class ThreadPool
+{
+
+    /* The tasks a thread has left: begin in the high 32 bits, end in the
+       low 32, so that the owner taking one from the front and a thief taking
+       half from the back are each a single compare-and-swap. Padded to a
+       cache line so threads don't slow each other down.
+       (Private to the ThreadPool class) */
+    struct alignas(64) Range {
+        std::atomic<uint64_t> bounds;
+
+        /* Constructor */
+        Range(){
+            bounds = 0;
+        }
+    };
+
+    public:
+        ThreadPool(int threads = 0);
+        virtual ~ThreadPool();
+        void run(int tasks, task_function function, void *userdata);
+        int getThreadCount() { return (int)workers.size() + 1; }
+
+    protected:
+    private:
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+        bool take(int self, int &task);
+        bool steal(int self);
+        void work(int self);
+        void workerLoop(int self);
+        std::vector<std::thread> workers;
+        std::vector<Range> ranges;          /* One per thread; the caller's is 0 */
+        std::mutex mutex;
+        std::condition_variable wake;       /* Signalled when a run starts */
+        std::condition_variable finished;   /* Signalled when workers are done */
+        unsigned long generation;           /* Number of runs started */
+        int busy;                           /* Workers still on this run */
+        bool stopping;
+
+        /* The current run */
+        task_function function;
+        void *userdata;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,95 @@
+#ifndef TITLESEARCH_H
+#define TITLESEARCH_H
+#include "LibraryEntry.h"
+#include "Arena.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+class LibraryStore;
+
+/* A title found by TitleSearch::search(), with how close it was to the
+   query. distance is the edit distance between the normalized query and
+   the normalized title (0 means they only differ in case or punctuation),
+   and similarity is the fraction of trigrams they share (0 to 1). */
+
+struct TitleMatch {
+    LibraryEntry *entry;
+    int distance;
+    float similarity;
+};
+
+/* Defines the TitleSearch class, which finds titles from partial or
+   misspelled input, for when getLibraryEntry() (which needs the exact
+   title) comes up empty.
+
+   Every title is reduced to a normalized key: lowercase, with punctuation
+   turned into spaces and runs of spaces collapsed, so "Steins;Gate" and
+   "steins gate" have the same key. The keys are kept in sorted order and
+   a compact trie (a radix tree) is built over them: each node stands for
+   the prefix shared by a run of sorted keys, and its edge from its parent
+   is the part of that prefix its parent doesn't have, so a chain of
+   single children is one node. The titles starting with a prefix are then
+   the run of the node the prefix ends in (or ends part of the way into),
+   found by walking one node per branching point in the prefix. A node's
+   edge isn't stored: it's read from the first key of its run.
+
+   For typos, each key is also broken into trigrams (overlapping runs of
+   three characters), and every trigram has a posting list of the titles
+   containing it. A query counts how many trigrams it shares with each
+   title by walking its own trigrams' lists, keeps the titles with the
+   highest Dice similarity, and ranks those by edit distance to the query.
+
+   The index is built in one go by build() once the entries are loaded;
+   it doesn't see entries added afterwards until build() is called again.
+   Once built, any number of threads can use it at once (search() keeps
+   its scratch space per thread), as long as build() isn't running. */
+
+class TitleSearch
+{
+    public:
+        TitleSearch();
+        virtual ~TitleSearch();
+        void build(LibraryStore *store);
+        LibraryEntry* find(std::string_view title);
+        std::vector<LibraryEntry*> complete(std::string_view prefix, int limit = 10);
+        std::vector<TitleMatch> search(std::string_view query, int limit = 5);
+        int size() { return (int)entries.size(); }
+
+        static std::string normalize(std::string_view title);
+        static int editDistance(std::string_view a, std::string_view b);
+
+        /* How many titles search() ranks by edit distance per result wanted */
+        static const int CANDIDATES_PER_RESULT = 8;
+
+    protected:
+    private:
+        /* A node of the trie over the sorted keys */
+        struct TrieNode {
+            int begin, end;      /* The run of sorted with this prefix */
+            int depth;           /* Length of the prefix */
+            int first_child;     /* Children are next to each other, in */
+            int children;        /* order of the byte their edges start with */
+        };
+
+        void clear();
+        void addTrigrams(std::string_view key, std::vector<uint32_t> &grams);
+        void buildTrie();
+        const TrieNode* descend(std::string_view key);
+
+        Arena text;                          /* Normalized keys */
+        std::vector<LibraryEntry*> entries;  /* By document number */
+        std::vector<std::string_view> keys;  /* By document number */
+        std::vector<int> sorted;             /* Document numbers by key, then row */
+        std::vector<TrieNode> nodes;         /* nodes[0] is the root (the empty prefix) */
+
+        /* Posting lists: the documents containing gram_keys[g] are
+           postings[gram_offsets[g]] to postings[gram_offsets[g + 1]] */
+        std::vector<uint32_t> gram_keys;     /* Sorted */
+        std::vector<uint32_t> gram_offsets;
+        std::vector<int> postings;
+        std::vector<uint16_t> gram_counts;   /* Distinct trigrams per document */
+};
+
+#endif // TITLESEARCH_H
@@ -0,0 +1,152 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <curl/curl.h>
+#include "LoadMetrics.h"
+#include "ConcurrencyLimit.h"
+#include "ConnectionPool.h"
+#include "BufferPool.h"
+
+/* Defines the TransferScheduler class, which downloads a list of URLs using
+   cURL's multi interface with a sliding window: at most window transfers are
+   in flight at a time, and as soon as one of them finishes the next queued
+   URL takes its slot. Unlike waiting for a whole batch to finish, one slow
+   response only ever holds up its own slot.
+
+   More transfers can be added while run() is going (from the callback), and
+   they are started as slots free up, so a response can queue up the
+   downloads that depend on it.
+
+   How long each step of each transfer took (DNS, connect, TLS, first
+   byte) is read from curl as it finishes, see getTimings().
+
+   Optionally (see setAdaptive()) the window isn't fixed but follows a
+   ConcurrencyLimit, which grows it while the server keeps up and shrinks it
+   when responses slow down or the server turns requests away. Every
+   transfer can be given a deadline (setTimeout()), and transfers that time
+   out, can't connect or get an HTTP 429 or 5xx response can be retried a
+   few times (setRetries()), after a random delay that grows with each
+   attempt, so retries from many transfers don't all arrive at once.
+
+   Transfers ask for HTTP/2 and compressed responses. Over HTTP/2 they are
+   multiplexed: new transfers wait for the connection that is already open
+   rather than opening their own, so a whole window of transfers can share
+   one connection. With a ConnectionPool (setConnectionPool()), DNS lookups,
+   TLS sessions and open connections are also kept between runs.
+
+   Transfers added without a buffer of their own are downloaded into one
+   from a BufferPool (setBufferPool()), which the transfer only holds while
+   it's in flight and during its callback (see getBuffer()). Those
+   transfers only start when the pool has a buffer to spare, so the pool's
+   budget, as well as the window, limits how many are in flight.
+
+   cancel() may be called from any thread to stop a run() early: the
+   transfers that haven't finished by then fail with
+   CURLE_ABORTED_BY_CALLBACK, and their callbacks aren't called. */
+
+/* Called by run() each time a transfer finishes, with the index returned by
+   add() and the transfer's cURL result code */
+typedef void (*transfer_callback)(int index, CURLcode result, void *userdata);
+
+class TransferScheduler
+{
+
+    /* A queued download and where its response goes.
+       (Private to the TransferScheduler class) */
+    struct Transfer {
+        std::string url;
+        std::string *buffer;
+        bool pooled;            /* buffer comes from the BufferPool */
+        CURLcode result;
+        TransferTimings timings;
+        int attempts;
+        bool done;
+    };
+
+    /* A transfer waiting to be tried again.
+       (Private to the TransferScheduler class) */
+    struct Retry {
+        std::chrono::steady_clock::time_point due;
+        int index;
+
+        /* Soonest first, in a priority_queue */
+        bool operator<(const Retry &r) const { return due > r.due; }
+    };
+
+    public:
+        TransferScheduler(int window = DEFAULT_WINDOW);
+        virtual ~TransferScheduler();
+        int add(std::string url, std::string *buffer = NULL);
+        void setCallback(transfer_callback callback, void *userdata);
+        void setAdaptive(int min_window, int max_window);
+        void setTimeout(long timeout_ms);
+        void setRetries(int max_retries, long backoff_ms = DEFAULT_BACKOFF_MS);
+        void setMetrics(LoadMetrics *metrics);
+        void setConnectionPool(ConnectionPool *pool);
+        void setBufferPool(BufferPool *buffers);
+        int run();
+        void cancel();
+        bool isCancelled() { return cancelled; }
+        CURLcode getResult(int index) { return transfers[index].result; }
+        const TransferTimings& getTimings(int index) { return transfers[index].timings; }
+        int getAttempts(int index) { return transfers[index].attempts; }
+        std::string* getBuffer(int index) { return transfers[index].buffer; }
+        int getTransferCount() { return (int)transfers.size(); }
+        int getWindow();
+
+        /* Number of transfers to keep in flight when the window isn't
+           adaptive */
+        static const int DEFAULT_WINDOW = 50;
+
+        /* The first retry waits up to this long, and each one after that up
+           to twice as long as the one before, but never more than
+           MAX_BACKOFF_MS (or the server's Retry-After, if it sent one) */
+        static const long DEFAULT_BACKOFF_MS = 100;
+        static const long MAX_BACKOFF_MS = 10000;
+
+    protected:
+    private:
+        CURL* newCurl();
+        void start(CURL *curl, int index);
+        void releaseBuffer(int index);
+        void fill();
+        bool finished(CURL *curl, int index, CURLcode result);
+        long backoff(CURL *curl, int attempt);
+        long untilNextRetry();
+        static bool retryable(CURLcode result, long status);
+        static bool overloaded(CURLcode result, long status);
+        static void readTimings(CURL *curl, TransferTimings &t);
+        static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
+        std::vector<Transfer> transfers;
+        int window;
+        ConcurrencyLimit *limit;        /* NULL if the window is fixed */
+        long timeout_ms;                /* 0 for no deadline */
+        int max_retries;
+        long backoff_ms;
+        LoadMetrics *metrics;           /* Where to record every attempt, or NULL */
+        ConnectionPool *pool;           /* Shared caches, or NULL */
+        BufferPool *buffers;            /* For transfers without a buffer, or NULL */
+        std::minstd_rand random;        /* For the backoff jitter */
+
+        /* State of run(): easy curls made so far, the ones not in use, the
+           next transfer to start and the number in flight */
+        CURLM *multi_handle;
+        std::vector<CURL*> curls;
+        std::vector<CURL*> idle;
+        std::priority_queue<Retry> retries;   /* Waiting out their backoff */
+        std::vector<int> due;                 /* Backoff over, to start first */
+        int next;
+        int active;
+        std::mutex cancel_lock;         /* Guards multi_handle against cancel() */
+        std::atomic<bool> cancelled;
+        transfer_callback callback;
+        void *userdata;
+};
+
+#endif // TRANSFERSCHEDULER_H
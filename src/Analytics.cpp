@@ -0,0 +1,229 @@
+#include "Analytics.h"
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+/* LibraryStats stats;
+
+   Constructor for the LibraryStats struct. Every counter starts at 0. */
+
+LibraryStats::LibraryStats()
+{
+    entries = 0;
+    rated = 0;
+    rating_sum = 0;
+    community_rating_sum = 0;
+    for(int t=0; t<=SHOW_UNKNOWN; t++) {
+        type_entries[t] = 0;
+        type_completed[t] = 0;
+        type_dropped[t] = 0;
+    }
+    for(int s=0; s<=UNDEFINED; s++) {
+        status_entries[s] = 0;
+        status_episodes_known[s] = 0;
+        status_episodes_watched[s] = 0;
+    }
+}
+
+/* Returns n / d, or NaN if there's nothing to divide by */
+static double ratio(double n, long long d) {
+    return d == 0 ? NAN : n / d;
+}
+
+/* Mean of the ratings the users gave, over the entries they rated */
+double LibraryStats::meanRating() {
+    return ratio(rating_sum, rated);
+}
+
+/* Mean community rating of the same entries as meanRating() */
+double LibraryStats::meanCommunityRating() {
+    return ratio(community_rating_sum, rated);
+}
+
+/* Fraction of the entries of show type t that are completed */
+double LibraryStats::completionRate(show_type t) {
+    return ratio(type_completed[t], type_entries[t]);
+}
+
+/* Fraction of the entries of show type t that are dropped */
+double LibraryStats::dropRate(show_type t) {
+    return ratio(type_dropped[t], type_entries[t]);
+}
+
+/* Mean episodes watched of the entries with library status s */
+double LibraryStats::meanEpisodesWatched(library_status s) {
+    return ratio(status_episodes_watched[s], status_episodes_known[s]);
+}
+
+/* Analytics analytics(int);
+
+   Constructor for the Analytics class. threads is the number of threads to
+   compute with, or 0 for one per CPU core.
+
+   ex. Analytics analytics;
+
+   Pre-conditions: none.
+
+   Post-conditions: the thread pool is started. */
+
+Analytics::Analytics(int threads) : pool(threads)
+{
+    //ctor
+}
+
+/* Destructor: the thread pool stops its threads */
+Analytics::~Analytics()
+{
+    //dtor
+}
+
+/* computeChunk(int, int, void*);
+
+   ThreadPool task: aggregates the rows of one chunk into its partial.
+   userdata points to the Job set up by compute(). */
+
+void Analytics::computeChunk(int task, int thread, void *userdata) {
+    Job *job = (Job*)userdata;
+    const Chunk &c = job->chunks[task];
+    Partial &p = job->partials[task];
+    LibraryStats &s = p.stats;
+    p.genre_counts.assign(job->genre_count, 0);
+
+    const std::vector<uint8_t> &statuses = c.store->getLibraryStatuses();
+    const std::vector<uint8_t> &types = c.store->getShowTypes();
+    const std::vector<float> &ratings = c.store->getRatings();
+    const std::vector<float> &community_ratings = c.store->getCommunityRatings();
+    const std::vector<int32_t> &watched = c.store->getEpisodesWatched();
+    const std::vector<uint32_t> &genre_offsets = c.store->getGenreOffsets();
+    const std::vector<uint16_t> &genre_ids = c.store->getGenreIds();
+    const std::vector<uint8_t> &removed = c.store->getRemoved();
+    const std::vector<int> &genre_map = *c.genre_map;
+
+    for(int row=c.begin; row<c.end; row++) {
+        if(removed[row])
+            continue;
+        int status = statuses[row];
+        int type = types[row];
+        s.entries++;
+
+        if(!std::isnan(ratings[row])) {
+            s.rated++;
+            s.rating_sum += ratings[row];
+            s.community_rating_sum += community_ratings[row];
+        }
+
+        s.type_entries[type]++;
+        s.type_completed[type] += status == COMPLETED;
+        s.type_dropped[type] += status == DROPPED;
+
+        s.status_entries[status]++;
+        if(watched[row] >= 0) {
+            s.status_episodes_known[status]++;
+            s.status_episodes_watched[status] += watched[row];
+        }
+
+        for(uint32_t g=genre_offsets[row]; g<genre_offsets[row + 1]; g++)
+            p.genre_counts[genre_map[genre_ids[g]]]++;
+    }
+}
+
+/* LibraryStats compute(const vector<Library*>&);
+
+   Computes the aggregates over every entry of every library. Libraries
+   that failed to download are skipped.
+
+   ex. LibraryStats stats = analytics.compute(libraries);
+
+   Pre-conditions: the libraries aren't changed while this runs.
+
+   Post-conditions: none. */
+
+LibraryStats Analytics::compute(const std::vector<Library*> &libraries) {
+    std::vector<LibraryStore*> stores;
+    for(unsigned i=0; i<libraries.size(); i++) {
+        if(libraries[i] != NULL && libraries[i]->getLibrarySize() != -1)
+            stores.push_back(libraries[i]->getStore());
+    }
+    return compute(stores);
+}
+
+/* LibraryStats compute(const vector<LibraryStore*>&);
+
+   Computes the aggregates over every row of every store, except rows that
+   have been removed. The result is the same, to the last bit, for any
+   number of threads.
+
+   ex. LibraryStats stats = analytics.compute(stores);
+
+   Pre-conditions: the stores aren't changed while this runs.
+
+   Post-conditions: none. */
+
+LibraryStats Analytics::compute(const std::vector<LibraryStore*> &stores) {
+    Job job;
+
+    /* Each store numbers its genres its own way, so give every genre name
+       one number, in order of first appearance */
+    std::vector<std::vector<int> > genre_maps(stores.size());
+    std::vector<std::string> genre_names;
+    std::unordered_map<std::string_view, int> genre_numbers;
+    for(unsigned i=0; i<stores.size(); i++) {
+        for(int g=0; g<stores[i]->getGenreCount(); g++) {
+            std::string_view name = stores[i]->getGenreName(g);
+            std::unordered_map<std::string_view, int>::iterator it = genre_numbers.find(name);
+            if(it == genre_numbers.end()) {
+                it = genre_numbers.insert(std::make_pair(name, (int)genre_names.size())).first;
+                genre_names.push_back(std::string(name));
+            }
+            genre_maps[i].push_back(it->second);
+        }
+    }
+    job.genre_count = (int)genre_names.size();
+
+    for(unsigned i=0; i<stores.size(); i++) {
+        for(int begin=0; begin<stores[i]->size(); begin+=CHUNK_ROWS) {
+            Chunk c;
+            c.store = stores[i];
+            c.genre_map = &genre_maps[i];
+            c.begin = begin;
+            c.end = std::min(begin + CHUNK_ROWS, stores[i]->size());
+            job.chunks.push_back(c);
+        }
+    }
+    job.partials.resize(job.chunks.size());
+
+    pool.run((int)job.chunks.size(), computeChunk, &job);
+
+    /* Merge the partials, always in chunk order */
+    LibraryStats stats;
+    std::vector<long long> genre_counts(job.genre_count, 0);
+    for(unsigned i=0; i<job.partials.size(); i++) {
+        LibraryStats &s = job.partials[i].stats;
+        stats.entries += s.entries;
+        stats.rated += s.rated;
+        stats.rating_sum += s.rating_sum;
+        stats.community_rating_sum += s.community_rating_sum;
+        for(int t=0; t<=SHOW_UNKNOWN; t++) {
+            stats.type_entries[t] += s.type_entries[t];
+            stats.type_completed[t] += s.type_completed[t];
+            stats.type_dropped[t] += s.type_dropped[t];
+        }
+        for(int st=0; st<=UNDEFINED; st++) {
+            stats.status_entries[st] += s.status_entries[st];
+            stats.status_episodes_known[st] += s.status_episodes_known[st];
+            stats.status_episodes_watched[st] += s.status_episodes_watched[st];
+        }
+        for(int g=0; g<job.genre_count; g++)
+            genre_counts[g] += job.partials[i].genre_counts[g];
+    }
+
+    for(int g=0; g<job.genre_count; g++) {
+        if(genre_counts[g] > 0)
+            stats.genres.push_back(std::make_pair(genre_names[g], genre_counts[g]));
+    }
+    std::sort(stats.genres.begin(), stats.genres.end(),
+        [](const std::pair<std::string, long long> &a, const std::pair<std::string, long long> &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+    return stats;
+}
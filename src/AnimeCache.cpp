@@ -0,0 +1,335 @@
+#include "AnimeCache.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Identifies the start of the cache file and of every record in it */
+#define FILE_MAGIC "HBCACHE1"
+#define FILE_MAGIC_SIZE 8
+#define RECORD_MAGIC 0x48424152
+
+/* Records are padded so that every header stays 8-byte aligned in the map */
+#define RECORD_ALIGN 8
+
+/* Smallest mapping made; it doubles from there as the file grows */
+#define MIN_MAP_SIZE (1024 * 1024)
+
+static size_t paddedSize(size_t length) {
+    return (length + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+/* AnimeCache* = new AnimeCache(string, long, size_t);
+
+   Constructor for the AnimeCache class. Opens (or creates) the cache file at
+   the given path, maps it into memory and indexes the records it contains.
+
+   ex. AnimeCache cache("anime_cache.bin");
+       AnimeCache cache("anime_cache.bin", 24 * 60 * 60, 16 * 1024 * 1024);
+
+   Pre-conditions: path must be in a writable directory. A ttl_seconds of 0 or
+   less means cached records never expire.
+
+   Post-conditions: the cache is ready for get() and put(). If the file could
+   not be opened, isOpen() returns false and every get() is a miss. */
+
+AnimeCache::AnimeCache(std::string path, long ttl_seconds, size_t max_bytes)
+{
+    this->path = path;
+    this->ttl = ttl_seconds;
+    this->max_bytes = max_bytes;
+    hits = 0;
+    misses = 0;
+    fd = -1;
+    map = NULL;
+    map_size = 0;
+    file_size = 0;
+
+    if(openFile())
+        scan();
+}
+
+/* Destructor: unmaps and closes the cache file. Records are written as soon
+   as they are put(), so there is nothing left to flush. */
+AnimeCache::~AnimeCache()
+{
+    closeFile();
+}
+
+/* bool openFile();
+
+   Opens the cache file, writing the file header if the file is new.
+   Returns true on success. */
+
+bool AnimeCache::openFile() {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd == -1) {
+        fprintf(stderr, "AnimeCache: couldn't open %s\n", path.c_str());
+        return false;
+    }
+
+    flock(fd, LOCK_EX);
+    struct stat st;
+    fstat(fd, &st);
+    if(st.st_size == 0) {
+        if(write(fd, FILE_MAGIC, FILE_MAGIC_SIZE) != FILE_MAGIC_SIZE) {
+            flock(fd, LOCK_UN);
+            closeFile();
+            return false;
+        }
+        st.st_size = FILE_MAGIC_SIZE;
+    }
+    flock(fd, LOCK_UN);
+    file_size = st.st_size;
+
+    if(!remap()) {
+        closeFile();
+        return false;
+    }
+
+    /* Refuse to use a file that isn't a cache file (don't overwrite it either) */
+    if(memcmp(map, FILE_MAGIC, FILE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "AnimeCache: %s is not a cache file\n", path.c_str());
+        closeFile();
+        return false;
+    }
+    return true;
+}
+
+/* void closeFile();
+
+   Unmaps and closes the cache file, and forgets the index. */
+
+void AnimeCache::closeFile() {
+    if(map != NULL)
+        munmap(map, map_size);
+    if(fd != -1)
+        close(fd);
+    map = NULL;
+    map_size = 0;
+    fd = -1;
+    index.clear();
+}
+
+/* bool remap();
+
+   Makes sure the first file_size bytes of the cache file are mapped.
+   Called whenever records have been appended. The mapping is made at
+   least twice as big as the last one, past the end of the file, so that
+   appending a record usually finds it already mapped rather than costing
+   an munmap() and mmap() each time. Only the first file_size bytes of it
+   are ever read. */
+
+bool AnimeCache::remap() {
+    if(map != NULL && file_size <= map_size)
+        return true;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = std::max(std::max(file_size, map_size * 2), (size_t)MIN_MAP_SIZE);
+    size = (size + page - 1) / page * page;
+    if(map != NULL)
+        munmap(map, map_size);
+    map = (char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        map = NULL;
+        map_size = 0;
+        return false;
+    }
+    map_size = size;
+    return true;
+}
+
+/* void scan();
+
+   Walks every record in the mapped file and points the index at the newest
+   record of each anime id. Stops at the first corrupt or truncated record
+   (e.g. from a crash half way through a write) and ignores the rest. */
+
+void AnimeCache::scan() {
+    index.clear();
+    size_t offset = FILE_MAGIC_SIZE;
+    while(offset + sizeof(RecordHeader) <= file_size) {
+        RecordHeader *h = (RecordHeader*)(map + offset);
+        if(h->magic != RECORD_MAGIC || offset + sizeof(RecordHeader) + h->length > file_size)
+            break;
+        const char *body = map + offset + sizeof(RecordHeader);
+        if(checksumOf(body, h->length) != h->checksum)
+            break;
+        index[h->id] = offset;
+        offset += sizeof(RecordHeader) + paddedSize(h->length);
+    }
+}
+
+/* bool get(int, string&);
+
+   Looks up the cached /anime/{id} response for the given anime id. On a hit
+   the response is copied into body and true is returned. Records older than
+   the TTL count as misses.
+
+   ex. std::string body;
+       if(cache.get(6, body)) ...
+
+   Pre-conditions: none.
+
+   Post-conditions: the hit or miss counter has been incremented. */
+
+bool AnimeCache::get(int id, std::string &body) {
+    std::unordered_map<int, size_t>::iterator it = index.find(id);
+    if(it == index.end()) {
+        misses++;
+        return false;
+    }
+
+    RecordHeader *h = (RecordHeader*)(map + it->second);
+    if(expired(h->stored_at, time(NULL))) {
+        misses++;
+        return false;
+    }
+
+    body.assign(map + it->second + sizeof(RecordHeader), h->length);
+    hits++;
+    return true;
+}
+
+/* bool has(int);
+
+   Whether get() would find a response for the given anime id, without
+   copying it out. Doesn't count as a hit or a miss.
+
+   ex. if(cache.has(6)) ...
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+bool AnimeCache::has(int id) {
+    std::unordered_map<int, size_t>::iterator it = index.find(id);
+    if(it == index.end())
+        return false;
+    return !expired(((RecordHeader*)(map + it->second))->stored_at, time(NULL));
+}
+
+/* void put(int, const string&);
+
+   Appends the /anime/{id} response for the given anime id to the cache file,
+   replacing any older record for that id. Compacts the file first if the new
+   record would take it past the size limit. A response too big to fit under
+   the size limit even in an empty file isn't cached at all.
+
+   ex. cache.put(6, buffer);
+
+   Pre-conditions: body should be a complete, successful API response.
+
+   Post-conditions: the record is on disk and will be returned by get(). */
+
+void AnimeCache::put(int id, const std::string &body) {
+    if(fd == -1 || body.empty())
+        return;
+
+    size_t record_size = sizeof(RecordHeader) + paddedSize(body.size());
+    if(FILE_MAGIC_SIZE + record_size > max_bytes)
+        return;
+    if(file_size + record_size > max_bytes)
+        compact(record_size);
+    if(fd == -1 || file_size + record_size > max_bytes)
+        return;
+
+    std::vector<char> record(record_size, 0);
+    RecordHeader *h = (RecordHeader*)&record[0];
+    h->magic = RECORD_MAGIC;
+    h->id = id;
+    h->length = body.size();
+    h->checksum = checksumOf(body.data(), body.size());
+    h->stored_at = time(NULL);
+    memcpy(&record[sizeof(RecordHeader)], body.data(), body.size());
+
+    /* Another process may have appended since we last looked, so always
+       write at the real end of the file while holding the lock */
+    flock(fd, LOCK_EX);
+    struct stat st;
+    fstat(fd, &st);
+    size_t offset = st.st_size;
+    ssize_t written = pwrite(fd, &record[0], record_size, offset);
+    flock(fd, LOCK_UN);
+
+    if(written != (ssize_t)record_size)
+        return;
+
+    file_size = offset + record_size;
+    if(remap())
+        index[id] = offset;
+    else
+        closeFile();
+}
+
+/* void compact(size_t);
+
+   Rewrites the cache file keeping only the newest, unexpired record of each
+   anime id, dropping the oldest records until the file is below three
+   quarters of the size limit and has room for another reserve bytes under
+   it. The new file replaces the old one atomically. */
+
+void AnimeCache::compact(size_t reserve) {
+    int64_t now = time(NULL);
+
+    /* (stored_at, offset) of every live record, newest first */
+    std::vector<std::pair<int64_t, size_t> > live;
+    for(std::unordered_map<int, size_t>::iterator it = index.begin(); it != index.end(); ++it) {
+        RecordHeader *h = (RecordHeader*)(map + it->second);
+        if(!expired(h->stored_at, now))
+            live.push_back(std::make_pair(h->stored_at, it->second));
+    }
+    std::sort(live.rbegin(), live.rend());
+
+    std::string tmp_path = path + ".tmp";
+    int tmp = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(tmp == -1)
+        return;
+
+    bool ok = write(tmp, FILE_MAGIC, FILE_MAGIC_SIZE) == FILE_MAGIC_SIZE;
+    size_t size = FILE_MAGIC_SIZE;
+    for(unsigned i=0; ok && i<live.size(); i++) {
+        RecordHeader *h = (RecordHeader*)(map + live[i].second);
+        size_t record_size = sizeof(RecordHeader) + paddedSize(h->length);
+        if(size + record_size > max_bytes / 4 * 3 || size + record_size + reserve > max_bytes)
+            break;
+        ok = write(tmp, h, record_size) == (ssize_t)record_size;
+        size += record_size;
+    }
+    close(tmp);
+
+    if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return;
+    }
+
+    closeFile();
+    if(openFile())
+        scan();
+}
+
+/* bool expired(int64_t, int64_t);
+
+   Returns true if a record stored at stored_at is older than the TTL. */
+
+bool AnimeCache::expired(int64_t stored_at, int64_t now) {
+    return ttl > 0 && now - stored_at > ttl;
+}
+
+/* uint32_t checksumOf(const char*, size_t);
+
+   32-bit FNV-1a hash of a record body, used to detect torn writes. */
+
+uint32_t AnimeCache::checksumOf(const char *data, size_t length) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
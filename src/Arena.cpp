@@ -0,0 +1,104 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <new>
+
+/* Arena arena(size_t);
+
+   Constructor for the Arena class. chunk_size is how much memory to get
+   from the system at a time; allocations bigger than that get a chunk of
+   their own.
+
+   ex. Arena arena;
+
+   Pre-conditions: none.
+
+   Post-conditions: an empty arena. No memory is reserved until the first
+   allocation. */
+
+Arena::Arena(size_t chunk_size)
+{
+    this->chunk_size = chunk_size;
+    next = NULL;
+    end = NULL;
+    used = 0;
+    reserved = 0;
+}
+
+/* Destructor: releases every chunk, and with them everything allocated */
+Arena::~Arena()
+{
+    for(unsigned i=0; i<chunks.size(); i++)
+        free(chunks[i].data);
+}
+
+/* void clear();
+
+   Frees everything allocated from the arena at once, so it can be filled
+   again from scratch.
+
+   ex. arena.clear();
+
+   Pre-conditions: nothing still points into the arena.
+
+   Post-conditions: the arena is empty and has no memory reserved. */
+
+void Arena::clear() {
+    for(unsigned i=0; i<chunks.size(); i++)
+        free(chunks[i].data);
+    chunks.clear();
+    next = NULL;
+    end = NULL;
+    used = 0;
+    reserved = 0;
+}
+
+/* void* allocate(size_t, size_t);
+
+   Returns size bytes of memory aligned to align (a power of two), which
+   stays valid until the arena is destroyed.
+
+   ex. int *xs = (int*)arena.allocate(100 * sizeof(int), alignof(int));
+
+   Pre-conditions: align is a power of two no bigger than 16.
+
+   Post-conditions: none. Throws std::bad_alloc if memory runs out. */
+
+void* Arena::allocate(size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t)next + align - 1) & ~(uintptr_t)(align - 1);
+    if(next == NULL || p + size > (uintptr_t)end) {
+        Chunk c;
+        c.size = size + align > chunk_size ? size + align : chunk_size;
+        c.data = (char*)malloc(c.size);
+        if(c.data == NULL)
+            throw std::bad_alloc();
+        chunks.push_back(c);
+        reserved += c.size;
+        next = c.data;
+        end = c.data + c.size;
+        p = ((uintptr_t)next + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    next = (char*)(p + size);
+    used += size;
+    return (void*)p;
+}
+
+/* string_view copy(const char*, size_t);
+
+   Copies a string into the arena and returns a view of the copy. The copy
+   is followed by a '\0', so its data() can also be used as a C string.
+
+   ex. std::string_view title = arena.copy(s, strlen(s));
+
+   Pre-conditions: s points to length bytes (or is NULL if length is 0).
+
+   Post-conditions: none. */
+
+std::string_view Arena::copy(const char *s, size_t length) {
+    char *p = (char*)allocate(length + 1, 1);
+    if(length > 0)
+        memcpy(p, s, length);
+    p[length] = '\0';
+    return std::string_view(p, length);
+}
@@ -0,0 +1,106 @@
+#include "BufferPool.h"
+#include <algorithm>
+
+/* A released buffer bigger than this many times the usual response is
+   emptied instead of kept, so one huge response doesn't hold on to its
+   memory for the rest of the load */
+#define KEEP_FACTOR 4
+
+/* BufferPool pool(size_t);
+
+   Constructor for the BufferPool class. budget is the most bytes the
+   pool's buffers should hold between them, or 0 for no limit.
+
+   ex. BufferPool pool(4 * 1024 * 1024);
+
+   Pre-conditions: none.
+
+   Post-conditions: an empty pool; buffers are made as they're needed. */
+
+BufferPool::BufferPool(size_t budget)
+{
+    this->budget = budget;
+    estimate = INITIAL_ESTIMATE;
+    in_use_bytes = 0;
+    free_bytes = 0;
+    peak_bytes = 0;
+}
+
+/* Destructor: frees every buffer, including any still in use */
+BufferPool::~BufferPool()
+{
+    for(unsigned i=0; i<buffers.size(); i++)
+        delete buffers[i];
+}
+
+/* string* acquire();
+
+   Hands out an empty buffer with room for a response of the usual size:
+   one that has been released before if there is one, otherwise a new one.
+
+   ex. std::string *buffer = pool.acquire();
+
+   Pre-conditions: none.
+
+   Post-conditions: returns NULL if the buffer would put the pool over its
+   budget and other buffers are in use; otherwise the buffer belongs to
+   the caller until it's given back with release(). */
+
+std::string* BufferPool::acquire() {
+    std::string *buffer = NULL;
+    size_t held = 0;
+    if(!free_buffers.empty()) {
+        buffer = free_buffers.back();
+        held = buffer->capacity();
+    }
+    size_t need = std::max(held, estimate);
+    if(budget != 0 && !reserved.empty() && in_use_bytes + free_bytes - held + need > budget)
+        return NULL;
+
+    if(buffer != NULL) {
+        free_buffers.pop_back();
+        free_bytes -= held;
+    } else {
+        buffer = new std::string();
+        buffers.push_back(buffer);
+    }
+    buffer->reserve(need);
+    reserved[buffer] = need;
+    in_use_bytes += need;
+    peak_bytes = std::max(peak_bytes, in_use_bytes + free_bytes);
+    return buffer;
+}
+
+/* void release(string*);
+
+   Takes back a buffer handed out by acquire(), once what is in it is no
+   longer needed, and empties it for the next one. Learns from its size how
+   big responses are.
+
+   ex. pool.release(buffer);
+
+   Pre-conditions: buffer came from this pool's acquire() and hasn't been
+   released since.
+
+   Post-conditions: buffer mustn't be used any more by the caller. */
+
+void BufferPool::release(std::string *buffer) {
+    std::unordered_map<std::string*, size_t>::iterator it = reserved.find(buffer);
+    if(it == reserved.end())
+        return;
+    in_use_bytes -= it->second;
+    reserved.erase(it);
+
+    /* It may have grown past what was set aside for it */
+    size_t held = buffer->capacity();
+    peak_bytes = std::max(peak_bytes, in_use_bytes + free_bytes + held);
+    estimate = (estimate * 7 + buffer->size()) / 8;
+
+    buffer->clear();
+    if(held > estimate * KEEP_FACTOR || (budget != 0 && in_use_bytes + free_bytes + held > budget)) {
+        std::string().swap(*buffer);
+        held = buffer->capacity();
+    }
+    free_buffers.push_back(buffer);
+    free_bytes += held;
+}
@@ -0,0 +1,114 @@
+#include "ConcurrencyLimit.h"
+#include <algorithm>
+
+/* ConcurrencyLimit limit(int, int, int);
+
+   Constructor for the ConcurrencyLimit class. The limit starts at initial
+   and always stays between min_limit and max_limit.
+
+   ex. ConcurrencyLimit limit(1, 100);
+
+   Pre-conditions: none.
+
+   Post-conditions: get() returns initial, clamped to the range. */
+
+ConcurrencyLimit::ConcurrencyLimit(int min_limit, int max_limit, int initial)
+{
+    if(min_limit < 1)
+        min_limit = 1;
+    if(max_limit < min_limit)
+        max_limit = min_limit;
+    this->min_limit = min_limit;
+    this->max_limit = max_limit;
+    limit = std::min(std::max(initial, min_limit), max_limit);
+    slow_start = true;
+    baseline = 0;
+    sample_count = 0;
+    next_sample = 0;
+    since_decrease = 0;
+}
+
+/* Destructor: nothing to do */
+ConcurrencyLimit::~ConcurrencyLimit()
+{
+    //dtor
+}
+
+/* void success(double);
+
+   Records a successful response that took latency seconds, not counting
+   the time spent connecting. Grows the limit, unless the median latency is
+   well above the baseline, in which case the limit is cut a little.
+
+   ex. limit.success(t.ttfb - t.dns - t.connect - t.tls);
+
+   Pre-conditions: none.
+
+   Post-conditions: get() may have changed. */
+
+void ConcurrencyLimit::success(double latency) {
+    samples[next_sample] = latency;
+    next_sample = (next_sample + 1) % SAMPLES;
+    if(sample_count < SAMPLES)
+        sample_count++;
+    since_decrease++;
+
+    /* Too few samples to tell a trend from noise yet */
+    if(sample_count < SAMPLES) {
+        if(slow_start)
+            limit = std::min(limit + 1, (double)max_limit);
+        return;
+    }
+
+    double m = median();
+    if(baseline == 0 || m < baseline)
+        baseline = m;
+    else
+        baseline += (m - baseline) * BASELINE_DRIFT;
+
+    if(m > baseline * LATENCY_TOLERANCE + LATENCY_SLACK) {
+        decrease(LATENCY_DECREASE);
+        return;
+    }
+
+    /* Slow start adds one per response, which doubles the limit every round
+       trip; after that, one per round trip */
+    limit += slow_start ? 1 : 1 / limit;
+    if(limit > max_limit)
+        limit = max_limit;
+}
+
+/* void overload();
+
+   Records that the server turned a request away because it is overloaded
+   (HTTP 429, 503 or 504) or that one timed out, and halves the limit.
+
+   ex. limit.overload();
+
+   Pre-conditions: none.
+
+   Post-conditions: get() may have changed. */
+
+void ConcurrencyLimit::overload() {
+    since_decrease++;
+    decrease(OVERLOAD_DECREASE);
+}
+
+/* Multiplies the limit by factor, unless it was already cut within the
+   last window's worth of responses (which were all sent before that cut
+   could have had an effect) */
+void ConcurrencyLimit::decrease(double factor) {
+    slow_start = false;
+    if(since_decrease < (long)limit)
+        return;
+    limit = std::max(limit * factor, (double)min_limit);
+    since_decrease = 0;
+}
+
+/* The median of the recent latencies */
+double ConcurrencyLimit::median() {
+    double sorted[SAMPLES];
+    std::copy(samples, samples + sample_count, sorted);
+    std::nth_element(sorted, sorted + sample_count / 2, sorted + sample_count);
+    return sorted[sample_count / 2];
+}
@@ -0,0 +1,58 @@
+#include "ConnectionPool.h"
+
+/* ConnectionPool pool;
+
+   Constructor for the ConnectionPool class. Makes a share handle that
+   shares DNS lookups, TLS sessions and open connections.
+
+   ex. ConnectionPool pool;
+
+   Pre-conditions: none.
+
+   Post-conditions: an empty pool; getShare() can be given to easy curls
+   with CURLOPT_SHARE. */
+
+ConnectionPool::ConnectionPool()
+{
+    /* Opposite of curl_global_cleanup() */
+    curl_global_init(CURL_GLOBAL_SSL);
+
+    share = curl_share_init();
+    if(share != NULL) {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+}
+
+/* Destructor for the ConnectionPool class. Closes the pooled connections.
+   Every easy curl that used the pool must have been cleaned up already. */
+ConnectionPool::~ConnectionPool()
+{
+    if(share != NULL)
+        curl_share_cleanup(share);
+
+    /* Opposite of curl_global_init() */
+    curl_global_cleanup();
+}
+
+/* curl_share_setopt(CURLSH, CURLSHOPT_LOCKFUNC, lock);
+
+   Callback function that should only be called by curl! Locks the kind of
+   data curl is about to use. userdata points to the ConnectionPool. */
+
+void ConnectionPool::lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userdata) {
+    ((ConnectionPool*)userdata)->locks[data].lock();
+}
+
+/* curl_share_setopt(CURLSH, CURLSHOPT_UNLOCKFUNC, unlock);
+
+   Callback function that should only be called by curl! Unlocks the kind
+   of data curl is done with. userdata points to the ConnectionPool. */
+
+void ConnectionPool::unlock(CURL *curl, curl_lock_data data, void *userdata) {
+    ((ConnectionPool*)userdata)->locks[data].unlock();
+}
@@ -0,0 +1,352 @@
+#include "EntryIndex.h"
+#include <cstring>
+
+/* Ids at or above this go in a hash map instead of the dense array */
+#define MAX_DENSE_ID (1 << 22)
+
+/* Grow when the table is more than LOAD_NUM/LOAD_DEN full */
+#define LOAD_NUM 7
+#define LOAD_DEN 8
+
+typedef std::unordered_multimap<int, LibraryEntry*>::iterator DuplicateIterator;
+
+/* EntryIndex index(int);
+
+   Constructor for the EntryIndex class. capacity is the number of entries
+   the index should be able to hold before it has to grow.
+
+   ex. EntryIndex index(library_size);
+
+   Pre-conditions: none.
+
+   Post-conditions: an empty index. */
+
+EntryIndex::EntryIndex(int capacity)
+{
+    /* Each shard's table size is the smallest power of two that fits its
+       share of capacity */
+    uint64_t size = 16;
+    while(size * LOAD_NUM / LOAD_DEN < (uint64_t)capacity / SHARDS)
+        size *= 2;
+
+    Slot empty = { 0, NULL };
+    for(int i=0; i<SHARDS; i++) {
+        shards[i].slots.assign(size, empty);
+        shards[i].mask = size - 1;
+        shards[i].count = 0;
+    }
+}
+
+/* Destructor: nothing to do, the index doesn't own its entries */
+EntryIndex::~EntryIndex()
+{
+    //dtor
+}
+
+/* uint64_t hash(const char*, size_t);
+
+   Returns the 64-bit MurmurHash64A of a string. Unlike adding up character
+   codes, every bit of every character affects every bit of the hash, so
+   titles that are anagrams of each other (or just have similar letters)
+   don't collide.
+
+   ex. uint64_t h = EntryIndex::hash(title.data(), title.size());
+
+   Pre-conditions: key points to length bytes.
+
+   Post-conditions: none. */
+
+uint64_t EntryIndex::hash(const char *key, size_t length) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (length * m);
+
+    const char *end = key + (length & ~(size_t)7);
+    for(const char *p = key; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char *tail = (const unsigned char*)end;
+    switch(length & 7) {
+    case 7: h ^= (uint64_t)tail[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t)tail[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t)tail[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t)tail[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t)tail[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t)tail[1] << 8;  /* fall through */
+    case 1: h ^= (uint64_t)tail[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/* void insert(LibraryEntry*);
+
+   Adds a LibraryEntry to the index, by title and by anime id. If another
+   entry has the same title, find() returns whichever of them has the lower
+   row; the same goes for findById() and ids. Safe to call from several
+   threads at once (see the top of EntryIndex.h).
+
+   ex. index.insert(le);
+
+   Pre-conditions: le is not NULL.
+
+   Post-conditions: le can be found with find() and findById(). */
+
+void EntryIndex::insert(LibraryEntry *le) {
+    std::string_view title = le->getTitle();
+    Slot slot;
+    slot.hash = hash(title.data(), title.size());
+    slot.entry = le;
+
+    /* The title and the id are usually in different shards, so their locks
+       are taken one after the other, never both at once */
+    {
+        Shard &s = titleShard(slot.hash);
+        std::lock_guard<std::mutex> lock(s.lock);
+        if((uint64_t)(s.count + 1) > s.slots.size() * LOAD_NUM / LOAD_DEN)
+            grow(s);
+        insertSlot(s, slot);
+        s.count++;
+    }
+
+    int id = le->getId();
+    Shard &s = idShard(id);
+    std::lock_guard<std::mutex> lock(s.lock);
+    LibraryEntry **there;
+    if(id >= 0 && id < MAX_DENSE_ID) {
+        unsigned i = (unsigned)id >> SHARD_BITS;
+        if(i >= s.ids.size())
+            s.ids.resize(i < s.ids.size() * 2 ? s.ids.size() * 2 : i + 1, NULL);
+        there = &s.ids[i];
+    } else {
+        there = &s.sparse_ids[id];
+    }
+    if(*there == NULL) {
+        *there = le;
+    } else if(le->getRow() < (*there)->getRow()) {
+        s.duplicate_ids.insert(std::make_pair(id, *there));
+        *there = le;
+    } else {
+        s.duplicate_ids.insert(std::make_pair(id, le));
+    }
+}
+
+/* void remove(LibraryEntry*);
+
+   Removes a LibraryEntry from the index, by title and by anime id. Uses
+   backward shift deletion: the slots after the removed one that aren't in
+   their home slot are moved back one, so no tombstones are left behind and
+   the table stays as if the entry had never been inserted. Safe to call
+   from several threads at once, like insert().
+
+   ex. index.remove(le);
+
+   Pre-conditions: le is not NULL.
+
+   Post-conditions: find() and findById() no longer return le. If another
+   entry has the same title, find() returns that one instead, and if
+   another has the same id, findById() returns that one. */
+
+void EntryIndex::remove(LibraryEntry *le) {
+    std::string_view title = le->getTitle();
+    uint64_t h = hash(title.data(), title.size());
+    {
+        Shard &s = titleShard(h);
+        std::lock_guard<std::mutex> lock(s.lock);
+        uint64_t pos = h & s.mask;
+        uint64_t dist = 0;
+        while(s.slots[pos].entry != NULL) {
+            if(((pos - (s.slots[pos].hash & s.mask)) & s.mask) < dist)
+                break;
+            if(s.slots[pos].entry == le) {
+                uint64_t next = (pos + 1) & s.mask;
+                while(s.slots[next].entry != NULL && ((next - (s.slots[next].hash & s.mask)) & s.mask) != 0) {
+                    s.slots[pos] = s.slots[next];
+                    pos = next;
+                    next = (next + 1) & s.mask;
+                }
+                s.slots[pos].hash = 0;
+                s.slots[pos].entry = NULL;
+                s.count--;
+                break;
+            }
+            pos = (pos + 1) & s.mask;
+            dist++;
+        }
+    }
+
+    int id = le->getId();
+    Shard &s = idShard(id);
+    std::lock_guard<std::mutex> lock(s.lock);
+
+    /* Take le out of the duplicates, or if it's the one indexed, find the
+       duplicate with the lowest row to index instead */
+    std::pair<DuplicateIterator, DuplicateIterator> same = s.duplicate_ids.equal_range(id);
+    DuplicateIterator next = s.duplicate_ids.end();
+    for(DuplicateIterator it = same.first; it != same.second; ++it) {
+        if(it->second == le) {
+            s.duplicate_ids.erase(it);
+            return;
+        }
+        if(next == s.duplicate_ids.end() || it->second->getRow() < next->second->getRow())
+            next = it;
+    }
+
+    LibraryEntry **there = NULL;
+    if(id >= 0 && id < MAX_DENSE_ID) {
+        unsigned i = (unsigned)id >> SHARD_BITS;
+        if(i < s.ids.size())
+            there = &s.ids[i];
+    } else {
+        std::unordered_map<int, LibraryEntry*>::iterator it = s.sparse_ids.find(id);
+        if(it != s.sparse_ids.end())
+            there = &it->second;
+    }
+    if(there == NULL || *there != le)
+        return;
+    if(next != s.duplicate_ids.end()) {
+        *there = next->second;
+        s.duplicate_ids.erase(next);
+    } else if(id >= 0 && id < MAX_DENSE_ID) {
+        *there = NULL;
+    } else {
+        s.sparse_ids.erase(id);
+    }
+}
+
+/* void insertSlot(Shard&, Slot);
+
+   Robin Hood insertion: walks forward from the slot's home position, and
+   whenever the slot being inserted is further from home than the one
+   already there, swaps them and carries on inserting the displaced one.
+   Slots with equal hashes are kept in row order, so that find() comes to
+   the entry with the lowest row first whatever order they came in. */
+
+void EntryIndex::insertSlot(Shard &s, Slot slot) {
+    uint64_t pos = slot.hash & s.mask;
+    uint64_t dist = 0;
+    while(s.slots[pos].entry != NULL) {
+        Slot &there = s.slots[pos];
+        uint64_t their_dist = (pos - (there.hash & s.mask)) & s.mask;
+        if(their_dist < dist || (there.hash == slot.hash && slot.entry->getRow() < there.entry->getRow())) {
+            Slot t = there;
+            there = slot;
+            slot = t;
+            dist = their_dist;
+        }
+        pos = (pos + 1) & s.mask;
+        dist++;
+    }
+    s.slots[pos] = slot;
+}
+
+/* void grow(Shard&);
+
+   Doubles the size of a shard's title table and reinserts every slot. */
+
+void EntryIndex::grow(Shard &s) {
+    std::vector<Slot> old;
+    old.swap(s.slots);
+
+    Slot empty = { 0, NULL };
+    s.slots.assign(old.size() * 2, empty);
+    s.mask = s.slots.size() - 1;
+
+    for(unsigned i=0; i<old.size(); i++) {
+        if(old[i].entry != NULL)
+            insertSlot(s, old[i]);
+    }
+}
+
+/* LibraryEntry* find(string_view);
+
+   Returns the LibraryEntry with the given title, or NULL if there isn't one.
+   Titles are compared exactly (case-sensitive).
+
+   ex. LibraryEntry *le = index.find("Serial Experiments Lain");
+
+   Pre-conditions: no insert() or remove() is running.
+
+   Post-conditions: none. */
+
+LibraryEntry* EntryIndex::find(std::string_view title) {
+    uint64_t h = hash(title.data(), title.size());
+    Shard &s = titleShard(h);
+    uint64_t pos = h & s.mask;
+    uint64_t dist = 0;
+
+    /* Once we reach a slot that is closer to home than we would be, the
+       title can't be further along (that's the Robin Hood invariant) */
+    while(s.slots[pos].entry != NULL) {
+        if(((pos - (s.slots[pos].hash & s.mask)) & s.mask) < dist)
+            break;
+        if(s.slots[pos].hash == h && s.slots[pos].entry->getTitle() == title)
+            return s.slots[pos].entry;
+        pos = (pos + 1) & s.mask;
+        dist++;
+    }
+    return NULL;
+}
+
+/* LibraryEntry* findById(int);
+
+   Returns the LibraryEntry with the given Hummingbird anime id, or NULL if
+   there isn't one.
+
+   ex. LibraryEntry *le = index.findById(6);
+
+   Pre-conditions: no insert() or remove() is running.
+
+   Post-conditions: none. */
+
+LibraryEntry* EntryIndex::findById(int id) {
+    Shard &s = idShard(id);
+    if(id >= 0 && id < MAX_DENSE_ID) {
+        unsigned i = (unsigned)id >> SHARD_BITS;
+        return i < s.ids.size() ? s.ids[i] : NULL;
+    }
+
+    std::unordered_map<int, LibraryEntry*>::iterator it = s.sparse_ids.find(id);
+    return it == s.sparse_ids.end() ? NULL : it->second;
+}
+
+/* int size();
+
+   Returns the number of entries in the index.
+
+   Pre-conditions: no insert() or remove() is running.
+
+   Post-conditions: none. */
+
+int EntryIndex::size() {
+    int count = 0;
+    for(int i=0; i<SHARDS; i++)
+        count += shards[i].count;
+    return count;
+}
+
+/* int getCapacity();
+
+   Returns the total number of slots in the title tables.
+
+   Pre-conditions: no insert() or remove() is running.
+
+   Post-conditions: none. */
+
+int EntryIndex::getCapacity() {
+    int capacity = 0;
+    for(int i=0; i<SHARDS; i++)
+        capacity += (int)shards[i].slots.size();
+    return capacity;
+}
@@ -0,0 +1,202 @@
+#include "Epoch.h"
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+std::atomic<Epoch::Slot*> Epoch::chunks[Epoch::MAX_CHUNKS];
+std::atomic<uint64_t> Epoch::global(1);
+std::mutex Epoch::retired_lock;
+std::vector<Epoch::Retired> Epoch::retired;
+
+/* The slot a thread has taken, and how many guards it's in. Gives the slot
+   back when the thread exits. */
+struct EpochThread {
+    int slot;
+    int depth;
+
+    /* Constructor */
+    EpochThread(){
+        slot = -1;
+        depth = 0;
+    }
+
+    ~EpochThread();
+};
+
+static thread_local EpochThread this_thread;
+
+/* int slotOfThisThread();
+
+   Returns the calling thread's slot, taking a free one the first time.
+   If every slot is taken, adds a chunk of them; if there are already
+   MAX_CHUNKS, there are more threads than an Epoch can keep track of,
+   and the program is aborted rather than left waiting for a slot that may
+   never come free. */
+
+int Epoch::slotOfThisThread() {
+    if(this_thread.slot != -1)
+        return this_thread.slot;
+    for(int c=0; c<MAX_CHUNKS; c++) {
+        Slot *chunk = chunks[c].load();
+        if(chunk == NULL) {
+            Slot *added = new Slot[SLOTS_PER_CHUNK];
+            if(chunks[c].compare_exchange_strong(chunk, added))
+                chunk = added;
+            else
+                delete[] added;
+        }
+        for(int i=0; i<SLOTS_PER_CHUNK; i++) {
+            bool expected = false;
+            if(!chunk[i].taken.load(std::memory_order_relaxed) &&
+               chunk[i].taken.compare_exchange_strong(expected, true)) {
+                this_thread.slot = c * SLOTS_PER_CHUNK + i;
+                return this_thread.slot;
+            }
+        }
+    }
+    fprintf(stderr, "Epoch: more than %d threads are reading at once\n", MAX_THREADS);
+    abort();
+}
+
+EpochThread::~EpochThread() {
+    Epoch::exitThread(slot);
+}
+
+/* void enter();
+
+   Marks the calling thread as reading, from the current epoch on, unless
+   it already is (see Guard). Nothing retired from now on is freed until
+   it calls exit() as many times.
+
+   ex. Epoch::enter();
+
+   Pre-conditions: none.
+
+   Post-conditions: pointers loaded from now on stay valid until exit(). */
+
+void Epoch::enter() {
+    if(this_thread.depth++ > 0)
+        return;
+
+    /* Sequentially consistent, so no load of what is read can be moved
+       before the slot says we're reading */
+    slot(slotOfThisThread()).epoch.store(global.load());
+}
+
+/* void exit();
+
+   Undoes an enter(); once the outermost one is undone, nothing the thread
+   loaded while reading may be used any more.
+
+   ex. Epoch::exit();
+
+   Pre-conditions: the thread called enter() more times than exit().
+
+   Post-conditions: none. */
+
+void Epoch::exit() {
+    if(--this_thread.depth > 0)
+        return;
+    slot(this_thread.slot).epoch.store(0, std::memory_order_release);
+}
+
+/* Gives a slot back for another thread to take, when its thread exits */
+void Epoch::exitThread(int i) {
+    if(i != -1)
+        slot(i).taken.store(false, std::memory_order_release);
+}
+
+/* void retire(void*, retire_function);
+
+   Hands over an object that has just been unpublished (no reader can load
+   a pointer to it any more), to be freed with free(object) once no reader
+   can still be using it: straight away if no thread is reading, otherwise
+   by a later retire() or synchronize() call.
+
+   ex. Thing *old = current.exchange(replacement);
+       Epoch::retire(old, deleteThing);
+
+   Pre-conditions: the object can no longer be reached by a reader that
+   enters from now on.
+
+   Post-conditions: the object belongs to Epoch. Objects retired earlier
+   that no reader can be using have been freed. */
+
+void Epoch::retire(void *object, retire_function free) {
+    std::unique_lock<std::mutex> guard(retired_lock);
+    Retired r;
+    r.object = object;
+    r.free = free;
+    r.epoch = global.fetch_add(1);
+    retired.push_back(r);
+    guard.unlock();
+    reclaim();
+}
+
+/* void synchronize();
+
+   Waits until every thread that is reading has left the epoch it's in,
+   then frees everything retired before the call. Threads that start
+   reading meanwhile aren't waited for.
+
+   ex. Epoch::retire(old, deleteThing);
+       Epoch::synchronize();
+
+   Pre-conditions: the calling thread isn't reading (it would wait for
+   itself forever).
+
+   Post-conditions: everything retired before the call has been freed. */
+
+void Epoch::synchronize() {
+    uint64_t now = global.fetch_add(1);
+    for(int i=0; i<MAX_THREADS && chunks[i / SLOTS_PER_CHUNK].load() != NULL; i++) {
+        while(1) {
+            uint64_t e = slot(i).epoch.load();
+            if(e == 0 || e > now)
+                break;
+            std::this_thread::yield();
+        }
+    }
+    reclaim();
+}
+
+/* int getRetiredCount();
+
+   Number of retired objects that haven't been freed yet. */
+
+int Epoch::getRetiredCount() {
+    std::lock_guard<std::mutex> guard(retired_lock);
+    return (int)retired.size();
+}
+
+/* void reclaim();
+
+   Frees every retired object that was retired before the epoch of the
+   oldest reader still reading, or all of them if nothing is being read.
+   The objects are freed after letting go of the lock, so freeing them may
+   retire more. */
+
+void Epoch::reclaim() {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> guard(retired_lock);
+        if(retired.empty())
+            return;
+        uint64_t oldest = UINT64_MAX;
+        for(int i=0; i<MAX_THREADS && chunks[i / SLOTS_PER_CHUNK].load() != NULL; i++) {
+            uint64_t e = slot(i).epoch.load();
+            if(e != 0 && e < oldest)
+                oldest = e;
+        }
+        unsigned kept = 0;
+        for(unsigned i=0; i<retired.size(); i++) {
+            if(retired[i].epoch < oldest)
+                ready.push_back(retired[i]);
+            else
+                retired[kept++] = retired[i];
+        }
+        retired.resize(kept);
+    }
+    for(unsigned i=0; i<ready.size(); i++)
+        ready[i].free(ready[i].object);
+}
@@ -0,0 +1,469 @@
+#include "JsonReader.h"
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+
+/* JsonReader r;
+
+   Constructor for the JsonReader class. Has no input until reset(). */
+
+JsonReader::JsonReader()
+{
+    reset(NULL, 0);
+}
+
+/* Destructor: nothing to do */
+JsonReader::~JsonReader()
+{
+    //dtor
+}
+
+/* void reset(const char*, size_t);
+
+   Starts reading a new document of size bytes at data. Strings read from
+   the previous document are no longer valid.
+
+   ex. r.reset(body.data(), body.size());
+
+   Pre-conditions: data stays valid and unchanged while the document is
+   read, and while the strings read from it are used.
+
+   Post-conditions: the reader is at the start of the document. */
+
+void JsonReader::reset(const char *data, size_t size) {
+    p = data;
+    end = data + size;
+    error = data == NULL && size > 0;
+    depth = 0;
+    first = 0;
+
+    /* A decoded string is never longer than its JSON, so with this much room
+       the scratch buffer never moves, and the views into it stay valid */
+    scratch.clear();
+    scratch.reserve(size);
+}
+
+/* Marks the input as invalid; returns false so it can be returned */
+bool JsonReader::fail() {
+    error = true;
+    return false;
+}
+
+void JsonReader::skipSpace() {
+    while(p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        p++;
+}
+
+/* json_token peek();
+
+   Returns the type of the next value, without reading it.
+
+   ex. if(r.peek() == TOKEN_STRING) ...
+
+   Pre-conditions: the reader is at a value (not at a key).
+
+   Post-conditions: none. */
+
+json_token JsonReader::peek() {
+    if(error)
+        return TOKEN_ERROR;
+    skipSpace();
+    if(p == end)
+        return TOKEN_END;
+    switch(*p) {
+        case '{': return TOKEN_OBJECT;
+        case '[': return TOKEN_ARRAY;
+        case '"': return TOKEN_STRING;
+        case 't': case 'f': return TOKEN_BOOL;
+        case 'n': return TOKEN_NULL;
+        case '-': return TOKEN_NUMBER;
+        default:
+            return *p >= '0' && *p <= '9' ? TOKEN_NUMBER : TOKEN_ERROR;
+    }
+}
+
+/* bool beginObject();
+
+   Reads the start of an object, whose members are then read with
+   nextKey(). Returns false if the next value isn't an object.
+
+   ex. if(r.beginObject()) while(r.nextKey(key)) ...
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: the reader is inside the object. */
+
+bool JsonReader::beginObject() {
+    if(peek() != TOKEN_OBJECT || depth == MAX_DEPTH)
+        return fail();
+    p++;
+    depth++;
+    first |= (uint64_t)1 << (depth - 1);
+    return true;
+}
+
+/* bool beginArray();
+
+   Reads the start of an array, whose elements are then read after each
+   nextElement(). Returns false if the next value isn't an array.
+
+   ex. if(r.beginArray()) while(r.nextElement()) ...
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: the reader is inside the array. */
+
+bool JsonReader::beginArray() {
+    if(peek() != TOKEN_ARRAY || depth == MAX_DEPTH)
+        return fail();
+    p++;
+    depth++;
+    first |= (uint64_t)1 << (depth - 1);
+    return true;
+}
+
+/* Moves to the next member of the current object or element of the current
+   array: reads the comma before it, or the closing bracket if there are
+   no more (and returns false) */
+bool JsonReader::next(bool object) {
+    if(error || depth == 0)
+        return fail();
+    skipSpace();
+    if(p == end)
+        return fail();
+    if(*p == (object ? '}' : ']')) {
+        p++;
+        depth--;
+        return false;
+    }
+
+    uint64_t bit = (uint64_t)1 << (depth - 1);
+    if(first & bit) {
+        first &= ~bit;
+    } else {
+        if(*p != ',')
+            return fail();
+        p++;
+    }
+    return true;
+}
+
+/* bool nextKey(string_view&);
+
+   Reads the key of the next member of the current object, after which its
+   value must be read or skipped. Returns false at the end of the object
+   (which it reads), or if the input is invalid.
+
+   ex. while(r.nextKey(key)) {
+           if(key == "id") r.readNumber(id); else r.skipValue();
+       }
+
+   Pre-conditions: the reader is inside an object, after a value.
+
+   Post-conditions: the reader is at the member's value. */
+
+bool JsonReader::nextKey(std::string_view &key) {
+    if(!next(true))
+        return false;
+    skipSpace();
+    if(p == end || *p != '"' || !readString(key))
+        return fail();
+    skipSpace();
+    if(p == end || *p != ':')
+        return fail();
+    p++;
+    return true;
+}
+
+/* bool nextElement();
+
+   Moves to the next element of the current array, which must then be read
+   or skipped. Returns false at the end of the array (which it reads), or
+   if the input is invalid.
+
+   ex. while(r.nextElement()) r.skipValue();
+
+   Pre-conditions: the reader is inside an array, after a value.
+
+   Post-conditions: the reader is at the element. */
+
+bool JsonReader::nextElement() {
+    return next(false);
+}
+
+/* bool readString(string_view&);
+
+   Reads a string, decoding its escapes. Returns false if the next value
+   isn't a string.
+
+   ex. std::string_view title;
+       r.readString(title);
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: s stays valid until the next reset(). */
+
+bool JsonReader::readString(std::string_view &s) {
+    if(peek() != TOKEN_STRING)
+        return fail();
+    const char *start = ++p;
+    while(p < end && *p != '"' && *p != '\\')
+        p++;
+    if(p == end)
+        return fail();
+    if(*p == '"') {
+        s = std::string_view(start, p - start);
+        p++;
+        return true;
+    }
+    return decodeString(start, s);
+}
+
+/* Appends the UTF-8 encoding of code point c to s */
+static void appendUtf8(std::string &s, uint32_t c) {
+    if(c < 0x80) {
+        s.push_back((char)c);
+    } else if(c < 0x800) {
+        s.push_back((char)(0xc0 | (c >> 6)));
+        s.push_back((char)(0x80 | (c & 0x3f)));
+    } else if(c < 0x10000) {
+        s.push_back((char)(0xe0 | (c >> 12)));
+        s.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+        s.push_back((char)(0x80 | (c & 0x3f)));
+    } else {
+        s.push_back((char)(0xf0 | (c >> 18)));
+        s.push_back((char)(0x80 | ((c >> 12) & 0x3f)));
+        s.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+        s.push_back((char)(0x80 | (c & 0x3f)));
+    }
+}
+
+/* Reads the 4 hex digits of a \u escape at p */
+static bool readHex4(const char *p, const char *end, uint32_t &c) {
+    if(end - p < 4)
+        return false;
+    c = 0;
+    for(int i=0; i<4; i++) {
+        char h = p[i];
+        c <<= 4;
+        if(h >= '0' && h <= '9')
+            c |= h - '0';
+        else if(h >= 'a' && h <= 'f')
+            c |= h - 'a' + 10;
+        else if(h >= 'A' && h <= 'F')
+            c |= h - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+/* bool decodeString(const char*, string_view&);
+
+   Decodes a string that has escapes into the scratch buffer, from its
+   first character at start, with p at its first backslash. Each \u escape
+   takes at most 6 characters and gives at most 3 bytes of UTF-8 (4 for a
+   surrogate pair, which takes 12), so the result is never longer than the
+   JSON it came from. */
+
+bool JsonReader::decodeString(const char *start, std::string_view &s) {
+    size_t offset = scratch.size();
+    scratch.append(start, p - start);
+    while(p < end && *p != '"') {
+        if(*p != '\\') {
+            const char *run = p;
+            while(p < end && *p != '"' && *p != '\\')
+                p++;
+            scratch.append(run, p - run);
+            continue;
+        }
+        if(++p == end)
+            return fail();
+        switch(*p++) {
+            case '"': scratch.push_back('"'); break;
+            case '\\': scratch.push_back('\\'); break;
+            case '/': scratch.push_back('/'); break;
+            case 'b': scratch.push_back('\b'); break;
+            case 'f': scratch.push_back('\f'); break;
+            case 'n': scratch.push_back('\n'); break;
+            case 'r': scratch.push_back('\r'); break;
+            case 't': scratch.push_back('\t'); break;
+            case 'u': {
+                uint32_t c;
+                if(!readHex4(p, end, c))
+                    return fail();
+                p += 4;
+
+                /* A high surrogate followed by a low one is one code point */
+                uint32_t low;
+                if(c >= 0xd800 && c < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                   readHex4(p + 2, end, low) && low >= 0xdc00 && low < 0xe000) {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                    p += 6;
+                } else if(c >= 0xd800 && c < 0xe000) {
+                    /* A lone surrogate isn't a character; UTF-8 can't hold it */
+                    c = 0xfffd;
+                }
+                appendUtf8(scratch, c);
+                break;
+            }
+            default:
+                return fail();
+        }
+    }
+    if(p == end)
+        return fail();
+    p++;
+    s = std::string_view(scratch.data() + offset, scratch.size() - offset);
+    return true;
+}
+
+/* bool readNumber(double&);
+
+   Reads a number. Returns false if the next value isn't a number.
+
+   ex. double rating;
+       r.readNumber(rating);
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: none. */
+
+bool JsonReader::readNumber(double &d) {
+    if(peek() != TOKEN_NUMBER)
+        return fail();
+
+    /* from_chars doesn't take a leading + but does take "inf" and "nan",
+       which JSON doesn't, so only digits may follow the sign */
+    const char *digits = *p == '-' ? p + 1 : p;
+    if(digits == end || *digits < '0' || *digits > '9')
+        return fail();
+    std::from_chars_result r = std::from_chars(p, end, d);
+    if(r.ec == std::errc::invalid_argument)
+        return fail();
+
+    /* Too big or too small for a double: from_chars leaves d alone, so give
+       what strtod does (+-HUGE_VAL, or 0 or the nearest denormal) */
+    if(r.ec == std::errc::result_out_of_range)
+        d = strtod(std::string(p, r.ptr).c_str(), NULL);
+    p = r.ptr;
+    return true;
+}
+
+/* Reads the given literal (true, false or null) */
+bool JsonReader::readLiteral(const char *literal, size_t length) {
+    if((size_t)(end - p) < length || memcmp(p, literal, length) != 0)
+        return fail();
+    p += length;
+    return true;
+}
+
+/* bool readBool(bool&);
+
+   Reads true or false. Returns false if the next value isn't either.
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: none. */
+
+bool JsonReader::readBool(bool &b) {
+    if(peek() != TOKEN_BOOL)
+        return fail();
+    b = *p == 't';
+    return b ? readLiteral("true", 4) : readLiteral("false", 5);
+}
+
+/* bool readNull();
+
+   Reads a null. Returns false if the next value isn't null.
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: none. */
+
+bool JsonReader::readNull() {
+    if(peek() != TOKEN_NULL)
+        return fail();
+    return readLiteral("null", 4);
+}
+
+/* Moves past a string, without decoding it */
+bool JsonReader::skipString() {
+    p++;
+    while(p < end && *p != '"') {
+        if(*p == '\\')
+            p++;
+        p++;
+    }
+    if(p >= end)
+        return fail();
+    p++;
+    return true;
+}
+
+/* bool skipValue();
+
+   Moves past the next value, whatever it is, without building anything.
+   Objects and arrays are skipped by counting brackets, so their contents
+   are not checked beyond that.
+
+   ex. if(key != "title") r.skipValue();
+
+   Pre-conditions: the reader is at a value.
+
+   Post-conditions: the reader is after the value. */
+
+bool JsonReader::skipValue() {
+    double d;
+    bool b;
+    switch(peek()) {
+        case TOKEN_STRING:
+            return skipString();
+        case TOKEN_NUMBER:
+            return readNumber(d);
+        case TOKEN_BOOL:
+            return readBool(b);
+        case TOKEN_NULL:
+            return readNull();
+        case TOKEN_OBJECT:
+        case TOKEN_ARRAY: {
+            int nesting = 0;
+            while(p < end) {
+                char c = *p;
+                if(c == '"') {
+                    if(!skipString())
+                        return false;
+                    continue;
+                }
+                p++;
+                if(c == '{' || c == '[') {
+                    nesting++;
+                } else if(c == '}' || c == ']') {
+                    if(--nesting == 0)
+                        return true;
+                }
+            }
+            return fail();
+        }
+        default:
+            return fail();
+    }
+}
+
+/* bool atEnd();
+
+   Returns true if the whole document has been read and was valid: every
+   object and array has been closed and only whitespace is left.
+
+   ex. if(!r.atEnd()) ... // Trailing garbage or an error
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+bool JsonReader::atEnd() {
+    if(error)
+        return false;
+    skipSpace();
+    return p == end && depth == 0;
+}
@@ -1,478 +1,675 @@
 #include "Library.h"
+#include "LibraryLoader.h"
+#include "ThreadPool.h"
 #include <iostream>
+#include <cstdio>
 #include <vector>
-#include <curl/curl.h>
+#include <chrono>
 
-/* Number of easy curls to bundle in a multi curl. ~50-100 seems to be optimum */
-#define N 50
+typedef std::chrono::steady_clock Clock;
 
-/* Number of slots to use in the hash table */
-#define HASHSIZE 100
+/* Entries parsed by each task of finishEntries(), and entries added to the
+   index by each of its index tasks */
+#define FINISH_CHUNK 32
+#define INDEX_CHUNK 256
 
-/* new Library(string);
+/* new Library(string, LibraryOptions);
 
-   Constructor for the Library class. Initializes curl globally in preparation
-   for downloading library contents; sets the h hash table size; initializes
-   the hash table, and initializes download of user's library by calling
-   the getLibrary() function. Sets size of library to -1 on failure.
+   Constructor for the Library class. Downloads the user's library with a
+   LibraryLoader (see LibraryLoader.h), which is the same as loading just
+   this one user with it. Sets size of library to -1 on failure.
 
    ex. Library *L = new Library("Josh");
 
+       LibraryOptions options;
+       options.cache = &cache;
+       Library *L = new Library("Josh", options);
+
    Pre-conditions: must be passed a string corresponding to the name of a
-   user on Hummingbird.me, otherwise the call to getLibrary will fail. Internet
-   access is also required for cURL to work!
+   user on Hummingbird.me, otherwise the download will fail. Internet
+   access is also required for cURL to work! If options.cache is set, it must
+   outlive the constructor call.
 
 
    Post-conditions: user's anime library has been downloaded from the Hummingbird
-   API, parsed into LibraryEntry objects using libjson-c, and stored in hashTable,
-   including all metadata defined in the LibraryEntry class. cURL has been globally
-   initialized, and the size of the library has been defined. */
+   API, parsed into LibraryEntry objects by a ResponseParser, and stored in the index,
+   including all metadata defined in the LibraryEntry class, and the size of the
+   library has been defined. */
 
-Library::Library(std::string username)
+Library::Library(std::string username, LibraryOptions options)
 {
-    /* Should be called only once for the entire program */
-    curl_global_init(CURL_GLOBAL_SSL);
+    this->username = username;
+    this->options = options;
+    library_size = 0;
+    loading = false;
+    titles_stale = false;
+    version = NULL;
+    versions = 0;
+
+    LibraryLoader loader(options);
+    loader.addLibrary(this, username);
+    loader.run();
+}
 
-    hash_size = HASHSIZE;
-    hashTable = new LibraryEntryWrapper[hash_size];
+/* Library(LibraryOptions);
 
-    int failure = getLibrary(username);
+   Constructor used by LibraryLoader: creates an empty library, which the
+   loader then fills with beginLoad(), finishEntry() or finishEntries()
+   and endLoad(). */
 
-    /* To indicate that the user's library could not be gotten.
-       the library size is set to -1. */
-    if(failure == 1)
+Library::Library(LibraryOptions options)
+{
+    this->options = options;
+    library_size = 0;
+    loading = false;
+    titles_stale = false;
+    version = NULL;
+    versions = 0;
+}
+
+/* new Library(SnapshotFile, LibraryOptions);
+
+   Constructor for the Library class that loads a library saved by save(),
+   instead of downloading it. Nothing is parsed: the snapshot file is
+   memory-mapped and the library's columns are copied straight out of it,
+   while its text is used in place. Sets size of library to -1 if the file
+   doesn't exist or isn't a valid snapshot. Only the title search index is
+   built from scratch.
+
+   ex. Library *L = new Library(SnapshotFile("josh.snapshot"));
+       if(L->getLibrarySize() == -1)
+           L = new Library("Josh");
+
+   Pre-conditions: options is used by refresh().
+
+   Post-conditions: the library is the same as the one that was saved, and
+   refresh() brings it up to date. getLoadTimings().total is the time it
+   took to load. */
+
+Library::Library(SnapshotFile file, LibraryOptions options)
+{
+    this->options = options;
+    library_size = 0;
+    loading = false;
+    titles_stale = false;
+    version = NULL;
+    versions = 0;
+
+    Clock::time_point start = Clock::now();
+    if(!loadSnapshot(file.path))
         library_size = -1;
+    else if(options.versioned)
+        publish();
+    timings.total = std::chrono::duration<double>(Clock::now() - start).count();
 }
 
-/* Destructor for the Library class. Cleans up curl globally in anticipation of
-   no more network transfers being required.
+/* Destructor for the Library class.
 
    ex. delete L;
 
    Pre-conditions: Library has been constructed by calling the class constructor.
    The construction does not have to have been successful.
 
-   Post-conditions: All LibraryEntry objects stored in the hashTable are deleted. */
+   Post-conditions: The library's LibraryStore, and with it every LibraryEntry,
+   has been freed. So have its LibraryVersions, once the threads reading
+   them were done with them (this waits for them). */
 
 Library::~Library()
 {
+    /* The versions point into the store's text, so they have to go first */
+    LibraryVersion *v = version.exchange(NULL);
+    if(v != NULL) {
+        Epoch::retire(v, LibraryVersion::destroy);
+        Epoch::synchronize();
+    }
+}
 
-    /* Opposite of curl_global_init() */
-    curl_global_cleanup();
-
-    /* Delete hashtable */
-    if(library_size > 0) {
-        for(int i=0; i<hash_size; i++) {
-            if(hashTable[i].entry != NULL) {
-                LibraryEntryWrapper *x = &hashTable[i];
-                while(x != NULL) {
-                    x = x->next;
-                    delete x;
-                }
-            }
-        }
+/* int refresh();
+
+   Brings the library up to date with the user's library on Hummingbird,
+   without downloading it all again: only the user's library list is
+   downloaded, and compared with the current entries by anime id. Entries
+   that are still there have their library status, episodes watched and
+   rating updated in place, entries that are gone are removed, and only the
+   anime that are new to the library have their metadata downloaded (or
+   taken from options.cache).
+
+   ex. if(L->refresh() != 0)
+           cout << "Couldn't refresh the library" << endl;
+
+   Pre-conditions: Library object has been created by the constructor. If it
+   failed to download then, refresh() tries again.
+
+   Post-conditions: returns 0 on success. Returns 1 if the library list
+   couldn't be downloaded or parsed, in which case the library is left as
+   it was. LibraryEntry pointers to removed entries stay valid, but the
+   entries are no longer returned by any of the getters. */
+
+int Library::refresh() {
+    LibraryLoader loader(options);
+    loader.addRefresh(this);
+    return loader.run() == 0 ? 0 : 1;
+}
+
+/* int save(const string&);
+
+   Saves the library to a snapshot file (see Snapshot.h), which the
+   Library(SnapshotFile) constructor loads back in milliseconds. Along with
+   the store's columns it saves the username and the status indexes, which
+   are already in title order, so loading doesn't have to sort anything.
+
+   ex. if(L->save("josh.snapshot") != 0)
+           cout << "Couldn't save the library" << endl;
+
+   Pre-conditions: Library object has been created by a constructor.
+
+   Post-conditions: returns 0 on success. Returns 1 if the library failed to
+   load (so there is nothing to save) or the file couldn't be written. */
+
+int Library::save(const std::string &path) {
+    ReadWriteLock::Reader guard(lock);
+    if(library_size == -1 || loading)
+        return 1;
+
+    Snapshot out;
+    store.save(out);
+
+    int32_t size = library_size;
+    out.add(SNAPSHOT_LIBRARY_SIZE, &size, sizeof(size));
+    out.add(SNAPSHOT_USERNAME, username.data(), username.size());
+
+    std::vector<int32_t> status_rows;
+    for(int s=0; s<=UNDEFINED; s++)
+        status_rows.push_back(status_index[s].size());
+    for(int s=0; s<=UNDEFINED; s++) {
+        for(unsigned i=0; i<status_index[s].size(); i++)
+            status_rows.push_back(status_index[s][i]->getRow());
     }
+    out.add(SNAPSHOT_STATUS_ROWS, status_rows.data(), status_rows.size() * sizeof(int32_t));
+
+    return out.write(path) ? 0 : 1;
 }
 
-/* curl_easy_setopt(CURL, CURLOPT_WRITEFUNCTION, WriteCallback);
+/* bool loadSnapshot(const string&);
+
+   Loads the library from a snapshot file, for the Library(SnapshotFile)
+   constructor: the store's columns, then the username and library size,
+   then the index and status indexes. Returns false if the file can't be
+   opened or doesn't hold a valid store. */
+
+bool Library::loadSnapshot(const std::string &path) {
+    if(!source.open(path))
+        return false;
+    if(!store.load(source)) {
+        fprintf(stderr, "Snapshot: %s doesn't hold a library\n", path.c_str());
+        source.close();
+        return false;
+    }
+
+    size_t bytes;
+    const int32_t *size_in = (const int32_t*)source.get(SNAPSHOT_LIBRARY_SIZE, bytes);
+    if(size_in != NULL && bytes == sizeof(int32_t))
+        library_size = *size_in;
+    else
+        library_size = store.size() - store.getRemovedCount();
+    const char *username_in = (const char*)source.get(SNAPSHOT_USERNAME, bytes);
+    if(username_in != NULL)
+        username.assign(username_in, bytes);
+
+    for(int row=0; row<store.size(); row++) {
+        if(!store.isRemoved(row))
+            index.insert(store.getEntry(row));
+    }
 
-   Callback function that should only be called by curl! Will store all of the
-   data returned by the CURL object in the variable passed to curl by
-   curl_easy_setopt(CURL, CURLOPT_WRITEDATA, &buffer);
+    /* A snapshot without its status indexes can still be used, they just
+       need sorting again */
+    if(!loadStatusIndexes()) {
+        for(int s=0; s<=UNDEFINED; s++)
+            status_index[s].clear();
+        for(int row=0; row<store.size(); row++) {
+            if(!store.isRemoved(row))
+                status_index[store.getLibraryStatuses()[row]].push_back(store.getEntry(row));
+        }
+        sortStatusIndexes();
+    }
 
-   ex. curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-       curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+    title_search.build(&store);
+    return true;
+}
 
-   Pre-conditions: Curl has been set up globally, CURL object has been initialized.
+/* bool loadStatusIndexes();
+
+   Fills the status indexes from the snapshot's list of the rows in each
+   one, which save() wrote in title order. Returns false if there is no
+   such list or it doesn't match the store. */
+
+bool Library::loadStatusIndexes() {
+    size_t bytes;
+    const int32_t *rows = (const int32_t*)source.get(SNAPSHOT_STATUS_ROWS, bytes);
+    size_t count = bytes / sizeof(int32_t);
+    if(rows == NULL || count < UNDEFINED + 1)
+        return false;
+
+    size_t next = UNDEFINED + 1;
+    for(int s=0; s<=UNDEFINED; s++) {
+        if(rows[s] < 0 || next + rows[s] > count)
+            return false;
+        status_index[s].resize(rows[s]);
+        for(int i=0; i<rows[s]; i++) {
+            int row = rows[next + i];
+            if(row < 0 || row >= store.size() || store.isRemoved(row) || store.getLibraryStatuses()[row] != s)
+                return false;
+            status_index[s][i] = store.getEntry(row);
+        }
+        next += rows[s];
+    }
+    return next == count;
+}
 
-   Post-conditions: Data returned by CURL is stored in buffer.
+/* void setConcurrent(bool);
 
-   Alternative description: Writes the data returned by each curl to the buffer
-   string pointed to by *userp.
+   Switches the locks of the library and its store on or off (see
+   ReadWriteLock.h), so that it can be read on other threads while it's
+   loaded on one.
 
-   Source: http://stackoverflow.com/questions/9786150/save-curl-content-result-into-a-string-in-c
+   Pre-conditions: This function is private and should only be called by
+   LibraryLoad, while nothing is writing to the library.
 
-   Also see the libcurl documentation at http://curl.haxx.se/libcurl/c/allfuncs.html */
+   Post-conditions: none. */
 
-size_t Library::WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+void Library::setConcurrent(bool on) {
+    lock.setEnabled(on);
+    store.getLock().setEnabled(on);
 }
 
-/* int getLibrary(string)
+/* int beginLoad(const string&, vector<int>&);
+
+   First stage of loading: parses the user's library list (the response of
+   /users/{name}/library) into the fields of each entry that come from the
+   list. Sets ids to the Hummingbird id of each entry, in order, whose
+   /anime/{id} response must then be given to finishEntry().
+
+   ex. int rc = library->beginLoad(buffer, ids);
+
+   Pre-conditions: This function is private and should only be called by
+   LibraryLoader, once.
 
-   The most important function in the library (sorry it's so long):
-   Given the username of a Hummingbird.me user, it downloads that person's Library array from
-   the Hummingbird API, which contains all of the Libray Entry objects corresponding to the
-   shows in their anime library. However, since the Library Entry objects do not contain all
-   of the desired information, like genres, it then goes through the array and downloads the
-   complete anime objects from the API using cURL's "multi interface" to make all of the
-   transfers fast and asynchronous. This makes the function quite complex, but increases
-   performance a lot. Once all the needed information is gotten from the API, it is parsed
-   using libjson-c and LibraryEntry objects are created and added to the hash table.
+   Post-conditions: returns 0 on success, or 1 if the list couldn't be
+   parsed (in which case there are no entries to finish). */
 
-   ***In the future, this will be split up into multiple smaller functions for clarity.
+int Library::beginLoad(const std::string &list_body, std::vector<int> &ids) {
+    ReadWriteLock::Writer guard(lock);
 
-   ex. int rc = getLibrary();
+    /* Entries are sorted into the status indexes once, at the end */
+    loading = true;
+    for(int s=0; s<=UNDEFINED; s++)
+        partial_sorted[s].clear();
 
-   Pre-conditions: Library constructor must have globally initialized curl and set up hash table.
-   This function is private because it should only be called from the Library constructor!
+    /* Parse the downloaded library straight into the fields of each entry.
+       The rest of each entry's fields are filled in by finishEntry(), and
+       then it's added to the LibraryStore. */
+    if(!parser.parseLibraryList(list_body, pending))
+        return 1;
 
-   Post-conditions: Library class is fully constructed; see post-conditions of constructor above.
-   Returns 0 on success, 1 on failure.
+    library_size = (int)pending.size();
+    ids.resize(library_size);
+    for(int counter=0; counter<library_size; counter++)
+        ids[counter] = pending[counter].id;
+    return 0;
+}
+
+/* int beginRefresh(const string&, vector<int>&);
 
-   */
-int Library::getLibrary(std::string username) {
+   First stage of refreshing: parses the user's library list and compares it
+   with the library by anime id. Entries already in the library are updated
+   in place (moving between status indexes if their status changed), and
+   entries no longer in the list are removed. Only the new entries are left
+   to finish: ids is set to the Hummingbird id of each of them, in order,
+   whose /anime/{id} response must then be given to finishEntry().
 
-    /* Return code: 1 on failure, 0 on success */
-    int rc = 0;
+   ex. int rc = library->beginRefresh(buffer, ids);
 
-    /* Hummingbird.me API URL for getting library */
-	std::string baseurl = "https://hummingbird.me/api/v1";
-	std::string endpoint = baseurl + "/users/" + username + "/library";
+   Pre-conditions: This function is private and should only be called by
+   LibraryLoader.
 
-	/* Buffer string for storing the API response */
-	std::string buffer;
+   Post-conditions: returns 0 on success, or 1 if the list couldn't be
+   parsed, in which case the library hasn't been changed. */
 
-    /* Set up curl for downloading library information from API.
-       This will go to the API endpoint URL above and download
-       the server's response in plain text (unparsed JSON) */
-	CURL *curl;
-	CURLcode res;
-	curl = curl_easy_init();
+int Library::beginRefresh(const std::string &list_body, std::vector<int> &ids) {
+    ReadWriteLock::Writer guard(lock);
+    std::vector<EntryFields> entries;
+    if(!parser.parseLibraryList(list_body, entries))
+        return 1;
 
-	/* Set curl options and perform curl downloads */
-	if(curl) {
-		curl_easy_setopt(curl, CURLOPT_URL, endpoint.c_str());
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-		curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
-		curl_easy_setopt(curl, CURLOPT_HEADER, 0);
-		curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1);
-		curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1);
-		res = curl_easy_perform(curl);
-		curl_easy_cleanup(curl);
+    int size = (int)entries.size();
+    std::vector<bool> seen(store.size(), false);
+    pending.clear();
+    ids.clear();
 
-		/* Check if curl succeeded */
-		if (res != CURLE_OK) {
-            /* Curl failed! */
-            fprintf(stderr, "cURL failed: %s\n",
-                curl_easy_strerror(res));
-            rc = 1;
+    for(int i=0; i<size; i++) {
+        LibraryEntry *le = index.findById(entries[i].id);
+        if(le == NULL) {
+            pending.push_back(entries[i]);
+            ids.push_back(entries[i].id);
+            continue;
         }
-	}
-
-    if(rc == 0) {
-        /* Curl succeeded! Now we must download all of the metadata for
-           the shows in the library */
-
-        /* Parse the downloaded library from buffer to a JSON object */
-        library_json = json_tokener_parse(buffer.c_str());
-
-        /* Get the size of the library from JSON object */
-        library_size = json_object_array_length(library_json);
-
-        /* The final json objects containing all of the desired metadata
-           that we've downloaded will be stored in this array. From these
-           json objects we can construct LibraryEntry objects using the
-           LibraryEntry constructor, which takes a json object as input. */
-        json_object *library_entries_json[library_size];
-
-        /* Set up N new curls, which will be reused multiple times
-           to download all of the metadata for the shows in the library.
-           Reusing a bunch of curls makes the transfer go faster because
-           each curl maintains a connection to the same server even after
-           being reset using curl_easy_reset(). */
-        CURL *curls[N];
-        std::string buffers[library_size];
-
-        /* No. of entries that we have read from library_json so far */
-        int counter = 0;
-
-        /* Initialize curl multi interface. This performs a bunch of
-           easy curls at once asynchronously, speeding things up a lot.
-           In this case, we perform batches of N curls at a time,
-           reusing both the multi_handle and the easy curls. */
-        CURLM *multi_handle = curl_multi_init();
-
-        /* Stores the number of easy curls still running in multi_curl */
-        int still_running;
-
-        /* Initialize our N easy curls (only has to be done once) */
-        for(int i=0; i<N; i++)
-            curls[i] = curl_easy_init();
-
-        /* Main loop in which we perform all of the curls */
-        while(counter < library_size) {
-
-            /* How many easy curls to put in the multi curl */
-            int multi_handle_size = N;
-
-            if(library_size-counter < N)
-                multi_handle_size = library_size - counter;
-
-            /* Add easy curls to multi curl */
-            for(int i=0; i<multi_handle_size; i++) {
-
-                /* Get the library entry from library json array */
-                json_object *entry = json_object_array_get_idx(library_json, counter);
-
-                /* Initialize the final library entry */
-                library_entries_json[counter] = json_object_new_object();
-
-                /* Add library status field to final library entry */
-                json_object *entry_library_status;
-                json_object_object_get_ex(entry, "status", &entry_library_status);
-                json_object_object_add(library_entries_json[counter], "library_status", entry_library_status);
-
-                /* Add episodes watched field to final library entry */
-                json_object *entry_episodes_watched;
-                json_object_object_get_ex(entry, "episodes_watched", &entry_episodes_watched);
-                json_object_object_add(library_entries_json[counter], "episodes_watched", entry_episodes_watched);
-
-                /* Add rating field to final library entry */
-                json_object *entry_rating;
-                json_object_object_get_ex(entry, "rating", &entry_rating);
-                json_object *entry_rating_value;
-                json_object_object_get_ex(entry_rating, "value", &entry_rating_value);
-                json_object_object_add(library_entries_json[counter], "rating", entry_rating_value);
-
-                /* Get Hummingbird ID number of library entry */
-                json_object *entry_anime;
-                json_object_object_get_ex(entry, "anime", &entry_anime);
-                json_object *entry_id;
-                json_object_object_get_ex(entry_anime, "id", &entry_id);
-
-                /* Use ID number to figure out URL for downloading more metadata */
-                std::string id = json_object_to_json_string(entry_id);
-                endpoint = baseurl + "/anime/" + id;
-
-                /* Set up curl with the required options */
-                if(curls[i]) {
-                    curl_easy_setopt(curls[i], CURLOPT_URL, endpoint.c_str());
-                    curl_easy_setopt(curls[i], CURLOPT_WRITEFUNCTION, WriteCallback);
-                    curl_easy_setopt(curls[i], CURLOPT_WRITEDATA, &buffers[counter]);
-                    curl_easy_setopt(curls[i], CURLOPT_FAILONERROR, 1);
-                    curl_easy_setopt(curls[i], CURLOPT_HEADER, 0);
-                } else {
-                    rc = 1;
-                    break;
-                }
-
-                /* Add ith curl to multi handle */
-                curl_multi_add_handle(multi_handle, curls[i]);
-
-                counter++;
-            }
 
-            /* Kickstart multi curl, as per https://moz.com/devblog/high-performance-libcurl-tips/*/
-            if(counter == multi_handle_size)
-                curl_multi_socket_action(multi_handle, CURL_SOCKET_TIMEOUT, 0, &still_running);
-
-            /* Perform multi curl action (asynchronous) */
-            curl_multi_perform(multi_handle, &still_running);
-
-            /* libcurl mutli interface voodoo (basically just waiting for multi curl to finish)
-               Source: http://curl.haxx.se/libcurl/c/multi-app.html */
-            do {
-                struct timeval timeout;
-                int rc; /* select() return code */
-                CURLMcode mc; /* curl_multi_fdset() return code */
-
-                fd_set fdread;
-                fd_set fdwrite;
-                fd_set fdexcep;
-                int maxfd = -1;
-
-                long curl_timeo = -1;
-
-                FD_ZERO(&fdread);
-                FD_ZERO(&fdwrite);
-                FD_ZERO(&fdexcep);
-
-                /* set a suitable timeout to play around with */
-                timeout.tv_sec = 1;
-                timeout.tv_usec = 0;
-
-                curl_multi_timeout(multi_handle, &curl_timeo);
-                if(curl_timeo >= 0) {
-                    timeout.tv_sec = curl_timeo / 1000;
-                    if(timeout.tv_sec > 1)
-                        timeout.tv_sec = 1;
-                    else
-                        timeout.tv_usec = (curl_timeo % 1000) * 1000;
-                }
-
-                /* get file descriptors from the transfers */
-                mc = curl_multi_fdset(multi_handle, &fdread, &fdwrite, &fdexcep, &maxfd);
-
-                if(mc != CURLM_OK)
-                {
-                      fprintf(stderr, "curl_multi_fdset() failed, code %d.\n", mc);
-                      break;
-                }
-
-                /* On success the value of maxfd is guaranteed to be >= -1. We call
-                   select(maxfd + 1, ...); specially in case of (maxfd == -1) there are
-                   no fds ready yet so we call select(0, ...) --or Sleep() on Windows--
-                   to sleep 100ms, which is the minimum suggested value in the
-                   curl_multi_fdset() doc. */
-
-                if(maxfd == -1) {
-                      /* Portable sleep for platforms other than Windows. */
-                      struct timeval wait = { 0, 100 * 1000 }; /* 100ms */
-                      rc = select(0, NULL, NULL, NULL, &wait);
-                }
-                else {
-                      /* Note that on some platforms 'timeout' may be modified by select().
-                         If you need access to the original value save a copy beforehand. */
-                      rc = select(maxfd+1, &fdread, &fdwrite, &fdexcep, &timeout);
-                }
-
-                switch(rc) {
-                case -1:
-                      /* select error */
-                      break;
-                case 0: /* timeout */
-                default: /* action */
-                      curl_multi_perform(multi_handle, &still_running);
-                      break;
-                }
-            } while(still_running);
-
-            /* Remove easy curls from multi handle and reset them for next loop or cleanup*/
-            for(int i=0; i<N; i++) {
-                curl_multi_remove_handle(multi_handle, curls[i]);
-                curl_easy_reset(curls[i]);
-            }
+        library_status old_status = le->getLibraryStatus();
+        store.update(le->getRow(), entries[i]);
+        if(le->getLibraryStatus() != old_status) {
+            removeFromStatusIndex(le, old_status);
+            std::vector<LibraryEntry*> &v = status_index[le->getLibraryStatus()];
+            v.insert(std::upper_bound(v.begin(), v.end(), le, libraryEntryTitleSort), le);
         }
+        seen[le->getRow()] = true;
+    }
 
-        /* Clean up easy curls */
-        for(int i=0; i<N; i++)
-            curl_easy_cleanup(curls[i]);
+    /* Whatever isn't in the list any more has been removed by the user */
+    int removed = 0;
+    for(unsigned row=0; row<seen.size(); row++) {
+        if(!seen[row] && !store.isRemoved(row)) {
+            removeEntry(store.getEntry(row));
+            removed++;
+        }
+    }
 
-        /* Clean up multi curl */
-        curl_multi_cleanup(multi_handle);
+    /* The title search is rebuilt by endLoad(), once the new entries are
+       finished, rather than as each one is */
+    if(removed > 0 || !pending.empty())
+        titles_stale = true;
 
-        /* Parse all of the JSON respones from the API and add the fields
-           we want to our own library_entries_json array */
-        for(int i=0; i<library_size; i++) {
+    library_size = size;
+    return 0;
+}
 
-             /* Parse anime object from buffer*/
-             json_object *anime_json = json_tokener_parse(buffers[i].c_str());
+/* int finishEntry(int, const string&);
 
-             /* Add title field to ith final library entry */
-             json_object *entry_anime_title;
-             json_object_object_get_ex(anime_json, "title", &entry_anime_title);
-             json_object_object_add(library_entries_json[i], "title", entry_anime_title);
+   Second stage of loading: parses an /anime/{id} response into the rest of
+   the fields of an entry from beginLoad(), adds a row for the entry to the
+   LibraryStore and adds that row's LibraryEntry to the indexes. Entries can
+   be finished in any order. If body isn't a json object (e.g. it's empty
+   because the download failed), the entry is left out of the library
+   instead.
 
-             /* Add synopsis field to ith final library entry */
-             json_object *entry_anime_synopsis;
-             json_object_object_get_ex(anime_json, "synopsis", &entry_anime_synopsis);
-             json_object_object_add(library_entries_json[i], "synopsis", entry_anime_synopsis);
+   ex. library->finishEntry(i, buffer);
 
-             /* Add airing status field to ith final library entry */
-             json_object *entry_airing_status;
-             json_object_object_get_ex(anime_json, "status", &entry_airing_status);
-             json_object_object_add(library_entries_json[i], "airing_status", entry_airing_status);
+   Pre-conditions: entry is one of the entries from beginLoad(), and hasn't
+   been finished yet. This function is private and should only be called by
+   LibraryLoader.
 
-             /* Add episode count field to ith final library entry */
-             json_object *entry_anime_episode_count;
-             json_object_object_get_ex(anime_json, "episode_count", &entry_anime_episode_count);
-             json_object_object_add(library_entries_json[i], "episode_count", entry_anime_episode_count);
+   Post-conditions: returns 0 if the LibraryEntry has been added to the
+   library, or 1 if it was left out. */
 
-             /* Add show type field to ith final library entry */
-             json_object *entry_anime_type;
-             json_object_object_get_ex(anime_json, "show_type", &entry_anime_type);
-             json_object_object_add(library_entries_json[i], "show_type", entry_anime_type);
+int Library::finishEntry(int entry, const std::string &body) {
+    /* Parse only the fields we want from the anime object, straight into
+       the entry's fields. Only the loading thread uses the parser and the
+       pending entries, so readers don't have to wait for the parse. */
+    EntryFields &f = pending[entry];
+    bool parsed = parser.parseAnime(body, f);
 
-             /* Add community rating field to ith final library entry */
-             json_object *entry_anime_community_rating;
-             json_object_object_get_ex(anime_json, "community_rating", &entry_anime_community_rating);
-             json_object_object_add(library_entries_json[i], "community_rating", entry_anime_community_rating);
+    ReadWriteLock::Writer guard(lock);
+    if(!parsed) {
+        library_size--;
+        return 1;
+    }
 
-             /* Add genres field to ith final library entry */
-             json_object *entry_anime_genres;
-             json_object_object_get_ex(anime_json, "genres", &entry_anime_genres);
-             json_object_object_add(library_entries_json[i], "genres", entry_anime_genres);
+    /* Add a row to the store from the entry's fields */
+    LibraryEntry *le = store.add(f);
 
-             /* Create LibraryEntry object from ith final library entry json object */
-             LibraryEntry *le = new LibraryEntry(library_entries_json[i]);
+    /* Add final library entry to the library */
+    addEntry(le);
+    return 0;
+}
 
-             /* Add final library entry to internal hash table */
-             addEntry(le);
+/* int finishEntries(const vector<int>&, const vector<const string*>&,
+                      ThreadPool&, vector<int>&);
+
+   Does what finishEntry() does for a whole batch of entries, on every
+   thread of pool: bodies[i] is the /anime/{id} response for entries[i].
+   First each thread parses responses into their entries' fields with its
+   own parser, and copies their text into its own arena in the store. Then
+   the rows are added to the store and the status indexes one by one, in
+   the order of entries, which is quick now that there is nothing left to
+   parse or copy. Last, the rows are added to the index on every thread
+   (see EntryIndex). Row numbers, genre ids and the index come out exactly
+   the same as from calling finishEntry() on each entry in order, whatever
+   the number of threads. Entries whose response isn't a json object are
+   left out, and put in left_out.
+
+   ex. library->finishEntries(entries, bodies, pool, left_out);
+
+   Pre-conditions: the entries are from beginLoad() or beginRefresh() and
+   haven't been finished yet; the bodies stay unchanged until this returns.
+   This function is private and should only be called by LibraryLoader.
+
+   Post-conditions: returns the number of entries added to the library. */
+
+int Library::finishEntries(const std::vector<int> &entries, const std::vector<const std::string*> &bodies,
+                           ThreadPool &pool, std::vector<int> &left_out) {
+    int n = (int)entries.size();
+    FinishJob job;
+    job.library = this;
+    job.entries = &entries;
+    job.bodies = &bodies;
+    job.threads.resize(pool.getThreadCount());
+    job.genre_starts.assign(n, -1);
+    job.parsed_by.assign(n, 0);
+    store.setTextArenas(pool.getThreadCount());
+    pool.run((n + FINISH_CHUNK - 1) / FINISH_CHUNK, parseTask, &job);
+
+    /* Nothing that can be read has changed until here */
+    ReadWriteLock::Writer guard(lock);
+    left_out.clear();
+    for(int i=0; i<n; i++) {
+        if(job.genre_starts[i] < 0) {
+            left_out.push_back(entries[i]);
+            library_size--;
+            continue;
         }
-        /* Success */
-        rc = 0;
+        EntryFields &f = pending[entries[i]];
+        std::vector<std::string_view> &genres = job.threads[job.parsed_by[i]].genres;
+        f.genres = f.genre_count > 0 ? &genres[job.genre_starts[i]] : NULL;
+        LibraryEntry *le = store.add(f, false);
+        addToStatusIndex(le);
+        job.added.push_back(le);
+    }
+
+    pool.run(((int)job.added.size() + INDEX_CHUNK - 1) / INDEX_CHUNK, indexTask, &job);
+    return (int)job.added.size();
+}
+
+/* parseTask(int, int, void*);
+
+   ThreadPool task for finishEntries(): parses the responses of one chunk
+   of entries into their fields, and copies the fields' text into the
+   store, in the arena for this thread. userdata points to the FinishJob. */
+
+void Library::parseTask(int task, int thread, void *userdata) {
+    FinishJob *job = (FinishJob*)userdata;
+    Library *library = job->library;
+    ParseThread &t = job->threads[thread];
+    int end = std::min((task + 1) * FINISH_CHUNK, (int)job->entries->size());
+
+    for(int i=task*FINISH_CHUNK; i<end; i++) {
+        EntryFields &f = library->pending[(*job->entries)[i]];
+        if(!t.parser.parseAnime(*(*job->bodies)[i], f))
+            continue;
+
+        /* The fields point into the response or the parser, which are only
+           good until the next parse */
+        f.title = library->store.copyText(f.title, thread);
+        f.synopsis = library->store.copyText(f.synopsis, thread);
+        job->genre_starts[i] = (int)t.genres.size();
+        job->parsed_by[i] = thread;
+        for(int g=0; g<f.genre_count; g++) {
+            std::unordered_map<std::string_view, std::string_view>::iterator it = t.genre_copies.find(f.genres[g]);
+            if(it == t.genre_copies.end()) {
+                std::string_view copy = library->store.copyText(f.genres[g], thread);
+                it = t.genre_copies.insert(std::make_pair(copy, copy)).first;
+            }
+            t.genres.push_back(it->second);
+        }
+    }
+}
+
+/* indexTask(int, int, void*);
+
+   ThreadPool task for finishEntries(): adds the rows of one chunk of the
+   added entries to the index. userdata points to the FinishJob. */
+
+void Library::indexTask(int task, int thread, void *userdata) {
+    FinishJob *job = (FinishJob*)userdata;
+    int end = std::min((task + 1) * INDEX_CHUNK, (int)job->added.size());
+    for(int i=task*INDEX_CHUNK; i<end; i++)
+        job->library->index.insert(job->added[i]);
+}
+
+/* void endLoad(bool, bool);
+
+   Last stage of loading or refreshing: after a full load, sorts the status
+   indexes, now that every entry has been added (a refresh keeps them up to
+   date as it goes), and builds the title search index after a full load or
+   a refresh that changed the entries. If failed, marks the
+   library as failed by setting its size to -1. If cancelled, the entries
+   that were never finished are dropped, and the size is the number of
+   entries that were.
+
+   ex. library->endLoad(false);
+
+   Pre-conditions: This function is private and should only be called by
+   LibraryLoader, after every entry has been finished (or the load was
+   cancelled).
+
+   Post-conditions: the library is ready to use. */
+
+void Library::endLoad(bool failed, bool cancelled) {
+    ReadWriteLock::Writer guard(lock);
+    if(loading) {
+        sortStatusIndexes();
+        for(int s=0; s<=UNDEFINED; s++)
+            std::vector<LibraryEntry*>().swap(partial_sorted[s]);
+    }
+    if(loading || titles_stale) {
+        title_search.build(&store);
+        titles_stale = false;
     }
+    pending.clear();
+    loading = false;
+    if(cancelled)
+        library_size = store.size() - store.getRemovedCount();
 
-	return rc;
+    /* To indicate that the user's library could not be gotten.
+       the library size is set to -1. */
+    if(failed)
+        library_size = -1;
+
+    if(options.versioned)
+        publish();
+}
+
+/* void publish();
+
+   Publishes the library as it is now as a new LibraryVersion, which
+   LibraryVersion::Readers made from now on read instead of the last one.
+   The last one is freed once the Readers already reading it are done (see
+   Epoch.h). Called at the end of every load and refresh when
+   options.versioned is set; call it to publish a library without it.
+   Copies the whole library each time (see LibraryVersion.h).
+
+   ex. library->publish();
+
+   Pre-conditions: the library isn't loading, and isn't being written to
+   on another thread (publish from the thread that refreshes it).
+
+   Post-conditions: LibraryVersion::Reader(library) gets the new version. */
+
+void Library::publish() {
+    LibraryVersion *v = new LibraryVersion(this, ++versions);
+    LibraryVersion *old = version.exchange(v);
+    if(old != NULL)
+        Epoch::retire(old, LibraryVersion::destroy);
 }
 
 /* void addEntry(LibraryEntry);
 
-   Takes a LibraryEntry object and packs it in a LibraryEntryWrapper struct,
-   and puts that struct into the hash table at the index given by the hash
-   function of the LibraryEntry's title.
+   Adds a LibraryEntry from the library's store to the index, so it can be
+   found by its title and by its anime id, and to the status index
+   for its library status. While the library is loading, entries are just
+   appended to the status index and sorted all at once at the end, otherwise
+   they are inserted in title order with a binary search.
 
    ex. addEntry(le);
 
-   Pre-conditions: Library constructor must have initialized the hash table.
-   This function is private and should only be called from getLibrary().
+   Pre-conditions: This function is private and should only be called while
+   loading or refreshing the library.
 
-   Post-conditions: a LibraryEntry has been stored in the hash table. */
+   Post-conditions: a LibraryEntry has been stored in the library. */
 
 void Library::addEntry(LibraryEntry *le) {
+    index.insert(le);
+    addToStatusIndex(le);
+}
 
-    /* Create a new LibraryEntryWrapper and put le into it */
-    LibraryEntryWrapper *wrapper = new LibraryEntryWrapper();
-    wrapper->entry = le;
+/* Adds le to the status index for its library status (see addEntry()) */
+void Library::addToStatusIndex(LibraryEntry *le) {
+    std::vector<LibraryEntry*> &v = status_index[le->getLibraryStatus()];
+    if(loading)
+        v.push_back(le);
+    else
+        v.insert(std::upper_bound(v.begin(), v.end(), le, libraryEntryTitleSort), le);
+}
 
-    /* Temporary wrapper for traversing chains in the hash table */
-    LibraryEntryWrapper *y = NULL;
+/* void removeEntry(LibraryEntry*);
 
-    /* Get the hash table index from hashSum */
-    int h = hashSum(le->getTitle());
+   Removes a LibraryEntry from the index, its status index and the store,
+   when the user has taken it out of their library. The entry itself stays
+   in memory, as removed, so pointers to it stay valid.
 
-    /* Get the LibraryEntryWrapper at the index */
-    y = &hashTable[h];
+   ex. removeEntry(le);
 
-    /* Put the wrapper into the first empty spot at the index */
-    if(y->entry == NULL) {
-        hashTable[h] = *wrapper;
-        delete wrapper;
-    } else {
-        while(y->next != NULL) {
-            y = y->next;
-        }
-        y->next = wrapper;
-        wrapper->previous = y;
-    }
+   Pre-conditions: This function is private and should only be called while
+   refreshing the library.
+
+   Post-conditions: le is no longer returned by any of the getters. */
+
+void Library::removeEntry(LibraryEntry *le) {
+    index.remove(le);
+    removeFromStatusIndex(le, le->getLibraryStatus());
+    store.remove(le->getRow());
 }
 
-/* int hashSum(string)
+/* Takes le out of the status index for ls, which is sorted by title */
+void Library::removeFromStatusIndex(LibraryEntry *le, library_status ls) {
+    std::vector<LibraryEntry*> &v = status_index[ls];
+    std::vector<LibraryEntry*>::iterator it = std::lower_bound(v.begin(), v.end(), le, libraryEntryTitleSort);
+    while(it != v.end() && *it != le)
+        it++;
+    if(it != v.end())
+        v.erase(it);
+}
 
-   Returns the hash value of the string using the simple hash sum algorithm.
+/* void sortStatusIndexes();
 
-   ex. int h = hashSum("Howl's Moving Castle");
+   Sorts every status index alphabetically by title. Entries with the same
+   title stay in the order they were added.
 
-   Pre-conditions: string must be a valid string.
+   ex. sortStatusIndexes();
 
-   Post-conditions: none. */
+   Pre-conditions: This function is private and should only be called at the
+   end of loading the library.
 
-int Library::hashSum(std::string title) {
-    int sum = 0;
-    for (unsigned i = 0; i < title.size(); i++)
-        sum += title[i];  /* ascii value of ith character in the string */
-    sum = sum % hash_size;
-    return sum;
+   Post-conditions: getLibraryEntries() returns entries in title order. */
+
+void Library::sortStatusIndexes() {
+    for(int i=0; i<=UNDEFINED; i++)
+        std::stable_sort(status_index[i].begin(), status_index[i].end(), libraryEntryTitleSort);
 }
 
 /*  int getLibrarySize();
 
     Public method. Returns the number of items in the anime library.
-    Should be the same as the number of entries in the hash table,
-    unless getLibrary() failed, in which case it should be -1.
+    Should be the same as the number of entries in the index,
+    unless the download failed, in which case it should be -1.
 
     ex. int x = L->getLibrarySize();
 
@@ -481,10 +678,52 @@ int Library::hashSum(std::string title) {
     Post-conditions: none. This is just a getter for the library size. */
 
 int Library::getLibrarySize() {
+    ReadWriteLock::Reader guard(lock);
     return library_size;
 }
 
-/* LibraryEntry* getLibraryEntry(string);
+/*  LoadTimings getLoadTimings();
+
+    Public method. Returns how long each stage of downloading and parsing
+    the library took, in seconds. Useful for finding which stage is the
+    bottleneck: in pipelined mode, network_wait + parse should add up to
+    about metadata_fetch, and whichever is bigger is the limiting stage.
+
+    ex. LoadTimings t = L->getLoadTimings();
+
+    Pre-conditions: Library object has been created by the constructor.
+
+    Post-conditions: none. This is just a getter. */
+
+LoadTimings Library::getLoadTimings() {
+    ReadWriteLock::Reader guard(lock);
+    return timings;
+}
+
+/*  LoadMetrics metrics();
+
+    Public method. Returns everything measured during the library's most
+    recent load or refresh: request, failure, retry, byte and connection
+    counters, latency histograms of each step of the transfers (DNS,
+    connect, TLS, time to first byte, total) and the time each stage took.
+    When the library was loaded along with others by a LibraryLoader, the
+    counters and histograms cover every transfer of that load, since the
+    users shared them. Use toJson() to export them.
+
+    ex. std::string json = L->metrics().toJson();
+
+    Pre-conditions: Library object has been created by the constructor.
+
+    Post-conditions: none. This is just a getter. */
+
+LoadMetrics Library::metrics() {
+    ReadWriteLock::Reader guard(lock);
+    LoadMetrics m = load_metrics;
+    m.phases = timings;
+    return m;
+}
+
+/* LibraryEntry* getLibraryEntry(string_view);
 
    Public method. Returns the LibraryEntry associated with the given
    title string, or NULL if it isn't found.
@@ -495,25 +734,25 @@ int Library::getLibrarySize() {
 
    Post-conditions: none. This is just a getter. */
 
-LibraryEntry* Library::getLibraryEntry(std::string title) {
-    LibraryEntryWrapper *x;
-    int h = hashSum(title);
-    bool found = false;
+LibraryEntry* Library::getLibraryEntry(std::string_view title) {
+    ReadWriteLock::Reader guard(lock);
+    return index.find(title);
+}
 
-    x = &hashTable[h];
+/* LibraryEntry* getLibraryEntryById(int);
 
-    while(found == false && x->entry != NULL) {
-        if(x->entry->getTitle().compare(title) == 0) {
-            found = true;
-        } else {
-            x = x->next;
-        }
-    }
+   Public method. Returns the LibraryEntry for the anime with the given
+   Hummingbird id, or NULL if it isn't in the library.
 
-    if(found == true)
-        return x->entry;
-    else
-        return NULL;
+   ex. LibraryEntry *le = getLibraryEntryById(6);
+
+   Pre-conditions: Library object has been constructed by constructor.
+
+   Post-conditions: none. This is just a getter. */
+
+LibraryEntry* Library::getLibraryEntryById(int id) {
+    ReadWriteLock::Reader guard(lock);
+    return index.findById(id);
 }
 
 /* bool libraryEntryTitleSort(LibraryEntry*, LibraryEntry*);
@@ -527,22 +766,19 @@ LibraryEntry* Library::getLibraryEntry(std::string title) {
    Post-conditions: none. */
 
 bool Library::libraryEntryTitleSort(LibraryEntry* i, LibraryEntry* j) {
-
-    bool goesBefore;
-
-    if(i->getTitle().compare(j->getTitle()) < 0)
-        goesBefore = true;
-    else
-        goesBefore = false;
-
-    return goesBefore;
+    return i->getTitle().compare(j->getTitle()) < 0;
 }
 
 /* vector<LibraryEntry*> getLibraryEntries(library_status);
 
    Returns a vector of LibraryEntry pointers sorted alphabetically by title
    corresponding to what the show's status is in the user's library, as
-   defined by the enum library_status in LibraryEntry.h
+   defined by the enum library_status in LibraryEntry.h. The entries are
+   kept sorted by status as they are added, so this is just a copy of the
+   pointers: no searching, sorting or string copying. While the library is
+   loading in the background (see LibraryLoad.h), the entries that have
+   been added since the last call are sorted and merged into the ones
+   sorted before, so polling it costs a copy and a merge, not a sort.
 
    ex. lev = getLibraryEntries(CURRRENTLY_WATCHING);
 
@@ -551,22 +787,86 @@ bool Library::libraryEntryTitleSort(LibraryEntry* i, LibraryEntry* j) {
    Post-conditions: none, this is just a getter. */
 
 std::vector<LibraryEntry*> Library::getLibraryEntries(library_status ls) {
+    if(ls < 0 || ls > UNDEFINED)
+        return std::vector<LibraryEntry*>();
+    ReadWriteLock::Reader guard(lock);
+    if(!loading)
+        return status_index[ls];
+
+    /* Only the entries added since the last call need sorting; they're
+       merged in after any with the same title, as a stable sort would */
+    std::lock_guard<std::mutex> partial(partial_lock);
+    std::vector<LibraryEntry*> &sorted = partial_sorted[ls];
+    size_t done = sorted.size();
+    if(done < status_index[ls].size()) {
+        sorted.insert(sorted.end(), status_index[ls].begin() + done, status_index[ls].end());
+        std::stable_sort(sorted.begin() + done, sorted.end(), libraryEntryTitleSort);
+        std::inplace_merge(sorted.begin(), sorted.begin() + done, sorted.end(), libraryEntryTitleSort);
+    }
+    return sorted;
+}
 
-    std::vector<LibraryEntry*> libraryEntries;
+/* vector<LibraryEntry*> query(const LibraryQuery&);
 
-    for(int i=0; i<hash_size; i++) {
-        if(hashTable[i].entry != NULL) {
-            LibraryEntryWrapper *x = &hashTable[i];
-            while(x != NULL) {
-                if(x->entry->getLibraryStatus() == ls) {
-                    libraryEntries.push_back(x->entry);
-                }
-                x = x->next;
-            }
-        }
-    }
+   Returns every LibraryEntry that matches all of the predicates in a
+   LibraryQuery (see LibraryQuery.h), in the order they were loaded. The
+   predicates are evaluated over the library's columns all at once, using
+   SIMD instructions where the CPU has them.
+
+   ex. LibraryQuery q;
+       q.status = COMPLETED;
+       q.genres.push_back("Action");
+       q.min_community_rating = 4.0;
+       lev = L->query(q);
 
-    std::sort(libraryEntries.begin(), libraryEntries.end(), libraryEntryTitleSort);
+   Pre-conditions: Library object must have been created by constructor.
+
+   Post-conditions: none, this is just a getter. */
+
+std::vector<LibraryEntry*> Library::query(const LibraryQuery &q) {
+    ReadWriteLock::Reader guard(lock);
+    ReadWriteLock::Reader store_guard(store.getLock());
+    std::vector<int> rows;
+    store.select(q, rows);
+
+    std::vector<LibraryEntry*> libraryEntries(rows.size());
+    for(unsigned i=0; i<rows.size(); i++)
+        libraryEntries[i] = store.getEntry(rows[i]);
     return libraryEntries;
+}
+
+/* vector<LibraryEntry*> completeTitle(string_view, int);
+
+   Returns up to limit entries whose titles start with prefix, ignoring case
+   and punctuation, in alphabetical order.
+
+   ex. lev = L->completeTitle("fullmetal");
+
+   Pre-conditions: Library object must have been created by constructor.
+
+   Post-conditions: none, this is just a getter. */
+
+std::vector<LibraryEntry*> Library::completeTitle(std::string_view prefix, int limit) {
+    ReadWriteLock::Reader guard(lock);
+    return title_search.complete(prefix, limit);
+}
+
+/* vector<TitleMatch> searchTitles(string_view, int);
+
+   Returns up to limit entries whose titles are closest to query, allowing
+   for typos as well as differences in case and punctuation, best match
+   first. A match with distance 0 is the same title apart from case and
+   punctuation. See TitleSearch.h.
+
+   ex. vector<TitleMatch> v = L->searchTitles("cowboy bepop");
+       if(!v.empty() && v[0].distance == 0)
+           le = v[0].entry;
+
+   Pre-conditions: Library object must have been created by constructor.
+
+   Post-conditions: none, this is just a getter. */
 
+std::vector<TitleMatch> Library::searchTitles(std::string_view query, int limit) {
+    ReadWriteLock::Reader guard(lock);
+    return title_search.search(query, limit);
 }
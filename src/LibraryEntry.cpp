@@ -1,81 +1,153 @@
 #include "LibraryEntry.h"
+#include "LibraryStore.h"
+#include <cmath>
+#include <cstdio>
 
-/* LibraryEntry* = new LibraryEntry(json_object);
+/* LibraryEntry(LibraryStore*, int);
 
-   Constructor for the LibraryEntry class. Defines all of the private members
-   by parsing the final json_object created by the Library class.
+   Constructor for the LibraryEntry class. A LibraryEntry is just a handle
+   to a row of a LibraryStore; all of its data lives in the store's columns.
 
-   ex. LibraryEntry *le = new LibraryEntry(json_object_final);
+   ex. if(parser.parseAnime(body, fields))
+           le = store.add(fields);
 
-   Pre-conditions: final json object created by getLibrary(). This constructor
-   should really only be called from within getLibrary().
+   Pre-conditions: row is a row of store. This constructor should really only
+   be called from within LibraryStore::add().
 
-   Post-conditions: returns a fully constructed LibraryEntry. */
+   Post-conditions: returns a handle to the row. */
 
-LibraryEntry::LibraryEntry(json_object *j)
+LibraryEntry::LibraryEntry(LibraryStore *store, int row)
 {
-    json_object *title_json;
-    json_object_object_get_ex(j, "title", &title_json);
-    title = std::string(json_object_get_string(title_json));
-
-    json_object *synopsis_json;
-    json_object_object_get_ex(j, "synopsis", &synopsis_json);
-    synopsis = std::string(json_object_get_string(synopsis_json));
-
-    json_object *airing_status_json;
-    json_object_object_get_ex(j, "airing_status", &airing_status_json);
-    airingStatus = std::string(json_object_get_string(airing_status_json));
-
-    json_object *episode_count_json;
-    json_object_object_get_ex(j, "episode_count", &episode_count_json);
-    episodeCount = std::string(json_object_to_json_string(episode_count_json));
-
-    json_object *episodes_watched_json;
-    json_object_object_get_ex(j, "episodes_watched", &episodes_watched_json);
-    episodesWatched = std::string(json_object_to_json_string(episodes_watched_json));
-
-    json_object *library_status_json;
-    json_object_object_get_ex(j, "library_status", &library_status_json);
-    std::string libraryStatusString = std::string(json_object_get_string(library_status_json));
-
-    if(libraryStatusString.compare("currently-watching") == 0)
-        libraryStatus = CURRENTLY_WATCHING;
-    else if(libraryStatusString.compare("plan-to-watch") == 0)
-        libraryStatus = PLAN_TO_WATCH;
-    else if(libraryStatusString.compare("completed") == 0)
-        libraryStatus = COMPLETED;
-    else if(libraryStatusString.compare("on-hold") == 0)
-        libraryStatus = ON_HOLD;
-    else if(libraryStatusString.compare("dropped") == 0)
-        libraryStatus = DROPPED;
-    else /* Undefined, this shouldn't happen (means anime isn't in the user's library) */
-        libraryStatus = UNDEFINED;
-
-    json_object *rating_json;
-    json_object_object_get_ex(j, "rating", &rating_json);
-    rating = std::string(json_object_to_json_string(rating_json));
-
-    json_object *community_rating_json;
-    json_object_object_get_ex(j, "community_rating", &community_rating_json);
-    communityRating = json_object_get_double(community_rating_json);
-
-    json_object *type_json;
-    json_object_object_get_ex(j, "show_type", &type_json);
-    type = std::string(json_object_get_string(type_json));
-
-    json_object *genres_json;
-    json_object_object_get_ex(j, "genres", &genres_json);
-    genres.assign(json_object_array_length(genres_json),"");
-    for(int i=0; i<json_object_array_length(genres_json); i++) {
-        json_object *genre_json = json_object_array_get_idx(genres_json, i);
-        json_object *genre_name_json;
-        json_object_object_get_ex(genre_json, "name", &genre_name_json);
-        genres[i] = std::string(json_object_get_string(genre_name_json));
-    }
-}
-
-/* Destructor: nothing to do */
+    this->store = store;
+    this->row = row;
+}
+
+/* Destructor: nothing to do, the store owns the data */
 LibraryEntry::~LibraryEntry()
 {
     //dtor
 }
+
+/* Formats a number that the API may send as null */
+static std::string numberOrNull(int n) {
+    if(n < 0)
+        return "null";
+    char s[16];
+    snprintf(s, sizeof(s), "%d", n);
+    return std::string(s);
+}
+
+int LibraryEntry::getId() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->ids[row];
+}
+
+std::string_view LibraryEntry::getTitle() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->titles[row];
+}
+
+std::string_view LibraryEntry::getSynopsis() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->synopses[row];
+}
+
+std::string_view LibraryEntry::getAiringStatus() {
+    return LibraryStore::airingStatusName(getAiringStatusCode());
+}
+
+std::string LibraryEntry::getEpisodeCount() {
+    ReadWriteLock::Reader guard(store->lock);
+    return numberOrNull(store->episode_counts[row]);
+}
+
+std::string_view LibraryEntry::getType() {
+    return LibraryStore::showTypeName(getShowType());
+}
+
+library_status LibraryEntry::getLibraryStatus() {
+    ReadWriteLock::Reader guard(store->lock);
+    return (library_status)store->library_statuses[row];
+}
+
+std::string LibraryEntry::getEpisodesWatched() {
+    ReadWriteLock::Reader guard(store->lock);
+    return numberOrNull(store->episodes_watched[row]);
+}
+
+/* Ratings are in half stars, so one decimal place is exact */
+std::string LibraryEntry::getRating() {
+    ReadWriteLock::Reader guard(store->lock);
+    float rating = store->ratings[row];
+    if(std::isnan(rating))
+        return "null";
+    char s[16];
+    snprintf(s, sizeof(s), "%.1f", rating);
+    return std::string(s);
+}
+
+double LibraryEntry::getCommunityRating() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->community_ratings[row];
+}
+
+/* Returns the entry's genre names in a new vector; see getGenreCount() and
+   getGenre() to go through them without allocating */
+std::vector<std::string_view> LibraryEntry::getGenres() {
+    ReadWriteLock::Reader guard(store->lock);
+    uint32_t begin = store->genre_offsets[row];
+    std::vector<std::string_view> genres(store->genre_offsets[row + 1] - begin);
+    for(unsigned i=0; i<genres.size(); i++)
+        genres[i] = store->genre_names[store->genre_ids[begin + i]];
+    return genres;
+}
+
+int LibraryEntry::getGenreCount() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->genre_offsets[row + 1] - store->genre_offsets[row];
+}
+
+/* Name of the i-th genre, 0 <= i < getGenreCount() */
+std::string_view LibraryEntry::getGenre(int i) {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->genre_names[store->genre_ids[store->genre_offsets[row] + i]];
+}
+
+airing_status LibraryEntry::getAiringStatusCode() {
+    ReadWriteLock::Reader guard(store->lock);
+    return (airing_status)store->airing_statuses[row];
+}
+
+show_type LibraryEntry::getShowType() {
+    ReadWriteLock::Reader guard(store->lock);
+    return (show_type)store->show_types[row];
+}
+
+/* -1 if unknown */
+int LibraryEntry::getEpisodeCountValue() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->episode_counts[row];
+}
+
+/* -1 if unknown */
+int LibraryEntry::getEpisodesWatchedValue() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->episodes_watched[row];
+}
+
+/* NaN if the user hasn't rated the show */
+double LibraryEntry::getRatingValue() {
+    ReadWriteLock::Reader guard(store->lock);
+    return store->ratings[row];
+}
+
+/* Sets count to the number of genres and returns a pointer to their ids,
+   which can be turned into names with LibraryStore::getGenreName(). The
+   ids may move while the library is loading in the background (see
+   LibraryLoad.h); use getGenre() or getGenres() then. */
+const uint16_t* LibraryEntry::getGenreIds(int &count) {
+    ReadWriteLock::Reader guard(store->lock);
+    uint32_t begin = store->genre_offsets[row];
+    count = store->genre_offsets[row + 1] - begin;
+    return count == 0 ? NULL : &store->genre_ids[begin];
+}
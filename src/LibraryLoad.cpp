@@ -0,0 +1,128 @@
+#include "LibraryLoad.h"
+#include "LibraryLoader.h"
+
+/* LibraryLoad load(string, LibraryOptions);
+
+   Constructor for the LibraryLoad class. Creates an empty library for the
+   user and starts downloading it on a new thread, so it returns straight
+   away.
+
+   ex. LibraryLoad load("Josh");
+
+       LibraryOptions options;
+       options.cache = &cache;
+       options.progress = showProgress;
+       LibraryLoad load("Josh", options);
+
+   Pre-conditions: the same as the Library constructor's. If options.cache
+   or options.connections is set, it must outlive the load and not be used
+   by anything else until it's finished.
+
+   Post-conditions: getLibrary() is the library being loaded, which has a
+   size of 0 until its list has arrived. */
+
+LibraryLoad::LibraryLoad(std::string username, LibraryOptions options)
+{
+    progress = options.progress;
+    progress_userdata = options.progress_userdata;
+    this->options = options;
+    this->options.progress = onProgress;
+    this->options.progress_userdata = this;
+    loader = NULL;
+    cancelled = false;
+    finished = false;
+    done = 0;
+    total = 0;
+    future = promise.get_future().share();
+
+    /* Opposite of curl_global_cleanup(); here rather than on the loading
+       thread, where it could race with another thread's */
+    curl_global_init(CURL_GLOBAL_SSL);
+
+    /* The library keeps the caller's options, for refresh() */
+    library = new Library(options);
+    library->username = username;
+    library->setConcurrent(true);
+    thread = std::thread(&LibraryLoad::run, this);
+}
+
+/* Destructor: cancels the load if it's still going and waits for its
+   thread. The library is not freed; it belongs to the caller. */
+LibraryLoad::~LibraryLoad()
+{
+    if(!finished)
+        cancel();
+    if(thread.joinable())
+        thread.join();
+
+    /* Opposite of curl_global_init() */
+    curl_global_cleanup();
+}
+
+/* Library* wait();
+
+   Waits for the load to finish (or to stop, if it was cancelled) and
+   returns the library, just as the Library constructor would have left it:
+   its size is -1 if it couldn't be downloaded.
+
+   ex. Library *L = load.wait();
+
+   Pre-conditions: none.
+
+   Post-conditions: isFinished() is true. */
+
+Library* LibraryLoad::wait() {
+    return future.get();
+}
+
+/* void cancel();
+
+   Stops the load as soon as it can (see LibraryLoader::cancel()): wait()
+   then returns the library with the entries finished so far. Does nothing
+   if the load is already over.
+
+   ex. load.cancel();
+
+   Pre-conditions: none; may be called from any thread.
+
+   Post-conditions: isCancelled() is true. */
+
+void LibraryLoad::cancel() {
+    std::lock_guard<std::mutex> guard(cancel_lock);
+    cancelled = true;
+    if(loader != NULL)
+        loader->cancel();
+}
+
+/* Loads the library; runs on the load's thread */
+void LibraryLoad::run() {
+    {
+        LibraryLoader l(options);
+        l.addLibrary(library, library->username);
+        {
+            std::lock_guard<std::mutex> guard(cancel_lock);
+            loader = &l;
+            if(cancelled)
+                l.cancel();
+        }
+        l.run();
+        {
+            std::lock_guard<std::mutex> guard(cancel_lock);
+            loader = NULL;
+        }
+    }
+
+    library->setConcurrent(false);
+    finished = true;
+    promise.set_value(library);
+}
+
+/* Keeps the progress for getDone() and getTotal(), and passes it on to the
+   caller's options.progress, if any. userdata points to the LibraryLoad. */
+void LibraryLoad::onProgress(Library *library, int done, int total, void *userdata) {
+    LibraryLoad *load = (LibraryLoad*)userdata;
+    load->total = total;
+    load->done = done;
+    if(load->progress != NULL)
+        load->progress(library, done, total, load->progress_userdata);
+}
@@ -0,0 +1,556 @@
+#include "LibraryLoader.h"
+#include <cstdio>
+
+typedef std::chrono::steady_clock Clock;
+
+/* Fewest entries worth starting parse threads for */
+#define PARALLEL_FINISH_MIN 256
+
+/* Most entries finishAll() adds at once, so the progress callback hears
+   about them, and a library being read while it loads is locked, a bit at
+   a time */
+#define FINISH_BATCH 4096
+
+/* Seconds elapsed since start */
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/* Percent-encodes everything in a username but letters, digits and - _ ~,
+   so whatever the name (even "..") it stays one segment of the path */
+static std::string escapeUsername(const std::string &username) {
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string escaped;
+    for(unsigned i=0; i<username.size(); i++) {
+        unsigned char c = username[i];
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '_' || c == '~') {
+            escaped += (char)c;
+        } else {
+            escaped += '%';
+            escaped += HEX[c >> 4];
+            escaped += HEX[c & 15];
+        }
+    }
+    return escaped;
+}
+
+/* LibraryLoader loader(LibraryOptions);
+
+   Constructor for the LibraryLoader class. Initializes curl globally in
+   preparation for the downloads. options applies to every library loaded;
+   with options.memory_budget set, the load is always pipelined.
+
+   ex. LibraryOptions options;
+       options.cache = &cache;
+       LibraryLoader loader(options);
+
+   Pre-conditions: if options.cache is set, it must outlive the loader.
+
+   Post-conditions: a loader with no users, ready for addUser(). */
+
+LibraryLoader::LibraryLoader(LibraryOptions options)
+{
+    this->options = options;
+    streaming = options.memory_budget > 0;
+    if(streaming)
+        this->options.pipelined = true;
+    buffers.setBudget(options.memory_budget);
+    scheduler = NULL;
+    cancelled = false;
+    parse_pool = NULL;
+    requests = 0;
+    parse_time = 0;
+
+    /* Opposite of curl_global_cleanup() */
+    curl_global_init(CURL_GLOBAL_SSL);
+}
+
+/* Destructor for the LibraryLoader class. Stops the parse threads, if
+   any, and cleans up curl globally. The libraries returned by load() are
+   not freed; they belong to the caller. */
+LibraryLoader::~LibraryLoader()
+{
+    delete parse_pool;
+
+    /* Opposite of curl_global_init() */
+    curl_global_cleanup();
+}
+
+/* void addUser(string);
+
+   Adds a user whose library will be downloaded by load().
+
+   ex. loader.addUser("Josh");
+
+   Pre-conditions: username is the name of a user on Hummingbird.me.
+
+   Post-conditions: load() returns one more library. */
+
+void LibraryLoader::addUser(std::string username) {
+    addLibrary(NULL, username);
+}
+
+/* void addLibrary(Library*, string);
+
+   Adds a user whose library will be downloaded into library, or into a new
+   Library if library is NULL. Used by the Library constructor to load
+   itself. */
+
+void LibraryLoader::addLibrary(Library *library, std::string username) {
+    User u;
+    u.username = username;
+    u.library = library;
+    u.refresh = false;
+    u.failed = false;
+    u.done = 0;
+    u.list_time = 0;
+    u.parse_time = 0;
+    users.push_back(u);
+}
+
+/* void addRefresh(Library*);
+
+   Adds a library to bring up to date with its user's library on
+   Hummingbird.me: only its library list and the metadata of anime new to it
+   are downloaded (see Library::refresh()). The library is returned by
+   load() like any other.
+
+   ex. loader.addRefresh(library);
+
+   Pre-conditions: library was created by the Library constructor or by a
+   LibraryLoader, and isn't used by anything else until load() returns.
+
+   Post-conditions: load() returns one more library. */
+
+void LibraryLoader::addRefresh(Library *library) {
+    addLibrary(library, library->username);
+    users.back().refresh = true;
+}
+
+/* vector<Library*> load();
+
+   Downloads the library of every user added with addUser(), and returns the
+   libraries in the same order. A library that couldn't be downloaded has a
+   size of -1, just like one from the Library constructor.
+
+   ex. std::vector<Library*> libraries = loader.load();
+
+   Pre-conditions: should only be called once per loader.
+
+   Post-conditions: the libraries belong to the caller, who must delete
+   them. */
+
+std::vector<Library*> LibraryLoader::load() {
+    run();
+    std::vector<Library*> libraries(users.size());
+    for(unsigned u=0; u<users.size(); u++)
+        libraries[u] = users[u].library;
+    return libraries;
+}
+
+/* void cancel();
+
+   Stops a load that is going on in another thread: no more downloads are
+   started, the ones in flight are abandoned, and no more entries are
+   finished. run() then ends each library with the entries it has so far
+   (see Library::endLoad()). Can be called before run() too.
+
+   ex. loader.cancel();
+
+   Pre-conditions: none; may be called from any thread.
+
+   Post-conditions: isCancelled() is true, and run() returns soon. */
+
+void LibraryLoader::cancel() {
+    std::lock_guard<std::mutex> guard(cancel_lock);
+    cancelled = true;
+    if(scheduler != NULL)
+        scheduler->cancel();
+}
+
+/* int run();
+
+   Downloads every user's library: queues the download of each user's
+   library list on one TransferScheduler, and, as each list arrives (see
+   listDone()), queues the download of every anime in it that isn't already
+   downloaded, queued or in options.cache. Everything runs through cURL's
+   multi interface, so all of the users' transfers share one window and one
+   pool of connections. How many transfers are in flight adapts to how
+   fast the API responds, and transfers that time out or are turned away
+   are retried (see the options). With options.pipelined each anime is
+   parsed into every entry waiting for it as soon as its download finishes,
+   so parsing overlaps with waiting for the network; otherwise everything
+   is parsed after the downloads, on the parse threads (see finishAll()).
+   Newly downloaded metadata is added to the cache, the time spent in each
+   stage is kept in each library's timings, and the timings of every
+   transfer are added up in metrics. When streaming, the anime downloads use
+   buffers from the BufferPool, so the budget limits how many are in flight,
+   and any anime that has to be downloaded again after its response was let
+   go of (see requeue()) is, once the rest are done.
+
+   Pre-conditions: This function is private and should only be called by
+   load() or the Library constructor!
+
+   Post-conditions: every library is fully constructed; see post-conditions
+   of the Library constructor. Returns the number of users whose library
+   couldn't be downloaded. */
+
+int LibraryLoader::run() {
+    run_start = Clock::now();
+    parse_time = 0;
+
+    for(unsigned u=0; u<users.size(); u++) {
+        if(users[u].library == NULL) {
+            users[u].library = new Library(options);
+            users[u].library->username = users[u].username;
+        }
+    }
+
+    /* Download every user's list; the callback queues up the rest */
+    TransferScheduler transfers(options.max_concurrency);
+    if(options.adaptive_concurrency)
+        transfers.setAdaptive(1, options.max_concurrency);
+    transfers.setTimeout(options.timeout_ms);
+    transfers.setRetries(options.max_retries);
+    transfers.setMetrics(&metrics);
+    transfers.setConnectionPool(options.connections != NULL ? options.connections : &pool);
+    if(streaming)
+        transfers.setBufferPool(&buffers);
+    {
+        std::lock_guard<std::mutex> guard(cancel_lock);
+        scheduler = &transfers;
+        if(cancelled)
+            transfers.cancel();
+    }
+    for(unsigned u=0; u<users.size(); u++) {
+        Target t;
+        t.is_list = true;
+        t.index = u;
+        targets.push_back(t);
+        transfers.add(options.base_url + "/users/" + escapeUsername(users[u].username) + "/library", &users[u].list_buffer);
+        requests++;
+    }
+    transfers.setCallback(onTransferDone, this);
+    transfers.run();
+
+    metrics.concurrency = transfers.getWindow();
+    for(unsigned a=0; a<anime.size(); a++)
+        metrics.cache_hits += anime[a].cached;
+    double downloads = secondsSince(run_start);
+    double parse_during_downloads = parse_time;
+
+    /* Parse whatever hasn't been parsed yet: everything when not pipelining,
+       otherwise just the cached responses we didn't get to */
+    int queued = transfers.getTransferCount();
+    std::vector<std::vector<int> > left(users.size());
+    if(options.pipelined) {
+        for(unsigned i=0; i<ready.size(); i++)
+            left[ready[i].user].push_back(ready[i].entry);
+        ready.clear();
+    } else {
+        for(unsigned u=0; u<users.size(); u++) {
+            for(unsigned i=0; i<users[u].anime.size(); i++)
+                left[u].push_back(i);
+        }
+    }
+    for(unsigned u=0; u<users.size() && !cancelled; u++) {
+        if(!left[u].empty())
+            finishAll(u, left[u]);
+    }
+
+
+    /* When streaming, anime whose cached response had gone by the time it
+       was needed are queued to download again (see requeue()), and their
+       entries are finished as they arrive */
+    if(transfers.getTransferCount() > queued && !cancelled)
+        transfers.run();
+    {
+        std::lock_guard<std::mutex> guard(cancel_lock);
+        scheduler = NULL;
+    }
+    metrics.buffer_peak = buffers.getPeakBytes();
+
+    /* Remember the metadata we just downloaded for next time (only what
+       finished downloading, a cancelled load leaves some half way) */
+    if(options.cache != NULL) {
+        for(unsigned a=0; a<anime.size(); a++) {
+            if(!anime[a].cached && anime[a].ready && anime[a].result == CURLE_OK && !anime[a].body.empty())
+                options.cache->put(anime[a].id, anime[a].body);
+        }
+    }
+
+    int failed = 0;
+    for(unsigned u=0; u<users.size(); u++) {
+        /* A refresh that failed leaves the library as it was */
+        Clock::time_point start = Clock::now();
+        users[u].library->endLoad(users[u].failed && !users[u].refresh, cancelled);
+        double index_build = secondsSince(start);
+        failed += users[u].failed;
+
+        ReadWriteLock::Writer guard(users[u].library->lock);
+        LoadTimings &t = users[u].library->timings;
+        t = LoadTimings();
+        t.library_fetch = users[u].list_time;
+        t.metadata_fetch = users[u].failed ? 0 : downloads - users[u].list_time;
+        t.network_wait = t.metadata_fetch - parse_during_downloads;
+        if(t.network_wait < 0)
+            t.network_wait = 0;
+        t.parse = users[u].parse_time;
+        t.index_build = index_build;
+        t.total = secondsSince(run_start);
+        users[u].library->load_metrics = metrics;
+    }
+    metrics.phases.total = secondsSince(run_start);
+    return failed;
+}
+
+/* void listDone(int, CURLcode);
+
+   Called when a user's library list has been downloaded. Parses it into the
+   user's library (see Library::beginLoad(), or Library::beginRefresh() for a
+   refresh, which leaves only the new entries to finish), and queues a download for each
+   anime in it that no other user has needed yet and that isn't in the
+   cache. With options.pipelined, each entry either waits on its anime's
+   download or, if the metadata is already here, goes in the ready queue.
+   When streaming, cached metadata is only checked for here, and read from
+   the cache once its entry is finished. */
+
+void LibraryLoader::listDone(int user, CURLcode result) {
+    User &u = users[user];
+    u.list_time = secondsSince(run_start);
+
+    std::vector<int> ids;
+    int rc = 1;
+    if(result == CURLE_OK)
+        rc = u.refresh ? u.library->beginRefresh(u.list_buffer, ids) : u.library->beginLoad(u.list_buffer, ids);
+    if(rc != 0) {
+        if(result == CURLE_OK)
+            fprintf(stderr, "Couldn't parse %s's library\n", u.username.c_str());
+        u.failed = true;
+        return;
+    }
+
+    /* Parsed into the library's json, so the text isn't needed any more */
+    std::string().swap(u.list_buffer);
+    u.anime.resize(ids.size());
+    progress(user);
+
+    for(unsigned i=0; i<ids.size(); i++) {
+        int a;
+        std::unordered_map<int, int>::iterator it = anime_lookup.find(ids[i]);
+        if(it != anime_lookup.end()) {
+            a = it->second;
+        } else {
+            a = (int)anime.size();
+            anime_lookup[ids[i]] = a;
+            anime.push_back(Anime());
+            Anime &an = anime.back();
+            an.id = ids[i];
+            an.result = CURLE_OK;
+
+            /* Use the cached metadata instead of downloading it, if we have it */
+            if(streaming)
+                an.cached = options.cache != NULL && options.cache->has(an.id);
+            else
+                an.cached = options.cache != NULL && options.cache->get(an.id, an.body);
+            an.ready = an.cached;
+            if(!an.cached)
+                download(a);
+        }
+        u.anime[i] = a;
+
+        if(options.pipelined) {
+            Waiter w;
+            w.user = user;
+            w.entry = i;
+            if(anime[a].ready)
+                ready.push_back(w);
+            else
+                anime[a].waiters.push_back(w);
+        }
+    }
+}
+
+/* Queues the download of the a'th anime: into its body, or when streaming,
+   into a buffer from the pool */
+void LibraryLoader::download(int a) {
+    Target t;
+    t.is_list = false;
+    t.index = a;
+    targets.push_back(t);
+    scheduler->add(options.base_url + "/anime/" + std::to_string(anime[a].id), streaming ? NULL : &anime[a].body);
+    requests++;
+}
+
+/* Makes an entry wait for its anime to be downloaded again, when streaming
+   and its response is no longer in the cache. Downloads it unless that's
+   already been queued for another entry. */
+void LibraryLoader::requeue(const Waiter &w) {
+    int a = users[w.user].anime[w.entry];
+    if(anime[a].ready) {
+        anime[a].ready = false;
+        anime[a].cached = false;
+        download(a);
+    }
+    anime[a].waiters.push_back(w);
+}
+
+/* Finishes one entry of a user's library with its anime's metadata, body.
+   If the metadata couldn't be downloaded, the entry is left out of the
+   library (a refresh will try it again) */
+void LibraryLoader::finish(int user, int entry, const std::string &body) {
+    Clock::time_point start = Clock::now();
+    Anime &an = anime[users[user].anime[entry]];
+    if(users[user].library->finishEntry(entry, an.result == CURLE_OK ? body : std::string()) != 0)
+        fprintf(stderr, "Left anime %d out of %s's library, its metadata couldn't be downloaded\n",
+            an.id, users[user].username.c_str());
+    users[user].done++;
+    progress(user);
+    double t = secondsSince(start);
+    users[user].parse_time += t;
+    parse_time += t;
+}
+
+/* Tells options.progress, if it's set, how far the user's library has got */
+void LibraryLoader::progress(int user) {
+    if(options.progress != NULL)
+        options.progress(users[user].library, users[user].done, (int)users[user].anime.size(), options.progress_userdata);
+}
+
+/* Finishes an entry from the ready queue, whose anime's metadata is
+   already here: in its body, or when streaming, in the cache */
+void LibraryLoader::finishReady(const Waiter &w) {
+    Anime &an = anime[users[w.user].anime[w.entry]];
+    if(!streaming || an.result != CURLE_OK) {
+        finish(w.user, w.entry, an.body);
+    } else if(options.cache != NULL && options.cache->get(an.id, cache_body)) {
+        finish(w.user, w.entry, cache_body);
+    } else {
+        requeue(w);
+    }
+}
+
+/* void finishAll(int, const vector<int>&);
+
+   Finishes many entries of a user's library at once, like finish() does
+   one, with Library::finishEntries() (see finishBatch()), FINISH_BATCH
+   entries at a time. When streaming, the responses are read from the
+   cache into buffers from the pool, and the batches are also cut short
+   when the pool is used up, so that the budget holds here too. Stops early
+   if the load is cancelled. */
+
+void LibraryLoader::finishAll(int user, const std::vector<int> &entries) {
+    Clock::time_point start = Clock::now();
+    User &u = users[user];
+
+    std::string failed;
+    std::vector<int> batch;
+    std::vector<const std::string*> bodies;
+    std::vector<std::string*> held;
+    unsigned i = 0;
+    while(i < entries.size() && !cancelled) {
+        batch.clear();
+        bodies.clear();
+        for(; i<entries.size() && batch.size() < FINISH_BATCH; i++) {
+            Waiter w;
+            w.user = user;
+            w.entry = entries[i];
+            Anime &an = anime[u.anime[entries[i]]];
+            if(an.result != CURLE_OK) {
+                bodies.push_back(&failed);
+            } else if(!streaming) {
+                bodies.push_back(&an.body);
+            } else {
+                std::string *buffer = buffers.acquire();
+                if(buffer == NULL)
+                    break;
+                if(options.cache == NULL || !options.cache->get(an.id, *buffer)) {
+                    buffers.release(buffer);
+                    requeue(w);
+                    continue;
+                }
+                held.push_back(buffer);
+                bodies.push_back(buffer);
+            }
+            batch.push_back(entries[i]);
+        }
+
+        if(!batch.empty())
+            finishBatch(user, batch, bodies);
+        for(unsigned b=0; b<held.size(); b++)
+            buffers.release(held[b]);
+        held.clear();
+    }
+
+    double t = secondsSince(start);
+    u.parse_time += t;
+    parse_time += t;
+}
+
+/* void finishBatch(int, const vector<int>&, const vector<const string*>&);
+
+   Finishes the given entries of a user's library with Library::finishEntries(),
+   each with the response at the same position in bodies (empty if it
+   couldn't be downloaded): on the parse threads (options.parse_threads of
+   them), which are started the first time there are enough entries to be
+   worth it, or else on this thread. */
+
+void LibraryLoader::finishBatch(int user, const std::vector<int> &entries, const std::vector<const std::string*> &bodies) {
+    User &u = users[user];
+    ThreadPool this_thread(1);
+    ThreadPool *threads = &this_thread;
+    if(entries.size() >= PARALLEL_FINISH_MIN) {
+        if(parse_pool == NULL)
+            parse_pool = new ThreadPool(options.parse_threads);
+        threads = parse_pool;
+    }
+
+    std::vector<int> left_out;
+    u.library->finishEntries(entries, bodies, *threads, left_out);
+    for(unsigned i=0; i<left_out.size(); i++)
+        fprintf(stderr, "Left anime %d out of %s's library, its metadata couldn't be downloaded\n",
+            anime[u.anime[left_out[i]]].id, u.username.c_str());
+    u.done += (int)entries.size();
+    progress(user);
+}
+
+/* onTransferDone(int, CURLcode, void*);
+
+   TransferScheduler callback: handles a finished library list, or in
+   pipelined mode finishes every entry waiting on the anime that just
+   finished downloading, then one entry from the ready queue, if any are
+   left. When streaming, the anime's response is in a buffer from the pool,
+   which is put in the cache here, since it goes back to the pool as soon as
+   this returns. userdata points to the LibraryLoader.
+
+   Pre-conditions: should only be called by TransferScheduler::run()!
+
+   Post-conditions: more transfers may have been queued, or more entries
+   added to the libraries. */
+
+void LibraryLoader::onTransferDone(int index, CURLcode result, void *userdata) {
+    LibraryLoader *loader = (LibraryLoader*)userdata;
+    Target t = loader->targets[index];
+
+    if(t.is_list) {
+        loader->listDone(t.index, result);
+    } else {
+        Anime &an = loader->anime[t.index];
+        an.result = result;
+        an.ready = true;
+        const std::string &body = loader->streaming ? *loader->scheduler->getBuffer(index) : an.body;
+        for(unsigned i=0; i<an.waiters.size(); i++)
+            loader->finish(an.waiters[i].user, an.waiters[i].entry, body);
+        std::vector<Waiter>().swap(an.waiters);
+        if(loader->streaming && loader->options.cache != NULL && result == CURLE_OK && !body.empty())
+            loader->options.cache->put(an.id, body);
+    }
+
+    /* Parse a cached response in between, so they overlap with the network too */
+    if(!loader->ready.empty()) {
+        Waiter w = loader->ready.front();
+        loader->ready.pop_front();
+        loader->finishReady(w);
+    }
+}
@@ -0,0 +1,751 @@
+#include "LibraryStore.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+/* Names of the show types, airing statuses and library statuses, as the
+   API spells them */
+static const char *SHOW_TYPE_NAMES[] = { "TV", "Movie", "OVA", "ONA", "Special", "Music", "Unknown" };
+static const char *AIRING_STATUS_NAMES[] = { "Not Yet Aired", "Currently Airing", "Finished Airing", "Unknown" };
+static const char *LIBRARY_STATUS_NAMES[] = { "currently-watching", "plan-to-watch", "completed", "on-hold", "dropped", "" };
+
+/* LibraryStore store;
+
+   Constructor for the LibraryStore class. Creates an empty store. */
+
+LibraryStore::LibraryStore()
+{
+    genre_offsets.push_back(0);
+    removed_count = 0;
+}
+
+/* Destructor: nothing to do, the columns and the arenas clean up after
+   themselves */
+LibraryStore::~LibraryStore()
+{
+    //dtor
+}
+
+/* Returns the string value of j, or an empty view if j is null (or
+   missing) */
+static std::string_view stringOrEmpty(json_object *j) {
+    if(j == NULL)
+        return std::string_view();
+    return std::string_view(json_object_get_string(j), json_object_get_string_len(j));
+}
+
+/* Returns the integer value of j, or -1 if j is null (or missing) */
+static int intOrUnknown(json_object *j) {
+    return j == NULL ? -1 : json_object_get_int(j);
+}
+
+/* Reads the fields of a user's library entry (library status, episodes
+   watched, rating and anime id) from a final json_object */
+static void entryFieldsFromJson(json_object *j, EntryFields &f) {
+    json_object *id_json = NULL;
+    json_object_object_get_ex(j, "anime_id", &id_json);
+    f.id = id_json == NULL ? 0 : json_object_get_int(id_json);
+
+    json_object *episodes_watched_json = NULL;
+    json_object_object_get_ex(j, "episodes_watched", &episodes_watched_json);
+    f.episodes_watched = intOrUnknown(episodes_watched_json);
+
+    json_object *library_status_json = NULL;
+    json_object_object_get_ex(j, "library_status", &library_status_json);
+    f.status = LibraryStore::parseLibraryStatus(stringOrEmpty(library_status_json));
+
+    /* The API sends the user's rating as a string like "3.5", or null */
+    json_object *rating_json = NULL;
+    json_object_object_get_ex(j, "rating", &rating_json);
+    f.rating = rating_json == NULL ? NAN : (float)json_object_get_double(rating_json);
+}
+
+/* LibraryEntry* add(const EntryFields&, bool);
+
+   Adds a row to the store with the given fields, copying its text into
+   the store, and returns its handle. With copy_text false the title and
+   synopsis are kept as they are, because they have already been copied
+   into the store with copyText(); genre names are always copied, but only
+   once per name.
+
+   ex. LibraryEntry *le = store.add(fields);
+
+   Pre-conditions: if copy_text is false, f's title and synopsis came from
+   copyText().
+
+   Post-conditions: returns a handle to the new row, which stays valid for
+   the life of the store. */
+
+LibraryEntry* LibraryStore::add(const EntryFields &f, bool copy_text) {
+    ReadWriteLock::Writer guard(lock);
+    int row = size();
+    ids.push_back(f.id);
+    titles.push_back(copy_text ? text.copy(f.title) : f.title);
+    synopses.push_back(copy_text ? text.copy(f.synopsis) : f.synopsis);
+    airing_statuses.push_back(f.airing);
+    episode_counts.push_back(f.episode_count);
+    episodes_watched.push_back(f.episodes_watched);
+    library_statuses.push_back(f.status);
+    ratings.push_back(f.rating);
+    community_ratings.push_back(f.community_rating);
+    show_types.push_back(f.type);
+
+    uint64_t mask = 0;
+    for(int i=0; i<f.genre_count; i++) {
+        int genre = internGenre(f.genres[i]);
+        genre_ids.push_back(genre);
+        if(genre < 64)
+            mask |= (uint64_t)1 << genre;
+    }
+    genre_offsets.push_back(genre_ids.size());
+    genre_masks.push_back(mask);
+
+    removed.push_back(0);
+
+    handles.push_back(LibraryEntry(this, row));
+    return &handles.back();
+}
+
+/* void setTextArenas(int);
+
+   Makes sure the store has at least count arenas for its text, numbered
+   from 0, so that copyText() can be called from count threads at once.
+
+   ex. store.setTextArenas(pool.getThreadCount());
+
+   Pre-conditions: copyText() isn't running.
+
+   Post-conditions: copyText() can be given arenas 0 to count-1. */
+
+void LibraryStore::setTextArenas(int count) {
+    while((int)thread_text.size() < count - 1)
+        thread_text.emplace_back();
+}
+
+/* string_view copyText(string_view, int);
+
+   Copies s into the store's text, in the given arena, and returns the
+   copy, for a row that's added later with add(f, false). Threads that each
+   use their own arena can call this at the same time (with each other, not
+   with add()), which is how a Library copies the text of the entries it
+   parses on several threads.
+
+   ex. f.title = store.copyText(f.title, thread);
+
+   Pre-conditions: arena is less than the count given to setTextArenas()
+   (or 0), and no other thread is using it.
+
+   Post-conditions: the copy stays valid for the life of the store. */
+
+std::string_view LibraryStore::copyText(std::string_view s, int arena) {
+    return arena == 0 ? text.copy(s) : thread_text[arena - 1].copy(s);
+}
+
+/* size_t getTextBytes();
+
+   Returns the memory used by the text of the rows, in all of the arenas.
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+size_t LibraryStore::getTextBytes() {
+    size_t bytes = text.getBytesReserved();
+    for(unsigned i=0; i<thread_text.size(); i++)
+        bytes += thread_text[i].getBytesReserved();
+    return bytes;
+}
+
+/* LibraryEntry* add(json_object*);
+
+   Adds a row to the store, with all of its fields parsed from a final
+   json_object in the format of the API's responses (with the user's fields
+   renamed to library_status and anime_id), and returns its handle. Loading
+   uses the ResponseParser instead; this is for entries that are already
+   json_objects.
+
+   ex. LibraryEntry *le = store.add(json_object_final);
+
+   Pre-conditions: Missing or null fields are stored as unknown.
+
+   Post-conditions: returns a handle to the new row, which stays valid for
+   the life of the store. */
+
+LibraryEntry* LibraryStore::add(json_object *j) {
+    EntryFields f;
+    entryFieldsFromJson(j, f);
+
+    json_object *title_json = NULL;
+    json_object_object_get_ex(j, "title", &title_json);
+    f.title = stringOrEmpty(title_json);
+
+    json_object *synopsis_json = NULL;
+    json_object_object_get_ex(j, "synopsis", &synopsis_json);
+    f.synopsis = stringOrEmpty(synopsis_json);
+
+    json_object *airing_status_json = NULL;
+    json_object_object_get_ex(j, "airing_status", &airing_status_json);
+    f.airing = parseAiringStatus(stringOrEmpty(airing_status_json));
+
+    json_object *episode_count_json = NULL;
+    json_object_object_get_ex(j, "episode_count", &episode_count_json);
+    f.episode_count = intOrUnknown(episode_count_json);
+
+    json_object *community_rating_json = NULL;
+    json_object_object_get_ex(j, "community_rating", &community_rating_json);
+    f.community_rating = community_rating_json == NULL ? 0 : (float)json_object_get_double(community_rating_json);
+
+    json_object *type_json = NULL;
+    json_object_object_get_ex(j, "show_type", &type_json);
+    f.type = parseShowType(stringOrEmpty(type_json));
+
+    json_object *genres_json = NULL;
+    json_object_object_get_ex(j, "genres", &genres_json);
+    int genre_count = genres_json == NULL ? 0 : (int)json_object_array_length(genres_json);
+    std::vector<std::string_view> genres;
+    for(int i=0; i<genre_count; i++) {
+        json_object *genre_json = json_object_array_get_idx(genres_json, i);
+        json_object *genre_name_json = NULL;
+        json_object_object_get_ex(genre_json, "name", &genre_name_json);
+        if(genre_name_json != NULL)
+            genres.push_back(stringOrEmpty(genre_name_json));
+    }
+    f.genres = genres.data();
+    f.genre_count = (int)genres.size();
+
+    return add(f);
+}
+
+/* void update(int, const EntryFields&);
+
+   Updates the fields of a row that belong to the user's library entry
+   (library status, episodes watched and rating), leaving the anime's
+   metadata as it is.
+
+   ex. store.update(le->getRow(), fields);
+
+   Pre-conditions: row is a row of the store; only the library list's
+   fields of f are used.
+
+   Post-conditions: the row has the new values. */
+
+void LibraryStore::update(int row, const EntryFields &f) {
+    ReadWriteLock::Writer guard(lock);
+    episodes_watched[row] = f.episodes_watched;
+    library_statuses[row] = f.status;
+    ratings[row] = f.rating;
+}
+
+/* void remove(int);
+
+   Marks a row as removed. Its data stays where it is (so its LibraryEntry
+   stays valid), but it no longer matches any select(). Rows are never
+   reused.
+
+   ex. store.remove(le->getRow());
+
+   Pre-conditions: row is a row of the store.
+
+   Post-conditions: isRemoved(row) is true. */
+
+void LibraryStore::remove(int row) {
+    ReadWriteLock::Writer guard(lock);
+    if(!removed[row]) {
+        removed[row] = 1;
+        removed_count++;
+    }
+}
+
+/* void save(Snapshot&);
+
+   Adds every column of the store to a snapshot, as one section each. The
+   text (titles, synopses and genre names) goes in one section, each string
+   followed by a NUL, with the length of each string in another.
+
+   ex. store.save(snapshot);
+
+   Pre-conditions: none.
+
+   Post-conditions: load() on the written snapshot gives the same rows. */
+
+void LibraryStore::save(Snapshot &snapshot) {
+    int n = size();
+    snapshot.add(SNAPSHOT_IDS, ids.data(), n * sizeof(int32_t));
+    snapshot.add(SNAPSHOT_EPISODE_COUNTS, episode_counts.data(), n * sizeof(int32_t));
+    snapshot.add(SNAPSHOT_EPISODES_WATCHED, episodes_watched.data(), n * sizeof(int32_t));
+    snapshot.add(SNAPSHOT_RATINGS, ratings.data(), n * sizeof(float));
+    snapshot.add(SNAPSHOT_COMMUNITY_RATINGS, community_ratings.data(), n * sizeof(float));
+    snapshot.add(SNAPSHOT_SHOW_TYPES, show_types.data(), n);
+    snapshot.add(SNAPSHOT_AIRING_STATUSES, airing_statuses.data(), n);
+    snapshot.add(SNAPSHOT_LIBRARY_STATUSES, library_statuses.data(), n);
+    snapshot.add(SNAPSHOT_REMOVED, removed.data(), n);
+    snapshot.add(SNAPSHOT_GENRE_OFFSETS, genre_offsets.data(), (n + 1) * sizeof(uint32_t));
+    snapshot.add(SNAPSHOT_GENRE_IDS, genre_ids.data(), genre_ids.size() * sizeof(uint16_t));
+    snapshot.add(SNAPSHOT_GENRE_MASKS, genre_masks.data(), n * sizeof(uint64_t));
+
+    std::vector<uint32_t> lengths;
+    lengths.reserve(2 * n + genre_names.size());
+    std::string all_text;
+    for(int pass=0; pass<3; pass++) {
+        const std::vector<std::string_view> &v = pass == 0 ? titles : pass == 1 ? synopses : genre_names;
+        for(unsigned i=0; i<v.size(); i++) {
+            lengths.push_back(v[i].size());
+            all_text.append(v[i].data(), v[i].size());
+            all_text.push_back('\0');
+        }
+    }
+    snapshot.add(SNAPSHOT_TEXT, all_text.data(), all_text.size());
+    snapshot.add(SNAPSHOT_TEXT_LENGTHS, lengths.data(), lengths.size() * sizeof(uint32_t));
+}
+
+/* Points column at the section of the snapshot with the given tag, if it
+   has exactly count elements of type T */
+template <class T>
+static bool getColumn(Snapshot &snapshot, uint32_t tag, size_t count, const T *&column) {
+    size_t bytes;
+    column = (const T*)snapshot.get(tag, bytes);
+    return column != NULL && bytes == count * sizeof(T);
+}
+
+/* Returns true if every one of the count bytes of column is at most max */
+static bool allAtMost(const uint8_t *column, size_t count, int max) {
+    for(size_t i=0; i<count; i++) {
+        if(column[i] > max)
+            return false;
+    }
+    return true;
+}
+
+/* bool load(Snapshot&);
+
+   Fills an empty store from a snapshot written by save(). Each column is
+   copied out of the snapshot in one go, and the titles, synopses and genre
+   names aren't copied at all: they point into the snapshot's mapped file.
+   Nothing is parsed, and there is no allocation per row.
+
+   ex. if(!store.load(snapshot))
+
+   Pre-conditions: the store is empty, and the snapshot is open and stays
+   open for the life of the store.
+
+   Post-conditions: returns true on success. If the snapshot doesn't hold a
+   valid store, returns false and the store is still empty. */
+
+bool LibraryStore::load(Snapshot &snapshot) {
+    size_t bytes;
+    const int32_t *ids_in = (const int32_t*)snapshot.get(SNAPSHOT_IDS, bytes);
+    if(ids_in == NULL || size() != 0)
+        return false;
+    size_t n = bytes / sizeof(int32_t);
+
+    /* Check everything before changing anything */
+    const int32_t *episode_counts_in, *episodes_watched_in;
+    const float *ratings_in, *community_ratings_in;
+    const uint8_t *show_types_in, *airing_statuses_in, *library_statuses_in, *removed_in;
+    const uint32_t *genre_offsets_in, *lengths_in;
+    const uint16_t *genre_ids_in;
+    const uint64_t *genre_masks_in;
+    if(!getColumn(snapshot, SNAPSHOT_EPISODE_COUNTS, n, episode_counts_in) ||
+       !getColumn(snapshot, SNAPSHOT_EPISODES_WATCHED, n, episodes_watched_in) ||
+       !getColumn(snapshot, SNAPSHOT_RATINGS, n, ratings_in) ||
+       !getColumn(snapshot, SNAPSHOT_COMMUNITY_RATINGS, n, community_ratings_in) ||
+       !getColumn(snapshot, SNAPSHOT_SHOW_TYPES, n, show_types_in) ||
+       !getColumn(snapshot, SNAPSHOT_AIRING_STATUSES, n, airing_statuses_in) ||
+       !getColumn(snapshot, SNAPSHOT_LIBRARY_STATUSES, n, library_statuses_in) ||
+       !getColumn(snapshot, SNAPSHOT_REMOVED, n, removed_in) ||
+       !getColumn(snapshot, SNAPSHOT_GENRE_OFFSETS, n + 1, genre_offsets_in) ||
+       !getColumn(snapshot, SNAPSHOT_GENRE_MASKS, n, genre_masks_in))
+        return false;
+    if(!allAtMost(show_types_in, n, SHOW_UNKNOWN) || !allAtMost(airing_statuses_in, n, AIRING_UNKNOWN) ||
+       !allAtMost(library_statuses_in, n, UNDEFINED))
+        return false;
+
+    size_t genre_id_count = genre_offsets_in[n];
+    if(genre_offsets_in[0] != 0 || !getColumn(snapshot, SNAPSHOT_GENRE_IDS, genre_id_count, genre_ids_in))
+        return false;
+    for(size_t row=0; row<n; row++) {
+        if(genre_offsets_in[row] > genre_offsets_in[row + 1])
+            return false;
+    }
+
+    const char *text_in = (const char*)snapshot.get(SNAPSHOT_TEXT, bytes);
+    size_t text_size = bytes;
+    lengths_in = (const uint32_t*)snapshot.get(SNAPSHOT_TEXT_LENGTHS, bytes);
+    size_t string_count = bytes / sizeof(uint32_t);
+    if(text_in == NULL || lengths_in == NULL || string_count < 2 * n)
+        return false;
+    size_t genre_count = string_count - 2 * n;
+    size_t text_used = 0;
+    for(size_t i=0; i<string_count; i++) {
+        text_used += (size_t)lengths_in[i] + 1;
+        if(text_used > text_size || text_in[text_used - 1] != '\0')
+            return false;
+    }
+    for(size_t g=0; g<genre_id_count; g++) {
+        if(genre_ids_in[g] >= genre_count)
+            return false;
+    }
+
+    ids.assign(ids_in, ids_in + n);
+    episode_counts.assign(episode_counts_in, episode_counts_in + n);
+    episodes_watched.assign(episodes_watched_in, episodes_watched_in + n);
+    ratings.assign(ratings_in, ratings_in + n);
+    community_ratings.assign(community_ratings_in, community_ratings_in + n);
+    show_types.assign(show_types_in, show_types_in + n);
+    airing_statuses.assign(airing_statuses_in, airing_statuses_in + n);
+    library_statuses.assign(library_statuses_in, library_statuses_in + n);
+    removed.assign(removed_in, removed_in + n);
+    genre_offsets.assign(genre_offsets_in, genre_offsets_in + n + 1);
+    genre_ids.assign(genre_ids_in, genre_ids_in + genre_id_count);
+    genre_masks.assign(genre_masks_in, genre_masks_in + n);
+
+    removed_count = 0;
+    for(size_t row=0; row<n; row++)
+        removed_count += removed[row] != 0;
+
+    /* Point the text columns into the mapping */
+    const char *s = text_in;
+    titles.resize(n);
+    synopses.resize(n);
+    genre_names.resize(genre_count);
+    for(size_t i=0; i<string_count; i++) {
+        std::string_view v(s, lengths_in[i]);
+        if(i < n)
+            titles[i] = v;
+        else if(i < 2 * n)
+            synopses[i - n] = v;
+        else {
+            genre_names[i - 2 * n] = v;
+            genre_lookup[v] = i - 2 * n;
+        }
+        s += lengths_in[i] + 1;
+    }
+
+    for(size_t row=0; row<n; row++)
+        handles.push_back(LibraryEntry(this, row));
+    return true;
+}
+
+/* void copyFrom(LibraryStore&);
+
+   Makes this store a copy of another one's rows, numbered the same, with
+   handles of its own. Only the columns are copied: the text columns and
+   genre names are views of the other store's text, which never moves or
+   goes away while that store exists. This is how a LibraryVersion gets a
+   copy of the library's rows that the library can go on changing without
+   it seeing.
+
+   ex. version_store.copyFrom(store);
+
+   Pre-conditions: this store is empty, and nothing is writing to other.
+   other must outlive this store.
+
+   Post-conditions: this store has the same rows as other has now. */
+
+void LibraryStore::copyFrom(LibraryStore &other) {
+    ids = other.ids;
+    titles = other.titles;
+    synopses = other.synopses;
+    episode_counts = other.episode_counts;
+    episodes_watched = other.episodes_watched;
+    ratings = other.ratings;
+    community_ratings = other.community_ratings;
+    show_types = other.show_types;
+    airing_statuses = other.airing_statuses;
+    library_statuses = other.library_statuses;
+    genre_offsets = other.genre_offsets;
+    genre_ids = other.genre_ids;
+    genre_masks = other.genre_masks;
+    removed = other.removed;
+    removed_count = other.removed_count;
+    genre_names = other.genre_names;
+    genre_lookup = other.genre_lookup;
+
+    int n = (int)ids.size();
+    for(int row=0; row<n; row++)
+        handles.push_back(LibraryEntry(this, row));
+}
+
+/* int internGenre(string_view);
+
+   Returns the id of the genre with the given name, adding it to the genre
+   table if this is the first time it has been seen.
+
+   ex. int action = store.internGenre("Action");
+
+   Pre-conditions: none.
+
+   Post-conditions: getGenreName(id) returns name. */
+
+int LibraryStore::internGenre(std::string_view name) {
+    std::unordered_map<std::string_view, int>::iterator it = genre_lookup.find(name);
+    if(it != genre_lookup.end())
+        return it->second;
+
+    /* The lookup's keys are views too, so they point at the arena copy */
+    int id = (int)genre_names.size();
+    std::string_view copy = text.copy(name);
+    genre_names.push_back(copy);
+    genre_lookup[copy] = id;
+    return id;
+}
+
+/* int findGenre(string_view);
+
+   Returns the id of the genre with the given name, or -1 if no entry in the
+   store has that genre. */
+
+int LibraryStore::findGenre(std::string_view name) {
+    std::unordered_map<std::string_view, int>::iterator it = genre_lookup.find(name);
+    return it == genre_lookup.end() ? -1 : it->second;
+}
+
+/* show_type parseShowType(string_view);
+
+   Converts a show type as spelled by the API ("TV", "Movie", ...) to a
+   show_type. Returns SHOW_UNKNOWN for an empty string or anything
+   unrecognized. */
+
+show_type LibraryStore::parseShowType(std::string_view s) {
+    for(int t=SHOW_TV; t<SHOW_UNKNOWN; t++) {
+        if(s == SHOW_TYPE_NAMES[t])
+            return (show_type)t;
+    }
+    return SHOW_UNKNOWN;
+}
+
+/* airing_status parseAiringStatus(string_view);
+
+   Converts an airing status as spelled by the API ("Finished Airing", ...)
+   to an airing_status. Returns AIRING_UNKNOWN for an empty string or
+   anything unrecognized. */
+
+airing_status LibraryStore::parseAiringStatus(std::string_view s) {
+    for(int a=NOT_YET_AIRED; a<AIRING_UNKNOWN; a++) {
+        if(s == AIRING_STATUS_NAMES[a])
+            return (airing_status)a;
+    }
+    return AIRING_UNKNOWN;
+}
+
+/* library_status parseLibraryStatus(string_view);
+
+   Converts a library status as spelled by the API ("currently-watching",
+   ...) to a library_status. Returns UNDEFINED for an empty string or
+   anything unrecognized (means anime isn't in the user's library). */
+
+library_status LibraryStore::parseLibraryStatus(std::string_view s) {
+    if(s == "currently-watching")
+        return CURRENTLY_WATCHING;
+    else if(s == "plan-to-watch")
+        return PLAN_TO_WATCH;
+    else if(s == "completed")
+        return COMPLETED;
+    else if(s == "on-hold")
+        return ON_HOLD;
+    else if(s == "dropped")
+        return DROPPED;
+    else
+        return UNDEFINED;
+}
+
+/* const char* libraryStatusName(library_status);
+
+   Returns the name of a library status as the API spells it, or "" for
+   UNDEFINED, so that parseLibraryStatus() gives the status back. */
+
+const char* LibraryStore::libraryStatusName(library_status ls) {
+    return LIBRARY_STATUS_NAMES[ls <= UNDEFINED ? ls : UNDEFINED];
+}
+
+/* const char* showTypeName(show_type);
+
+   Returns the name of a show type as the API spells it. */
+
+const char* LibraryStore::showTypeName(show_type t) {
+    return SHOW_TYPE_NAMES[t <= SHOW_UNKNOWN ? t : SHOW_UNKNOWN];
+}
+
+/* const char* airingStatusName(airing_status);
+
+   Returns the name of an airing status as the API spells it. */
+
+const char* LibraryStore::airingStatusName(airing_status a) {
+    return AIRING_STATUS_NAMES[a <= AIRING_UNKNOWN ? a : AIRING_UNKNOWN];
+}
+
+/* bool hasGenre(int, int);
+
+   Returns true if the given row has the genre with the given id. */
+
+bool LibraryStore::hasGenre(int row, int genre) {
+    if(genre < 64)
+        return (genre_masks[row] >> genre) & 1;
+    for(uint32_t i=genre_offsets[row]; i<genre_offsets[row + 1]; i++) {
+        if(genre_ids[i] == genre)
+            return true;
+    }
+    return false;
+}
+
+/* A LibraryQuery resolved against a store: genre names turned into a
+   bitmask (plus a list of any genre ids too big for the mask), and the
+   columns it will be evaluated over */
+struct QueryFilter {
+    int status;
+    int type;
+    float min_community_rating;
+    float max_community_rating;
+    bool has_min_rating;
+    float min_rating;
+    uint64_t genre_mask;
+    std::vector<int> wide_genres;
+    const uint8_t *statuses;
+    const uint8_t *types;
+    const float *community_ratings;
+    const float *ratings;
+    const uint64_t *genre_masks;
+};
+
+/* Tests rows [begin, end) one at a time, appending matches to rows */
+static void selectScalar(const QueryFilter &f, int begin, int end, std::vector<int> &rows) {
+    for(int i=begin; i<end; i++) {
+        if(f.status >= 0 && f.statuses[i] != f.status)
+            continue;
+        if(f.type >= 0 && f.types[i] != f.type)
+            continue;
+        if(!(f.community_ratings[i] >= f.min_community_rating && f.community_ratings[i] <= f.max_community_rating))
+            continue;
+        if(f.has_min_rating && !(f.ratings[i] >= f.min_rating))
+            continue;
+        if((f.genre_masks[i] & f.genre_mask) != f.genre_mask)
+            continue;
+        rows.push_back(i);
+    }
+}
+
+/* Tests rows [0, n) eight at a time with AVX2, appending matches to rows.
+   Each predicate produces a mask of 8 lanes; the lanes that pass every
+   predicate are turned into bits with movemask and their row numbers are
+   appended. Returns how many rows were tested (a multiple of 8); the
+   caller tests the rest with selectScalar(). */
+__attribute__((target("avx2")))
+static int selectAVX2(const QueryFilter &f, int n, std::vector<int> &rows) {
+    const __m256i status = _mm256_set1_epi32(f.status);
+    const __m256i type = _mm256_set1_epi32(f.type);
+    const __m256 min_community_rating = _mm256_set1_ps(f.min_community_rating);
+    const __m256 max_community_rating = _mm256_set1_ps(f.max_community_rating);
+    const __m256 min_rating = _mm256_set1_ps(f.min_rating);
+    const __m256i genre_mask = _mm256_set1_epi64x(f.genre_mask);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256 community = _mm256_loadu_ps(f.community_ratings + i);
+        __m256 pass = _mm256_and_ps(_mm256_cmp_ps(community, min_community_rating, _CMP_GE_OQ),
+                                    _mm256_cmp_ps(community, max_community_rating, _CMP_LE_OQ));
+
+        if(f.status >= 0) {
+            __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(f.statuses + i)));
+            pass = _mm256_and_ps(pass, _mm256_castsi256_ps(_mm256_cmpeq_epi32(s, status)));
+        }
+        if(f.type >= 0) {
+            __m256i t = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(f.types + i)));
+            pass = _mm256_and_ps(pass, _mm256_castsi256_ps(_mm256_cmpeq_epi32(t, type)));
+        }
+        if(f.has_min_rating) {
+            __m256 r = _mm256_loadu_ps(f.ratings + i);
+            pass = _mm256_and_ps(pass, _mm256_cmp_ps(r, min_rating, _CMP_GE_OQ));
+        }
+
+        unsigned bits = _mm256_movemask_ps(pass);
+        if(bits != 0 && f.genre_mask != 0) {
+            /* 64-bit masks, so four rows per register */
+            __m256i lo = _mm256_loadu_si256((const __m256i*)(f.genre_masks + i));
+            __m256i hi = _mm256_loadu_si256((const __m256i*)(f.genre_masks + i + 4));
+            lo = _mm256_cmpeq_epi64(_mm256_and_si256(lo, genre_mask), genre_mask);
+            hi = _mm256_cmpeq_epi64(_mm256_and_si256(hi, genre_mask), genre_mask);
+            bits &= _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+                    (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+        }
+
+        while(bits != 0) {
+            rows.push_back(i + __builtin_ctz(bits));
+            bits &= bits - 1;
+        }
+    }
+    return i;
+}
+
+/* void select(const LibraryQuery&, vector<int>&, bool);
+
+   Finds every row that matches a query and puts their row numbers, in
+   order, in rows. The status, type, rating and genre predicates are all
+   evaluated over the columns at once, eight rows at a time with AVX2 when
+   the CPU supports it (and allow_simd is true), otherwise one at a time.
+
+   ex. std::vector<int> rows;
+       store.select(query, rows);
+
+   Pre-conditions: none.
+
+   Post-conditions: rows holds the matching row numbers. */
+
+void LibraryStore::select(const LibraryQuery &query, std::vector<int> &rows, bool allow_simd) {
+    rows.clear();
+
+    QueryFilter f;
+    f.status = query.status;
+    f.type = query.type;
+    f.min_community_rating = query.min_community_rating;
+    f.max_community_rating = query.max_community_rating;
+    f.has_min_rating = query.min_rating != -INFINITY;
+    f.min_rating = query.min_rating;
+    f.genre_mask = 0;
+    for(unsigned i=0; i<query.genres.size(); i++) {
+        int genre = findGenre(query.genres[i]);
+        if(genre == -1)
+            return; /* No row has this genre */
+        if(genre < 64)
+            f.genre_mask |= (uint64_t)1 << genre;
+        else
+            f.wide_genres.push_back(genre);
+    }
+
+    int n = size();
+    if(n == 0)
+        return;
+    f.statuses = &library_statuses[0];
+    f.types = &show_types[0];
+    f.community_ratings = &community_ratings[0];
+    f.ratings = &ratings[0];
+    f.genre_masks = &genre_masks[0];
+
+    int done = 0;
+    if(allow_simd && __builtin_cpu_supports("avx2"))
+        done = selectAVX2(f, n, rows);
+    selectScalar(f, done, n, rows);
+
+    /* Genres that don't fit in the mask are checked the slow way */
+    if(!f.wide_genres.empty()) {
+        unsigned kept = 0;
+        for(unsigned i=0; i<rows.size(); i++) {
+            bool match = true;
+            for(unsigned g=0; g<f.wide_genres.size() && match; g++)
+                match = hasGenre(rows[i], f.wide_genres[g]);
+            if(match)
+                rows[kept++] = rows[i];
+        }
+        rows.resize(kept);
+    }
+
+    /* Rows that have been removed never match */
+    if(removed_count > 0) {
+        unsigned kept = 0;
+        for(unsigned i=0; i<rows.size(); i++) {
+            if(!removed[rows[i]])
+                rows[kept++] = rows[i];
+        }
+        rows.resize(kept);
+    }
+}
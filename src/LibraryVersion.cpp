@@ -0,0 +1,94 @@
+#include "LibraryVersion.h"
+#include "Library.h"
+
+/* LibraryVersion::Reader reader(Library*);
+
+   Constructor for the Reader class: pins the library's current version,
+   which it then gives access to with get() and ->.
+
+   ex. LibraryVersion::Reader reader(library);
+
+   Pre-conditions: library outlives the Reader.
+
+   Post-conditions: get() is the version, or NULL if the library hasn't
+   published one, and stays valid until the Reader goes out of scope. */
+
+LibraryVersion::Reader::Reader(Library *library)
+{
+    version = library->version.load();
+}
+
+/* LibraryVersion(Library*, long);
+
+   Constructor for the LibraryVersion class, used by Library::publish():
+   copies the library's columns, status indexes and size, and indexes the
+   copied entries by title and id.
+
+   Pre-conditions: the library isn't loading, and nothing is writing to it.
+
+   Post-conditions: the version has the same entries as the library, in the
+   same order, and doesn't change when the library does. */
+
+LibraryVersion::LibraryVersion(Library *library, long number)
+{
+    this->number = number;
+    library_size = library->library_size;
+    store.copyFrom(library->store);
+    for(int s=0; s<=UNDEFINED; s++) {
+        const std::vector<LibraryEntry*> &from = library->status_index[s];
+        status_index[s].resize(from.size());
+        for(unsigned i=0; i<from.size(); i++) {
+            LibraryEntry *le = store.getEntry(from[i]->getRow());
+            status_index[s][i] = le;
+            index.insert(le);
+        }
+    }
+}
+
+/* Destructor: nothing to do, the store and index clean up after
+   themselves */
+LibraryVersion::~LibraryVersion()
+{
+    //dtor
+}
+
+/* const vector<LibraryEntry*>& getLibraryEntries(library_status);
+
+   Returns the entries with the given library status, in alphabetical order
+   by title, without copying them.
+
+   ex. const std::vector<LibraryEntry*> &v = reader->getLibraryEntries(COMPLETED);
+
+   Pre-conditions: ls is a library_status.
+
+   Post-conditions: the list stays valid while the version's Reader does. */
+
+const std::vector<LibraryEntry*>& LibraryVersion::getLibraryEntries(library_status ls) {
+    return status_index[ls];
+}
+
+/* vector<LibraryEntry*> query(const LibraryQuery&);
+
+   Returns the entries of this version that match every condition in q,
+   in row order, like Library::query().
+
+   ex. std::vector<LibraryEntry*> tv = reader->query(q);
+
+   Pre-conditions: none.
+
+   Post-conditions: the entries stay valid while the version's Reader does. */
+
+std::vector<LibraryEntry*> LibraryVersion::query(const LibraryQuery &q) {
+    std::vector<int> rows;
+    store.select(q, rows);
+
+    std::vector<LibraryEntry*> libraryEntries(rows.size());
+    for(unsigned i=0; i<rows.size(); i++)
+        libraryEntries[i] = store.getEntry(rows[i]);
+    return libraryEntries;
+}
+
+/* Frees a version given to Epoch::retire() */
+void LibraryVersion::destroy(void *version) {
+    delete (LibraryVersion*)version;
+}
@@ -0,0 +1,229 @@
+#include "LoadMetrics.h"
+#include <cstdio>
+#include <cmath>
+
+/* Histogram h;
+
+   Constructor for the Histogram struct. Starts out empty. */
+
+Histogram::Histogram()
+{
+    for(int i=0; i<BUCKETS; i++)
+        counts[i] = 0;
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+/* Returns the upper limit, in seconds, of a bucket: 100us, 200us, 400us, ...
+   The last bucket has no limit, so this returns infinity for it. */
+double Histogram::bucketLimit(int bucket) {
+    if(bucket >= BUCKETS - 1)
+        return INFINITY;
+    return 0.0001 * (double)(1L << bucket);
+}
+
+/* Adds one latency, in seconds */
+void Histogram::add(double seconds) {
+    int bucket = 0;
+    while(bucket < BUCKETS - 1 && seconds > bucketLimit(bucket))
+        bucket++;
+    counts[bucket]++;
+    if(count == 0 || seconds < min)
+        min = seconds;
+    if(count == 0 || seconds > max)
+        max = seconds;
+    count++;
+    sum += seconds;
+}
+
+/* Adds every latency in h */
+void Histogram::merge(const Histogram &h) {
+    if(h.count == 0)
+        return;
+    for(int i=0; i<BUCKETS; i++)
+        counts[i] += h.counts[i];
+    if(count == 0 || h.min < min)
+        min = h.min;
+    if(count == 0 || h.max > max)
+        max = h.max;
+    count += h.count;
+    sum += h.sum;
+}
+
+/* Mean latency, or 0 if empty */
+double Histogram::mean() const {
+    return count == 0 ? 0 : sum / count;
+}
+
+/* double percentile(double) const;
+
+   Estimates the pth percentile (0 to 100) as the upper limit of the bucket
+   it falls in, but never more than the biggest latency seen. Returns 0 if
+   the histogram is empty.
+
+   ex. double p99 = h.percentile(99); */
+
+double Histogram::percentile(double p) const {
+    if(count == 0)
+        return 0;
+    long rank = (long)ceil(p / 100 * count);
+    if(rank < 1)
+        rank = 1;
+    long seen = 0;
+    for(int i=0; i<BUCKETS; i++) {
+        seen += counts[i];
+        if(seen >= rank)
+            return bucketLimit(i) < max ? bucketLimit(i) : max;
+    }
+    return max;
+}
+
+/* LoadMetrics metrics;
+
+   Constructor for the LoadMetrics struct. Every counter starts at 0. */
+
+LoadMetrics::LoadMetrics()
+{
+    requests = 0;
+    failures = 0;
+    retries = 0;
+    timeouts = 0;
+    bytes = 0;
+    connections = 0;
+    tls_handshakes = 0;
+    http2_requests = 0;
+    cache_hits = 0;
+    concurrency = 0;
+    buffer_peak = 0;
+}
+
+/* void record(const TransferTimings&, CURLcode, bool);
+
+   Adds a finished attempt at a transfer to the counters and histograms. If
+   retried, it failed but will be tried again, so it counts as a retry
+   rather than a failure.
+
+   ex. metrics.record(scheduler.getTimings(i), scheduler.getResult(i));
+
+   Pre-conditions: none.
+
+   Post-conditions: requests is one more. */
+
+void LoadMetrics::record(const TransferTimings &t, CURLcode result, bool retried) {
+    requests++;
+    if(retried)
+        retries++;
+    else if(result != CURLE_OK)
+        failures++;
+    bytes += t.bytes;
+    connections += t.connects;
+    if(t.connects > 0 && t.tls > 0)
+        tls_handshakes++;
+    if(t.http_version == CURL_HTTP_VERSION_2_0)
+        http2_requests++;
+
+    /* A reused connection has nothing to resolve or connect, so it would only
+       skew those histograms towards 0 */
+    if(t.connects > 0) {
+        dns.add(t.dns);
+        connect.add(t.connect);
+        if(t.tls > 0)
+            tls.add(t.tls);
+    }
+    if(t.status != 0)
+        ttfb.add(t.ttfb);
+    total.add(t.total);
+}
+
+/* void merge(const LoadMetrics&);
+
+   Adds the counters and histograms of m to these, e.g. to sum up several
+   loads. The phases aren't added, since they overlap in time, and the
+   concurrency is the highest of the two. */
+
+void LoadMetrics::merge(const LoadMetrics &m) {
+    requests += m.requests;
+    failures += m.failures;
+    retries += m.retries;
+    timeouts += m.timeouts;
+    bytes += m.bytes;
+    connections += m.connections;
+    tls_handshakes += m.tls_handshakes;
+    http2_requests += m.http2_requests;
+    cache_hits += m.cache_hits;
+    if(m.concurrency > concurrency)
+        concurrency = m.concurrency;
+    if(m.buffer_peak > buffer_peak)
+        buffer_peak = m.buffer_peak;
+    dns.merge(m.dns);
+    connect.merge(m.connect);
+    tls.merge(m.tls);
+    ttfb.merge(m.ttfb);
+    total.merge(m.total);
+}
+
+/* Appends a histogram to a JSON string, as an object with its summary
+   statistics and its non-empty buckets ("le" is the bucket's upper limit) */
+static void appendHistogram(std::string &json, const char *name, const Histogram &h) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+        "\"%s\": {\"count\": %ld, \"mean\": %.6f, \"min\": %.6f, \"p50\": %.6f, \"p90\": %.6f, "
+        "\"p99\": %.6f, \"max\": %.6f, \"buckets\": [",
+        name, h.count, h.mean(), h.min, h.percentile(50), h.percentile(90), h.percentile(99), h.max);
+    json += buffer;
+
+    bool first = true;
+    for(int i=0; i<Histogram::BUCKETS; i++) {
+        if(h.counts[i] == 0)
+            continue;
+        if(i == Histogram::BUCKETS - 1)
+            snprintf(buffer, sizeof(buffer), "%s{\"le\": null, \"count\": %ld}", first ? "" : ", ", h.counts[i]);
+        else
+            snprintf(buffer, sizeof(buffer), "%s{\"le\": %.4f, \"count\": %ld}", first ? "" : ", ",
+                Histogram::bucketLimit(i), h.counts[i]);
+        json += buffer;
+        first = false;
+    }
+    json += "]}";
+}
+
+/* string toJson() const;
+
+   Returns the metrics as a JSON object, for logging or exporting. Times
+   are in seconds.
+
+   ex. fputs(L->metrics().toJson().c_str(), file);
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+std::string LoadMetrics::toJson() const {
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+        "{\"requests\": %ld, \"failures\": %ld, \"retries\": %ld, \"timeouts\": %ld, \"bytes\": %ld, "
+        "\"connections\": %ld, \"tls_handshakes\": %ld, \"http2_requests\": %ld, "
+        "\"cache_hits\": %ld, \"concurrency\": %ld, \"buffer_peak\": %ld,\n"
+        " \"phases\": {\"library_fetch\": %.6f, \"metadata_fetch\": %.6f, \"network_wait\": %.6f, "
+        "\"parse\": %.6f, \"index_build\": %.6f, \"total\": %.6f},\n"
+        " \"latency\": {\n  ",
+        requests, failures, retries, timeouts, bytes, connections, tls_handshakes, http2_requests,
+        cache_hits, concurrency, buffer_peak,
+        phases.library_fetch, phases.metadata_fetch, phases.network_wait, phases.parse,
+        phases.index_build, phases.total);
+    std::string json = buffer;
+
+    appendHistogram(json, "dns", dns);
+    json += ",\n  ";
+    appendHistogram(json, "connect", connect);
+    json += ",\n  ";
+    appendHistogram(json, "tls", tls);
+    json += ",\n  ";
+    appendHistogram(json, "ttfb", ttfb);
+    json += ",\n  ";
+    appendHistogram(json, "total", total);
+    json += "\n }\n}\n";
+    return json;
+}
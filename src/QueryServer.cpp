@@ -0,0 +1,738 @@
+#include "QueryServer.h"
+#include "LibraryLoader.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Most events epoll_wait() hands back at once */
+#define MAX_EVENTS 64
+
+/* Genres listed by STATS */
+#define STATS_GENRES 5
+
+/* Removes the next word (up to a space) from the front of rest and returns
+   it, or an empty view if there are none left */
+static std::string_view nextWord(std::string_view &rest) {
+    size_t start = rest.find_first_not_of(' ');
+    if(start == std::string_view::npos) {
+        rest = std::string_view();
+        return rest;
+    }
+    rest.remove_prefix(start);
+    size_t end = std::min(rest.find(' '), rest.size());
+    std::string_view word = rest.substr(0, end);
+    rest.remove_prefix(end);
+    return word;
+}
+
+/* Parses a whole word as a number; false if it isn't one */
+static bool parseNumber(std::string_view word, long &n) {
+    const char *end = word.data() + word.size();
+    std::from_chars_result r = std::from_chars(word.data(), end, n);
+    return !word.empty() && r.ec == std::errc() && r.ptr == end;
+}
+
+/* True if name could be a Hummingbird.me username: letters, digits, - and
+   _, and not too long */
+static bool validUsername(std::string_view name) {
+    if(name.empty() || name.size() > QueryServer::MAX_USERNAME)
+        return false;
+    for(size_t i=0; i<name.size(); i++) {
+        char c = name[i];
+        if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+/* Appends a count, or null if it's unknown (negative) */
+static void appendCount(std::string &out, long long n) {
+    char buffer[32];
+    if(n < 0)
+        out += "null";
+    else
+        out.append(buffer, snprintf(buffer, sizeof(buffer), "%lld", n));
+}
+
+/* Appends a real number, or null if it's unknown (NaN) */
+static void appendReal(std::string &out, double x) {
+    char buffer[32];
+    if(std::isnan(x))
+        out += "null";
+    else
+        out.append(buffer, snprintf(buffer, sizeof(buffer), "%g", x));
+}
+
+/* QueryServer server(LibraryOptions);
+
+   Constructor for the QueryServer class. The libraries it loads are loaded
+   with the given options, except that they are always versioned.
+
+   ex. LibraryOptions options;
+       options.cache = &cache;
+       QueryServer server(options);
+
+   Pre-conditions: if options.cache or options.connections is set, it must
+   outlive the server and not be used by anything else meanwhile.
+
+   Post-conditions: the server has no users, and isn't listening. */
+
+QueryServer::QueryServer(LibraryOptions options) : analytics(1)
+{
+    this->options = options;
+    this->options.versioned = true;
+    listen_fd = -1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopping = false;
+    requests = 0;
+    worker_exit = false;
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    worker = std::thread(&QueryServer::workerLoop, this);
+}
+
+/* Destructor: waits for a load or refresh that is going on to finish,
+   disconnects the clients, removes the socket file and frees every
+   library. */
+QueryServer::~QueryServer()
+{
+    {
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        worker_exit = true;
+    }
+    jobs_ready.notify_one();
+    worker.join();
+
+    while(!clients.empty())
+        disconnect(clients.begin()->second);
+
+    /* Loads finished but never picked up by run() */
+    for(unsigned i=0; i<done.size(); i++) {
+        if(users.count(done[i].username) == 0)
+            delete done[i].library;
+    }
+    for(std::unordered_map<std::string, User>::iterator it=users.begin(); it!=users.end(); ++it)
+        delete it->second.library;
+
+    if(listen_fd != -1) {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+/* int addUsers(const vector<string>&);
+
+   Loads the libraries of the given users, all at once with a LibraryLoader,
+   and keeps the ones that loaded. Users already loaded are skipped.
+   Returns the number of libraries loaded.
+
+   ex. int loaded = server.addUsers(usernames);
+
+   Pre-conditions: run() isn't running.
+
+   Post-conditions: the users whose libraries loaded can be queried. */
+
+int QueryServer::addUsers(const std::vector<std::string> &usernames) {
+    LibraryLoader loader(options);
+    std::vector<std::string> added;
+    std::unordered_set<std::string> seen;
+    for(unsigned i=0; i<usernames.size(); i++) {
+        if(users.count(usernames[i]) == 0 && seen.insert(usernames[i]).second) {
+            loader.addUser(usernames[i]);
+            added.push_back(usernames[i]);
+        }
+    }
+    if(added.empty())
+        return 0;
+
+    std::vector<Library*> libraries = loader.load();
+    int loaded = 0;
+    for(unsigned i=0; i<libraries.size(); i++) {
+        if(libraries[i]->getLibrarySize() == -1) {
+            delete libraries[i];
+            continue;
+        }
+        User u;
+        u.library = libraries[i];
+        u.stats_version = 0;
+        users[added[i]] = u;
+        loaded++;
+    }
+    return loaded;
+}
+
+/* bool listen(string);
+
+   Creates a Unix domain socket at the given path for run() to accept
+   clients on. A socket file left at the path by a server that didn't exit
+   cleanly is replaced; anything else there is left alone, and the server
+   doesn't listen.
+
+   ex. if(!server.listen("/tmp/hummingbird.sock"))
+           cout << "Couldn't listen" << endl;
+
+   Pre-conditions: the server isn't listening already.
+
+   Post-conditions: returns true if the socket was created. The destructor
+   removes it. */
+
+bool QueryServer::listen(std::string path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(listen_fd != -1 || path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    struct stat st;
+    if(stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+        return false;
+    if(bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return false;
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    listen_fd = fd;
+    this->path = path;
+    return true;
+}
+
+/* void run();
+
+   Accepts clients and answers their requests until stop() is called.
+   Everything is done on the calling thread, apart from loads and
+   refreshes.
+
+   ex. server.run();
+
+   Pre-conditions: listen() returned true.
+
+   Post-conditions: returns once stop() has been called. Clients stay
+   connected until the server is deleted. */
+
+void QueryServer::run() {
+    epoll_event events[MAX_EVENTS];
+    while(!stopping) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if(n == -1) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        /* New clients are accepted after the others' events, so none of
+           them can get the descriptor of a client disconnected in this
+           batch, and its events */
+        bool accepting = false;
+        for(int i=0; i<n; i++) {
+            int fd = events[i].data.fd;
+            if(fd == listen_fd) {
+                accepting = true;
+            } else if(fd == wake_fd) {
+                uint64_t count;
+                if(read(wake_fd, &count, sizeof(count)) == sizeof(count))
+                    finishJobs();
+            } else {
+                std::unordered_map<int, Client*>::iterator it = clients.find(fd);
+                if(it == clients.end())
+                    continue;
+                Client *c = it->second;
+                uint32_t e = events[i].events;
+                if((e & (EPOLLERR | EPOLLHUP)) && !(e & EPOLLIN)) {
+                    disconnect(c);
+                    continue;
+                }
+                if((e & EPOLLOUT) && !writeTo(c))
+                    continue;
+                if(e & EPOLLIN)
+                    readFrom(c);
+            }
+        }
+        if(accepting)
+            accept();
+    }
+}
+
+/* void stop();
+
+   Makes run() return. Safe to call from any thread, or a signal handler.
+
+   ex. server.stop();
+
+   Pre-conditions: none.
+
+   Post-conditions: run() returns as soon as it has finished what it's
+   doing, or straight away if it's called after this. */
+
+void QueryServer::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) != sizeof(one))
+        return;
+}
+
+/* Accepts every client that is waiting to connect */
+void QueryServer::accept() {
+    while(true) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1) {
+            if(errno == EINTR)
+                continue;
+            return;
+        }
+        Client *c = new Client();
+        c->fd = fd;
+        c->out_sent = 0;
+        c->events = EPOLLIN;
+        c->eof = false;
+
+        epoll_event ev;
+        ev.events = c->events;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        clients[fd] = c;
+    }
+}
+
+/* bool readFrom(Client*);
+
+   Reads what the client has sent (up to MAX_READ bytes, so one client
+   can't hold up the others), answers every complete request in it, and
+   writes the responses back. A client that has stopped sending is
+   disconnected once its responses are written. Returns false if the
+   client was disconnected. */
+
+bool QueryServer::readFrom(Client *c) {
+    char buffer[65536];
+    size_t got = 0;
+    while(got < MAX_READ) {
+        ssize_t n = read(c->fd, buffer, sizeof(buffer));
+        if(n > 0) {
+            c->in.append(buffer, n);
+            got += n;
+            if((size_t)n < sizeof(buffer))
+                break;
+        } else if(n == 0) {
+            c->eof = true;
+            break;
+        } else if(errno != EINTR) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            disconnect(c);
+            return false;
+        }
+    }
+
+    /* Answer every complete line, and a last one without a newline if the
+       client has stopped sending */
+    size_t start = 0;
+    bool too_long = false;
+    while(start < c->in.size()) {
+        size_t end = c->in.find('\n', start);
+        if(end == std::string::npos) {
+            if(!c->eof)
+                break;
+            end = c->in.size();
+        }
+        if(end - start > MAX_REQUEST) {
+            too_long = true;
+            break;
+        }
+        std::string_view line(c->in.data() + start, end - start);
+        if(!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if(!line.empty())
+            handle(line, c->out);
+        start = end + 1;
+    }
+    if(too_long || c->in.size() - std::min(start, c->in.size()) > MAX_REQUEST) {
+        appendError(c->out, "request too long");
+        c->out += '\n';
+        c->eof = true;
+        c->in.clear();
+    } else {
+        c->in.erase(0, start);
+    }
+    return writeTo(c);
+}
+
+/* bool writeTo(Client*);
+
+   Writes as much of the client's responses as the socket will take, and
+   has epoll watch the client for whatever it's waiting for next. Returns
+   false if the client was disconnected. */
+
+bool QueryServer::writeTo(Client *c) {
+    while(c->out_sent < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + c->out_sent, c->out.size() - c->out_sent, MSG_NOSIGNAL);
+        if(n >= 0) {
+            c->out_sent += n;
+        } else if(errno != EINTR) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            disconnect(c);
+            return false;
+        }
+    }
+
+    if(c->out_sent == c->out.size()) {
+        c->out.clear();
+        c->out_sent = 0;
+        if(c->eof) {
+            disconnect(c);
+            return false;
+        }
+    } else if(c->out_sent > c->out.size() / 2) {
+        c->out.erase(0, c->out_sent);
+        c->out_sent = 0;
+    }
+    watch(c);
+    return true;
+}
+
+/* Has epoll watch a client for the requests it may send, unless it has a
+   backlog of responses or has stopped sending, and for room to write its
+   responses, if it has any */
+void QueryServer::watch(Client *c) {
+    size_t backlog = c->out.size() - c->out_sent;
+    uint32_t want = 0;
+    if(!c->eof && backlog < MAX_BACKLOG)
+        want |= EPOLLIN;
+    if(backlog > 0)
+        want |= EPOLLOUT;
+    if(want == c->events)
+        return;
+
+    epoll_event ev;
+    ev.events = want;
+    ev.data.fd = c->fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+}
+
+/* Closes a client's connection and frees it */
+void QueryServer::disconnect(Client *c) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    clients.erase(c->fd);
+    delete c;
+}
+
+/* void handle(string_view, string&);
+
+   Answers one request (a line, without its newline), appending the
+   response and a newline to response. This is what run() does with each
+   request a client sends, and can be called directly too.
+
+   ex. std::string response;
+       server.handle("ID Josh 1", response);
+
+   Pre-conditions: run() isn't running on another thread.
+
+   Post-conditions: exactly one line has been appended to response. */
+
+void QueryServer::handle(std::string_view request, std::string &response) {
+    requests++;
+    std::string_view rest = request;
+    std::string_view command = nextWord(rest);
+
+    if(command == "USERS") {
+        response += "{\"users\":[";
+        bool first = true;
+        for(std::unordered_map<std::string, User>::iterator it=users.begin(); it!=users.end(); ++it) {
+            LibraryVersion::Reader reader(it->second.library);
+            response += first ? "{\"user\":" : ",{\"user\":";
+            appendString(response, it->first);
+            response += ",\"entries\":";
+            appendCount(response, reader.get() != NULL ? reader->getLibrarySize() : -1);
+            response += ",\"version\":";
+            appendCount(response, reader.get() != NULL ? reader->getNumber() : -1);
+            response += '}';
+            first = false;
+        }
+        response += "],\"loading\":[";
+        first = true;
+        for(std::unordered_set<std::string>::iterator it=pending.begin(); it!=pending.end(); ++it) {
+            if(!first)
+                response += ',';
+            appendString(response, *it);
+            first = false;
+        }
+        response += "]}\n";
+        return;
+    }
+
+    std::string username(nextWord(rest));
+    std::unordered_map<std::string, User>::iterator found = users.find(username);
+    User *u = found != users.end() ? &found->second : NULL;
+
+    if(username.empty()) {
+        appendError(response, command.empty() ? "empty request" : "no user given");
+    } else if(command == "LOAD" || command == "REFRESH") {
+        if(u == NULL && command == "REFRESH" && pending.count(username) == 0) {
+            appendError(response, "no such user");
+        } else if(!validUsername(username)) {
+            appendError(response, "bad username");
+        } else if(u == NULL && pending.count(username) == 0 && users.size() + pending.size() >= MAX_USERS) {
+            appendError(response, "too many users");
+        } else {
+            if(pending.count(username) == 0)
+                queue(username, u != NULL ? u->library : NULL);
+            response += "{\"user\":";
+            appendString(response, username);
+            response += ",\"loading\":true}";
+        }
+    } else if(command != "ID" && command != "GET" && command != "LIST" && command != "STATS") {
+        appendError(response, "unknown command");
+    } else if(u == NULL) {
+        appendError(response, pending.count(username) != 0 ? "still loading" : "no such user");
+    } else {
+        LibraryVersion::Reader reader(u->library);
+        LibraryVersion *v = reader.get();
+        if(v == NULL) {
+            appendError(response, "still loading");
+        } else if(command == "ID") {
+            long id;
+            LibraryEntry *le = NULL;
+            if(!parseNumber(nextWord(rest), id))
+                appendError(response, "bad anime id");
+            else if((le = v->getLibraryEntryById((int)id)) == NULL)
+                appendError(response, "not found");
+            else
+                entry(le, response);
+        } else if(command == "GET") {
+            size_t start = rest.find_first_not_of(' ');
+            LibraryEntry *le = NULL;
+            if(start == std::string_view::npos)
+                appendError(response, "no title given");
+            else if((le = v->getLibraryEntry(rest.substr(start))) == NULL)
+                appendError(response, "not found");
+            else
+                entry(le, response);
+        } else if(command == "LIST") {
+            std::string_view status = nextWord(rest);
+            std::string_view limit_word = nextWord(rest);
+            library_status ls = LibraryStore::parseLibraryStatus(status);
+            long limit = -1;
+            if(ls == UNDEFINED) {
+                appendError(response, "unknown status");
+            } else if(!limit_word.empty() && (!parseNumber(limit_word, limit) || limit < 0)) {
+                appendError(response, "bad limit");
+            } else {
+                const std::vector<LibraryEntry*> &entries = v->getLibraryEntries(ls);
+                size_t n = limit < 0 ? entries.size() : std::min(entries.size(), (size_t)limit);
+                response += "{\"status\":\"";
+                response += LibraryStore::libraryStatusName(ls);
+                response += "\",\"count\":";
+                appendCount(response, entries.size());
+                response += ",\"entries\":[";
+                for(size_t i=0; i<n; i++) {
+                    response += i == 0 ? "{\"id\":" : ",{\"id\":";
+                    appendCount(response, entries[i]->getId());
+                    response += ",\"title\":";
+                    appendString(response, entries[i]->getTitle());
+                    response += '}';
+                }
+                response += "]}";
+            }
+        } else {
+            stats(*u, v, response);
+        }
+    }
+    response += '\n';
+}
+
+/* Appends an entry as a JSON object */
+void QueryServer::entry(LibraryEntry *le, std::string &response) {
+    response += "{\"id\":";
+    appendCount(response, le->getId());
+    response += ",\"title\":";
+    appendString(response, le->getTitle());
+    response += ",\"status\":\"";
+    response += LibraryStore::libraryStatusName(le->getLibraryStatus());
+    response += "\",\"episodes_watched\":";
+    appendCount(response, le->getEpisodesWatchedValue());
+    response += ",\"episode_count\":";
+    appendCount(response, le->getEpisodeCountValue());
+    response += ",\"rating\":";
+    appendReal(response, le->getRatingValue());
+    response += ",\"community_rating\":";
+    appendReal(response, le->getCommunityRating());
+    response += ",\"type\":\"";
+    response += LibraryStore::showTypeName(le->getShowType());
+    response += "\",\"airing_status\":\"";
+    response += LibraryStore::airingStatusName(le->getAiringStatusCode());
+    response += "\",\"genres\":[";
+    int genre_count = le->getGenreCount();
+    for(int i=0; i<genre_count; i++) {
+        if(i > 0)
+            response += ',';
+        appendString(response, le->getGenre(i));
+    }
+    response += "]}";
+}
+
+/* Appends a user's stats as of version v, computing them with Analytics
+   only the first time they're asked for in each version */
+void QueryServer::stats(User &u, LibraryVersion *v, std::string &response) {
+    if(u.stats_version != v->getNumber()) {
+        std::vector<LibraryStore*> stores(1, v->getStore());
+        LibraryStats s = analytics.compute(stores);
+        std::string &out = u.stats;
+        out = "{\"version\":";
+        appendCount(out, v->getNumber());
+        out += ",\"entries\":";
+        appendCount(out, s.entries);
+        out += ",\"statuses\":{";
+        for(int ls=0; ls<UNDEFINED; ls++) {
+            out += ls == 0 ? "\"" : ",\"";
+            out += LibraryStore::libraryStatusName((library_status)ls);
+            out += "\":";
+            appendCount(out, s.status_entries[ls]);
+        }
+        out += "},\"episodes_watched\":";
+        long long watched = 0;
+        for(int ls=0; ls<=UNDEFINED; ls++)
+            watched += s.status_episodes_watched[ls];
+        appendCount(out, watched);
+        out += ",\"rated\":";
+        appendCount(out, s.rated);
+        out += ",\"mean_rating\":";
+        appendReal(out, s.meanRating());
+        out += ",\"mean_community_rating\":";
+        appendReal(out, s.meanCommunityRating());
+        out += ",\"genres\":[";
+        for(unsigned g=0; g<s.genres.size() && g<STATS_GENRES; g++) {
+            out += g == 0 ? "{\"genre\":" : ",{\"genre\":";
+            appendString(out, s.genres[g].first);
+            out += ",\"entries\":";
+            appendCount(out, s.genres[g].second);
+            out += '}';
+        }
+        out += "]}";
+        u.stats_version = v->getNumber();
+    }
+    response += u.stats;
+}
+
+/* Appends s as a JSON string, quoted and escaped */
+void QueryServer::appendString(std::string &out, std::string_view s) {
+    out += '"';
+    size_t start = 0;
+    for(size_t i=0; i<s.size(); i++) {
+        unsigned char ch = s[i];
+        if(ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+        out.append(s.data() + start, i - start);
+        if(ch == '"' || ch == '\\') {
+            out += '\\';
+            out += (char)ch;
+        } else if(ch == '\n') {
+            out += "\\n";
+        } else {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", ch);
+            out += escape;
+        }
+        start = i + 1;
+    }
+    out.append(s.data() + start, s.size() - start);
+    out += '"';
+}
+
+/* Appends an error response (without its newline) */
+void QueryServer::appendError(std::string &out, const char *message) {
+    out += "{\"error\":";
+    appendString(out, message);
+    out += '}';
+}
+
+/* Hands a load (library NULL) or refresh to the worker thread */
+void QueryServer::queue(std::string username, Library *library) {
+    pending.insert(username);
+    Job job;
+    job.username = username;
+    job.library = library;
+    job.rc = 0;
+    {
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        jobs.push_back(job);
+    }
+    jobs_ready.notify_one();
+}
+
+/* What the worker thread does: loads or refreshes one library at a time,
+   and wakes run() up with each one it finishes */
+void QueryServer::workerLoop() {
+    std::unique_lock<std::mutex> lock(jobs_lock);
+    while(true) {
+        while(!worker_exit && jobs.empty())
+            jobs_ready.wait(lock);
+        if(worker_exit)
+            return;
+        Job job = jobs.front();
+        jobs.pop_front();
+
+        lock.unlock();
+        if(job.library != NULL) {
+            job.rc = job.library->refresh();
+        } else {
+            job.library = new Library(job.username, options);
+            job.rc = job.library->getLibrarySize() == -1 ? 1 : 0;
+        }
+        lock.lock();
+
+        done.push_back(job);
+        uint64_t one = 1;
+        if(write(wake_fd, &one, sizeof(one)) != sizeof(one))
+            continue;
+    }
+}
+
+/* Takes in the loads and refreshes the worker thread has finished: new
+   libraries that loaded are added (the others freed), and refreshed ones
+   have already published their new version */
+void QueryServer::finishJobs() {
+    std::deque<Job> finished;
+    {
+        std::lock_guard<std::mutex> guard(jobs_lock);
+        finished.swap(done);
+    }
+    for(unsigned i=0; i<finished.size(); i++) {
+        Job &job = finished[i];
+        pending.erase(job.username);
+        if(users.count(job.username) != 0)
+            continue;
+        if(job.rc != 0) {
+            delete job.library;
+            continue;
+        }
+        User u;
+        u.library = job.library;
+        u.stats_version = 0;
+        users[job.username] = u;
+    }
+}
@@ -0,0 +1,413 @@
+#include "Recommender.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+/* Titles scored at a time, into a buffer on the stack, before the best of
+   them are put in the heap */
+#define SCORE_BLOCK 256
+
+/* A feature is in a user's profile if at least 1/PROFILE_SHARE of the
+   titles they liked have it */
+#define PROFILE_SHARE 4
+
+/* Rating given to titles without a community rating, in the middle */
+#define UNKNOWN_RATING 0.5f
+
+/* A query resolved for the kernels: its bitsets and their sizes, its
+   rating, the weights, and the catalog's columns */
+struct SimilarityQuery {
+    const uint64_t *bits;
+    float genre_count;
+    float user_count;
+    float rating;
+    float genre_weight;
+    float co_occurrence_weight;
+    float rating_weight;
+    bool cosine;
+    const uint64_t *titles;
+    const float *genre_counts;
+    const float *user_counts;
+    const float *ratings;
+};
+
+/* Similarity of two sets from the size of their intersection and their
+   sizes; 0 if both are empty */
+static inline float setSimilarity(bool cosine, float common, float a, float b) {
+    if(cosine) {
+        float product = a * b;
+        return product > 0 ? common / sqrtf(product) : 0;
+    }
+    float either = (a + b) - common;
+    return either > 0 ? common / either : 0;
+}
+
+/* Scores titles [begin, end) one at a time into scores[0...] */
+static void scoreScalar(const SimilarityQuery &q, int begin, int end, float *scores) {
+    const int half = Recommender::WORDS / 2;
+    for(int t=begin; t<end; t++) {
+        const uint64_t *title = q.titles + (size_t)t * Recommender::WORDS;
+        int genres = 0;
+        int users = 0;
+        for(int w=0; w<half; w++) {
+            genres += __builtin_popcountll(title[w] & q.bits[w]);
+            users += __builtin_popcountll(title[half + w] & q.bits[half + w]);
+        }
+        float genre_similarity = setSimilarity(q.cosine, (float)genres, q.genre_count, q.genre_counts[t]);
+        float user_similarity = setSimilarity(q.cosine, (float)users, q.user_count, q.user_counts[t]);
+        float rating_similarity = 1 - fabsf(q.rating - q.ratings[t]);
+        scores[t - begin] = (q.genre_weight * genre_similarity + q.co_occurrence_weight * user_similarity) +
+                            q.rating_weight * rating_similarity;
+    }
+}
+
+/* Counts the bits set in each byte of v, by looking up each half of each
+   byte in a table of the counts of 0 to 15 */
+__attribute__((target("avx2")))
+static inline __m256i popcountBytes(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_and_si256(v, low_nibbles);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(table, low), _mm256_shuffle_epi8(table, high));
+}
+
+/* Set similarities of 8 titles at once, like setSimilarity() */
+__attribute__((target("avx2")))
+static inline __m256 setSimilarity8(bool cosine, __m256 common, __m256 a, __m256 b) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 divisor;
+    if(cosine) {
+        __m256 product = _mm256_mul_ps(a, b);
+        divisor = _mm256_sqrt_ps(product);
+        return _mm256_and_ps(_mm256_div_ps(common, divisor), _mm256_cmp_ps(product, zero, _CMP_GT_OQ));
+    }
+    divisor = _mm256_sub_ps(_mm256_add_ps(a, b), common);
+    return _mm256_and_ps(_mm256_div_ps(common, divisor), _mm256_cmp_ps(divisor, zero, _CMP_GT_OQ));
+}
+
+/* Scores titles [begin, end) eight at a time with AVX2 into scores[0...].
+   Each title's bitsets are a register each: they're ANDed with the
+   query's, the bits of each byte counted, and the bytes summed with sad,
+   leaving the two intersection sizes in the low half of one register. The
+   sizes of 8 titles are then scored together. Returns how many titles were
+   scored (a multiple of 8); the caller scores the rest with scoreScalar(). */
+__attribute__((target("avx2")))
+static int scoreAVX2(const SimilarityQuery &q, int begin, int end, float *scores) {
+    const __m256i genre_query = _mm256_loadu_si256((const __m256i*)q.bits);
+    const __m256i user_query = _mm256_loadu_si256((const __m256i*)(q.bits + 4));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256 genre_count = _mm256_set1_ps(q.genre_count);
+    const __m256 user_count = _mm256_set1_ps(q.user_count);
+    const __m256 rating = _mm256_set1_ps(q.rating);
+    const __m256 genre_weight = _mm256_set1_ps(q.genre_weight);
+    const __m256 co_occurrence_weight = _mm256_set1_ps(q.co_occurrence_weight);
+    const __m256 rating_weight = _mm256_set1_ps(q.rating_weight);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    int t = begin;
+    for(; t + 8 <= end; t += 8) {
+        /* Intersection sizes, genres and users in turn: g0 u0 g1 u1 ... */
+        alignas(32) int32_t common[16];
+        for(int i=0; i<8; i++) {
+            const uint64_t *title = q.titles + (size_t)(t + i) * Recommender::WORDS;
+            __m256i genres = popcountBytes(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)title), genre_query));
+            __m256i users = popcountBytes(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(title + 4)), user_query));
+            __m256i sums = _mm256_or_si256(_mm256_sad_epu8(genres, zero), _mm256_slli_epi64(_mm256_sad_epu8(users, zero), 32));
+            __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+            half = _mm_add_epi32(half, _mm_unpackhi_epi64(half, half));
+            _mm_storel_epi64((__m128i*)(common + 2 * i), half);
+        }
+        __m256i first = _mm256_permutevar8x32_epi32(_mm256_load_si256((const __m256i*)common), deinterleave);
+        __m256i second = _mm256_permutevar8x32_epi32(_mm256_load_si256((const __m256i*)(common + 8)), deinterleave);
+        __m256 genres = _mm256_cvtepi32_ps(_mm256_permute2x128_si256(first, second, 0x20));
+        __m256 users = _mm256_cvtepi32_ps(_mm256_permute2x128_si256(first, second, 0x31));
+
+        __m256 genre_similarity = setSimilarity8(q.cosine, genres, genre_count, _mm256_loadu_ps(q.genre_counts + t));
+        __m256 user_similarity = setSimilarity8(q.cosine, users, user_count, _mm256_loadu_ps(q.user_counts + t));
+        __m256 rating_similarity = _mm256_sub_ps(one, _mm256_andnot_ps(sign,
+                                                 _mm256_sub_ps(rating, _mm256_loadu_ps(q.ratings + t))));
+        __m256 score = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(genre_weight, genre_similarity),
+                                                   _mm256_mul_ps(co_occurrence_weight, user_similarity)),
+                                     _mm256_mul_ps(rating_weight, rating_similarity));
+        _mm256_storeu_ps(scores + (t - begin), score);
+    }
+    return t - begin;
+}
+
+/* True if a should be recommended before b: a higher score, or the same
+   score and a lower id, so results never depend on the order of the
+   catalog */
+static bool betterRecommendation(const Recommendation &a, const Recommendation &b) {
+    if(a.score != b.score)
+        return a.score > b.score;
+    return a.id < b.id;
+}
+
+/* Community rating scaled to between 0 and 1 */
+static float scaledRating(float community_rating) {
+    if(!(community_rating > 0))
+        return UNKNOWN_RATING;
+    return std::min(community_rating / 5.0f, 1.0f);
+}
+
+/* Recommender recommender(const vector<Library*>&, RecommenderOptions);
+
+   Constructor for the Recommender class. Makes a catalog of every title in
+   any of the libraries, with its feature vector. Libraries that failed to
+   download are skipped (but still count for the numbering of users).
+
+   ex. Recommender recommender(libraries);
+
+   Pre-conditions: the libraries aren't changed while this runs.
+
+   Post-conditions: getTitleCount() is the number of different anime ids
+   in the libraries. */
+
+Recommender::Recommender(const std::vector<Library*> &libraries, RecommenderOptions options)
+{
+    this->options = options;
+    std::vector<LibraryStore*> stores;
+    for(unsigned i=0; i<libraries.size(); i++)
+        stores.push_back(libraries[i]->getLibrarySize() != -1 ? libraries[i]->getStore() : NULL);
+    build(stores);
+}
+
+/* Recommender recommender(const vector<LibraryStore*>&, RecommenderOptions);
+
+   Constructor for the Recommender class, from the libraries' stores, e.g.
+   those of LibraryVersions. NULL stores are skipped. */
+
+Recommender::Recommender(const std::vector<LibraryStore*> &stores, RecommenderOptions options)
+{
+    this->options = options;
+    build(stores);
+}
+
+/* Destructor: the arena frees the text */
+Recommender::~Recommender()
+{
+    //dtor
+}
+
+/* Adds every row of every store to the catalog: a title for each anime id
+   not seen before, with its genres, rating and the users that have it */
+void Recommender::build(const std::vector<LibraryStore*> &stores) {
+    for(unsigned s=0; s<stores.size(); s++) {
+        LibraryStore *store = stores[s];
+        if(store == NULL)
+            continue;
+
+        /* The store's genre ids -> bits, adding names not seen before */
+        std::vector<int> genre_bits(store->getGenreCount());
+        for(int g=0; g<store->getGenreCount(); g++) {
+            std::string_view name = store->getGenreName(g);
+            std::unordered_map<std::string_view, int>::iterator it = genre_lookup.find(name);
+            if(it == genre_lookup.end()) {
+                name = text.copy(name);
+                it = genre_lookup.insert(std::make_pair(name, (int)genre_names.size())).first;
+                genre_names.push_back(name);
+            }
+            genre_bits[g] = it->second;
+        }
+
+        const std::vector<int32_t> &store_ids = store->getIds();
+        const std::vector<std::string_view> &store_titles = store->getTitles();
+        const std::vector<float> &community_ratings = store->getCommunityRatings();
+        const std::vector<uint8_t> &statuses = store->getLibraryStatuses();
+        const std::vector<uint32_t> &genre_offsets = store->getGenreOffsets();
+        const std::vector<uint16_t> &genre_ids = store->getGenreIds();
+        const std::vector<uint8_t> &removed = store->getRemoved();
+        int user_bit = s % USER_BITS;
+
+        for(int row=0; row<store->size(); row++) {
+            if(removed[row])
+                continue;
+            std::pair<std::unordered_map<int, int>::iterator, bool> added =
+                index.insert(std::make_pair((int)store_ids[row], (int)ids.size()));
+            int t = added.first->second;
+            if(added.second) {
+                ids.push_back(store_ids[row]);
+                titles.push_back(text.copy(store_titles[row]));
+                ratings.push_back(scaledRating(community_ratings[row]));
+                bits.resize(bits.size() + WORDS, 0);
+            }
+            uint64_t *title = &bits[(size_t)t * WORDS];
+            for(uint32_t g=genre_offsets[row]; g<genre_offsets[row + 1]; g++) {
+                int bit = genre_bits[genre_ids[g]];
+                if(bit < GENRE_BITS)
+                    title[bit / 64] |= (uint64_t)1 << (bit % 64);
+            }
+            if(statuses[row] != DROPPED)
+                title[GENRE_BITS / 64 + user_bit / 64] |= (uint64_t)1 << (user_bit % 64);
+        }
+    }
+
+    genre_counts.resize(ids.size());
+    user_counts.resize(ids.size());
+    for(unsigned t=0; t<ids.size(); t++) {
+        const uint64_t *title = &bits[(size_t)t * WORDS];
+        int genres = 0;
+        int users = 0;
+        for(int w=0; w<WORDS/2; w++) {
+            genres += __builtin_popcountll(title[w]);
+            users += __builtin_popcountll(title[WORDS/2 + w]);
+        }
+        genre_counts[t] = (float)genres;
+        user_counts[t] = (float)users;
+    }
+}
+
+/* vector<Recommendation> similarTo(int, int, bool);
+
+   Returns the k titles most similar to the one with the given anime id,
+   best first, not counting itself. Returns nothing if the id isn't in the
+   catalog. The titles are compared with AVX2 when the CPU supports it
+   (and allow_simd is true), otherwise one at a time.
+
+   ex. std::vector<Recommendation> like_lain = recommender.similarTo(339, 10);
+
+   Pre-conditions: k >= 0.
+
+   Post-conditions: the titles stay valid for the life of the Recommender. */
+
+std::vector<Recommendation> Recommender::similarTo(int anime_id, int k, bool allow_simd) {
+    std::unordered_map<int, int>::iterator it = index.find(anime_id);
+    if(it == index.end())
+        return std::vector<Recommendation>();
+    int t = it->second;
+    std::vector<uint8_t> exclude(ids.size(), 0);
+    exclude[t] = 1;
+    return topK(&bits[(size_t)t * WORDS], ratings[t], k, exclude, allow_simd);
+}
+
+/* vector<Recommendation> recommendFor(Library*, int, bool);
+
+   Returns the k titles best recommended for the user whose library is
+   given, best first: those most similar to the user's profile, leaving out
+   anything already in the library. The profile is made from the titles the
+   user liked (see LIKED_RATING), or every title they haven't dropped if
+   they haven't liked any: the genres and users that at least a quarter of
+   those titles have, and their mean rating. The library doesn't have to be
+   one the catalog was made from, but only its titles that are in the
+   catalog count.
+
+   ex. std::vector<Recommendation> for_josh = recommender.recommendFor(josh, 10);
+
+   Pre-conditions: the library isn't changed while this runs; k >= 0.
+
+   Post-conditions: the titles stay valid for the life of the Recommender.
+   Returns nothing if none of the library's titles are in the catalog. */
+
+std::vector<Recommendation> Recommender::recommendFor(Library *library, int k, bool allow_simd) {
+    std::vector<uint8_t> exclude(ids.size(), 0);
+    std::vector<int> liked;
+    std::vector<int> kept;
+    if(library->getLibrarySize() != -1) {
+        LibraryStore *store = library->getStore();
+        const std::vector<int32_t> &store_ids = store->getIds();
+        const std::vector<float> &user_ratings = store->getRatings();
+        const std::vector<uint8_t> &statuses = store->getLibraryStatuses();
+        const std::vector<uint8_t> &removed = store->getRemoved();
+        for(int row=0; row<store->size(); row++) {
+            std::unordered_map<int, int>::iterator it = index.find(store_ids[row]);
+            if(removed[row] || it == index.end())
+                continue;
+            exclude[it->second] = 1;
+            float rating = user_ratings[row];
+            if(rating >= LIKED_RATING || (std::isnan(rating) && statuses[row] == COMPLETED))
+                liked.push_back(it->second);
+            if(statuses[row] != DROPPED)
+                kept.push_back(it->second);
+        }
+    }
+    if(liked.empty())
+        liked.swap(kept);
+    if(liked.empty())
+        return std::vector<Recommendation>();
+
+    /* Features that enough of the liked titles have */
+    std::vector<int> counts(WORDS * 64, 0);
+    float rating_sum = 0;
+    for(unsigned i=0; i<liked.size(); i++) {
+        const uint64_t *title = &bits[(size_t)liked[i] * WORDS];
+        for(int w=0; w<WORDS; w++) {
+            for(uint64_t word=title[w]; word!=0; word&=word - 1)
+                counts[w * 64 + __builtin_ctzll(word)]++;
+        }
+        rating_sum += ratings[liked[i]];
+    }
+    int needed = ((int)liked.size() + PROFILE_SHARE - 1) / PROFILE_SHARE;
+    uint64_t profile[WORDS];
+    memset(profile, 0, sizeof(profile));
+    for(int bit=0; bit<WORDS * 64; bit++) {
+        if(counts[bit] >= needed)
+            profile[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    return topK(profile, rating_sum / liked.size(), k, exclude, allow_simd);
+}
+
+/* Scores every title of the catalog against a feature vector and rating,
+   and returns the best k of those not excluded, best first. Scores are
+   worked out a block at a time, and each block's are checked against the
+   worst of the best so far, at the top of a heap of the best k. */
+std::vector<Recommendation> Recommender::topK(const uint64_t *query, float rating, int k,
+                                              const std::vector<uint8_t> &exclude, bool allow_simd) {
+    std::vector<Recommendation> best;
+    int n = (int)ids.size();
+    if(k <= 0 || n == 0)
+        return best;
+
+    SimilarityQuery q;
+    q.bits = query;
+    int genres = 0;
+    int users = 0;
+    for(int w=0; w<WORDS/2; w++) {
+        genres += __builtin_popcountll(query[w]);
+        users += __builtin_popcountll(query[WORDS/2 + w]);
+    }
+    q.genre_count = (float)genres;
+    q.user_count = (float)users;
+    q.rating = rating;
+    q.genre_weight = options.genre_weight;
+    q.co_occurrence_weight = options.co_occurrence_weight;
+    q.rating_weight = options.rating_weight;
+    q.cosine = options.metric == COSINE;
+    q.titles = &bits[0];
+    q.genre_counts = &genre_counts[0];
+    q.user_counts = &user_counts[0];
+    q.ratings = &ratings[0];
+    bool simd = allow_simd && __builtin_cpu_supports("avx2");
+
+    /* A heap with the worst of the best k on top */
+    best.reserve(k + 1);
+    float scores[SCORE_BLOCK];
+    for(int begin=0; begin<n; begin+=SCORE_BLOCK) {
+        int end = std::min(begin + SCORE_BLOCK, n);
+        int done = simd ? scoreAVX2(q, begin, end, scores) : 0;
+        scoreScalar(q, begin + done, end, scores + done);
+
+        for(int t=begin; t<end; t++) {
+            if(exclude[t] || ((int)best.size() == k && scores[t - begin] < best.front().score))
+                continue;
+            Recommendation r;
+            r.id = ids[t];
+            r.title = titles[t];
+            r.score = scores[t - begin];
+            if((int)best.size() < k) {
+                best.push_back(r);
+                std::push_heap(best.begin(), best.end(), betterRecommendation);
+            } else if(betterRecommendation(r, best.front())) {
+                std::pop_heap(best.begin(), best.end(), betterRecommendation);
+                best.back() = r;
+                std::push_heap(best.begin(), best.end(), betterRecommendation);
+            }
+        }
+    }
+    std::sort_heap(best.begin(), best.end(), betterRecommendation);
+    return best;
+}
@@ -0,0 +1,228 @@
+#include "ResponseParser.h"
+#include <charconv>
+#include <cmath>
+#include <climits>
+#include <cfloat>
+
+/* ResponseParser parser;
+
+   Constructor for the ResponseParser class. */
+
+ResponseParser::ResponseParser()
+{
+    //ctor
+}
+
+/* Destructor: nothing to do */
+ResponseParser::~ResponseParser()
+{
+    //dtor
+}
+
+/* Reads a string value into s. Anything else (usually null) is skipped and
+   leaves s as it was. Returns false only if the input is invalid. */
+bool ResponseParser::readText(std::string_view &s) {
+    if(reader.peek() == TOKEN_STRING)
+        return reader.readString(s);
+    return reader.skipValue();
+}
+
+/* bool readNumber(double&);
+
+   Reads a number value into d, also accepting a string holding a number
+   (the API sends the user's rating as a string like "3.5"). Returns false,
+   leaving d as it was, if the value is null, a string that isn't a number
+   or anything else, or if the input is invalid. */
+
+bool ResponseParser::readNumber(double &d) {
+    json_token t = reader.peek();
+    if(t == TOKEN_NUMBER)
+        return reader.readNumber(d);
+    if(t == TOKEN_STRING) {
+        std::string_view s;
+        if(!reader.readString(s))
+            return false;
+        double value;
+        std::from_chars_result r = std::from_chars(s.data(), s.data() + s.size(), value);
+        if(r.ec != std::errc() || std::isnan(value) || std::isinf(value))
+            return false;
+        d = value;
+        return true;
+    }
+    reader.skipValue();
+    return false;
+}
+
+/* bool readInt(int&);
+   bool readFloat(float&);
+
+   Read a number value (see readNumber()) into an int, dropping any
+   fraction, or into a float. A number that doesn't fit in the type, or is
+   infinite (readNumber() gives +-HUGE_VAL for one out of a double's range),
+   counts as unknown: it's skipped, the value is left as it was and false
+   is returned, just as for null. */
+
+bool ResponseParser::readInt(int &i) {
+    double d;
+    if(!readNumber(d) || !std::isfinite(d) || d <= (double)INT_MIN - 1 || d >= (double)INT_MAX + 1)
+        return false;
+    i = (int)d;
+    return true;
+}
+
+bool ResponseParser::readFloat(float &x) {
+    double d;
+    if(!readNumber(d) || !std::isfinite(d) || std::fabs(d) > FLT_MAX)
+        return false;
+    x = (float)d;
+    return true;
+}
+
+/* bool parseListEntry(EntryFields&);
+
+   Reads one entry of a library list: its status, episodes watched, the
+   value of its rating and the id of its anime. Returns false if the input
+   is invalid. */
+
+bool ResponseParser::parseListEntry(EntryFields &f) {
+    if(!reader.beginObject())
+        return false;
+
+    std::string_view key;
+    while(reader.nextKey(key)) {
+        if(key == "status") {
+            std::string_view status;
+            readText(status);
+            f.status = LibraryStore::parseLibraryStatus(status);
+        } else if(key == "episodes_watched") {
+            readInt(f.episodes_watched);
+        } else if(key == "rating" && reader.peek() == TOKEN_OBJECT) {
+            reader.beginObject();
+            while(reader.nextKey(key)) {
+                if(key == "value")
+                    readFloat(f.rating);
+                else
+                    reader.skipValue();
+            }
+        } else if(key == "anime" && reader.peek() == TOKEN_OBJECT) {
+            reader.beginObject();
+            while(reader.nextKey(key)) {
+                if(key == "id")
+                    readInt(f.id);
+                else
+                    reader.skipValue();
+            }
+        } else {
+            reader.skipValue();
+        }
+    }
+    return !reader.failed();
+}
+
+/* bool parseLibraryList(const string&, vector<EntryFields>&);
+
+   Parses a user's library list (the response of /users/{name}/library)
+   into entries, one for each entry in it, with the fields of the user's
+   library entry (status, episodes watched, rating) and the anime's id set.
+
+   ex. parser.parseLibraryList(list_body, entries);
+
+   Pre-conditions: none.
+
+   Post-conditions: returns false, with entries empty, if body isn't a json
+   array of objects. */
+
+bool ResponseParser::parseLibraryList(const std::string &body, std::vector<EntryFields> &entries) {
+    entries.clear();
+    reader.reset(body.data(), body.size());
+    if(reader.peek() != TOKEN_ARRAY || !reader.beginArray())
+        return false;
+
+    while(reader.nextElement()) {
+        entries.push_back(EntryFields());
+        if(!parseListEntry(entries.back()))
+            break;
+    }
+    if(!reader.atEnd()) {
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+/* Reads a genres array: the name of each genre object in it */
+bool ResponseParser::parseGenres() {
+    if(reader.peek() != TOKEN_ARRAY)
+        return reader.skipValue();
+
+    reader.beginArray();
+    std::string_view key;
+    while(reader.nextElement()) {
+        if(reader.peek() != TOKEN_OBJECT) {
+            reader.skipValue();
+            continue;
+        }
+        reader.beginObject();
+        while(reader.nextKey(key)) {
+            std::string_view name;
+            if(key == "name" && reader.peek() == TOKEN_STRING) {
+                reader.readString(name);
+                genres.push_back(name);
+            } else {
+                reader.skipValue();
+            }
+        }
+    }
+    return !reader.failed();
+}
+
+/* bool parseAnime(const string&, EntryFields&);
+
+   Parses an anime's metadata (the response of /anime/{id}) into the
+   anime's fields of f: title, synopsis, airing status, episode count, show
+   type, community rating and genres. The text fields point into body, or
+   into the parser, so they are only valid until the next parse or until
+   body changes.
+
+   ex. if(parser.parseAnime(body, fields))
+           store.add(fields);
+
+   Pre-conditions: none.
+
+   Post-conditions: returns false if body isn't a json object, in which
+   case f may have been partly filled in. */
+
+bool ResponseParser::parseAnime(const std::string &body, EntryFields &f) {
+    reader.reset(body.data(), body.size());
+    genres.clear();
+    if(reader.peek() != TOKEN_OBJECT || !reader.beginObject())
+        return false;
+
+    std::string_view key;
+    while(reader.nextKey(key)) {
+        if(key == "title") {
+            readText(f.title);
+        } else if(key == "synopsis") {
+            readText(f.synopsis);
+        } else if(key == "status") {
+            std::string_view status;
+            readText(status);
+            f.airing = LibraryStore::parseAiringStatus(status);
+        } else if(key == "episode_count") {
+            readInt(f.episode_count);
+        } else if(key == "show_type") {
+            std::string_view type;
+            readText(type);
+            f.type = LibraryStore::parseShowType(type);
+        } else if(key == "community_rating") {
+            readFloat(f.community_rating);
+        } else if(key == "genres") {
+            parseGenres();
+        } else {
+            reader.skipValue();
+        }
+    }
+    f.genres = genres.data();
+    f.genre_count = (int)genres.size();
+    return reader.atEnd();
+}
@@ -0,0 +1,253 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* "HBSN", identifies a snapshot file (and its byte order) */
+static const uint32_t FILE_MAGIC = 0x4e534248;
+
+/* Rounds size up to the next multiple of 8 bytes */
+static size_t paddedSize(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+/* Snapshot snapshot;
+
+   Constructor for the Snapshot class. Creates an empty snapshot, ready for
+   add() and write(), or for open().
+
+   ex. Snapshot snapshot;
+
+   Pre-conditions: none.
+
+   Post-conditions: no sections, nothing open. */
+
+Snapshot::Snapshot()
+{
+    map = NULL;
+    map_size = 0;
+}
+
+/* Destructor: unmaps the file, if one is open */
+Snapshot::~Snapshot()
+{
+    close();
+}
+
+/* void add(uint32_t, const void*, size_t);
+
+   Adds a section to be written by write(). The data is copied, so it
+   doesn't need to outlive the call.
+
+   ex. snapshot.add(SNAPSHOT_RATINGS, ratings.data(), ratings.size() * sizeof(float));
+
+   Pre-conditions: no other section has the same tag.
+
+   Post-conditions: the section will be in the file. */
+
+void Snapshot::add(uint32_t tag, const void *data, size_t size) {
+    SectionHeader s;
+    s.tag = tag;
+    s.reserved = 0;
+    s.offset = body.size();
+    s.size = size;
+    sections.push_back(s);
+
+    body.append((const char*)data, size);
+    body.resize(paddedSize(body.size()), '\0');
+}
+
+/* bool write(const string&);
+
+   Writes the sections added so far to a snapshot file. The file is written
+   under a temporary name and then renamed over path, so a snapshot that is
+   being read (even by this process) is never left half-written.
+
+   ex. if(!snapshot.write("josh.snapshot"))
+           cout << "Couldn't save" << endl;
+
+   Pre-conditions: none.
+
+   Post-conditions: returns true if the file was written. */
+
+bool Snapshot::write(const std::string &path) {
+    size_t table_size = sections.size() * sizeof(SectionHeader);
+    size_t data_start = sizeof(FileHeader) + table_size;
+
+    std::string file(data_start, '\0');
+    file.append(body);
+
+    SectionHeader *table = (SectionHeader*)&file[sizeof(FileHeader)];
+    for(unsigned i=0; i<sections.size(); i++) {
+        table[i] = sections[i];
+        table[i].offset += data_start;
+    }
+
+    FileHeader *h = (FileHeader*)&file[0];
+    h->magic = FILE_MAGIC;
+    h->version = VERSION;
+    h->section_count = sections.size();
+    h->reserved = 0;
+    h->size = file.size();
+    h->checksum = checksumOf(file.data() + sizeof(FileHeader), file.size() - sizeof(FileHeader));
+
+    std::string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) {
+        fprintf(stderr, "Snapshot: couldn't write %s\n", path.c_str());
+        return false;
+    }
+    size_t written = 0;
+    while(written < file.size()) {
+        ssize_t n = ::write(fd, file.data() + written, file.size() - written);
+        if(n <= 0)
+            break;
+        written += n;
+    }
+    bool ok = written == file.size() && fsync(fd) == 0;
+    ::close(fd);
+
+    if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Snapshot: couldn't write %s\n", path.c_str());
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* bool open(const string&);
+
+   Memory-maps a snapshot file for reading with get(), and checks that it
+   is a snapshot of this version and that its checksum matches. Prints why
+   to stderr if not.
+
+   ex. if(snapshot.open("josh.snapshot"))
+
+   Pre-conditions: nothing is open yet.
+
+   Post-conditions: returns true if the file is open. The mapping stays
+   valid until close() or the destructor, even if the file is replaced or
+   deleted in the meantime. */
+
+bool Snapshot::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FileHeader)) {
+        fprintf(stderr, "Snapshot: %s is not a snapshot file\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    /* Every page is read for the checksum anyway, so map them all now */
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    map = (char*)mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        map = NULL;
+        return false;
+    }
+    map_size = st.st_size;
+
+    const FileHeader *h = (const FileHeader*)map;
+    const char *problem = NULL;
+    if(h->magic != FILE_MAGIC)
+        problem = "is not a snapshot file";
+    else if(h->version != VERSION)
+        problem = "was saved by a different version";
+    else if(h->size != map_size || h->section_count > (map_size - sizeof(FileHeader)) / sizeof(SectionHeader))
+        problem = "is truncated";
+    else if(checksumOf(map + sizeof(FileHeader), map_size - sizeof(FileHeader)) != h->checksum)
+        problem = "is corrupt";
+
+    const SectionHeader *table = (const SectionHeader*)(map + sizeof(FileHeader));
+    for(uint32_t i=0; problem == NULL && i<h->section_count; i++) {
+        if(table[i].offset % 8 != 0 || table[i].offset > map_size || table[i].size > map_size - table[i].offset)
+            problem = "is corrupt";
+    }
+
+    if(problem != NULL) {
+        fprintf(stderr, "Snapshot: %s %s\n", path.c_str(), problem);
+        close();
+        return false;
+    }
+    return true;
+}
+
+/* void close();
+
+   Unmaps the open file, if any. Anything pointing into it is invalid
+   after this. */
+
+void Snapshot::close() {
+    if(map != NULL)
+        munmap(map, map_size);
+    map = NULL;
+    map_size = 0;
+}
+
+/* const void* get(uint32_t, size_t&);
+
+   Returns the data of the section with the given tag in the open file, and
+   sets size to its size in bytes. The data is 8-byte aligned, so arrays of
+   numbers can be used in place.
+
+   ex. const float *ratings = (const float*)snapshot.get(SNAPSHOT_RATINGS, bytes);
+
+   Pre-conditions: a file is open.
+
+   Post-conditions: returns NULL (and sets size to 0) if there is no such
+   section. */
+
+const void* Snapshot::get(uint32_t tag, size_t &size) {
+    size = 0;
+    if(map == NULL)
+        return NULL;
+
+    const FileHeader *h = (const FileHeader*)map;
+    const SectionHeader *table = (const SectionHeader*)(map + sizeof(FileHeader));
+    for(uint32_t i=0; i<h->section_count; i++) {
+        if(table[i].tag == tag) {
+            size = table[i].size;
+            return map + table[i].offset;
+        }
+    }
+    return NULL;
+}
+
+/* uint64_t checksumOf(const char*, size_t);
+
+   64-bit checksum of a block of memory, used to detect torn or corrupted
+   files. A multiply-xorshift hash over four independent 8-byte lanes, so
+   it runs at several bytes per cycle instead of the one byte per step of
+   the FNV-1a hash used for the AnimeCache's small records. */
+
+uint64_t Snapshot::checksumOf(const char *data, size_t length) {
+    const uint64_t K = 0x9e3779b97f4a7c15ull;
+    uint64_t lane[4] = { K, K ^ 1, K ^ 2, K ^ 3 };
+
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32) {
+        for(int l=0; l<4; l++) {
+            uint64_t w;
+            memcpy(&w, data + i + 8 * l, 8);
+            lane[l] = (lane[l] ^ w) * K;
+            lane[l] ^= lane[l] >> 31;
+        }
+    }
+
+    uint64_t h = length * K;
+    for(int l=0; l<4; l++)
+        h = (h ^ lane[l]) * K;
+    for(; i < length; i++)
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ull;
+    return h ^ (h >> 29);
+}
@@ -0,0 +1,175 @@
+#include "ThreadPool.h"
+
+/* Packing and unpacking of Range::bounds */
+static uint64_t packRange(uint32_t begin, uint32_t end) {
+    return ((uint64_t)begin << 32) | end;
+}
+
+static uint32_t rangeBegin(uint64_t bounds) {
+    return (uint32_t)(bounds >> 32);
+}
+
+static uint32_t rangeEnd(uint64_t bounds) {
+    return (uint32_t)bounds;
+}
+
+/* ThreadPool pool(int);
+
+   Constructor for the ThreadPool class. threads is the total number of
+   threads that run tasks, including the one calling run(), so threads-1
+   workers are started. 0 means one per CPU core.
+
+   ex. ThreadPool pool(4);
+
+   Pre-conditions: none.
+
+   Post-conditions: the workers are started and waiting for run(). */
+
+ThreadPool::ThreadPool(int threads)
+{
+    if(threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    if(threads <= 0)
+        threads = 1;
+
+    std::vector<Range>(threads).swap(ranges);
+    generation = 0;
+    busy = 0;
+    stopping = false;
+    function = NULL;
+    userdata = NULL;
+
+    for(int i=1; i<threads; i++)
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+/* Destructor: stops the workers and waits for them to exit */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(unsigned i=0; i<workers.size(); i++)
+        workers[i].join();
+}
+
+/* Takes the task at the front of thread self's range, if it has any left */
+bool ThreadPool::take(int self, int &task) {
+    std::atomic<uint64_t> &bounds = ranges[self].bounds;
+    uint64_t b = bounds.load();
+    while(rangeBegin(b) < rangeEnd(b)) {
+        if(bounds.compare_exchange_weak(b, packRange(rangeBegin(b) + 1, rangeEnd(b)))) {
+            task = rangeBegin(b);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* bool steal(int);
+
+   Moves the back half of another thread's remaining tasks (or its last
+   one) into thread self's range, which is empty. Tries the other threads
+   in turn, starting with the next one, so thieves spread out over their
+   victims. Returns false if every other thread's range is empty too.
+
+   Only the owner moves an empty range's bounds, so self's range can just
+   be stored: a thief can't have taken anything from it in between. */
+
+bool ThreadPool::steal(int self) {
+    int threads = (int)ranges.size();
+    for(int i=1; i<threads; i++) {
+        std::atomic<uint64_t> &victim = ranges[(self + i) % threads].bounds;
+        uint64_t b = victim.load();
+        while(rangeBegin(b) < rangeEnd(b)) {
+            uint32_t middle = rangeBegin(b) + (rangeEnd(b) - rangeBegin(b)) / 2;
+            if(victim.compare_exchange_weak(b, packRange(rangeBegin(b), middle))) {
+                ranges[self].bounds.store(packRange(middle, rangeEnd(b)));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Runs tasks on thread self until there are none left anywhere */
+void ThreadPool::work(int self) {
+    int task;
+    while(true) {
+        if(take(self, task))
+            function(task, self, userdata);
+        else if(!steal(self))
+            return;
+    }
+}
+
+/* What each worker thread does: waits for a run, works on it, repeat */
+void ThreadPool::workerLoop(int self) {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        while(!stopping && generation == seen)
+            wake.wait(lock);
+        if(stopping)
+            return;
+        seen = generation;
+
+        lock.unlock();
+        work(self);
+        lock.lock();
+
+        if(--busy == 0)
+            finished.notify_one();
+    }
+}
+
+/* void run(int, task_function, void*);
+
+   Calls function(task, thread, userdata) for every task from 0 to tasks-1,
+   spread over the pool's threads, and waits for all of them to return.
+   Tasks may run in any order and at the same time as each other, so
+   function must be safe to call from several threads at once, but no two
+   tasks run on the same thread number at the same time.
+
+   ex. pool.run(chunks, computeChunk, &state);
+
+   Pre-conditions: not called from inside a task, or from two threads at
+   once.
+
+   Post-conditions: every task has been run. */
+
+void ThreadPool::run(int tasks, task_function function, void *userdata) {
+    if(tasks <= 0)
+        return;
+
+    /* Not worth waking anyone up for */
+    if(workers.empty() || tasks == 1) {
+        for(int i=0; i<tasks; i++)
+            function(i, 0, userdata);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->function = function;
+        this->userdata = userdata;
+        int threads = (int)ranges.size();
+        for(int t=0; t<threads; t++) {
+            uint32_t begin = (uint32_t)((long long)tasks * t / threads);
+            uint32_t end = (uint32_t)((long long)tasks * (t + 1) / threads);
+            ranges[t].bounds.store(packRange(begin, end));
+        }
+        busy = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    /* The calling thread works too, instead of just waiting */
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(busy > 0)
+        finished.wait(lock);
+}
@@ -0,0 +1,359 @@
+#include "TitleSearch.h"
+#include "LibraryStore.h"
+#include <algorithm>
+#include <utility>
+
+/* TitleSearch search;
+
+   Constructor for the TitleSearch class. Creates an empty index; call
+   build() to fill it. */
+
+TitleSearch::TitleSearch()
+{
+    //ctor
+}
+
+/* Destructor: nothing to do, the arena and vectors clean up after themselves */
+TitleSearch::~TitleSearch()
+{
+    //dtor
+}
+
+/* string normalize(string_view);
+
+   Returns the key a title is indexed under: ASCII letters are lowercased,
+   apostrophes are dropped, any other punctuation or whitespace separates
+   words, and words are joined with single spaces. Bytes outside ASCII
+   (UTF-8 sequences) are kept as they are.
+
+   ex. normalize("Steins;Gate 0") returns "steins gate 0"
+       normalize("JoJo's  Bizarre Adventure") returns "jojos bizarre adventure"
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+std::string TitleSearch::normalize(std::string_view title) {
+    std::string key;
+    key.reserve(title.size());
+    bool separate = false;
+    for(unsigned i=0; i<title.size(); i++) {
+        unsigned char c = title[i];
+        if(c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            if(separate && !key.empty())
+                key += ' ';
+            separate = false;
+            key += (char)c;
+        } else if(c != '\'') {
+            separate = true;
+        }
+    }
+    return key;
+}
+
+/* int editDistance(string_view, string_view);
+
+   Returns the Levenshtein distance between a and b: the number of single
+   character insertions, deletions and substitutions to turn one into the
+   other. */
+
+int TitleSearch::editDistance(std::string_view a, std::string_view b) {
+    std::vector<int> row(b.size() + 1);
+    for(unsigned j=0; j<=b.size(); j++)
+        row[j] = j;
+    for(unsigned i=1; i<=a.size(); i++) {
+        int diagonal = row[0];
+        row[0] = i;
+        for(unsigned j=1; j<=b.size(); j++) {
+            int above = row[j];
+            int cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1), diagonal + cost);
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+/* Appends the distinct trigrams of key to grams, in sorted order. The key is
+   padded with two spaces in front and one behind, so the start of the key
+   counts for more than the rest and even one letter keys have a trigram. */
+void TitleSearch::addTrigrams(std::string_view key, std::vector<uint32_t> &grams) {
+    if(key.empty())
+        return;
+    size_t begin = grams.size();
+    size_t length = key.size() + 3;
+    uint32_t gram = ' ' << 8 | ' ';
+    for(size_t i=2; i<length; i++) {
+        unsigned char c = i - 2 < key.size() ? key[i - 2] : ' ';
+        gram = (gram << 8 | c) & 0xffffff;
+        grams.push_back(gram);
+    }
+    std::sort(grams.begin() + begin, grams.end());
+    grams.erase(std::unique(grams.begin() + begin, grams.end()), grams.end());
+}
+
+/* Empties the index */
+void TitleSearch::clear() {
+    entries.clear();
+    keys.clear();
+    sorted.clear();
+    nodes.clear();
+    gram_keys.clear();
+    gram_offsets.clear();
+    postings.clear();
+    gram_counts.clear();
+    text.clear();
+}
+
+/* void build(LibraryStore*);
+
+   (Re)builds the index from every row of store that hasn't been removed.
+
+   ex. search.build(&store);
+
+   Pre-conditions: store is not NULL.
+
+   Post-conditions: every title in store can be found by find(), complete()
+   and search(). The store's entries must outlive the index. */
+
+void TitleSearch::build(LibraryStore *store) {
+    clear();
+    int n = store->size();
+    entries.reserve(n);
+    keys.reserve(n);
+    gram_counts.reserve(n);
+
+    /* Each (trigram, document) pair, trigram in the high half, so sorting
+       them groups the postings by trigram with documents in order */
+    std::vector<uint64_t> pairs;
+    std::vector<uint32_t> grams;
+    for(int row=0; row<n; row++) {
+        if(store->isRemoved(row))
+            continue;
+        uint32_t doc = entries.size();
+        LibraryEntry *le = store->getEntry(row);
+        std::string_view key = text.copy(normalize(le->getTitle()));
+        entries.push_back(le);
+        keys.push_back(key);
+
+        grams.clear();
+        addTrigrams(key, grams);
+        gram_counts.push_back(std::min<size_t>(grams.size(), UINT16_MAX));
+        for(unsigned i=0; i<grams.size(); i++)
+            pairs.push_back((uint64_t)grams[i] << 32 | doc);
+    }
+
+    int docs = (int)entries.size();
+    sorted.resize(docs);
+    for(int i=0; i<docs; i++)
+        sorted[i] = i;
+    std::stable_sort(sorted.begin(), sorted.end(), [this](int a, int b) {
+        return keys[a] < keys[b];
+    });
+    buildTrie();
+
+    std::sort(pairs.begin(), pairs.end());
+    postings.reserve(pairs.size());
+    for(unsigned i=0; i<pairs.size(); i++) {
+        uint32_t gram = pairs[i] >> 32;
+        if(gram_keys.empty() || gram_keys.back() != gram) {
+            gram_keys.push_back(gram);
+            gram_offsets.push_back(postings.size());
+        }
+        postings.push_back((int)(uint32_t)pairs[i]);
+    }
+    gram_offsets.push_back(postings.size());
+}
+
+/* Builds the trie over the sorted keys. The nodes double as the queue of
+   ones whose children are still to be made: each one's children are
+   appended together when it's reached, which keeps them next to each other.
+   A node's run is split by the byte after its prefix (keys that are just
+   the prefix come first and stay with the node), and each child's prefix
+   runs on for as long as the first and last keys of its run agree. */
+void TitleSearch::buildTrie() {
+    TrieNode root;
+    root.begin = 0;
+    root.end = (int)sorted.size();
+    root.depth = 0;
+    root.first_child = 0;
+    root.children = 0;
+    nodes.push_back(root);
+    for(size_t n=0; n<nodes.size(); n++) {
+        int begin = nodes[n].begin, end = nodes[n].end;
+        size_t depth = nodes[n].depth;
+        while(begin < end && keys[sorted[begin]].size() == depth)
+            begin++;
+        nodes[n].first_child = (int)nodes.size();
+        while(begin < end) {
+            unsigned char c = keys[sorted[begin]][depth];
+            int last = std::partition_point(sorted.begin() + begin, sorted.begin() + end, [&](int doc) {
+                return (unsigned char)keys[doc][depth] <= c;
+            }) - sorted.begin();
+            std::string_view first_key = keys[sorted[begin]], last_key = keys[sorted[last - 1]];
+            size_t shared = depth + 1;
+            while(shared < first_key.size() && shared < last_key.size() && first_key[shared] == last_key[shared])
+                shared++;
+            TrieNode child;
+            child.begin = begin;
+            child.end = last;
+            child.depth = (int)shared;
+            child.first_child = 0;
+            child.children = 0;
+            nodes.push_back(child);
+            nodes[n].children++;
+            begin = last;
+        }
+    }
+}
+
+/* Returns the node for the shortest prefix in the trie that starts with
+   key (whose run is every key starting with key), or NULL if no key does */
+const TitleSearch::TrieNode* TitleSearch::descend(std::string_view key) {
+    if(nodes.empty())
+        return NULL;
+    const TrieNode *node = &nodes[0];
+    size_t depth = 0;
+    while(depth < key.size()) {
+        unsigned char c = key[depth];
+        const TrieNode *first = &nodes[node->first_child], *last = first + node->children;
+        const TrieNode *child = std::lower_bound(first, last, c, [&](const TrieNode &t, unsigned char b) {
+            return (unsigned char)keys[sorted[t.begin]][depth] < b;
+        });
+        if(child == last || (unsigned char)keys[sorted[child->begin]][depth] != c)
+            return NULL;
+        size_t upto = std::min<size_t>(child->depth, key.size());
+        if(keys[sorted[child->begin]].compare(depth, upto - depth, key.substr(depth, upto - depth)) != 0)
+            return NULL;
+        node = child;
+        depth = upto;
+    }
+    return node;
+}
+
+/* LibraryEntry* find(string_view);
+
+   Returns the entry whose title has the same normalized key as title, or
+   NULL if there isn't one. If several titles share the key, returns the
+   one added to the store first.
+
+   ex. LibraryEntry *le = search.find("steins gate");
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+LibraryEntry* TitleSearch::find(std::string_view title) {
+    std::string key = normalize(title);
+    const TrieNode *node = descend(key);
+    if(node != NULL && keys[sorted[node->begin]] == key)
+        return entries[sorted[node->begin]];
+    return NULL;
+}
+
+/* vector<LibraryEntry*> complete(string_view, int);
+
+   Returns up to limit entries whose normalized title starts with the
+   normalized prefix, in order of their keys.
+
+   ex. vector<LibraryEntry*> v = search.complete("full", 10);
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+std::vector<LibraryEntry*> TitleSearch::complete(std::string_view prefix, int limit) {
+    std::vector<LibraryEntry*> v;
+    std::string key = normalize(prefix);
+    const TrieNode *node = descend(key);
+    if(node == NULL)
+        return v;
+    for(int i=node->begin; i<node->end && (int)v.size() < limit; i++)
+        v.push_back(entries[sorted[i]]);
+    return v;
+}
+
+/* vector<TitleMatch> search(string_view, int);
+
+   Returns up to limit entries whose titles are closest to query, best
+   first: by edit distance between the normalized titles, then by trigram
+   similarity. Only titles sharing at least one trigram with the query are
+   considered, so the result may be shorter than limit, or empty.
+
+   ex. vector<TitleMatch> v = search.search("Cowboy Bepop", 5);
+
+   Pre-conditions: build() isn't running. Safe to call from several threads
+   at once.
+
+   Post-conditions: none. */
+
+std::vector<TitleMatch> TitleSearch::search(std::string_view query, int limit) {
+    std::vector<TitleMatch> results;
+    std::string key = normalize(query);
+    std::vector<uint32_t> grams;
+    addTrigrams(key, grams);
+    if(limit <= 0 || grams.empty())
+        return results;
+
+    /* Count the trigrams each document shares with the query, in this
+       thread's scratch space, which is all zeros between searches */
+    static thread_local std::vector<uint16_t> shared;
+    static thread_local std::vector<int> touched;
+    if(shared.size() < entries.size())
+        shared.resize(entries.size(), 0);
+    unsigned most = 0;
+    for(unsigned i=0; i<grams.size(); i++) {
+        std::vector<uint32_t>::iterator g = std::lower_bound(gram_keys.begin(), gram_keys.end(), grams[i]);
+        if(g == gram_keys.end() || *g != grams[i])
+            continue;
+        size_t k = g - gram_keys.begin();
+        for(uint32_t p=gram_offsets[k]; p<gram_offsets[k + 1]; p++) {
+            int doc = postings[p];
+            if(shared[doc]++ == 0)
+                touched.push_back(doc);
+            else if(shared[doc] > most)
+                most = shared[doc];
+        }
+    }
+
+    /* Keep the documents with the best Dice coefficient as candidates. Ones
+       sharing less than half as many trigrams as the best document are too
+       far off to be worth ranking. */
+    std::vector<std::pair<float, int> > candidates;
+    for(unsigned i=0; i<touched.size(); i++) {
+        int doc = touched[i];
+        if(shared[doc] * 2 >= most)
+            candidates.push_back(std::make_pair(2.0f * shared[doc] / (grams.size() + gram_counts[doc]), doc));
+        shared[doc] = 0;
+    }
+    touched.clear();
+
+    std::vector<std::pair<float, int> >::iterator cut = candidates.end();
+    if(candidates.size() > (size_t)limit * CANDIDATES_PER_RESULT) {
+        cut = candidates.begin() + (size_t)limit * CANDIDATES_PER_RESULT;
+        std::nth_element(candidates.begin(), cut, candidates.end(), [](const std::pair<float, int> &a, const std::pair<float, int> &b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+    }
+
+    /* Rank the candidates by how many edits away they are */
+    for(std::vector<std::pair<float, int> >::iterator it = candidates.begin(); it != cut; ++it) {
+        TitleMatch m;
+        m.entry = entries[it->second];
+        m.distance = editDistance(key, keys[it->second]);
+        m.similarity = it->first;
+        results.push_back(m);
+    }
+    std::sort(results.begin(), results.end(), [](const TitleMatch &a, const TitleMatch &b) {
+        if(a.distance != b.distance)
+            return a.distance < b.distance;
+        if(a.similarity != b.similarity)
+            return a.similarity > b.similarity;
+        return a.entry->getRow() < b.entry->getRow();
+    });
+    if((int)results.size() > limit)
+        results.resize(limit);
+    return results;
+}
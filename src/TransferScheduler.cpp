@@ -0,0 +1,582 @@
+#include "TransferScheduler.h"
+#include <cstdio>
+#include <stdint.h>
+
+typedef std::chrono::steady_clock Clock;
+
+/* TransferScheduler* = new TransferScheduler(int);
+
+   Constructor for the TransferScheduler class. Sets the number of transfers
+   that will be kept in flight at once.
+
+   ex. TransferScheduler scheduler(50);
+
+   Pre-conditions: curl_global_init() has been called.
+
+   Post-conditions: an empty scheduler, ready for add(). */
+
+TransferScheduler::TransferScheduler(int window)
+{
+    if(window < 1)
+        window = 1;
+    this->window = window;
+    limit = NULL;
+    timeout_ms = 0;
+    max_retries = 0;
+    backoff_ms = DEFAULT_BACKOFF_MS;
+    metrics = NULL;
+    pool = NULL;
+    buffers = NULL;
+    random.seed(std::random_device()());
+    callback = NULL;
+    userdata = NULL;
+    multi_handle = NULL;
+    cancelled = false;
+    next = 0;
+    active = 0;
+}
+
+/* Destructor: frees the ConcurrencyLimit, if any. run() cleans up its own
+   curls. */
+TransferScheduler::~TransferScheduler()
+{
+    delete limit;
+}
+
+/* int add(string, string*);
+
+   Queues a download of url whose response will be appended to *buffer, or
+   if buffer is NULL, to a buffer from the BufferPool that the callback can
+   get with getBuffer(). Returns the index of the transfer, which is passed
+   to the callback and to getResult().
+
+   ex. int i = scheduler.add("https://hummingbird.me/api/v1/anime/6", &buffer);
+
+   Pre-conditions: buffer must stay valid until run() returns. If it is
+   NULL, setBufferPool() must have been called.
+
+   Post-conditions: the transfer will be performed by the next run(), or by
+   the current one if called from the callback. */
+
+int TransferScheduler::add(std::string url, std::string *buffer) {
+    Transfer t;
+    t.url = url;
+    t.buffer = buffer;
+    t.pooled = buffer == NULL;
+    t.result = CURLE_OK;
+    t.attempts = 0;
+    t.done = false;
+    transfers.push_back(t);
+    return (int)transfers.size() - 1;
+}
+
+/* void setCallback(transfer_callback, void*);
+
+   Sets a function to be called (from within run()) each time a transfer
+   finishes. userdata is passed through to it unchanged.
+
+   ex. scheduler.setCallback(onTransferDone, this);
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+void TransferScheduler::setCallback(transfer_callback callback, void *userdata) {
+    this->callback = callback;
+    this->userdata = userdata;
+}
+
+/* void setAdaptive(int, int);
+
+   Makes the window adaptive: instead of always keeping the window given to
+   the constructor in flight, a ConcurrencyLimit between min_window and
+   max_window decides how many transfers to keep in flight, from how fast
+   the responses come back and whether the server is turning requests away.
+
+   ex. scheduler.setAdaptive(1, 100);
+
+   Pre-conditions: not called during run().
+
+   Post-conditions: getWindow() returns the current limit. */
+
+void TransferScheduler::setAdaptive(int min_window, int max_window) {
+    delete limit;
+    limit = new ConcurrencyLimit(min_window, max_window);
+}
+
+/* void setTimeout(long);
+
+   Gives every transfer a deadline: one that takes longer than timeout_ms
+   milliseconds in total (connecting included) is aborted with
+   CURLE_OPERATION_TIMEDOUT, and retried if retries are on. 0 means no
+   deadline, which is the default.
+
+   ex. scheduler.setTimeout(30000);
+
+   Pre-conditions: none.
+
+   Post-conditions: transfers started from now on have the deadline. */
+
+void TransferScheduler::setTimeout(long timeout_ms) {
+    this->timeout_ms = timeout_ms < 0 ? 0 : timeout_ms;
+}
+
+/* void setRetries(int, long);
+
+   Retries a transfer up to max_retries times if it times out, can't
+   connect, loses its connection or gets an HTTP 429 or 5xx response. Before
+   each retry it waits a random time of up to backoff_ms milliseconds,
+   doubling with every attempt (see backoff()). Other failures, like a 404,
+   aren't retried. The default is no retries.
+
+   ex. scheduler.setRetries(3);
+
+   Pre-conditions: none.
+
+   Post-conditions: none. */
+
+void TransferScheduler::setRetries(int max_retries, long backoff_ms) {
+    this->max_retries = max_retries < 0 ? 0 : max_retries;
+    this->backoff_ms = backoff_ms < 1 ? 1 : backoff_ms;
+}
+
+/* void setMetrics(LoadMetrics*);
+
+   Records every attempt of every transfer in *metrics as it finishes,
+   including the ones that are retried.
+
+   ex. scheduler.setMetrics(&metrics);
+
+   Pre-conditions: metrics must stay valid until run() returns.
+
+   Post-conditions: none. */
+
+void TransferScheduler::setMetrics(LoadMetrics *metrics) {
+    this->metrics = metrics;
+}
+
+/* void setConnectionPool(ConnectionPool*);
+
+   Makes every transfer use pool's DNS cache, TLS sessions and open
+   connections, so they outlive run() and can be shared with other
+   schedulers.
+
+   ex. scheduler.setConnectionPool(&pool);
+
+   Pre-conditions: pool must outlive the scheduler's run()s.
+
+   Post-conditions: none. */
+
+void TransferScheduler::setConnectionPool(ConnectionPool *pool) {
+    this->pool = pool;
+}
+
+/* Number of transfers currently allowed in flight */
+int TransferScheduler::getWindow() {
+    return limit == NULL ? window : limit->get();
+}
+
+/* curl_easy_setopt(CURL, CURLOPT_WRITEFUNCTION, WriteCallback);
+
+   Callback function that should only be called by curl! Appends the data
+   returned by a transfer to the string pointed to by *userp. */
+
+size_t TransferScheduler::WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
+    ((std::string*)userp)->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+/* CURL* newCurl();
+
+   Makes an easy curl with the options every transfer has in common, or
+   returns NULL if curl couldn't make one. Easy curls are reused for
+   transfer after transfer without being reset, so start() only has to set
+   what differs. */
+
+CURL* TransferScheduler::newCurl() {
+    CURL *curl = curl_easy_init();
+    if(curl == NULL)
+        return NULL;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0);
+
+    /* HTTP/2 over TLS, HTTP/1.1 otherwise. Waiting for a connection that
+       can multiplex rather than opening another one is what lets the
+       transfers share connections. */
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+    /* Ask for every encoding curl can decode; JSON compresses well */
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    if(pool != NULL && pool->getShare() != NULL)
+        curl_easy_setopt(curl, CURLOPT_SHARE, pool->getShare());
+    if(timeout_ms > 0)
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curls.push_back(curl);
+    return curl;
+}
+
+/* void setBufferPool(BufferPool*);
+
+   Gives the transfers added without a buffer their buffers from buffers,
+   one each while they're in flight, and only starts them while it has one
+   to give.
+
+   ex. scheduler.setBufferPool(&buffers);
+
+   Pre-conditions: buffers must outlive the scheduler's run()s.
+
+   Post-conditions: none. */
+
+void TransferScheduler::setBufferPool(BufferPool *buffers) {
+    this->buffers = buffers;
+}
+
+/* void start(CURL*, int);
+
+   Sets up an easy curl to perform the index'th transfer. */
+
+void TransferScheduler::start(CURL *curl, int index) {
+    curl_easy_setopt(curl, CURLOPT_URL, transfers[index].url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfers[index].buffer);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)(intptr_t)index);
+    transfers[index].attempts++;
+}
+
+/* Gives the index'th transfer's buffer back to the BufferPool, if it came
+   from there */
+void TransferScheduler::releaseBuffer(int index) {
+    Transfer &t = transfers[index];
+    if(t.pooled && t.buffer != NULL) {
+        buffers->release(t.buffer);
+        t.buffer = NULL;
+    }
+}
+
+/* void readTimings(CURL*, TransferTimings&);
+
+   Reads how long each step of a finished transfer took, how much it
+   downloaded and its HTTP status from curl_easy_getinfo(). curl reports
+   each step as the time since the transfer started, so the previous step
+   is subtracted to get the length of each one. */
+
+void TransferScheduler::readTimings(CURL *curl, TransferTimings &t) {
+    curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0, bytes = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &t.status);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &t.connects);
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &t.http_version);
+
+    /* The times are in microseconds */
+    t.dns = namelookup / 1e6;
+    t.connect = connect > namelookup ? (connect - namelookup) / 1e6 : 0;
+    t.tls = appconnect > connect ? (appconnect - connect) / 1e6 : 0;
+    t.ttfb = starttransfer / 1e6;
+    t.total = total / 1e6;
+    t.bytes = bytes;
+}
+
+/* Whether a failed transfer is worth trying again: the server was
+   overloaded or unavailable (429, 5xx), the transfer timed out, or the
+   connection failed. Anything else, like a 404, would only fail again. */
+bool TransferScheduler::retryable(CURLcode result, long status) {
+    switch(result) {
+        case CURLE_HTTP_RETURNED_ERROR:
+            return status == 429 || status >= 500;
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Whether a failure means the server is overloaded and fewer transfers
+   should be kept in flight: it said so (429 Too Many Requests, 503 Service
+   Unavailable, 504 Gateway Timeout) or the transfer timed out. Other errors,
+   like a 500, happen just as often at any load, so they are only retried. */
+bool TransferScheduler::overloaded(CURLcode result, long status) {
+    if(result == CURLE_OPERATION_TIMEDOUT)
+        return true;
+    return result == CURLE_HTTP_RETURNED_ERROR && (status == 429 || status == 503 || status == 504);
+}
+
+/* long backoff(CURL*, int);
+
+   How many milliseconds to wait before trying a transfer again after its
+   attempt'th attempt failed: a random time between 0 and backoff_ms *
+   2^(attempt-1), capped at MAX_BACKOFF_MS ("full jitter", so that the
+   transfers that failed together don't all come back together). If the
+   server sent a Retry-After header, waits at least that long (up to a
+   minute). */
+
+long TransferScheduler::backoff(CURL *curl, int attempt) {
+    long cap = backoff_ms;
+    for(int i=1; i<attempt && cap < MAX_BACKOFF_MS; i++)
+        cap *= 2;
+    if(cap > MAX_BACKOFF_MS)
+        cap = MAX_BACKOFF_MS;
+    long ms = std::uniform_int_distribution<long>(0, cap)(random);
+
+    /* Retry-After is in seconds; don't wait more than a minute for it */
+    curl_off_t retry_after = 0;
+    if(curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK && retry_after > 0) {
+        long server_ms = retry_after > 60 ? 60000 : (long)retry_after * 1000;
+        if(server_ms > ms)
+            ms = server_ms;
+    }
+    return ms;
+}
+
+/* bool finished(CURL*, int, CURLcode);
+
+   Handles the end of an attempt at the index'th transfer: records it in
+   the metrics, tells the ConcurrencyLimit how it went (see overloaded()),
+   and, if it failed in a way worth retrying and has attempts left, queues
+   it to be tried again once its backoff is over. Returns true if the transfer is done for good,
+   false if it will be retried. */
+
+bool TransferScheduler::finished(CURL *curl, int index, CURLcode result) {
+    Transfer &t = transfers[index];
+    readTimings(curl, t.timings);
+    bool retry = result != CURLE_OK && retryable(result, t.timings.status);
+
+    if(limit != NULL) {
+        if(overloaded(result, t.timings.status))
+            limit->overload();
+        else if(result == CURLE_OK)
+            limit->success(t.timings.ttfb - t.timings.dns - t.timings.connect - t.timings.tls);
+    }
+
+    retry = retry && t.attempts <= max_retries;
+    if(metrics != NULL) {
+        metrics->record(t.timings, result, retry);
+        if(result == CURLE_OPERATION_TIMEDOUT)
+            metrics->timeouts++;
+    }
+    if(!retry)
+        return true;
+
+    /* Throw away whatever part of the response did arrive; a pooled buffer
+       goes back to the pool for the wait */
+    if(t.pooled)
+        releaseBuffer(index);
+    else
+        t.buffer->clear();
+    Retry r;
+    r.due = Clock::now() + std::chrono::milliseconds(backoff(curl, t.attempts));
+    r.index = index;
+    retries.push(r);
+    return false;
+}
+
+/* Milliseconds until the next retry is due (0 if one already is), or -1 if
+   there are none waiting. Moves the retries that are due to due. */
+long TransferScheduler::untilNextRetry() {
+    Clock::time_point now = Clock::now();
+    while(!retries.empty() && retries.top().due <= now) {
+        due.push_back(retries.top().index);
+        retries.pop();
+    }
+    if(!due.empty())
+        return 0;
+    if(retries.empty())
+        return -1;
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(retries.top().due - now).count() + 1;
+}
+
+/* void fill();
+
+   Starts transfers until the window is full or there is nothing left to
+   start: retries whose backoff is over first, then queued transfers.
+   Reuses idle easy curls before making new ones. Also stops when the next
+   transfer needs a buffer from the BufferPool and it has none to spare. */
+
+void TransferScheduler::fill() {
+    untilNextRetry();
+    while(active < getWindow() && (!due.empty() || next < (int)transfers.size())) {
+        int index = !due.empty() ? due.front() : next;
+        Transfer &t = transfers[index];
+        if(t.pooled) {
+            t.buffer = buffers->acquire();
+            if(t.buffer == NULL)
+                return;
+        }
+
+        CURL *curl;
+        if(!idle.empty()) {
+            curl = idle.back();
+            idle.pop_back();
+        } else {
+            curl = newCurl();
+            if(curl == NULL) {
+                releaseBuffer(index);
+                return;
+            }
+        }
+        if(!due.empty())
+            due.erase(due.begin());
+        else
+            next++;
+        start(curl, index);
+        curl_multi_add_handle(multi_handle, curl);
+        active++;
+    }
+}
+
+/* int run();
+
+   Performs every queued transfer, keeping up to window of them in flight.
+   Whenever curl reports a finished transfer (CURLMSG_DONE) its easy curl is
+   immediately reused for the next queued URL, so the window stays full until
+   the queue runs out. Failed transfers are retried if setRetries() allows
+   it; the callback is only called once a transfer is done for good. Waits for activity with curl_multi_poll() instead of
+   select(), so there is no limit on the number of sockets.
+
+   ex. int failed = scheduler.run();
+
+   Pre-conditions: transfers have been queued with add().
+
+   Post-conditions: every transfer has finished; returns the number that
+   failed (see getResult() for which ones). */
+
+int TransferScheduler::run() {
+    int failed = 0;
+    if(next >= (int)transfers.size())
+        return 0;
+
+    {
+        std::lock_guard<std::mutex> guard(cancel_lock);
+        multi_handle = curl_multi_init();
+    }
+    curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    active = 0;
+    if(!cancelled)
+        fill();
+
+    while((active > 0 || !retries.empty() || !due.empty()) && !cancelled) {
+        int still_running;
+        CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
+        if(mc != CURLM_OK) {
+            fprintf(stderr, "curl_multi_perform() failed, code %d.\n", mc);
+            break;
+        }
+
+        /* Refill the slot of every transfer that has just finished */
+        CURLMsg *msg;
+        int msgs_left;
+        while((msg = curl_multi_info_read(multi_handle, &msgs_left)) != NULL) {
+            if(msg->msg != CURLMSG_DONE)
+                continue;
+
+            CURL *curl = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            char *priv;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+            int index = (int)(intptr_t)priv;
+
+            bool done = finished(curl, index, result);
+            curl_multi_remove_handle(multi_handle, curl);
+            idle.push_back(curl);
+            active--;
+            if(!done) {
+                fill();
+                continue;
+            }
+
+            transfers[index].result = result;
+            transfers[index].done = true;
+            if(result != CURLE_OK) {
+                fprintf(stderr, "cURL failed: %s (%s)\n",
+                    curl_easy_strerror(result), transfers[index].url.c_str());
+                failed++;
+            }
+
+            /* The callback may add more transfers, so refill after it */
+            if(callback != NULL)
+                callback(index, result, userdata);
+            releaseBuffer(index);
+            fill();
+        }
+
+        /* Start any retries whose backoff has run out since */
+        if(untilNextRetry() == 0)
+            fill();
+        if(active == 0 && retries.empty() && due.empty())
+            break;
+
+        /* Sleep until there is socket activity, curl needs a timeout handled
+           or the next retry is due. Retries that are due but don't fit in
+           the window wait for a transfer to finish instead. */
+        long wait = due.empty() ? untilNextRetry() : -1;
+        int timeout = wait >= 0 && wait < 1000 ? (int)wait : 1000;
+        mc = curl_multi_poll(multi_handle, NULL, 0, timeout, NULL);
+        if(mc != CURLM_OK) {
+            fprintf(stderr, "curl_multi_poll() failed, code %d.\n", mc);
+            break;
+        }
+    }
+
+    for(unsigned i=0; i<curls.size(); i++) {
+        curl_multi_remove_handle(multi_handle, curls[i]);
+        curl_easy_cleanup(curls[i]);
+    }
+    curls.clear();
+    idle.clear();
+    retries = std::priority_queue<Retry>();
+    due.clear();
+
+    /* Anything that never finished (if cancelled, or if curl itself broke)
+       counts as failed */
+    for(unsigned i=0; i<transfers.size(); i++) {
+        releaseBuffer(i);
+        if(!transfers[i].done) {
+            transfers[i].result = cancelled ? CURLE_ABORTED_BY_CALLBACK : CURLE_FAILED_INIT;
+            transfers[i].done = true;
+            failed++;
+        }
+    }
+    next = (int)transfers.size();
+    active = 0;
+
+    CURLM *multi;
+    {
+        std::lock_guard<std::mutex> guard(cancel_lock);
+        multi = multi_handle;
+        multi_handle = NULL;
+    }
+    curl_multi_cleanup(multi);
+
+    return failed;
+}
+
+/* void cancel();
+
+   Stops run() as soon as it can, from any thread: wakes it if it's waiting
+   for activity, and it returns without starting anything else. If run()
+   hasn't been called yet, it returns as soon as it is. Transfers that were
+   in flight or queued fail with CURLE_ABORTED_BY_CALLBACK, without their
+   callbacks being called.
+
+   ex. scheduler.cancel();
+
+   Pre-conditions: none.
+
+   Post-conditions: isCancelled() is true; it can't be undone. */
+
+void TransferScheduler::cancel() {
+    std::lock_guard<std::mutex> guard(cancel_lock);
+    cancelled = true;
+    if(multi_handle != NULL)
+        curl_multi_wakeup(multi_handle);
+}
@@ -4,13 +4,62 @@
  * Rhonda Hoenigman
 */
 #include "Library.h"
+#include "LibraryLoad.h"
+#include "QueryServer.h"
 #include <iostream>
 #include <cstdio>
 #include <string>
+#include <vector>
+#include <chrono>
+#include <future>
 #include <stdlib.h>
+#include <signal.h>
 
 using namespace std;
 
+/* File that anime metadata is cached in between runs */
+#define ANIME_CACHE_PATH "anime_cache.bin"
+
+/* Ending of the file each user's library is saved in between runs */
+#define SNAPSHOT_SUFFIX ".snapshot"
+
+
+/* Server run by --daemon, for the signal handler to stop */
+static QueryServer *daemon_server = NULL;
+
+void stopDaemon(int signal) {
+    if(daemon_server != NULL)
+        daemon_server->stop();
+}
+
+/* Keeps the given users' libraries loaded and answers queries about them on
+   a Unix domain socket until interrupted (see QueryServer.h) */
+int runDaemon(string socket_path, vector<string> usernames) {
+    AnimeCache cache(ANIME_CACHE_PATH);
+    LibraryOptions options;
+    options.cache = &cache;
+    QueryServer server(options);
+
+    if(!usernames.empty()) {
+        cout << "Loading " << usernames.size() << " libraries..." << endl;
+        int loaded = server.addUsers(usernames);
+        cout << "Loaded " << loaded << " of " << usernames.size() << " libraries" << endl;
+    }
+    if(!server.listen(socket_path)) {
+        cout << "Couldn't listen on " << socket_path << endl;
+        return 1;
+    }
+
+    daemon_server = &server;
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+    cout << "Answering queries on " << socket_path << " (Ctrl-C to stop)" << endl;
+    server.run();
+    daemon_server = NULL;
+
+    cout << "Stopped after " << server.getRequestCount() << " requests" << endl;
+    return 0;
+}
 
 int printMenu(string username)
 {
@@ -30,10 +79,40 @@ int printMenu(string username)
     return atoi(in.c_str());
 }
 
-Library* downloadLibrary(string username) {
-    cout << "Downloading " << username << "'s Hummingbird.me library..." << endl;
-    cout << "(This can take a while)" << endl;
-    Library *L = new Library(username);
+Library* downloadLibrary(string username, AnimeCache *cache) {
+
+    /* Reuse anime metadata downloaded by previous runs */
+    LibraryOptions options;
+    options.cache = cache;
+
+    /* If the library was saved by a previous run, start from that and just
+       download what has changed since */
+    Library *L = new Library(SnapshotFile(username + SNAPSHOT_SUFFIX), options);
+    if(L->getLibrarySize() != -1) {
+        cout << "Updating " << username << "'s saved library..." << endl;
+        if(L->refresh() != 0)
+            cout << "(Couldn't reach Hummingbird.me, showing the saved library)" << endl;
+    } else {
+        delete L;
+        cout << "Downloading " << username << "'s Hummingbird.me library..." << endl;
+
+        /* Load it in the background and show how far it has got */
+        LibraryLoad load(username, options);
+        int shown = -1;
+        while(load.getFuture().wait_for(chrono::milliseconds(100)) != future_status::ready) {
+            if(load.getTotal() > 0 && load.getDone() != shown) {
+                shown = load.getDone();
+                cout << "\rLoaded " << shown << " of " << load.getTotal() << " shows" << flush;
+            }
+        }
+        if(shown != -1)
+            cout << "\rLoaded " << load.getDone() << " of " << load.getTotal() << " shows" << endl;
+        L = load.wait();
+    }
+
+    /* Save it for next time */
+    if(L->getLibrarySize() != -1)
+        L->save(username + SNAPSHOT_SUFFIX);
     return L;
 }
 
@@ -45,6 +124,9 @@ void getMoreInfo(Library *L) {
     /* Stores library entry, if found */
     LibraryEntry* le;
 
+    /* Titles suggested after the last miss, which the user can pick by number */
+    vector<TitleMatch> suggestions;
+
     /* Get user input */
     while(1) {
         cout << "Type the name of a show to get more info about it:" << endl;
@@ -57,10 +139,31 @@ void getMoreInfo(Library *L) {
         /* Entry found */
         else if(le != NULL)
             break;
+
+        /* Suggestion picked */
+        char *end;
+        long pick = strtol(in.c_str(), &end, 10);
+        if(!in.empty() && *end == '\0' && pick >= 1 && pick <= (long)suggestions.size()) {
+            le = suggestions[pick - 1].entry;
+            break;
+        }
+
+        /* Same title apart from case and punctuation */
+        suggestions = L->searchTitles(in);
+        if(!suggestions.empty() && suggestions[0].distance == 0) {
+            le = suggestions[0].entry;
+            break;
+        }
+
         /* Entry not found */
-        else {
-            cout << "Couldn't find \"" << in;
-            cout << "\" (try again or type \"q\" to quit)" << endl << endl;
+        cout << "Couldn't find \"" << in << "\"";
+        if(suggestions.empty()) {
+            cout << " (try again or type \"q\" to quit)" << endl << endl;
+        } else {
+            cout << ", did you mean:" << endl;
+            for(unsigned i=0; i<suggestions.size(); i++)
+                cout << "  " << i+1 << ". " << suggestions[i].entry->getTitle() << endl;
+            cout << "(type a number, try again or type \"q\" to quit)" << endl << endl;
         }
     }
 
@@ -78,10 +181,10 @@ void getMoreInfo(Library *L) {
 
     /* Print Genres */
     cout << "#Genres: ";
-    vector<string> genres = le->getGenres();
-    for(unsigned i=0; i<genres.size(); i++) {
-        cout << genres[i];
-        if(i+1<genres.size())
+    int genre_count = le->getGenreCount();
+    for(int i=0; i<genre_count; i++) {
+        cout << le->getGenre(i);
+        if(i+1<genre_count)
             cout << ", ";
     }
     cout << endl;
@@ -103,20 +206,55 @@ int main(int argc, char *argv[])
     int rc;
     string username;
 
-    if(argc != 2) {
-        cout << "Usage: main [username]";
+    /* Daemon mode: main --daemon socket [username ...] */
+    bool daemon = argc >= 2 && string(argv[1]) == "--daemon";
+    if(daemon && argc >= 3)
+        return runDaemon(argv[2], vector<string>(argv + 3, argv + argc));
+
+    /* Optionally, where to write the load's metrics as JSON */
+    const char *metrics_path = NULL;
+    if(argc == 4 && string(argv[2]) == "--metrics")
+        metrics_path = argv[3];
+
+    if((argc != 2 && metrics_path == NULL) || daemon) {
+        cout << "Usage: main [username] [--metrics file]";
         cout << " (Example: main Josh)" << endl;
+        cout << "       main --daemon socket [username ...]";
+        cout << " (Example: main --daemon /tmp/hummingbird.sock Josh Hjalte)" << endl;
         rc = 1;
     } else {
         username = string(argv[1]);
 
-        Library *L = downloadLibrary(username);
+        AnimeCache cache(ANIME_CACHE_PATH);
+        Library *L = downloadLibrary(username, &cache);
+
+        /* Write out everything measured while loading, failed or not, so a
+           slow or failed load can be looked into */
+        if(metrics_path != NULL) {
+            FILE *f = fopen(metrics_path, "w");
+            if(f != NULL) {
+                fputs(L->metrics().toJson().c_str(), f);
+                fclose(f);
+            } else {
+                cout << "Couldn't write metrics to " << metrics_path << endl;
+            }
+        }
 
         /* The library's size will have been set to -1 if it failed to download */
         if(L->getLibrarySize() != -1) {
             /* The user's library was downloaded and parsed succesfully! Here we use
                getLibrarySize() to get the number of entries in the library. */
-            cout << "Done! (loaded " << L->getLibrarySize() << " entries)"<< endl << endl;
+            cout << "Done! (loaded " << L->getLibrarySize() << " entries, ";
+            cout << cache.getHits() << " from cache)" << endl;
+
+            /* Show how long each stage took, so slow loads can be diagnosed */
+            LoadTimings t = L->getLoadTimings();
+            printf("(%.2fs total: library %.2fs, metadata %.2fs of which %.2fs network"
+                   " and %.2fs parsing, indexing %.2fs)\n", t.total, t.library_fetch, t.metadata_fetch,
+                   t.network_wait, t.parse, t.index_build);
+            LoadMetrics m = L->metrics();
+            printf("(%ld requests over %ld new connections, %ld TLS handshakes, %ld over HTTP/2)\n\n",
+                   m.requests, m.connections, m.tls_handshakes, m.http2_requests);
             rc = 0;
         }
         else {